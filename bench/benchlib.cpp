@@ -0,0 +1,284 @@
+/**
+ * @file
+ * @brief Source file with benchlib implementation
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <thread>
+#include "benchlib.h"
+
+#ifndef STACK_SECURITY_LEVEL
+    #define STACK_SECURITY_LEVEL 0
+#endif
+
+/**
+ * Reads the given clock.
+ * @param[in] clock clock to read
+ * @return time in nanoseconds.
+ */
+static uint64_t readClock(clockid_t clock) {
+    timespec time {};
+    clock_gettime(clock, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+BenchmarkState::BenchmarkState(uint64_t iterations) : _iterations(iterations), _iterationsLeft(iterations) {
+}
+
+/**
+ * Stops timing, e.g. to prepare the data of the next iteration.
+ */
+void BenchmarkState::pauseTiming() {
+    assert(_pauseStart == 0);
+
+    _pauseStart = readClock(CLOCK_MONOTONIC);
+    _pauseCpuStart = readClock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/**
+ * Resumes timing stopped by pauseTiming().
+ */
+void BenchmarkState::resumeTiming() {
+    assert(_pauseStart != 0);
+
+    _pausedCpuTime += readClock(CLOCK_PROCESS_CPUTIME_ID) - _pauseCpuStart;
+    _pausedTime += readClock(CLOCK_MONOTONIC) - _pauseStart;
+    _pauseStart = 0;
+}
+
+/**
+ * Registers new benchmark in this runner.
+ * @param[in] name     name of the benchmark (e.g. "group/name")
+ * @param[in] function benchmark function
+ * @return true.
+ */
+bool BenchmarkRunner::addBenchmark(const std::string& name, BenchmarkPtr function) {
+    allBenchmarks.push_back({name, std::move(function)});
+    return true;
+}
+
+/** Maximal number of iterations of the benchmark loop */
+constexpr static uint64_t MAX_ITERATIONS = 1000000000u;
+
+/**
+ * Runs the given benchmark, increasing the number of iterations until it runs for at least the minimal time.
+ * @param[in] benchmark benchmark to run
+ * @param[in] minTime   minimal time of the run in seconds
+ * @return result of the benchmark.
+ */
+BenchmarkResult BenchmarkRunner::runBenchmark(const Benchmark& benchmark, double minTime) {
+    uint64_t minTimeNs = (uint64_t)(minTime * 1e9);
+    uint64_t iterations = 1;
+    while (true) {
+        BenchmarkState state(iterations);
+        uint64_t realStart = readClock(CLOCK_MONOTONIC);
+        uint64_t cpuStart = readClock(CLOCK_PROCESS_CPUTIME_ID);
+        benchmark.function(state);
+        uint64_t cpuTime = readClock(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+        uint64_t realTime = readClock(CLOCK_MONOTONIC) - realStart;
+        realTime -= std::min(realTime, state.pausedTime());
+        cpuTime -= std::min(cpuTime, state.pausedCpuTime());
+
+        if ((realTime >= minTimeNs) || (iterations >= MAX_ITERATIONS)) {
+            BenchmarkResult result;
+            result.name = benchmark.name;
+            result.iterations = iterations;
+            result.realTime = (double)realTime / (double)iterations;
+            result.cpuTime = (double)cpuTime / (double)iterations;
+            double seconds = std::max((double)realTime, 1.0) / 1e9;
+            result.itemsPerSecond = (double)state.itemsProcessed() / seconds;
+            result.bytesPerSecond = (double)state.bytesProcessed() / seconds;
+            result.label = state.label();
+            return result;
+        }
+
+        // Aims at 1.4 times the minimal time, so the next run most likely is the last one
+        uint64_t nextIterations = iterations * 10;
+        if (realTime > minTimeNs / 100) nextIterations = (uint64_t)((double)iterations * 1.4 * minTimeNs / realTime);
+        iterations = std::min(std::max(nextIterations, iterations + 1), MAX_ITERATIONS);
+    }
+}
+
+/**
+ * Runs the given benchmark several times and returns the fastest run. Slower runs are mostly noise of the system (other
+ * processes, frequency scaling, cache state), so the fastest run is the most repeatable measure of the code.
+ * @param[in] benchmark   benchmark to run
+ * @param[in] minTime     minimal time of each run in seconds
+ * @param[in] repetitions number of runs
+ * @param[in] fastest     fastest result of the previous runs, or result with no iterations if there are no such runs
+ * @return fastest result.
+ */
+BenchmarkResult BenchmarkRunner::runFastest(const Benchmark& benchmark, double minTime, unsigned int repetitions,
+                                            BenchmarkResult fastest) {
+    for (unsigned int i = 0; i < repetitions; ++i) {
+        BenchmarkResult result = runBenchmark(benchmark, minTime);
+        if ((fastest.iterations == 0) || (result.realTime < fastest.realTime)) fastest = result;
+    }
+    return fastest;
+}
+
+/**
+ * Writes the string into the JSON file with escaping.
+ * @param[out] output JSON file
+ * @param[in]  string string to write
+ */
+static void writeJsonString(FILE* output, const std::string& string) {
+    fputc('"', output);
+    for (char c : string) {
+        if ((c == '"') || (c == '\\')) fputc('\\', output);
+        fputc(c, output);
+    }
+    fputc('"', output);
+}
+
+/**
+ * Writes results into the JSON file in the format of Google Benchmark. Every benchmark is written on it's own line.
+ * @param[in] fileName name of the JSON file
+ * @param[in] results  results to write
+ * @return true, if file was written, false otherwise.
+ */
+static bool writeJsonResults(const std::string& fileName, const std::vector<BenchmarkResult>& results) {
+    FILE* output = fopen(fileName.c_str(), "w");
+    if (output == nullptr) return false;
+
+    char date[64] = "";
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fprintf(output, "{\n  \"context\": {\n");
+    fprintf(output, "    \"date\": \"%s\",\n", date);
+    fprintf(output, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(output, "    \"stack_security_level\": %d,\n", STACK_SECURITY_LEVEL);
+    fprintf(output, "    \"time_unit\": \"ns\"\n  },\n");
+    fprintf(output, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        fprintf(output, "    {\"name\": ");
+        writeJsonString(output, result.name);
+        fprintf(output, ", \"iterations\": %llu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\"",
+                (unsigned long long)result.iterations, result.realTime, result.cpuTime);
+        if (result.itemsPerSecond > 0) fprintf(output, ", \"items_per_second\": %.3f", result.itemsPerSecond);
+        if (result.bytesPerSecond > 0) fprintf(output, ", \"bytes_per_second\": %.3f", result.bytesPerSecond);
+        if (!result.label.empty()) {
+            fprintf(output, ", \"label\": ");
+            writeJsonString(output, result.label);
+        }
+        fprintf(output, "}%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(output, "  ]\n}\n");
+
+    bool isWritten = (ferror(output) == 0);
+    fclose(output);
+    return isWritten;
+}
+
+/**
+ * Reads real times of the benchmarks from the JSON file written by writeJsonResults.
+ * @param[in]  fileName name of the JSON file
+ * @param[out] times    real times of the benchmarks by their names
+ * @return true, if file was read, false otherwise.
+ */
+static bool readJsonResults(const std::string& fileName, std::map<std::string, double>& times) {
+    FILE* input = fopen(fileName.c_str(), "r");
+    if (input == nullptr) return false;
+
+    char line[4096] = "";
+    while (fgets(line, sizeof(line), input) != nullptr) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* realTime = strstr(line, "\"real_time\": ");
+        if ((name == nullptr) || (realTime == nullptr)) continue;
+
+        name += strlen("\"name\": \"");
+        const char* nameEnd = strchr(name, '"');
+        if (nameEnd == nullptr) continue;
+        times[std::string(name, nameEnd)] = strtod(realTime + strlen("\"real_time\": "), nullptr);
+    }
+    fclose(input);
+    return true;
+}
+
+/**
+ * Formats the rate with a metric prefix (e.g. "12.3M/s").
+ * @param[out] buffer buffer to format rate into
+ * @param[in]  rate   rate per second
+ */
+static void formatRate(char* buffer, double rate) {
+    const char* prefixes[] = {"", "k", "M", "G", "T"};
+    size_t prefix = 0;
+    while ((rate >= 1000) && (prefix + 1 < sizeof(prefixes) / sizeof(prefixes[0]))) {
+        rate /= 1000;
+        ++prefix;
+    }
+    sprintf(buffer, "%.4g%s/s", rate, prefixes[prefix]);
+}
+
+/** Number of times the benchmark slower than the baseline is run again before it's reported as a regression */
+constexpr static unsigned int REGRESSION_RERUNS = 3;
+
+/**
+ * Runs all benchmarks matching the filter, prints results, writes them to the JSON file and compares them with
+ * the baseline, if these files are given in options. Missing baseline file (e.g. on the first run) is not an error,
+ * results are only written then, so they can be used as the baseline of the next runs.
+ * @param[in] options options of the run
+ * @return true, if benchmarks were run and there are no regressions, false otherwise.
+ */
+bool BenchmarkRunner::runAllBenchmarks(const BenchmarkOptions& options) {
+    std::map<std::string, double> baselineTimes;
+    if (!options.baselineFileName.empty() && !readJsonResults(options.baselineFileName, baselineTimes)) {
+        printf("Baseline file %s not found, results are not compared\n", options.baselineFileName.c_str());
+    }
+
+    printf("%-48s %14s %14s %12s %12s %12s\n", "Benchmark", "Time, ns", "CPU, ns", "Iterations", "Items", "Bytes");
+    std::vector<BenchmarkResult> results;
+    unsigned int regressionsNumber = 0;
+    for (const Benchmark& benchmark : allBenchmarks) {
+        if (!options.filter.empty() && (benchmark.name.find(options.filter) == std::string::npos)) continue;
+
+        BenchmarkResult result = runFastest(benchmark, options.minTime, std::max(options.repetitions, 1u), {});
+        auto baseline = baselineTimes.find(result.name);
+        bool isCompared = (baseline != baselineTimes.end()) && (baseline->second > 0);
+        double change = 0;
+        for (unsigned int rerun = 0; isCompared && (rerun <= REGRESSION_RERUNS); ++rerun) {
+            // Slowdown of a single run is mostly noise, so only the slowdown that repeats is reported
+            if (rerun > 0) result = runFastest(benchmark, options.minTime, 1, result);
+            change = 100.0 * (result.realTime - baseline->second) / baseline->second;
+            if (change <= options.regressionThreshold) break;
+        }
+        results.push_back(result);
+
+        char items[32] = "", bytes[32] = "";
+        if (result.itemsPerSecond > 0) formatRate(items, result.itemsPerSecond);
+        if (result.bytesPerSecond > 0) formatRate(bytes, result.bytesPerSecond);
+        printf("%-48s %14.1f %14.1f %12llu %12s %12s %s", result.name.c_str(), result.realTime, result.cpuTime,
+               (unsigned long long)result.iterations, items, bytes, result.label.c_str());
+        if (isCompared) {
+            bool isRegression = (change > options.regressionThreshold);
+            if (isRegression) ++regressionsNumber;
+            printf(" %+.1f%%%s", change, isRegression ? " REGRESSION" : "");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (!options.outputFileName.empty() && !writeJsonResults(options.outputFileName, results)) {
+        fprintf(stderr, "Can't write results file %s\n", options.outputFileName.c_str());
+        return false;
+    }
+    if (regressionsNumber > 0) {
+        fprintf(stderr, "%u %s slower than the baseline by more than %.1f%%\n", regressionsNumber,
+                (regressionsNumber == 1) ? "benchmark is" : "benchmarks are", options.regressionThreshold);
+    }
+    return regressionsNumber == 0;
+}
+
+/**
+ * Returns a singleton instance of the runner.
+ * @return singleton runner.
+ */
+BenchmarkRunner* BenchmarkRunner::getInstance() {
+    static BenchmarkRunner runner;
+    return &runner;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file
+ * @brief Header file with benchlib description
+ *
+ * Benchmarks can be created with BENCHMARK(group, name) macro, or registered with BenchmarkRunner::addBenchmark.
+ * Benchmark function runs the measured code in the loop `while (state.keepRunning()) { ... }`, and the runner
+ * chooses the number of iterations, so that the benchmark runs for at least the minimal time.
+ * Results are printed as a table and can be written to the JSON file (in the format of Google Benchmark), which
+ * can be compared with the results of the previous run to find regressions.
+ */
+#ifndef BENCH_BENCHLIB_H
+#define BENCH_BENCHLIB_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * State of the running benchmark: number of iterations to run and counters of the processed items and bytes.
+ */
+class BenchmarkState {
+private:
+    uint64_t _iterations;
+    uint64_t _iterationsLeft;
+    uint64_t _itemsProcessed = 0;
+    uint64_t _bytesProcessed = 0;
+    std::string _label;
+
+    /** Wall time (in nanoseconds) when timing was paused, or 0 if timing is running */
+    uint64_t _pauseStart = 0;
+    /** Process CPU time (in nanoseconds) when timing was paused */
+    uint64_t _pauseCpuStart = 0;
+    /** Wall time (in nanoseconds) spent in pauses */
+    uint64_t _pausedTime = 0;
+    /** Process CPU time (in nanoseconds) spent in pauses */
+    uint64_t _pausedCpuTime = 0;
+
+public:
+    explicit BenchmarkState(uint64_t iterations);
+
+    /**
+     * Checks if the measured code should be run once more. Use as a condition of the benchmark loop.
+     * @return true, if there are iterations left, false otherwise.
+     */
+    bool keepRunning() {
+        if (_iterationsLeft == 0) return false;
+        --_iterationsLeft;
+        return true;
+    }
+
+    /**
+     * Number of iterations of the benchmark loop.
+     * @return number of iterations.
+     */
+    uint64_t iterations() const {
+        return _iterations;
+    }
+
+    /**
+     * Stops timing, e.g. to prepare the data of the next iteration.
+     */
+    void pauseTiming();
+
+    /**
+     * Resumes timing stopped by pauseTiming().
+     */
+    void resumeTiming();
+
+    /**
+     * Sets the number of items (operations, lines, etc) processed by all iterations.
+     * @param[in] items number of items
+     */
+    void setItemsProcessed(uint64_t items) {
+        _itemsProcessed = items;
+    }
+
+    /**
+     * Sets the number of bytes processed by all iterations.
+     * @param[in] bytes number of bytes
+     */
+    void setBytesProcessed(uint64_t bytes) {
+        _bytesProcessed = bytes;
+    }
+
+    /**
+     * Sets the label that is shown next to the result.
+     * @param[in] label label to show
+     */
+    void setLabel(const std::string& label) {
+        _label = label;
+    }
+
+    uint64_t itemsProcessed() const {
+        return _itemsProcessed;
+    }
+
+    uint64_t bytesProcessed() const {
+        return _bytesProcessed;
+    }
+
+    const std::string& label() const {
+        return _label;
+    }
+
+    uint64_t pausedTime() const {
+        return _pausedTime;
+    }
+
+    uint64_t pausedCpuTime() const {
+        return _pausedCpuTime;
+    }
+};
+
+/**
+ * Pointer to a function created by BENCHMARK(group, name) macro.
+ */
+using BenchmarkPtr = std::function<void(BenchmarkState&)>;
+
+/**
+ * Result of the benchmark.
+ */
+struct BenchmarkResult {
+    std::string name;
+    uint64_t iterations = 0;
+    /** Wall time of a single iteration in nanoseconds */
+    double realTime = 0;
+    /** Process CPU time of a single iteration in nanoseconds */
+    double cpuTime = 0;
+    /** Items processed per second, or 0 if the benchmark doesn't count items */
+    double itemsPerSecond = 0;
+    /** Bytes processed per second, or 0 if the benchmark doesn't count bytes */
+    double bytesPerSecond = 0;
+    std::string label;
+};
+
+/**
+ * Options of the benchmarks run.
+ */
+struct BenchmarkOptions {
+    /** Only benchmarks with names containing this string are run, or all, if it's empty */
+    std::string filter;
+    /** Minimal time of the benchmark run in seconds */
+    double minTime = 0.5;
+    /** File to write results in JSON into, or empty if results are only printed */
+    std::string outputFileName;
+    /** File with results of the previous run to compare with, or empty if results are not compared */
+    std::string baselineFileName;
+    /** Maximal slowdown (in percents of the baseline time) that is not reported as a regression */
+    double regressionThreshold = 10;
+    /** Number of runs of every benchmark, the fastest one is reported */
+    unsigned int repetitions = 1;
+};
+
+/**
+ * Represents a benchmark runner - container for benchmarks that runs them and reports results.
+ *
+ * Benchmarks created by BENCHMARK(group, name) macro are automatically registered in this runner.
+ * Use BenchmarkRunner.runAllBenchmarks() in main() to run all created benchmarks.
+ */
+class BenchmarkRunner {
+private:
+    struct Benchmark {
+        std::string name;
+        BenchmarkPtr function;
+    };
+
+    /** Container for all benchmarks **/
+    std::vector<Benchmark> allBenchmarks;
+
+    /**
+     * Runs the given benchmark, increasing the number of iterations until it runs for at least the minimal time.
+     * @param[in] benchmark benchmark to run
+     * @param[in] minTime   minimal time of the run in seconds
+     * @return result of the benchmark.
+     */
+    static BenchmarkResult runBenchmark(const Benchmark& benchmark, double minTime);
+    static BenchmarkResult runFastest(const Benchmark& benchmark, double minTime, unsigned int repetitions,
+                                      BenchmarkResult fastest);
+
+public:
+    /**
+     * Registers new benchmark in this runner.
+     * @param[in] name     name of the benchmark (e.g. "group/name")
+     * @param[in] function benchmark function
+     * @return true.
+     */
+    bool addBenchmark(const std::string& name, BenchmarkPtr function);
+
+    /**
+     * Runs all benchmarks matching the filter, prints results, writes them to the JSON file and compares them with
+     * the baseline, if these files are given in options.
+     * @param[in] options options of the run
+     * @return true, if benchmarks were run and there are no regressions, false otherwise.
+     */
+    bool runAllBenchmarks(const BenchmarkOptions& options);
+
+    /**
+     * Returns a singleton instance of the runner.
+     * @return singleton runner.
+     */
+    static BenchmarkRunner* getInstance();
+};
+
+/**
+ * Prevents compiler from optimizing out the computation of the given value.
+ * @param[in] value value to keep
+ */
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/** Name that is given to a benchmark function created by BENCHMARK(group, name) macro. **/
+#define BENCHMARK_NAME(group, name) group##_##name##_benchmark
+/** Name that is given to a global variable that shows the benchmark is registered. **/
+#define BENCHMARK_INFO(group, name) group##_##name##_benchmarkinfo
+
+#define BENCHMARK_IMPL(group, name)                                                                                    \
+    static void BENCHMARK_NAME(group, name)(BenchmarkState& state);                                                    \
+    static const bool BENCHMARK_INFO(group, name) =                                                                    \
+        BenchmarkRunner::getInstance()->addBenchmark(#group "/" #name, &BENCHMARK_NAME(group, name));                  \
+    static void BENCHMARK_NAME(group, name)(BenchmarkState& state)
+
+/**
+ * Creates a benchmark with a given group and name (macros in them are expanded) and registers it in
+ * a BenchmarkRunner. Benchmark is named "group/name".
+ */
+#define BENCHMARK(group, name) BENCHMARK_IMPL(group, name)
+
+#endif // BENCH_BENCHLIB_H
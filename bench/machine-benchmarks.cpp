@@ -0,0 +1,258 @@
+/**
+ * @file
+ * @brief Micro benchmarks: dispatch cost of operations on every engine, RAM access, assembler and disassembler speed.
+ */
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include "benchlib.h"
+#include "../src/stack-machine.h"
+#include "../src/threaded-stack-machine.h"
+#include "../src/jit-stack-machine.h"
+#include "../src/bytecode-image.h"
+
+static const char* const sourceBenchFileName = "SOURCE_BENCH_FILE_NAME.txt";
+static const char* const asmBenchFileName = "ASM_BENCH_FILE_NAME.asm";
+
+/**
+ * Writes the given source code and assembles it.
+ * @param[in] source         source code
+ * @param[in] sourceFileName source code file name
+ * @param[in] asmFileName    assembly file name
+ * @param[in] fuseOperations shows if operations are fused
+ * @return exit code of the assembler.
+ */
+static int assembleSource(const std::string& source, const char* sourceFileName, const char* asmFileName,
+                          bool fuseOperations = false) {
+    FILE* sourceFile = fopen(sourceFileName, "w");
+    fputs(source.c_str(), sourceFile);
+    fclose(sourceFile);
+
+    AssemblyOptions options;
+    options.fuseOperations = fuseOperations;
+    // File is written anew, so it doesn't get the cached image of the previous benchmark with the same identity
+    remove(asmFileName);
+    return assemble(sourceFileName, asmFileName, options);
+}
+
+/**
+ * Gets the size of the file.
+ * @param[in] fileName name of the file
+ * @return size of the file in bytes.
+ */
+static uint64_t getFileSize(const char* fileName) {
+    struct stat fileStat {};
+    stat(fileName, &fileStat);
+    return (uint64_t)fileStat.st_size;
+}
+
+/**
+ * Creates the machine of the given engine that runs the given image.
+ * @param[in] engine execution engine
+ * @param[in] image  image of the assembly file
+ * @return created machine.
+ */
+static std::unique_ptr<StackMachine> createMachine(ExecutionEngine engine,
+                                                   const std::shared_ptr<const BytecodeImage>& image) {
+    switch (engine) {
+        case THREADED_ENGINE:    return std::unique_ptr<StackMachine>(new ThreadedStackMachine(image, false));
+        case TOS_CACHING_ENGINE: return std::unique_ptr<StackMachine>(new ThreadedStackMachine(image, true));
+        case JIT_ENGINE:         return std::unique_ptr<StackMachine>(new JitStackMachine(image));
+        case REFERENCE_ENGINE:
+        default:                 return std::unique_ptr<StackMachine>(new StackMachine(image));
+    }
+}
+
+/**
+ * Straight-line program that repeats the same operations, so it's run time is the dispatch cost of them.
+ */
+struct DispatchProgram {
+    const char* name;
+    /** Operations before the repeated ones */
+    const char* prologue;
+    /** Repeated operations. "%d" is replaced with the number of the repetition (to make labels unique) */
+    const char* body;
+    /** Number of operations executed by one repetition */
+    int bodyOperationsNumber;
+    /** Operations after HLT (subroutines) */
+    const char* epilogue;
+};
+
+static const DispatchProgram DISPATCH_PROGRAMS[] = {
+    {"PUSH_POP",       "",                   "PUSH 1\nPOP\n",                       2, ""},
+    {"PUSHR_POPR",     "",                   "PUSH AX\nPOP BX\n",                   2, ""},
+    {"PUSHM_POPM",     "",                   "PUSH [1]\nPOP [2]\n",                 2, ""},
+    {"PUSHRM_POPRM",   "PUSH 1\nPOP AX\n",   "PUSH [AX]\nPOP [AX]\n",               2, ""},
+    {"ADD",            "PUSH 0\n",           "PUSH 1\nADD\n",                       2, ""},
+    {"MUL",            "PUSH 1\n",           "PUSH 1\nMUL\n",                       2, ""},
+    {"DIV",            "PUSH 1\n",           "PUSH 1\nDIV\n",                       2, ""},
+    {"SQRT",           "PUSH 1\n",           "SQRT\n",                              1, ""},
+    {"DUP_POP",        "PUSH 1\n",           "DUP\nPOP\n",                          2, ""},
+    {"JMP",            "",                   "JMP J%d\nJ%d:\n",                     1, ""},
+    {"JMPE",           "",                   "PUSH 1\nPUSH 1\nJMPE J%d\nJ%d:\n",    3, ""},
+    {"IADD",           "IPUSH 0\n",          "IPUSH 1\nIADD\n",                     2, ""},
+    {"IJMPE",          "",                   "IPUSH 1\nIPUSH 1\nIJMPE J%d\nJ%d:\n", 3, ""},
+    {"CALL_RET",       "",                   "CALL F\n",                            2, "F:\nRET\n"},
+};
+
+/** Number of repetitions of the body in the dispatch program */
+constexpr static int DISPATCH_REPETITIONS = 1000;
+
+/**
+ * Registers dispatch benchmark of the program on the engine.
+ * @param[in] program    dispatch program
+ * @param[in] engine     execution engine
+ * @param[in] engineName name of the engine
+ * @return true.
+ */
+static bool addDispatchBenchmark(const DispatchProgram& program, ExecutionEngine engine, const char* engineName) {
+    std::string name = std::string("dispatch/") + program.name + "/" + engineName;
+    return BenchmarkRunner::getInstance()->addBenchmark(name, [program, engine](BenchmarkState& state) {
+        std::string source = program.prologue;
+        char body[256] = "";
+        for (int i = 0; i < DISPATCH_REPETITIONS; ++i) {
+            snprintf(body, sizeof(body), program.body, i, i);
+            source += body;
+        }
+        source += "HLT\n";
+        source += program.epilogue;
+
+        assembleSource(source, sourceBenchFileName, asmBenchFileName);
+        std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(asmBenchFileName);
+
+        while (state.keepRunning()) {
+            // Machine is created out of timing, because threaded engines decode the whole program when created
+            state.pauseTiming();
+            std::unique_ptr<StackMachine> machine = createMachine(engine, image);
+            state.resumeTiming();
+
+            doNotOptimize(machine->execute());
+
+            state.pauseTiming();
+            machine.reset();
+            state.resumeTiming();
+        }
+        state.setItemsProcessed(state.iterations() * DISPATCH_REPETITIONS * program.bodyOperationsNumber);
+    });
+}
+
+/**
+ * Registers dispatch benchmarks of all programs on all engines.
+ * @return true.
+ */
+static bool addDispatchBenchmarks() {
+    for (const DispatchProgram& program : DISPATCH_PROGRAMS) {
+        addDispatchBenchmark(program, REFERENCE_ENGINE, "reference");
+        addDispatchBenchmark(program, THREADED_ENGINE, "threaded");
+        addDispatchBenchmark(program, TOS_CACHING_ENGINE, "tos");
+        addDispatchBenchmark(program, JIT_ENGINE, "jit");
+    }
+    return true;
+}
+
+static const bool dispatchBenchmarksInfo = addDispatchBenchmarks();
+
+BENCHMARK(ram, setGet) {
+    RAM ram;
+    double sum = 0;
+    while (state.keepRunning()) {
+        for (int i = 0; i < ram.getSize(); ++i) {
+            ram.setAt(i, i);
+        }
+        for (int i = 0; i < ram.getSize(); ++i) {
+            sum += ram.getAt(i);
+        }
+    }
+    doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * ram.getSize() * 2);
+}
+
+BENCHMARK(ram, vectorAdd) {
+    RAM ram;
+    constexpr int count = RAM::DEFAULT_SIZE / 2;
+    while (state.keepRunning()) {
+        ram.add(0, 0, count, count);
+    }
+    doNotOptimize(ram.getMemory()[0]);
+    state.setItemsProcessed(state.iterations() * count);
+    state.setBytesProcessed(state.iterations() * count * 3 * sizeof(double));
+}
+
+BENCHMARK(ram, vectorDot) {
+    RAM ram;
+    constexpr int count = RAM::DEFAULT_SIZE / 2;
+    double sum = 0;
+    while (state.keepRunning()) {
+        sum += ram.dot(0, count, count);
+    }
+    doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * count);
+    state.setBytesProcessed(state.iterations() * count * 2 * sizeof(double));
+}
+
+/** Number of repetitions of the loop in the generated large source code */
+constexpr static int LARGE_SOURCE_LOOPS = 10000;
+
+/**
+ * Generates the large source code: loops with labels, jumps, register, RAM and arithmetic operations.
+ * @param[out] linesNumber number of lines in the source code
+ * @return source code.
+ */
+static std::string generateLargeSource(uint64_t& linesNumber) {
+    std::string source;
+    char loop[512] = "";
+    for (int i = 0; i < LARGE_SOURCE_LOOPS; ++i) {
+        snprintf(loop, sizeof(loop),
+                 "LOOP_%d:\n"
+                 "PUSH AX\nPUSH AX\nMUL\nPUSH 1.5\nADD\nPOP [%d]\n"
+                 "PUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\nJMPG LOOP_%d\n"
+                 "CALL SUB_%d\n",
+                 i, i % 1024, i, (i + 1) % LARGE_SOURCE_LOOPS);
+        source += loop;
+        snprintf(loop, sizeof(loop), "SUB_%d:\nPUSH [BX]\nDUP\nADD\nPOP BX\nRET\n", i);
+        source += loop;
+    }
+    source += "HLT\n";
+    linesNumber = (uint64_t)LARGE_SOURCE_LOOPS * 21 + 1;
+    return source;
+}
+
+/**
+ * Registers the assembler benchmark.
+ * @param[in] name           name of the benchmark
+ * @param[in] fuseOperations shows if operations are fused
+ * @return true.
+ */
+static bool addAssemblerBenchmark(const char* name, bool fuseOperations) {
+    return BenchmarkRunner::getInstance()->addBenchmark(name, [fuseOperations](BenchmarkState& state) {
+        uint64_t linesNumber = 0;
+        std::string source = generateLargeSource(linesNumber);
+        FILE* sourceFile = fopen(sourceBenchFileName, "w");
+        fputs(source.c_str(), sourceFile);
+        fclose(sourceFile);
+
+        AssemblyOptions options;
+        options.fuseOperations = fuseOperations;
+        while (state.keepRunning()) {
+            doNotOptimize(assemble(sourceBenchFileName, asmBenchFileName, options));
+        }
+        state.setItemsProcessed(state.iterations() * linesNumber);
+        state.setBytesProcessed(state.iterations() * source.size());
+    });
+}
+
+static const bool assemblerBenchmarksInfo = addAssemblerBenchmark("assembler/lines", false) &&
+                                            addAssemblerBenchmark("assembler/linesFused", true);
+
+BENCHMARK(disassembler, bytes) {
+    uint64_t linesNumber = 0;
+    assembleSource(generateLargeSource(linesNumber), sourceBenchFileName, asmBenchFileName);
+    uint64_t assemblySize = getFileSize(asmBenchFileName);
+
+    while (state.keepRunning()) {
+        doNotOptimize(disassemble(asmBenchFileName, "/dev/null"));
+    }
+    state.setItemsProcessed(state.iterations() * linesNumber);
+    state.setBytesProcessed(state.iterations() * assemblySize);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "benchlib.h"
+
+/**
+ * Returns the value of the option, if the given argument is this option (e.g. "--name=value").
+ * @param[in] argument   argument to check
+ * @param[in] optionName name of the option with leading dashes
+ * @return option value, or nullptr if the argument is not the given option.
+ */
+static const char* getOptionValue(const char* argument, const char* optionName) {
+    size_t optionNameLength = strlen(optionName);
+    if ((strncmp(argument, optionName, optionNameLength) != 0) || (argument[optionNameLength] != '=')) return nullptr;
+    return argument + optionNameLength + 1;
+}
+
+static void printUsage(const char* programName) {
+    printf("Usage: %s [options]\n", programName);
+    printf("Options:\n");
+    printf("  --help             Show this message\n");
+    printf("  --filter=TEXT      Run only benchmarks with names containing TEXT\n");
+    printf("  --min-time=SEC     Minimal time of each benchmark in seconds (default: 0.5)\n");
+    printf("  --out=FILE         Write results into FILE as JSON\n");
+    printf("  --baseline=FILE    Compare results with the JSON results of the previous run\n");
+    printf("  --threshold=P      Report benchmarks slower than the baseline by more than P percents (default: 10)\n");
+    printf("  --repetitions=N    Run every benchmark N times and report the fastest run (default: 1)\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const char* value = nullptr;
+        if (strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if ((value = getOptionValue(argv[i], "--filter")) != nullptr) {
+            options.filter = value;
+        } else if ((value = getOptionValue(argv[i], "--min-time")) != nullptr) {
+            options.minTime = strtod(value, nullptr);
+        } else if ((value = getOptionValue(argv[i], "--out")) != nullptr) {
+            options.outputFileName = value;
+        } else if ((value = getOptionValue(argv[i], "--baseline")) != nullptr) {
+            options.baselineFileName = value;
+        } else if ((value = getOptionValue(argv[i], "--threshold")) != nullptr) {
+            options.regressionThreshold = strtod(value, nullptr);
+        } else if ((value = getOptionValue(argv[i], "--repetitions")) != nullptr) {
+            options.repetitions = (unsigned int)strtoul(value, nullptr, 10);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    return BenchmarkRunner::getInstance()->runAllBenchmarks(options) ? 0 : -1;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @brief Macro benchmarks: example programs run on every engine with synthetic IN values.
+ */
+#include <cstdio>
+#include <string>
+#include "benchlib.h"
+#include "../src/stack-machine.h"
+#include "../src/bytecode-image.h"
+
+#ifndef BENCH_EXAMPLES_DIR
+    /** Directory with the example programs */
+    #define BENCH_EXAMPLES_DIR "examples"
+#endif
+
+static const char* const inputBenchFileName = "INPUT_BENCH_FILE_NAME.txt";
+
+/**
+ * Example program and the generator of it's IN values.
+ * Examples that never finish (example_3 and example_infinite_discriminant_sqrt) are not run.
+ */
+struct ExampleProgram {
+    /** Name of the example source code file in the examples directory without extension */
+    const char* name;
+    /**
+     * Generates IN values of the run.
+     * @return IN values as text.
+     */
+    std::string (*generateInput)();
+};
+
+static std::string generateSumInput() {
+    return "3 4\n";
+}
+
+static std::string generateSquareInput() {
+    return "5\n";
+}
+
+static std::string generateDoubleSumInput() {
+    return "1.5 2.5\n";
+}
+
+/** Sets 1000 array elements, then exits with an index out of the array */
+static std::string generateArrayInput() {
+    std::string input;
+    char line[64] = "";
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(line, sizeof(line), "%d %d\n", i % 5, i);
+        input += line;
+    }
+    return input + "-1\n";
+}
+
+/** Three equations: the loop of the example runs three times */
+static std::string generateDiscriminantInput() {
+    return "1 5 6\n1 -4 4\n2 7 3\n";
+}
+
+/** Fibonacci numbers 1..20, then 0 to exit */
+static std::string generateFibonacciInput() {
+    std::string input;
+    for (int i = 1; i <= 20; ++i) {
+        input += std::to_string(i) + "\n";
+    }
+    return input + "0\n";
+}
+
+static const ExampleProgram EXAMPLE_PROGRAMS[] = {
+    {"example_1",                                  generateSumInput},
+    {"example_2",                                  generateSquareInput},
+    {"example_4",                                  generateDoubleSumInput},
+    {"example_5",                                  generateArrayInput},
+    {"example_conditional_loop_discriminant_sqrt", generateDiscriminantInput},
+    {"example_recursive_fibonacci",                generateFibonacciInput},
+};
+
+/**
+ * Registers the benchmark of the example program on the engine.
+ * @param[in] example    example program
+ * @param[in] engine     execution engine
+ * @param[in] engineName name of the engine
+ * @return true.
+ */
+static bool addExampleBenchmark(const ExampleProgram& example, ExecutionEngine engine, const char* engineName) {
+    std::string name = std::string("example/") + example.name + "/" + engineName;
+    return BenchmarkRunner::getInstance()->addBenchmark(name, [example, engine](BenchmarkState& state) {
+        std::string sourceFileName = std::string(BENCH_EXAMPLES_DIR) + "/" + example.name + ".txt";
+        std::string asmFileName = std::string(example.name) + "_BENCH.asm";
+        remove(asmFileName.c_str());
+        if (assemble(sourceFileName.c_str(), asmFileName.c_str()) != 0) {
+            state.setLabel("can't assemble " + sourceFileName);
+            while (state.keepRunning()) { }
+            return;
+        }
+        std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(asmFileName.c_str());
+
+        std::string input = example.generateInput();
+        FILE* inputFile = fopen(inputBenchFileName, "w");
+        fputs(input.c_str(), inputFile);
+        fclose(inputFile);
+
+        RunOptions options;
+        options.engine = engine;
+        options.ioMode = TEXT_IO;
+        options.ioInputFileName = inputBenchFileName;
+        options.ioOutputFileName = "/dev/null";
+
+        int exitCode = 0;
+        while (state.keepRunning()) {
+            exitCode = run(image, options);
+        }
+        if (exitCode != 0) state.setLabel("exit code " + std::to_string(exitCode));
+        state.setBytesProcessed(state.iterations() * input.size());
+    });
+}
+
+/**
+ * Registers benchmarks of all example programs on all engines.
+ * @return true.
+ */
+static bool addExampleBenchmarks() {
+    for (const ExampleProgram& example : EXAMPLE_PROGRAMS) {
+        addExampleBenchmark(example, REFERENCE_ENGINE, "reference");
+        addExampleBenchmark(example, THREADED_ENGINE, "threaded");
+        addExampleBenchmark(example, TOS_CACHING_ENGINE, "tos");
+        addExampleBenchmark(example, JIT_ENGINE, "jit");
+    }
+    return true;
+}
+
+static const bool exampleBenchmarksInfo = addExampleBenchmarks();
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Push and pop throughput of the operand stack. The file is compiled once per stack security level
+ *        (STACK_SECURITY_LEVEL is given by the build), and benchmarks are grouped by the level, e.g. "stackLevel3".
+ */
+#include <cassert>
+#include <cstdlib>
+#include <sys/types.h>
+#include <typeinfo>
+#include "../src/immortal-stack/environment.h"
+#include "../src/immortal-stack/logger.h"
+#include "benchlib.h"
+
+// Stack of every level is a different type, so it is kept local to this file
+namespace {
+#define STACK_TYPE double
+#include "../src/immortal-stack/stack.h"
+#undef STACK_TYPE
+}
+
+#define STACK_BENCHMARK_GROUP_IMPL(level) stackLevel##level
+#define STACK_BENCHMARK_GROUP(level) STACK_BENCHMARK_GROUP_IMPL(level)
+
+/** Number of values pushed and popped by one iteration */
+constexpr static int STACK_DEPTH = 1024;
+
+BENCHMARK(STACK_BENCHMARK_GROUP(STACK_SECURITY_LEVEL), pushPop) {
+    Stack_double stack {};
+    constructStack(&stack, STACK_DEPTH);
+
+    double sum = 0;
+    while (state.keepRunning()) {
+        for (int i = 0; i < STACK_DEPTH; ++i) {
+            push(&stack, i);
+        }
+        for (int i = 0; i < STACK_DEPTH; ++i) {
+            sum += pop(&stack);
+        }
+    }
+    doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * STACK_DEPTH * 2);
+
+    destructStack(&stack);
+}
+
+BENCHMARK(STACK_BENCHMARK_GROUP(STACK_SECURITY_LEVEL), pushPopGrowing) {
+    double sum = 0;
+    while (state.keepRunning()) {
+        Stack_double stack {};
+        constructStack(&stack);
+        for (int i = 0; i < STACK_DEPTH; ++i) {
+            push(&stack, i);
+        }
+        for (int i = 0; i < STACK_DEPTH; ++i) {
+            sum += pop(&stack);
+        }
+        destructStack(&stack);
+    }
+    doNotOptimize(sum);
+    state.setItemsProcessed(state.iterations() * STACK_DEPTH * 2);
+}
@@ -0,0 +1,725 @@
+/**
+ * @file
+ * @brief Implementation of the ahead-of-time compiler.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+#include "aot-compiler.h"
+#include "bytecode-verifier.h"
+
+using byte = unsigned char;
+
+extern char** environ;
+
+/** Operand stack of the known depth is the local array, if it's not deeper than this, or the static array otherwise */
+constexpr static int MAX_LOCAL_STACK_DEPTH = 1024;
+/** Initial capacity of the operand stack of the unknown depth, it's doubled when the stack is full */
+constexpr static int INITIAL_STACK_CAPACITY = 1024;
+
+/**
+ * Runtime of the compiled program: I/O modes of `run` (see machine-io.h), RAM and it's vector operations. Values are
+ * read, written and summed exactly as the stack machine does it, so the program gives bit-identical results.
+ */
+static const char* const AOT_RUNTIME = R"(
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static int ioMode = AOT_INTERACTIVE_IO;
+static double ram[AOT_RAM_SIZE];
+
+static bool isSpace(int c) {
+    return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+static uint64_t toLittleEndian(uint64_t value) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return __builtin_bswap64(value);
+#else
+    return value;
+#endif
+}
+
+static double readValue() {
+    if (ioMode == AOT_TEXT_IO) {
+        int c = getchar_unlocked();
+        while ((c != EOF) && isSpace(c)) c = getchar_unlocked();
+        if (c == EOF) return NAN;
+
+        char text[512];
+        size_t length = 0;
+        for (; (c != EOF) && !isSpace(c); c = getchar_unlocked()) {
+            if (length < sizeof(text) - 1) text[length++] = (char)c;
+        }
+        text[length] = '\0';
+        char* end = nullptr;
+        double value = strtod(text, &end);
+        return (end == text) ? NAN : value;
+    }
+    if (ioMode == AOT_BINARY_IO) {
+        uint64_t bits = 0;
+        if (fread(&bits, sizeof(bits), 1, stdin) != 1) return NAN;
+        bits = toLittleEndian(bits);
+        double value = NAN;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double value = NAN;
+    printf("> ");
+    if (scanf("%lg", &value) != 1) return value;
+    return value;
+}
+
+static void writeValue(double value) {
+    if (ioMode == AOT_BINARY_IO) {
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = toLittleEndian(bits);
+        fwrite(&bits, sizeof(bits), 1, stdout);
+        return;
+    }
+    printf("%lg\n", value);
+}
+
+static bool isValidAddress(double address) {
+    return (address >= 0) && (address < AOT_RAM_SIZE);
+}
+
+static bool isValidRange(double address, double count) {
+    if (!((address >= 0) && (address < AOT_RAM_SIZE) && (count >= 0) && (count <= AOT_RAM_SIZE))) return false;
+    return (long long)address + (long long)count <= AOT_RAM_SIZE;
+}
+
+static int64_t toIntegerOperand(double value) {
+    if (!((value >= -9223372036854775808.0) && (value < 9223372036854775808.0))) return 0;
+    return (int64_t)value;
+}
+
+static int64_t integerAdd(int64_t lhs, int64_t rhs) {
+    return (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+}
+
+static int64_t integerSubtract(int64_t lhs, int64_t rhs) {
+    return (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+}
+
+static int64_t integerMultiply(int64_t lhs, int64_t rhs) {
+    return (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+}
+
+static const double* getSource(int destination, int source, int count, std::vector<double>& copy) {
+    bool isPartialOverlap = (source != destination) && (source < destination + count) && (destination < source + count);
+    if (!isPartialOverlap) return ram + source;
+
+    copy.assign(ram + source, ram + source + count);
+    return copy.data();
+}
+
+// Sums are accumulated in two groups of 4 lanes, in the same order as the vector kernels of the stack machine
+static double sumValues(const double* values, int count) {
+    double first[4] = {0, 0, 0, 0}, second[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int lane = 0; lane < 4; ++lane) {
+            first[lane] += values[i + lane];
+            second[lane] += values[i + 4 + lane];
+        }
+    }
+    for (int lane = 0; lane < 4; ++lane) first[lane] += second[lane];
+    double sum = (first[0] + first[1]) + (first[2] + first[3]);
+    for (; i < count; ++i) sum += values[i];
+    return sum;
+}
+
+static double dotValues(const double* lhs, const double* rhs, int count) {
+    double first[4] = {0, 0, 0, 0}, second[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int lane = 0; lane < 4; ++lane) {
+            first[lane] += lhs[i + lane] * rhs[i + lane];
+            second[lane] += lhs[i + 4 + lane] * rhs[i + 4 + lane];
+        }
+    }
+    for (int lane = 0; lane < 4; ++lane) first[lane] += second[lane];
+    double sum = (first[0] + first[1]) + (first[2] + first[3]);
+    for (; i < count; ++i) sum += lhs[i] * rhs[i];
+    return sum;
+}
+
+// Operands are in the order they were pushed, so count is the last of them
+static int applyVectorOperation(int opcode, const double* operands, int operandsNumber, double* result) {
+    double count = operands[operandsNumber - 1];
+    if (!isValidRange(0, count)) return AOT_ERR_INVALID_RAM_ADDRESS;
+    int elementsNumber = (int)count;
+
+    std::vector<double> lhsCopy, rhsCopy;
+    switch (opcode) {
+        case AOT_VADD_OPCODE:
+        case AOT_VMUL_OPCODE: {
+            if (!isValidRange(operands[0], count) || !isValidRange(operands[1], count) ||
+                !isValidRange(operands[2], count)) {
+                return AOT_ERR_INVALID_RAM_ADDRESS;
+            }
+            int destination = (int)operands[0];
+            const double* lhs = getSource(destination, (int)operands[1], elementsNumber, lhsCopy);
+            const double* rhs = getSource(destination, (int)operands[2], elementsNumber, rhsCopy);
+            for (int i = 0; i < elementsNumber; ++i) {
+                ram[destination + i] = (opcode == AOT_VADD_OPCODE) ? lhs[i] + rhs[i] : lhs[i] * rhs[i];
+            }
+            return 0;
+        }
+        case AOT_VSUM_OPCODE:
+            if (!isValidRange(operands[0], count)) return AOT_ERR_INVALID_RAM_ADDRESS;
+            *result = sumValues(ram + (int)operands[0], elementsNumber);
+            return 0;
+        case AOT_VDOT_OPCODE:
+            if (!isValidRange(operands[0], count) || !isValidRange(operands[1], count)) return AOT_ERR_INVALID_RAM_ADDRESS;
+            *result = dotValues(ram + (int)operands[0], ram + (int)operands[1], elementsNumber);
+            return 0;
+        case AOT_VFILL_OPCODE:
+            if (!isValidRange(operands[0], count)) return AOT_ERR_INVALID_RAM_ADDRESS;
+            for (int i = 0; i < elementsNumber; ++i) ram[(int)operands[0] + i] = operands[1];
+            return 0;
+        default:
+            if (!isValidRange(operands[0], count) || !isValidRange(operands[1], count)) return AOT_ERR_INVALID_RAM_ADDRESS;
+            memmove(ram + (int)operands[0], ram + (int)operands[1], elementsNumber * sizeof(double));
+            return 0;
+    }
+}
+)";
+
+/** Entry point of the compiled program: options, buffering of non-interactive I/O modes and error messages */
+static const char* const AOT_MAIN = R"(
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--io=interactive") == 0) {
+            ioMode = AOT_INTERACTIVE_IO;
+        } else if (strcmp(argv[i], "--io=text") == 0) {
+            ioMode = AOT_TEXT_IO;
+        } else if (strcmp(argv[i], "--io=binary") == 0) {
+            ioMode = AOT_BINARY_IO;
+        } else {
+            fprintf(stderr, "Usage: %s [--io=interactive|text|binary]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    static char inputBuffer[AOT_IO_BUFFER_SIZE];
+    static char outputBuffer[AOT_IO_BUFFER_SIZE];
+    if (ioMode != AOT_INTERACTIVE_IO) {
+        setvbuf(stdin, inputBuffer, _IOFBF, sizeof(inputBuffer));
+        setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    }
+
+    int status = runProgram();
+    fflush(stdout);
+    if (status == AOT_ERR_INVALID_OPERATION) fprintf(stderr, "Invalid operation met\n");
+    if (status == AOT_ERR_STACK_UNDERFLOW) fprintf(stderr, "Stack underflow\n");
+    if (status == AOT_ERR_INVALID_RAM_ADDRESS) fprintf(stderr, "Invalid RAM address\n");
+    return status;
+}
+)";
+
+/** Depth of the operand stack that is known only at run time */
+constexpr static int UNKNOWN_DEPTH = -1;
+/** Entry depth of the offset, that doesn't start a block */
+constexpr static int NOT_BLOCK_START = -2;
+
+/**
+ * State of the translation of the image.
+ */
+struct Translation {
+    FILE* output;
+    const unsigned char* assembly;
+    int assemblySize;
+    int ramSize;
+    /** Shows if the operand stack is the growing array (it's depth is unknown) */
+    bool isStackGrowing;
+    /** Shows for each byte offset if the operation at it is the target of a jump or the return from CALL */
+    std::vector<bool> isLabel;
+    /** Offsets of operations after CALL operations */
+    std::vector<int> returnOffsets;
+    /** Entry depths of the operand stack of the blocks by their offsets (UNKNOWN_DEPTH or NOT_BLOCK_START) */
+    std::vector<int> entryDepths;
+    /** Depth of the operand stack before the translated operation, or UNKNOWN_DEPTH */
+    int depth;
+};
+
+/**
+ * Formats the finite immediate operand as the double literal, that is read back exactly.
+ * @param[in] value value of the operand
+ * @return literal in parentheses.
+ */
+static std::string formatImmediate(double value) {
+    assert(std::isfinite(value));
+
+    char text[64] = "";
+    snprintf(text, sizeof(text), "%.17g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos) literal += ".0";
+    return "(" + literal + ")";
+}
+
+/**
+ * Formats the integer immediate operand as the int64_t literal.
+ * @param[in] value value of the operand
+ * @return literal.
+ */
+static std::string formatIntegerImmediate(int64_t value) {
+    // -2^63 can't be written as the negated literal, as 2^63 doesn't fit into int64_t
+    if (value == INT64_MIN) return "INT64_MIN";
+    return "INT64_C(" + std::to_string(value) + ")";
+}
+
+/**
+ * Gets the name of the local variable of the register.
+ * @param[in] reg register number
+ * @return name of the variable (e.g. "ax").
+ */
+static std::string getRegisterVariable(byte reg) {
+    std::string name = getRegisterNameByNumber(reg);
+    for (char& c : name) c = (char)tolower(c);
+    return name;
+}
+
+/**
+ * Gets the name of the local variable of the integer register.
+ * @param[in] reg integer register number
+ * @return name of the variable (e.g. "iax").
+ */
+static std::string getIntegerRegisterVariable(byte reg) {
+    std::string name = getIntegerRegisterNameByNumber(reg);
+    for (char& c : name) c = (char)tolower(c);
+    return name;
+}
+
+/**
+ * Gets the condition of the conditional jump in C++.
+ * @param[in] opcode code of the conditional jump operation
+ * @param[in] lhs    expression of the left hand side operand (int64_t for integer jumps)
+ * @param[in] rhs    expression of the right hand side operand (int64_t for integer jumps)
+ * @return condition, with which the jump is taken (see isJumpTaken and isIntegerJumpTaken).
+ */
+static std::string getJumpCondition(byte opcode, const std::string& lhs, const std::string& rhs) {
+    switch (opcode) {
+        case JMPE_OPCODE:   return "fabs(" + lhs + " - " + rhs + ") < AOT_COMPARE_EPS";
+        case JMPNE_OPCODE:  return "fabs(" + lhs + " - " + rhs + ") >= AOT_COMPARE_EPS";
+        case JMPL_OPCODE:   return lhs + " < "  + rhs;
+        case JMPLE_OPCODE:  return lhs + " <= " + rhs;
+        case JMPG_OPCODE:   return lhs + " > "  + rhs;
+        case JMPGE_OPCODE:  return lhs + " >= " + rhs;
+        case IJMPE_OPCODE:  return lhs + " == " + rhs;
+        case IJMPNE_OPCODE: return lhs + " != " + rhs;
+        case IJMPL_OPCODE:  return lhs + " < "  + rhs;
+        case IJMPLE_OPCODE: return lhs + " <= " + rhs;
+        case IJMPG_OPCODE:  return lhs + " > "  + rhs;
+        default:            return lhs + " >= " + rhs;
+    }
+}
+
+/**
+ * Writes the check, that the operand stack has enough values for the operation. The check is omitted, if the depth
+ * is known to be enough, and the operation fails unconditionally, if the depth is known to be too small.
+ * @param[in, out] translation state of the translation
+ * @param[in]      valuesNumber number of values the operation needs
+ */
+static void writeDepthCheck(Translation& translation, int valuesNumber) {
+    if (translation.depth == UNKNOWN_DEPTH) {
+        fprintf(translation.output, "    if (sp < %d) return AOT_ERR_STACK_UNDERFLOW;\n", valuesNumber);
+    } else if (translation.depth < valuesNumber) {
+        fprintf(translation.output, "    return AOT_ERR_STACK_UNDERFLOW;\n");
+    }
+}
+
+/**
+ * Writes the check, that the integer stack has enough values for the operation. Depth of the integer stack isn't
+ * verified, so it's always checked at run time.
+ * @param[in] translation  state of the translation
+ * @param[in] valuesNumber number of values the operation needs
+ */
+static void writeIntegerDepthCheck(const Translation& translation, int valuesNumber) {
+    fprintf(translation.output, "    if (integerStack.size() < %du) return AOT_ERR_STACK_UNDERFLOW;\n", valuesNumber);
+}
+
+/**
+ * Writes the statements of the vector operation.
+ * @param[in] translation state of the translation
+ * @param[in] opcode      code of the vector operation
+ */
+static void writeVectorOperation(const Translation& translation, byte opcode) {
+    int poppedNumber = 0, pushedNumber = 0;
+    getOperationStackEffect(opcode, poppedNumber, pushedNumber);
+
+    fprintf(translation.output, "    {\n");
+    fprintf(translation.output, "        double result = 0;\n");
+    fprintf(translation.output, "        sp -= %d;\n", poppedNumber);
+    fprintf(translation.output, "        int status = applyVectorOperation(%u, stack + sp, %d, &result);\n", opcode,
+            poppedNumber);
+    fprintf(translation.output, "        if (status != 0) return status;\n");
+    if (pushedNumber != 0) fprintf(translation.output, "        PUSH(result);\n");
+    fprintf(translation.output, "    }\n");
+}
+
+/**
+ * Writes the statements of the reachable operation.
+ * @param[in, out] translation state of the translation
+ * @param[in]      offset      byte offset of the operation
+ * @param[in]      operation   decoded operation
+ */
+static void writeOperation(Translation& translation, int offset, const DecodedOperation& operation) {
+    FILE* output = translation.output;
+    byte opcode = operation.opcode;
+    int poppedNumber = 0, pushedNumber = 0;
+    getOperationStackEffect(opcode, poppedNumber, pushedNumber);
+
+    // RAM address is checked before the stack, as the stack machine does it
+    bool isImmediateRamOperation = (opcode == PUSHM_OPCODE) || (opcode == POPM_OPCODE);
+    bool isImmediateAddressValid = (operation.operand >= 0) && (operation.operand < translation.ramSize);
+    if (isImmediateRamOperation && !isImmediateAddressValid) {
+        fprintf(output, "    return AOT_ERR_INVALID_RAM_ADDRESS;\n");
+    } else if ((opcode == PUSHRM_OPCODE) || (opcode == POPRM_OPCODE)) {
+        fprintf(output, "    if (!isValidAddress(%s)) return AOT_ERR_INVALID_RAM_ADDRESS;\n",
+                getRegisterVariable(operation.reg).c_str());
+    }
+    if (poppedNumber != 0) writeDepthCheck(translation, poppedNumber);
+    int integerPoppedNumber = 0, integerPushedNumber = 0;
+    getIntegerStackEffect(opcode, integerPoppedNumber, integerPushedNumber);
+    if (integerPoppedNumber != 0) writeIntegerDepthCheck(translation, integerPoppedNumber);
+
+    std::string reg = isIntegerRegisterOperation(opcode) ? getIntegerRegisterVariable(operation.reg)
+                                                         : getRegisterVariable(operation.reg);
+    std::string target = "L" + std::to_string(operation.jumpTarget);
+    switch (opcode) {
+        case IN_OPCODE:
+            fprintf(output, "    PUSH(readValue());\n");
+            break;
+        case OUT_OPCODE:
+            fprintf(output, "    writeValue(stack[--sp]);\n");
+            break;
+        case POP_OPCODE:
+            fprintf(output, "    --sp;\n");
+            break;
+        case ADD_OPCODE: case SUB_OPCODE: case MUL_OPCODE: case DIV_OPCODE: {
+            const char* operators[] = {"+", "-", "*", "/"};
+            fprintf(output, "    --sp;\n    stack[sp - 1] = stack[sp - 1] %s stack[sp];\n",
+                    operators[opcode - ADD_OPCODE]);
+            break;
+        }
+        case POW_OPCODE:
+            fprintf(output, "    --sp;\n    stack[sp - 1] = pow(stack[sp - 1], stack[sp]);\n");
+            break;
+        case SQRT_OPCODE:
+            fprintf(output, "    stack[sp - 1] = sqrt(stack[sp - 1]);\n");
+            break;
+        case DUP_OPCODE:
+            fprintf(output, "    PUSH(stack[sp - 1]);\n");
+            break;
+        case IPUSH_OPCODE:
+            fprintf(output, "    integerStack.push_back(%s);\n",
+                    formatIntegerImmediate(operation.integerOperand).c_str());
+            break;
+        case IPUSHR_OPCODE:
+            fprintf(output, "    integerStack.push_back(%s);\n", reg.c_str());
+            break;
+        case IPOP_OPCODE:
+            fprintf(output, "    integerStack.pop_back();\n");
+            break;
+        case IPOPR_OPCODE:
+            fprintf(output, "    %s = integerStack.back();\n    integerStack.pop_back();\n", reg.c_str());
+            break;
+        case ITOF_OPCODE:
+            fprintf(output, "    PUSH((double)integerStack.back());\n    integerStack.pop_back();\n");
+            break;
+        case FTOI_OPCODE:
+            fprintf(output, "    integerStack.push_back(toIntegerOperand(stack[--sp]));\n");
+            break;
+        case IADD_OPCODE: case ISUB_OPCODE: case IMUL_OPCODE: {
+            const char* functions[] = {"integerAdd", "integerSubtract", "integerMultiply"};
+            fprintf(output, "    integerRhs = integerStack.back();\n    integerStack.pop_back();\n");
+            fprintf(output, "    integerStack.back() = %s(integerStack.back(), integerRhs);\n",
+                    functions[opcode - IADD_OPCODE]);
+            break;
+        }
+        case IJMPNE_OPCODE: case IJMPE_OPCODE: case IJMPL_OPCODE: case IJMPLE_OPCODE: case IJMPG_OPCODE:
+        case IJMPGE_OPCODE:
+            fprintf(output, "    integerRhs = integerStack.back();\n    integerStack.pop_back();\n");
+            fprintf(output, "    integerLhs = integerStack.back();\n    integerStack.pop_back();\n");
+            fprintf(output, "    if (%s) goto %s;\n", getJumpCondition(opcode, "integerLhs", "integerRhs").c_str(),
+                    target.c_str());
+            break;
+        case VADD_OPCODE: case VMUL_OPCODE: case VSUM_OPCODE: case VDOT_OPCODE: case VFILL_OPCODE: case VCOPY_OPCODE:
+            writeVectorOperation(translation, opcode);
+            break;
+        case HLT_OPCODE:
+            fprintf(output, "    return AOT_HLT;\n");
+            break;
+        case PUSH_OPCODE:
+            fprintf(output, "    PUSH(%s);\n", formatImmediate(operation.operand).c_str());
+            break;
+        case PUSHR_OPCODE:
+            fprintf(output, "    PUSH(%s);\n", reg.c_str());
+            break;
+        case PUSHM_OPCODE:
+            if (isImmediateAddressValid) fprintf(output, "    PUSH(ram[%d]);\n", (int)operation.operand);
+            break;
+        case PUSHRM_OPCODE:
+            fprintf(output, "    PUSH(ram[(int)%s]);\n", reg.c_str());
+            break;
+        case POPR_OPCODE:
+            fprintf(output, "    %s = stack[--sp];\n", reg.c_str());
+            break;
+        case POPM_OPCODE:
+            if (isImmediateAddressValid) fprintf(output, "    ram[%d] = stack[--sp];\n", (int)operation.operand);
+            break;
+        case POPRM_OPCODE:
+            fprintf(output, "    ram[(int)%s] = stack[--sp];\n", reg.c_str());
+            break;
+        case JMP_OPCODE: case TAILCALL_OPCODE:
+            fprintf(output, "    goto %s;\n", target.c_str());
+            break;
+        case CALL_OPCODE:
+            fprintf(output, "    returnAddresses.push_back(%d);\n    goto %s;\n", offset + operation.size, target.c_str());
+            break;
+        case RET_OPCODE:
+            fprintf(output, "    if (returnAddresses.empty()) return AOT_ERR_STACK_UNDERFLOW;\n");
+            fprintf(output, "    returnAddress = returnAddresses.back();\n    returnAddresses.pop_back();\n");
+            fprintf(output, "    goto RETURN_DISPATCH;\n");
+            break;
+        case CMP_IMM_JMPNE_OPCODE: case CMP_IMM_JMPE_OPCODE: case CMP_IMM_JMPL_OPCODE: case CMP_IMM_JMPLE_OPCODE:
+        case CMP_IMM_JMPG_OPCODE: case CMP_IMM_JMPGE_OPCODE:
+            fprintf(output, "    --sp;\n    if (%s) goto %s;\n",
+                    getJumpCondition(getFusedJumpOpcode(opcode), "stack[sp]",
+                                     formatImmediate(operation.operand)).c_str(),
+                    target.c_str());
+            break;
+        case PUSHR_PUSHR_MUL_OPCODE:
+            fprintf(output, "    PUSH(%s * %s);\n", reg.c_str(), getRegisterVariable(operation.reg2).c_str());
+            break;
+        case DUP_ADD_OPCODE:
+            fprintf(output, "    stack[sp - 1] = stack[sp - 1] + stack[sp - 1];\n");
+            break;
+        case POPR_PUSHR_OPCODE:
+            fprintf(output, "    %s = stack[sp - 1];\n", reg.c_str());
+            break;
+        default:
+            // Conditional jumps: rhs is on top of the stack
+            fprintf(output, "    sp -= 2;\n    if (%s) goto %s;\n",
+                    getJumpCondition(opcode, "stack[sp]", "stack[sp + 1]").c_str(), target.c_str());
+            break;
+    }
+
+    // Operations after the failed depth check are never run, so their depth is not negative only to stay known
+    if (translation.depth != UNKNOWN_DEPTH) translation.depth = std::max(0, translation.depth + pushedNumber - poppedNumber);
+}
+
+/**
+ * Finds jump targets, return offsets and entry depths of the blocks of the verified image.
+ * @param[in, out] translation  translation with the assembly to analyze
+ * @param[in]      verification verification of the image
+ */
+static void analyzeImage(Translation& translation, const BytecodeVerification& verification) {
+    translation.isLabel.assign(translation.assemblySize, false);
+    translation.entryDepths.assign(translation.assemblySize, NOT_BLOCK_START);
+    for (const VerifiedBlock& block : verification.blocks) {
+        translation.entryDepths[block.offset] = block.entryStackDepth;
+    }
+
+    DecodedOperation operation;
+    for (int offset = 0; offset < translation.assemblySize; ++offset) {
+        if (!verification.isReachable(offset)) continue;
+        decodeOperation(translation.assembly, translation.assemblySize, offset, operation);
+        if (isJumpOperation(operation.opcode) || isFusedJumpOperation(operation.opcode)) {
+            translation.isLabel[operation.jumpTarget] = true;
+        }
+        if (operation.opcode == CALL_OPCODE) {
+            // Return of the verified CALL lands on the next operation, that is within the assembly
+            translation.isLabel[offset + operation.size] = true;
+            translation.returnOffsets.push_back(offset + operation.size);
+        }
+    }
+}
+
+/**
+ * Writes definitions of the constants the runtime and the program use.
+ * @param[in] translation state of the translation
+ */
+static void writeDefinitions(const Translation& translation) {
+    FILE* output = translation.output;
+    fprintf(output, "// Generated by aot from the assembly (%d bytes). Do not edit\n", translation.assemblySize);
+    fprintf(output, "#define AOT_RAM_SIZE %d\n", translation.ramSize);
+    fprintf(output, "#define AOT_IO_BUFFER_SIZE %u\n", (unsigned int)IO_BUFFER_SIZE);
+    fprintf(output, "#define AOT_COMPARE_EPS %.17g\n", COMPARE_EPS);
+    fprintf(output, "#define AOT_INTERACTIVE_IO %d\n", (int)INTERACTIVE_IO);
+    fprintf(output, "#define AOT_TEXT_IO %d\n", (int)TEXT_IO);
+    fprintf(output, "#define AOT_BINARY_IO %d\n", (int)BINARY_IO);
+    fprintf(output, "#define AOT_HLT %u\n", HLT_OPCODE);
+    fprintf(output, "#define AOT_ERR_INVALID_OPERATION %u\n", ERR_INVALID_OPERATION);
+    fprintf(output, "#define AOT_ERR_STACK_UNDERFLOW %u\n", ERR_STACK_UNDERFLOW);
+    fprintf(output, "#define AOT_ERR_INVALID_RAM_ADDRESS %u\n", ERR_INVALID_RAM_ADDRESS);
+    fprintf(output, "#define AOT_VADD_OPCODE %u\n", VADD_OPCODE);
+    fprintf(output, "#define AOT_VMUL_OPCODE %u\n", VMUL_OPCODE);
+    fprintf(output, "#define AOT_VSUM_OPCODE %u\n", VSUM_OPCODE);
+    fprintf(output, "#define AOT_VDOT_OPCODE %u\n", VDOT_OPCODE);
+    fprintf(output, "#define AOT_VFILL_OPCODE %u\n", VFILL_OPCODE);
+}
+
+/**
+ * Writes the beginning of the function that runs the program: registers, operand and integer stacks and return
+ * addresses.
+ * @param[in] translation  state of the translation
+ * @param[in] maxStackDepth maximal depth of the operand stack, or UNKNOWN_DEPTH
+ */
+static void writeProgramPrologue(const Translation& translation, int maxStackDepth) {
+    FILE* output = translation.output;
+    fprintf(output, "\nstatic int runProgram() {\n");
+    fprintf(output, "    double ax = 0, bx = 0, cx = 0, dx = 0;\n");
+    fprintf(output, "    int64_t iax = 0, ibx = 0, icx = 0, idx = 0;\n");
+    fprintf(output, "    std::vector<int64_t> integerStack;\n");
+    fprintf(output, "    int64_t integerLhs = 0, integerRhs = 0;\n");
+    fprintf(output, "    std::vector<int> returnAddresses;\n");
+    fprintf(output, "    int returnAddress = 0;\n");
+    fprintf(output, "    int sp = 0;\n");
+    if (translation.isStackGrowing) {
+        fprintf(output, "    std::vector<double> stackValues(%d);\n", INITIAL_STACK_CAPACITY);
+        fprintf(output, "    double* stack = stackValues.data();\n");
+        fprintf(output, "    int stackCapacity = %d;\n", INITIAL_STACK_CAPACITY);
+        fprintf(output, "#define PUSH(value) do { double pushed = (value); if (sp == stackCapacity) { "
+                        "stackCapacity *= 2; stackValues.resize(stackCapacity); stack = stackValues.data(); } "
+                        "stack[sp++] = pushed; } while (0)\n");
+    } else {
+        int capacity = (maxStackDepth > 0) ? maxStackDepth : 1;
+        fprintf(output, "    %sdouble stack[%d];\n", (capacity > MAX_LOCAL_STACK_DEPTH) ? "static " : "", capacity);
+        fprintf(output, "#define PUSH(value) (stack[sp++] = (value))\n");
+    }
+    fprintf(output, "    (void)ax; (void)bx; (void)cx; (void)dx; (void)returnAddress;\n");
+    fprintf(output, "    (void)iax; (void)ibx; (void)icx; (void)idx; (void)integerLhs; (void)integerRhs;\n\n");
+}
+
+/**
+ * Writes the end of the function that runs the program: the switch, that jumps to the return address of CALL.
+ * @param[in] translation state of the translation
+ */
+static void writeProgramEpilogue(const Translation& translation) {
+    FILE* output = translation.output;
+    fprintf(output, "\nRETURN_DISPATCH:\n");
+    fprintf(output, "    switch (returnAddress) {\n");
+    for (int returnOffset : translation.returnOffsets) {
+        fprintf(output, "        case %d: goto L%d;\n", returnOffset, returnOffset);
+    }
+    fprintf(output, "        default: return AOT_ERR_INVALID_OPERATION;\n");
+    fprintf(output, "    }\n");
+    fprintf(output, "#undef PUSH\n");
+    fprintf(output, "}\n");
+}
+
+/**
+ * Translates the verified image into C++ source code of the standalone program.
+ * @param[in]  image   image of the assembly file
+ * @param[in]  output  file to write the source code into
+ * @param[in]  options compilation options
+ * @return 0, if the source code was written, or ERR_INVALID_FILE, if the image is not verified or the file can't be
+ *         written.
+ */
+byte translateToCpp(const BytecodeImage& image, FILE* output, const AotOptions& options) {
+    assert(output != nullptr);
+
+    const BytecodeVerification& verification = image.getVerification();
+    if (!verification.isVerified()) return ERR_INVALID_FILE;
+
+    Translation translation {};
+    translation.output = output;
+    translation.assembly = image.getAssembly();
+    translation.assemblySize = image.getAssemblySize();
+    translation.ramSize = options.ramSize;
+    translation.isStackGrowing = (verification.maxStackDepth == UNKNOWN_DEPTH);
+    analyzeImage(translation, verification);
+
+    writeDefinitions(translation);
+    fputs(AOT_RUNTIME, output);
+    writeProgramPrologue(translation, verification.maxStackDepth);
+
+    DecodedOperation operation;
+    for (int offset = 0; offset < translation.assemblySize; ++offset) {
+        if (!verification.isReachable(offset)) continue;
+        decodeOperation(translation.assembly, translation.assemblySize, offset, operation);
+
+        if (translation.isLabel[offset]) fprintf(output, "L%d:\n", offset);
+        // Depth is known at the entry of the block, and it's tracked through the operations of the block from there
+        int entryDepth = translation.entryDepths[offset];
+        if (entryDepth != NOT_BLOCK_START) translation.depth = (entryDepth < 0) ? UNKNOWN_DEPTH : entryDepth;
+
+        fprintf(output, "    // %d: %s\n", offset, getOperationNameByOpcode(operation.opcode));
+        writeOperation(translation, offset, operation);
+    }
+
+    writeProgramEpilogue(translation);
+    fputs(AOT_MAIN, output);
+    return (ferror(output) == 0) ? 0 : ERR_INVALID_FILE;
+}
+
+/**
+ * Runs the compiler on the source code file and waits until it finishes.
+ * @param[in] compiler       command of the compiler
+ * @param[in] sourceFileName source code file name
+ * @param[in] outputFileName executable file name
+ * @return true, if the executable was compiled, false otherwise.
+ */
+static bool runCompiler(const char* compiler, const char* sourceFileName, const char* outputFileName) {
+    // FP contraction is off, so products and sums are rounded separately, as the stack machine rounds them
+    const char* arguments[] = {compiler, "-std=c++14", "-O2", "-ffp-contract=off", "-o", outputFileName,
+                               sourceFileName, nullptr};
+
+    pid_t pid = 0;
+    if (posix_spawnp(&pid, compiler, nullptr, nullptr, const_cast<char* const*>(arguments), environ) != 0) {
+        fprintf(stderr, "Can't run the compiler %s\n", compiler);
+        return false;
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid) return false;
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/**
+ * Compiles the given assembly file into the native executable (or only into C++ source code, see AotOptions).
+ * @param[in] assemblyFileName assembly file name
+ * @param[in] outputFileName   resulting executable (or source code) file name
+ * @param[in] options          compilation options
+ * @return 0, if compilation finished successfully;
+ *         ERR_INVALID_FILE, if assembly file is invalid or not verified, output can't be written or the compiler
+ *         has failed.
+ */
+int compileAheadOfTime(const char* assemblyFileName, const char* outputFileName, const AotOptions& options) {
+    assert(assemblyFileName != nullptr);
+    assert(outputFileName != nullptr);
+
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(assemblyFileName);
+    if (image == nullptr) return ERR_INVALID_FILE;
+    if (!image->getVerification().isVerified()) {
+        fprintf(stderr, "Only verified assembly can be compiled: verification failed at offset %d\n",
+                image->getVerification().failedOffset);
+        return ERR_INVALID_FILE;
+    }
+
+    std::string sourceFileName = options.emitSource ? outputFileName : std::string(outputFileName) + ".cpp";
+    FILE* source = fopen(sourceFileName.c_str(), "w");
+    if (source == nullptr) return ERR_INVALID_FILE;
+    byte statusCode = translateToCpp(*image, source, options);
+    if (fclose(source) != 0) statusCode = ERR_INVALID_FILE;
+    if ((statusCode != 0) || options.emitSource) return statusCode;
+
+    bool isCompiled = runCompiler(options.compiler, sourceFileName.c_str(), outputFileName);
+    remove(sourceFileName.c_str());
+    return isCompiled ? 0 : ERR_INVALID_FILE;
+}
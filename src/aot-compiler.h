@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief Declaration of the ahead-of-time compiler: translation of the assembly into C++ source code of the standalone
+ * program, that is compiled into the native executable by the system compiler.
+ */
+#ifndef STACK_MACHINE_AOT_COMPILER_H
+#define STACK_MACHINE_AOT_COMPILER_H
+
+#include <cstdio>
+#include "stack-machine.h"
+#include "bytecode-image.h"
+
+/**
+ * Options that control the ahead-of-time compilation.
+ */
+struct AotOptions {
+    /** Number of RAM addresses of the compiled program */
+    int ramSize = RAM::DEFAULT_SIZE;
+    /** Shows if only the C++ source code is written, without compiling it */
+    bool emitSource = false;
+    /** Command of the C++ compiler the source code is compiled with */
+    const char* compiler = "c++";
+};
+
+/**
+ * Translates the verified image into C++ source code of the standalone program. Every reachable operation becomes
+ * a few statements: labels of jump targets are goto labels, registers are locals, the operand stack is a local array
+ * sized by the verifier (or a growing array, if it's depth is unknown), and RET jumps back by the switch over return
+ * addresses of all CALL operations. Underflow checks are left only where the verifier doesn't know the stack depth.
+ * The program has the same IN and OUT behaviour as `run` (--io=interactive, text or binary) and exits with the same
+ * error codes.
+ * @param[in]  image   image of the assembly file
+ * @param[in]  output  file to write the source code into
+ * @param[in]  options compilation options
+ * @return 0, if the source code was written, or ERR_INVALID_FILE, if the image is not verified (see
+ *         bytecode-verifier.h) or the file can't be written.
+ */
+unsigned char translateToCpp(const BytecodeImage& image, FILE* output, const AotOptions& options);
+
+/**
+ * Compiles the given assembly file into the native executable (or only into C++ source code, see AotOptions).
+ * Source code is written into the output file name followed by ".cpp", and is removed after the compilation.
+ * @param[in] assemblyFileName assembly file name
+ * @param[in] outputFileName   resulting executable (or source code) file name
+ * @param[in] options          compilation options
+ * @return 0, if compilation finished successfully;
+ *         ERR_INVALID_FILE, if assembly file is invalid or not verified, output can't be written or the compiler
+ *         has failed.
+ */
+int compileAheadOfTime(const char* assemblyFileName, const char* outputFileName, const AotOptions& options);
+
+#endif // STACK_MACHINE_AOT_COMPILER_H
@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief Implementation of the arena (bump) allocator.
+ */
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "arena.h"
+
+Arena::~Arena() {
+    for (char* block : blocks) {
+        free(block);
+    }
+}
+
+void Arena::swap(Arena& other) {
+    std::swap(blocks, other.blocks);
+    std::swap(blockPosition, other.blockPosition);
+    std::swap(blockSpaceLeft, other.blockSpaceLeft);
+}
+
+/**
+ * Allocates memory in the arena. Memory is valid until the arena is destroyed.
+ * @param[in] size      size of the memory in bytes
+ * @param[in] alignment alignment of the memory (power of 2)
+ * @return pointer to the allocated memory.
+ */
+void* Arena::allocate(size_t size, size_t alignment) {
+    assert((alignment != 0) && ((alignment & (alignment - 1)) == 0));
+    assert(alignment <= alignof(std::max_align_t));
+
+    size_t padding = (alignment - (uintptr_t)blockPosition % alignment) % alignment;
+    if (padding + size > blockSpaceLeft) {
+        // Large allocations get their own blocks, so the rest of the current block is not wasted
+        if (size > ARENA_BLOCK_SIZE / 4) {
+            char* block = (char*)malloc(size);
+            assert(block != nullptr);
+            blocks.push_back(block);
+            return block;
+        }
+
+        blockPosition = (char*)malloc(ARENA_BLOCK_SIZE);
+        assert(blockPosition != nullptr);
+        blocks.push_back(blockPosition);
+        blockSpaceLeft = ARENA_BLOCK_SIZE;
+        padding = 0;
+    }
+
+    char* memory = blockPosition + padding;
+    blockPosition += padding + size;
+    blockSpaceLeft -= padding + size;
+    return memory;
+}
+
+/**
+ * Copies the string into the arena.
+ * @param[in] string string to copy (doesn't need to be null terminated)
+ * @param[in] length length of the string
+ * @return null terminated copy of the string.
+ */
+const char* Arena::copyString(const char* string, size_t length) {
+    assert(string != nullptr);
+
+    char* copy = (char*)allocate(length + 1, 1);
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
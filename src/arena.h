@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief Declaration of the arena (bump) allocator.
+ */
+#ifndef STACK_MACHINE_ARENA_H
+#define STACK_MACHINE_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+#ifndef ARENA_BLOCK_SIZE
+    /** Size of the arena memory block in bytes */
+    #define ARENA_BLOCK_SIZE (1u << 16u)
+#endif
+
+/**
+ * Arena (bump) allocator. Memory is taken from large blocks one after another and is never freed separately: all
+ * blocks are released at once, when the arena is destroyed.
+ */
+class Arena {
+    std::vector<char*> blocks;
+    char* blockPosition = nullptr;
+    size_t blockSpaceLeft = 0;
+
+public:
+    Arena() = default;
+
+    ~Arena();
+
+    Arena(Arena& arena) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    void swap(Arena& other);
+
+    /**
+     * Allocates memory in the arena. Memory is valid until the arena is destroyed.
+     * @param[in] size      size of the memory in bytes
+     * @param[in] alignment alignment of the memory (power of 2)
+     * @return pointer to the allocated memory.
+     */
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Copies the string into the arena.
+     * @param[in] string string to copy (doesn't need to be null terminated)
+     * @param[in] length length of the string
+     * @return null terminated copy of the string.
+     */
+    const char* copyString(const char* string, size_t length);
+};
+
+#endif // STACK_MACHINE_ARENA_H
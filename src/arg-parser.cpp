@@ -4,9 +4,12 @@
  */
 
 #include <cassert>
+#include <cerrno>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <string>
 #include "arg-parser.h"
 
 void stripExtension(char* fileName) {
@@ -33,14 +36,332 @@ void replaceExtension(char* destination, const char* originalFileName, const cha
     strcpy(destination, strcat(tmp, newExtension));
 }
 
+void printUsage(const char* programName, RunningMode runningMode) {
+    assert(programName != nullptr);
+
+    switch (runningMode) {
+        case ASM:
+            printf("Usage: %s [options] file.txt [file.asm]\n", programName);
+            break;
+        case DISASM:
+            printf("Usage: %s [options] file.asm [file.txt]\n", programName);
+            break;
+        case RUN:
+            printf("Usage: %s [options] file.asm\n", programName);
+            printf("       %s --serve=ADDRESS [options] programs.txt\n", programName);
+            printf("Each line of the programs file is an assembly file name, program id is the number of it's line from 0\n");
+            break;
+        case RUN_BATCH:
+            printf("Usage: %s [options] manifest.txt\n", programName);
+            printf("Each line of the manifest is a job: program.asm input-file output-file\n");
+            break;
+        case REPLAY:
+            printf("Usage: %s [options] file.asm trace-file\n", programName);
+            printf("Runs the program with IN values of the trace recorded by 'run --trace', and compares outcomes of\n"
+                   "conditional jumps, OUT values and the final state of the machine with the recorded ones\n");
+            break;
+        case AOT:
+            printf("Usage: %s [options] file.asm [executable]\n", programName);
+            printf("Compiles the verified assembly file into the native executable, that runs with --io=MODE option of 'run'\n");
+            break;
+        default:
+            fprintf(stderr, "Invalid running mode");
+            exit(-1);
+    }
+
+    printf("Options:\n");
+    printf("  --help             Show this message\n");
+    if (runningMode == ASM) {
+        printf("  -O                 Fuse frequent operations sequences into superinstructions\n");
+        printf("  --threads=N        Number of threads that assemble large source code files (default: number of hardware threads)\n");
+        printf("  --format=FORMAT    Assembly file format: 'raw' (default, legacy) or 'container' (versioned, with constants\n"
+               "                     and pre-decoded operations)\n");
+        printf("  --stack-reserve=N[,M]\n"
+               "                     Write the hint to reserve N operand stack and M call stack values before the program\n"
+               "                     runs (container format only, default: operand stack depth found by the verifier)\n");
+    }
+    if (runningMode == AOT) {
+        printf("  --ram-size=N       Number of RAM addresses of the executable, K and M suffixes multiply it by 1024 and\n"
+               "                     1024^2 (default: %d)\n", RAM::DEFAULT_SIZE);
+        printf("  --emit-cpp         Write C++ source code of the executable instead of compiling it (default output:\n"
+               "                     assembly file name with '%s' extension)\n", aotSourceFileExtension);
+        printf("  --compiler=CXX     C++ compiler the executable is compiled with (default: %s)\n", AotOptions().compiler);
+    }
+    if ((runningMode == RUN) || (runningMode == RUN_BATCH) || (runningMode == REPLAY)) {
+        printf("  --engine=ENGINE    Execution engine: 'reference' (default), 'threaded', 'tos' (threaded with top of stack caching)\n"
+               "                     or 'jit' (compiles hot loops to native code)\n");
+        printf("  --ram-latency=N    Cost of a single RAM access in virtual cycles (default: %u, 0 disables timing model)\n", RAM_ACCESS_CYCLES);
+        printf("  --ram-size=N       Number of RAM addresses, K and M suffixes multiply it by 1024 and 1024^2\n"
+               "                     (default: %d). Memory is allocated as the program touches it\n", RAM::DEFAULT_SIZE);
+        printf("  --stack-reserve=N[,M]\n"
+               "                     Reserve N operand stack and M call stack values before the program runs, if the\n"
+               "                     assembly file doesn't expect deeper stacks (at most %u each)\n", MAX_STACK_RESERVE);
+        printf("  --max-instructions=N\n"
+               "                     Stop the program with an error after N executed operations (default: no limit)\n");
+        printf("  --time-limit=MS    Stop the program with an error after MS milliseconds (default: no limit)\n");
+    }
+    if ((runningMode == RUN) || (runningMode == RUN_BATCH)) {
+        printf("  --io=MODE          IN/OUT mode: 'interactive' (prompt before each IN), 'text' (no prompt, buffered)\n"
+               "                     or 'binary' (raw little-endian doubles, buffered). Default: '%s'\n",
+               (runningMode == RUN) ? "interactive" : "text");
+    }
+    if (runningMode == RUN_BATCH) {
+        printf("  --threads=N        Number of threads that run jobs (default: number of hardware threads)\n");
+    }
+    if (runningMode == RUN) {
+        printf("  --input=FILE       File with IN values (default: stdin)\n");
+        printf("  --output=FILE      File for OUT values (default: stdout)\n");
+        printf("  --lanes=N          Run the program once per line of the batch input, N (4 or 8) lines at a time\n");
+        printf("  --batch-input=F    File with IN values of batch runs, one line per run (default: stdin)\n");
+        printf("  --batch-output=F   File for OUT values of batch runs, one line per run (default: stdout)\n");
+        printf("  --profile[=FILE]   Count executions and cycles of every operation and outcomes of every jump, and write\n"
+               "                     the report into FILE (default: stderr). Program is run by the reference engine\n");
+        printf("  --snapshot-at=LABEL\n"
+               "                     Write the state of the machine into the snapshot file, when the operation at LABEL (or\n"
+               "                     byte offset) is reached, then continue. Labels are kept only by the container format\n");
+        printf("  --snapshot=FILE    Snapshot file (default: assembly file name followed by '%s')\n", SNAPSHOT_FILE_EXTENSION);
+        printf("  --resume=FILE      Restore the state of the machine from the snapshot file before the program is run\n");
+        printf("  --serve=ADDRESS    Keep programs resident and run them on requests received on ADDRESS: 'unix:PATH',\n"
+               "                     'tcp:PORT' (loopback interface) or 'tcp:HOST:PORT' (see protocol in README)\n");
+        printf("  --threads=N        Number of threads that run requests of --serve (default: number of hardware threads)\n");
+        printf("  --stats            Write numbers of executed operations, taken jumps, calls and RAM accesses to stderr.\n"
+               "                     Program is run by the reference dispatch loop on every engine\n");
+        printf("  --trace=FILE       Record IN and OUT values, outcomes of conditional jumps and the final state of the machine\n"
+               "                     into the trace file, that can be replayed on any engine by 'replay'\n");
+    }
+    if ((runningMode == RUN) || (runningMode == RUN_BATCH) || (runningMode == REPLAY)) {
+        printf("\n");
+        #if STACK_SECURITY_LEVEL >= 3
+            printf("Operand stack: hardened (security level %d: bounds checks, canary guards and hash checking)\n", STACK_SECURITY_LEVEL);
+        #elif STACK_SECURITY_LEVEL >= 1
+            printf("Operand stack: fast (security level %d: bounds checks only)\n", STACK_SECURITY_LEVEL);
+        #else
+            printf("Operand stack: unchecked (security level %d)\n", STACK_SECURITY_LEVEL);
+        #endif
+    }
+}
+
+/**
+ * Returns the value of the option, if the given argument is this option (e.g. "--name=value").
+ * @param[in] argument   argument to check
+ * @param[in] optionName name of the option with leading dashes
+ * @return option value, or nullptr if the argument is not the given option.
+ */
+static const char* getOptionValue(const char* argument, const char* optionName) {
+    assert(argument != nullptr);
+    assert(optionName != nullptr);
+
+    size_t optionNameLength = strlen(optionName);
+    if ((strncmp(argument, optionName, optionNameLength) != 0) || (argument[optionNameLength] != '=')) return nullptr;
+    return argument + optionNameLength + 1;
+}
+
+static ExecutionEngine parseEngine(const char* engineName) {
+    assert(engineName != nullptr);
+
+    if (strcmp(engineName, "reference") == 0) return REFERENCE_ENGINE;
+    if (strcmp(engineName, "threaded" ) == 0) return THREADED_ENGINE;
+    if (strcmp(engineName, "tos"      ) == 0) return TOS_CACHING_ENGINE;
+    if (strcmp(engineName, "jit"      ) == 0) return JIT_ENGINE;
+
+    fprintf(stderr, "Unknown engine: %s\n", engineName);
+    exit(-1);
+}
+
+static IOMode parseIOMode(const char* modeName) {
+    assert(modeName != nullptr);
+
+    if (strcmp(modeName, "interactive") == 0) return INTERACTIVE_IO;
+    if (strcmp(modeName, "text"       ) == 0) return TEXT_IO;
+    if (strcmp(modeName, "binary"     ) == 0) return BINARY_IO;
+
+    fprintf(stderr, "Unknown I/O mode: %s\n", modeName);
+    exit(-1);
+}
+
+static AssemblyFormat parseFormat(const char* formatName) {
+    assert(formatName != nullptr);
+
+    if (strcmp(formatName, "raw"      ) == 0) return RAW_FORMAT;
+    if (strcmp(formatName, "container") == 0) return CONTAINER_FORMAT;
+
+    fprintf(stderr, "Unknown assembly format: %s\n", formatName);
+    exit(-1);
+}
+
+static unsigned int parseUnsigned(const char* option, const char* value) {
+    assert(option != nullptr);
+    assert(value != nullptr);
+
+    char* end = nullptr;
+    unsigned long number = strtoul(value, &end, 10);
+    if ((end == value) || (*end != '\0') || (value[0] == '-') || (number > UINT_MAX)) {
+        fprintf(stderr, "Invalid value of option %s\n", option);
+        exit(-1);
+    }
+    return (unsigned int)number;
+}
+
+static unsigned long long parseUnsignedLongLong(const char* option, const char* value) {
+    assert(option != nullptr);
+    assert(value != nullptr);
+
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long number = strtoull(value, &end, 10);
+    if ((end == value) || (*end != '\0') || (value[0] == '-') || (errno == ERANGE)) {
+        fprintf(stderr, "Invalid value of option %s\n", option);
+        exit(-1);
+    }
+    return number;
+}
+
+static unsigned int parseLanes(const char* option, const char* value) {
+    unsigned int lanes = parseUnsigned(option, value);
+    if ((lanes != 4) && (lanes != 8)) {
+        fprintf(stderr, "Only 4 and 8 lanes are supported\n");
+        exit(-1);
+    }
+    return lanes;
+}
+
+/**
+ * Parses the number of RAM addresses (e.g. "--ram-size=65536" or "--ram-size=64K", K and M mean 1024 and 1024^2).
+ * @param[in] option option to report in the error message
+ * @param[in] value  number of addresses, optionally followed by K or M
+ * @return number of RAM addresses.
+ */
+static int parseRamSize(const char* option, const char* value) {
+    assert(value != nullptr);
+
+    std::string number = value;
+    unsigned long long multiplier = 1;
+    if (!number.empty() && ((number.back() == 'K') || (number.back() == 'M'))) {
+        multiplier = (number.back() == 'K') ? 1024ull : 1024ull * 1024ull;
+        number.pop_back();
+    }
+
+    unsigned long long size = parseUnsignedLongLong(option, number.c_str());
+    if ((size == 0) || (size > (unsigned long long)RAM::MAX_SIZE / multiplier)) {
+        fprintf(stderr, "RAM size must be from 1 to %d addresses\n", RAM::MAX_SIZE);
+        exit(-1);
+    }
+    return (int)(size * multiplier);
+}
+
+/**
+ * Parses the depths of the stacks to reserve (e.g. "--stack-reserve=N[,M]").
+ * @param[in] option option to report in the error message
+ * @param[in] value  operand stack depth, optionally followed by the comma and the call stack depth
+ * @return depths of the stacks.
+ */
+static StackReserve parseStackReserve(const char* option, const char* value) {
+    assert(value != nullptr);
+
+    StackReserve reserve;
+    const char* comma = strchr(value, ',');
+    if (comma == nullptr) {
+        reserve.operandStackDepth = parseUnsigned(option, value);
+        return reserve;
+    }
+
+    std::string operandStackDepth(value, comma);
+    reserve.operandStackDepth = parseUnsigned(option, operandStackDepth.c_str());
+    reserve.callStackDepth = parseUnsigned(option, comma + 1);
+    return reserve;
+}
+
+static void parseOption(const char* programName, const char* option, RunningMode runningMode, arguments& args) {
+    assert(option != nullptr);
+
+    const char* value = nullptr;
+    bool isRunningProgram = (runningMode == RUN) || (runningMode == RUN_BATCH);
+    bool isExecutingProgram = isRunningProgram || (runningMode == REPLAY);
+    if (strcmp(option, "--help") == 0) {
+        printUsage(programName, runningMode);
+        exit(0);
+    } else if ((runningMode == ASM) && (strcmp(option, "-O") == 0)) {
+        args.assemblyOptions.fuseOperations = true;
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--engine")) != nullptr)) {
+        args.runOptions.engine = parseEngine(value);
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--ram-latency")) != nullptr)) {
+        args.runOptions.ramAccessCycles = parseUnsigned(option, value);
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--ram-size")) != nullptr)) {
+        args.runOptions.ramSize = parseRamSize(option, value);
+    } else if (isRunningProgram && ((value = getOptionValue(option, "--io")) != nullptr)) {
+        args.runOptions.ioMode = parseIOMode(value);
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--stack-reserve")) != nullptr)) {
+        args.runOptions.stackReserve = parseStackReserve(option, value);
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--max-instructions")) != nullptr)) {
+        args.runOptions.budget.instructions = parseUnsignedLongLong(option, value);
+    } else if (isExecutingProgram && ((value = getOptionValue(option, "--time-limit")) != nullptr)) {
+        args.runOptions.budget.milliseconds = parseUnsignedLongLong(option, value);
+    } else if ((runningMode == AOT) && ((value = getOptionValue(option, "--ram-size")) != nullptr)) {
+        args.aotOptions.ramSize = parseRamSize(option, value);
+    } else if ((runningMode == AOT) && (strcmp(option, "--emit-cpp") == 0)) {
+        args.aotOptions.emitSource = true;
+    } else if ((runningMode == AOT) && ((value = getOptionValue(option, "--compiler")) != nullptr)) {
+        args.aotOptions.compiler = value;
+    } else if (((runningMode == RUN_BATCH) || (runningMode == RUN)) &&
+               ((value = getOptionValue(option, "--threads")) != nullptr)) {
+        args.threadsNumber = parseUnsigned(option, value);
+    } else if ((runningMode == ASM) && ((value = getOptionValue(option, "--threads")) != nullptr)) {
+        args.assemblyOptions.threadsNumber = parseUnsigned(option, value);
+    } else if ((runningMode == ASM) && ((value = getOptionValue(option, "--format")) != nullptr)) {
+        args.assemblyOptions.format = parseFormat(value);
+    } else if ((runningMode == ASM) && ((value = getOptionValue(option, "--stack-reserve")) != nullptr)) {
+        args.assemblyOptions.stackHint = parseStackReserve(option, value);
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--input")) != nullptr)) {
+        args.runOptions.ioInputFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--output")) != nullptr)) {
+        args.runOptions.ioOutputFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--lanes")) != nullptr)) {
+        args.runOptions.lanes = parseLanes(option, value);
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--batch-input")) != nullptr)) {
+        args.runOptions.batchInputFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--batch-output")) != nullptr)) {
+        args.runOptions.batchOutputFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--snapshot-at")) != nullptr)) {
+        args.runOptions.snapshotLabel = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--snapshot")) != nullptr)) {
+        args.runOptions.snapshotFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--resume")) != nullptr)) {
+        args.runOptions.resumeFileName = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--serve")) != nullptr)) {
+        args.runOptions.serveAddress = value;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--trace")) != nullptr)) {
+        args.runOptions.traceFileName = value;
+    } else if ((runningMode == RUN) && (strcmp(option, "--stats") == 0)) {
+        args.runOptions.printStats = true;
+    } else if ((runningMode == RUN) && (strcmp(option, "--profile") == 0)) {
+        args.runOptions.profile = true;
+    } else if ((runningMode == RUN) && ((value = getOptionValue(option, "--profile")) != nullptr)) {
+        args.runOptions.profile = true;
+        args.runOptions.profileFileName = value;
+    } else {
+        fprintf(stderr, "Unknown option: %s\n", option);
+        exit(-1);
+    }
+}
+
 arguments parseArgs(int argc, char* argv[], RunningMode runningMode) {
     assert(argv != nullptr);
 
-    arguments args { "", "" };
-    if (argc >= 2) strcpy(args.inputFile, argv[1]);
-    if (argc >= 3) strcpy(args.outputFile, argv[2]);
+    arguments args {};
+    if (runningMode == RUN_BATCH) args.runOptions.ioMode = TEXT_IO;
+    int positionalArgumentsNumber = 0;
+    for (int i = 1; i < argc; ++i) {
+        if ((strncmp(argv[i], "--", 2) == 0) || (strcmp(argv[i], "-O") == 0)) {
+            parseOption(argv[0], argv[i], runningMode, args);
+            continue;
+        }
+
+        if (positionalArgumentsNumber == 0) strcpy(args.inputFile, argv[i]);
+        if (positionalArgumentsNumber == 1) strcpy(args.outputFile, argv[i]);
+        ++positionalArgumentsNumber;
+    }
 
-    if (argc > 3) fprintf(stderr, "Only 2 arguments required. Other are ignored");
+    if (positionalArgumentsNumber > 2) fprintf(stderr, "Only 2 arguments required. Other are ignored");
 
     if (strlen(args.outputFile) == 0) {
         switch (runningMode) {
@@ -51,8 +372,20 @@ arguments parseArgs(int argc, char* argv[], RunningMode runningMode) {
                 replaceExtension(args.outputFile, args.inputFile, disassemblyFileExtension);
                 break;
             case RUN:
+            case RUN_BATCH:
                 /* Do nothing */
                 break;
+            case REPLAY:
+                printUsage(argv[0], runningMode);
+                exit(-1);
+            case AOT:
+                if (args.aotOptions.emitSource) {
+                    replaceExtension(args.outputFile, args.inputFile, aotSourceFileExtension);
+                    break;
+                }
+                replaceExtension(args.outputFile, args.inputFile, "");
+                if (strcmp(args.outputFile, args.inputFile) == 0) strcat(args.outputFile, aotExecutableExtension);
+                break;
             default:
                 fprintf(stderr, "Invalid running mode");
                 exit(-1);
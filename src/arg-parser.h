@@ -6,26 +6,41 @@
 #define STACK_MACHINE_ARG_PARSER_H
 
 #include <cstddef>
+#include "stack-machine.h"
+#include "aot-compiler.h"
 
 enum RunningMode {
-    ASM    = 1,
-    DISASM = 2,
-    RUN    = 3,
+    ASM       = 1,
+    DISASM    = 2,
+    RUN       = 3,
+    RUN_BATCH = 4,
+    REPLAY    = 5,
+    AOT       = 6,
 };
 
 constexpr size_t maxFileNameLength = 256;
 const char* const assemblyFileExtension = ".asm";
 const char* const disassemblyFileExtension = "__disassembly.txt";
+const char* const aotSourceFileExtension = ".cpp";
+/** Extension of the executable compiled by aot, if the assembly file has no extension to strip */
+const char* const aotExecutableExtension = ".out";
 
 struct arguments {
     char inputFile[maxFileNameLength];
     char outputFile[maxFileNameLength];
+    AssemblyOptions assemblyOptions;
+    RunOptions runOptions;
+    AotOptions aotOptions;
+    /** Number of threads that run jobs of the batch or requests of the server, or 0 for the number of hardware threads */
+    unsigned int threadsNumber;
 };
 
 void stripExtension(char* fileName);
 
 void replaceExtension(char* destination, const char* originalFileName, const char* newExtension);
 
+void printUsage(const char* programName, RunningMode runningMode);
+
 arguments parseArgs(int argc, char* argv[], RunningMode runningMode);
 
 #endif // STACK_MACHINE_ARG_PARSER_H
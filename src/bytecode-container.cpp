@@ -0,0 +1,302 @@
+/**
+ * @file
+ * @brief Implementation of the versioned container format of assembly files.
+ */
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode-container.h"
+#include "bytecode-image.h"
+
+using byte = unsigned char;
+
+/**
+ * Checks if the operation has the immediate operand (value or RAM address).
+ * @param[in] opcode operation code
+ * @return true, if operation has the immediate operand, false otherwise.
+ */
+static bool hasImmediateOperand(byte opcode) {
+    if (isFusedOperation(opcode)) return isFusedJumpOperation(opcode);
+    return (getOperationArityByOpcode(opcode) == 1) && ((opcode & IS_REG_OP_MASK) == 0) && !isJumpOperation(opcode);
+}
+
+/**
+ * Checks if the given file content is the container (starts with the container signature).
+ * @param[in] data content of the file
+ * @param[in] size size of the content in bytes
+ * @return true, if the content is the container, false if it's the legacy assembly.
+ */
+bool isBytecodeContainer(const byte* data, size_t size) {
+    return (size >= sizeof(CONTAINER_MAGIC)) && (memcmp(data, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0);
+}
+
+/**
+ * Checks the decoded operations of the container against the code, so they can be used by machines without checks.
+ * Each record must be exactly what the linear sweep of the code decodes (see predecodeAssembly), including the bits of
+ * it's constant, otherwise engines that run the code and engines that run the records would run different programs.
+ * @param[in] container container with decoded operations
+ * @return true, if records are the decoded operations of the code, false otherwise.
+ */
+static bool areDecodedOperationsValid(const BytecodeContainer& container) {
+    int offset = 0;
+    for (uint32_t i = 0; i < container.operationsNumber; ++i) {
+        const ContainerOperation& operation = container.operations[i];
+        if ((operation.offset != offset) || (offset >= container.codeSize)) return false;
+
+        DecodedOperation decoded;
+        byte status = decodeOperation(container.code, container.codeSize, offset, decoded);
+        if ((operation.status != status) || (operation.opcode != decoded.opcode) || (operation.reg != decoded.reg) ||
+            (operation.reg2 != decoded.reg2) || (operation.jumpTarget != decoded.jumpTarget) ||
+            (operation.size != decoded.size)) {
+            return false;
+        }
+
+        bool hasConstant = (status == decoded.opcode) && hasImmediateOperand(decoded.opcode);
+        if (!hasConstant && (operation.constantIndex != NO_CONSTANT)) return false;
+        if (hasConstant && ((operation.constantIndex >= container.constantsNumber) ||
+            (memcmp(&container.constants[operation.constantIndex], &decoded.operand, sizeof(double)) != 0))) {
+            return false;
+        }
+        offset += operation.size;
+    }
+    // Linear sweep covers the whole code (the last operation can be truncated)
+    return offset >= container.codeSize;
+}
+
+/**
+ * Checks the records of the labels section: each record and it's name are within the section, and offsets are
+ * within the code.
+ * @param[in] container container with labels section
+ * @return true, if labels are valid, false otherwise.
+ */
+static bool areLabelsValid(const BytecodeContainer& container) {
+    size_t position = 0;
+    while (position < container.labelsSize) {
+        if (container.labelsSize - position < sizeof(ContainerLabel)) return false;
+        ContainerLabel label {};
+        memcpy(&label, container.labels + position, sizeof(label));
+        position += sizeof(label);
+
+        if ((label.offset < 0) || (label.offset > container.codeSize)) return false;
+        if ((label.nameLength == 0) || (label.nameLength > container.labelsSize - position)) return false;
+        position += label.nameLength;
+    }
+    return true;
+}
+
+/**
+ * Reads the sections of the container. Sections are not copied, and must be aligned in memory as in the file.
+ * @param[in]  data      content of the container file
+ * @param[in]  size      size of the content in bytes
+ * @param[out] container sections of the container
+ * @return 0, if container was read successfully, or ERR_INVALID_FILE, if container is invalid.
+ */
+byte readBytecodeContainer(const byte* data, size_t size, BytecodeContainer& container) {
+    assert(data != nullptr);
+
+    container = BytecodeContainer();
+    if (!isBytecodeContainer(data, size) || (size < sizeof(ContainerHeader))) return ERR_INVALID_FILE;
+
+    ContainerHeader header {};
+    memcpy(&header, data, sizeof(header));
+    if ((header.version != CONTAINER_VERSION) || (header.headerSize < sizeof(header))) return ERR_INVALID_FILE;
+    if ((header.sectionsOffset > size) || (header.sectionsNumber > (size - header.sectionsOffset) / sizeof(ContainerSection))) {
+        return ERR_INVALID_FILE;
+    }
+
+    bool isSectionRead[LABELS_SECTION + 1] = {};
+    for (uint32_t i = 0; i < header.sectionsNumber; ++i) {
+        ContainerSection section {};
+        memcpy(&section, data + header.sectionsOffset + i * sizeof(section), sizeof(section));
+        if ((section.offset % CONTAINER_SECTION_ALIGNMENT != 0) || (section.offset > size) ||
+            (section.size > size - section.offset)) return ERR_INVALID_FILE;
+
+        // Sections of the newer versions are skipped
+        if ((section.type < CODE_SECTION) || (section.type > LABELS_SECTION)) continue;
+        if (isSectionRead[section.type]) return ERR_INVALID_FILE;
+        isSectionRead[section.type] = true;
+
+        const byte* sectionData = data + section.offset;
+        switch (section.type) {
+            case CODE_SECTION:
+                if ((section.size == 0) || (section.size > INT32_MAX)) return ERR_INVALID_FILE;
+                container.code = sectionData;
+                container.codeSize = (int)section.size;
+                break;
+            case CONSTANTS_SECTION:
+                if ((section.size % sizeof(double) != 0) || ((uintptr_t)sectionData % alignof(double) != 0)) {
+                    return ERR_INVALID_FILE;
+                }
+                container.constants = reinterpret_cast<const double*>(sectionData);
+                container.constantsNumber = (uint32_t)(section.size / sizeof(double));
+                break;
+            case DECODED_SECTION:
+                if ((section.size % sizeof(ContainerOperation) != 0) ||
+                    ((uintptr_t)sectionData % alignof(ContainerOperation) != 0)) return ERR_INVALID_FILE;
+                container.operations = reinterpret_cast<const ContainerOperation*>(sectionData);
+                container.operationsNumber = (uint32_t)(section.size / sizeof(ContainerOperation));
+                break;
+            case STACK_HINT_SECTION: {
+                if (section.size != sizeof(ContainerStackHint)) return ERR_INVALID_FILE;
+                ContainerStackHint stackHint {};
+                memcpy(&stackHint, sectionData, sizeof(stackHint));
+                container.stackHint.operandStackDepth = stackHint.operandStackDepth;
+                container.stackHint.callStackDepth = stackHint.callStackDepth;
+                break;
+            }
+            case LABELS_SECTION:
+                container.labels = sectionData;
+                container.labelsSize = section.size;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (container.code == nullptr) return ERR_INVALID_FILE;
+    for (uint32_t i = 0; i < container.constantsNumber; ++i) {
+        if (!std::isfinite(container.constants[i])) return ERR_INVALID_FILE;
+    }
+    if ((container.operations != nullptr) && !areDecodedOperationsValid(container)) return ERR_INVALID_FILE;
+    if ((container.labels != nullptr) && !areLabelsValid(container)) return ERR_INVALID_FILE;
+    return 0;
+}
+
+/**
+ * Finds the label in the labels section of the container.
+ * @param[in] container container read by readBytecodeContainer
+ * @param[in] labelName name of the label without ':'
+ * @return byte offset of the label in the code, or -1, if there is no such label or container has no labels section.
+ */
+int findContainerLabel(const BytecodeContainer& container, const char* labelName) {
+    assert(labelName != nullptr);
+
+    size_t labelNameLength = strlen(labelName);
+    size_t position = 0;
+    while (position < container.labelsSize) {
+        ContainerLabel label {};
+        memcpy(&label, container.labels + position, sizeof(label));
+        position += sizeof(label);
+
+        const char* name = reinterpret_cast<const char*>(container.labels + position);
+        if ((label.nameLength == labelNameLength) && (memcmp(name, labelName, labelNameLength) == 0)) {
+            return label.offset;
+        }
+        position += label.nameLength;
+    }
+    return -1;
+}
+
+/**
+ * Gets the offset of the next section after the given size of the file.
+ * @param[in] fileSize size of the file written before the section
+ * @return aligned offset of the section.
+ */
+static uint64_t alignSectionOffset(uint64_t fileSize) {
+    return (fileSize + CONTAINER_SECTION_ALIGNMENT - 1) / CONTAINER_SECTION_ALIGNMENT * CONTAINER_SECTION_ALIGNMENT;
+}
+
+/**
+ * Writes the container with the given code, it's constants and decoded operations into the file.
+ * @param[out] output                container file
+ * @param[in]  code                  code encoded as in the legacy assembly file
+ * @param[in]  codeSize              size of the code in bytes
+ * @param[in]  withDecodedOperations shows if the decoded section is written
+ * @param[in]  stackHint             expected depths of the stacks. Stack hint section is written, if any is not zero
+ * @param[in]  labels                labels of the source code. Labels section is written, if there are any
+ * @return 0, if container was written successfully, or ERR_INVALID_FILE, if the file can't be written.
+ */
+byte writeBytecodeContainer(FILE* output, const byte* code, int codeSize, bool withDecodedOperations,
+                            const StackReserve& stackHint, const std::vector<SourceLabel>& labels) {
+    assert(output != nullptr);
+    assert(code != nullptr);
+    assert(codeSize > 0);
+
+    std::vector<PredecodedOperation> predecodedOperations;
+    predecodeAssembly(code, codeSize, predecodedOperations);
+
+    // Constants are distinct by their bits, so -0.0 and 0.0 are different constants
+    std::vector<double> constants;
+    std::unordered_map<uint64_t, uint32_t> constantIndices;
+    std::vector<ContainerOperation> operations(predecodedOperations.size());
+    for (size_t i = 0; i < predecodedOperations.size(); ++i) {
+        const PredecodedOperation& predecoded = predecodedOperations[i];
+        ContainerOperation& operation = operations[i];
+        operation.offset = predecoded.offset;
+        operation.jumpTarget = predecoded.operation.jumpTarget;
+        operation.constantIndex = NO_CONSTANT;
+        operation.opcode = predecoded.operation.opcode;
+        operation.reg = predecoded.operation.reg;
+        operation.reg2 = predecoded.operation.reg2;
+        operation.status = predecoded.status;
+        operation.size = (byte)predecoded.operation.size;
+
+        if ((predecoded.status != predecoded.operation.opcode) || !hasImmediateOperand(operation.opcode)) continue;
+
+        uint64_t constantBits = 0;
+        memcpy(&constantBits, &predecoded.operation.operand, sizeof(constantBits));
+        auto constant = constantIndices.emplace(constantBits, (uint32_t)constants.size());
+        if (constant.second) constants.push_back(predecoded.operation.operand);
+        operation.constantIndex = constant.first->second;
+    }
+
+    ContainerStackHint containerStackHint {stackHint.operandStackDepth, stackHint.callStackDepth};
+    bool hasStackHint = (stackHint.operandStackDepth != 0) || (stackHint.callStackDepth != 0);
+
+    std::vector<byte> labelsData;
+    for (const SourceLabel& label : labels) {
+        ContainerLabel record {label.offset, (uint32_t)label.name.size()};
+        const byte* recordBytes = reinterpret_cast<const byte*>(&record);
+        labelsData.insert(labelsData.end(), recordBytes, recordBytes + sizeof(record));
+        labelsData.insert(labelsData.end(), label.name.begin(), label.name.end());
+    }
+
+    // Optional sections are written after the mandatory ones: decoded, stack hint and labels sections
+    ContainerSection sections[5] = {};
+    const void* sectionsData[5] = {code, constants.data(), nullptr, nullptr, nullptr};
+    uint32_t sectionsNumber = 2;
+    if (withDecodedOperations) {
+        sections[sectionsNumber] = {DECODED_SECTION, 0, 0, operations.size() * sizeof(ContainerOperation)};
+        sectionsData[sectionsNumber++] = operations.data();
+    }
+    if (hasStackHint) {
+        sections[sectionsNumber] = {STACK_HINT_SECTION, 0, 0, sizeof(containerStackHint)};
+        sectionsData[sectionsNumber++] = &containerStackHint;
+    }
+    if (!labelsData.empty()) {
+        sections[sectionsNumber] = {LABELS_SECTION, 0, 0, labelsData.size()};
+        sectionsData[sectionsNumber++] = labelsData.data();
+    }
+
+    uint64_t fileSize = sizeof(ContainerHeader) + sectionsNumber * sizeof(ContainerSection);
+    sections[0] = {CODE_SECTION, 0, alignSectionOffset(fileSize), (uint64_t)codeSize};
+    fileSize = sections[0].offset + sections[0].size;
+    sections[1] = {CONSTANTS_SECTION, 0, alignSectionOffset(fileSize), constants.size() * sizeof(double)};
+    for (uint32_t i = 2; i < sectionsNumber; ++i) {
+        fileSize = sections[i - 1].offset + sections[i - 1].size;
+        sections[i].offset = alignSectionOffset(fileSize);
+    }
+
+    ContainerHeader header {};
+    memcpy(header.magic, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+    header.version = CONTAINER_VERSION;
+    header.headerSize = sizeof(header);
+    header.sectionsNumber = sectionsNumber;
+    header.sectionsOffset = sizeof(header);
+
+    static const byte padding[CONTAINER_SECTION_ALIGNMENT] = {};
+
+    fwrite(&header, sizeof(header), 1, output);
+    fwrite(sections, sizeof(ContainerSection), sectionsNumber, output);
+    fileSize = sizeof(ContainerHeader) + sectionsNumber * sizeof(ContainerSection);
+    for (uint32_t i = 0; i < sectionsNumber; ++i) {
+        fwrite(padding, sizeof(byte), sections[i].offset - fileSize, output);
+        if (sections[i].size != 0) fwrite(sectionsData[i], sizeof(byte), sections[i].size, output);
+        fileSize = sections[i].offset + sections[i].size;
+    }
+
+    return (ferror(output) == 0) ? 0 : ERR_INVALID_FILE;
+}
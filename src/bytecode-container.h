@@ -0,0 +1,172 @@
+/**
+ * @file
+ * @brief Declaration of the versioned container format of assembly files.
+ */
+#ifndef STACK_MACHINE_BYTECODE_CONTAINER_H
+#define STACK_MACHINE_BYTECODE_CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "stack-machine-utils.h"
+
+#define CONTAINER_VERSION 2u
+
+/** Alignment of the sections in the container file */
+#define CONTAINER_SECTION_ALIGNMENT 64u
+
+/** Constant index of the operations without immediate operand */
+#define NO_CONSTANT UINT32_MAX
+
+/** Signature of the container file. It starts with the invalid operation code, so legacy assembly can't start with it */
+constexpr unsigned char CONTAINER_MAGIC[4] = {0xFF, 'S', 'M', 'B'};
+
+enum ContainerSectionType : uint32_t {
+    /** Operations encoded as in the legacy assembly file, so byte offsets and jumps are the same */
+    CODE_SECTION       = 1,
+    /** Distinct immediate operands (double literals) */
+    CONSTANTS_SECTION  = 2,
+    /** Optional operations decoded by the linear sweep of the code (see ContainerOperation) */
+    DECODED_SECTION    = 3,
+    /** Optional expected depths of the stacks (see ContainerStackHint) */
+    STACK_HINT_SECTION = 4,
+    /** Optional labels of the source code: ContainerLabel records, each followed by the label name */
+    LABELS_SECTION     = 5,
+};
+
+/**
+ * Header at the beginning of the container file.
+ */
+struct ContainerHeader {
+    unsigned char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t sectionsNumber;
+    uint32_t flags;
+    /** Offset of the sections table in bytes from the beginning of the file */
+    uint64_t sectionsOffset;
+};
+
+/**
+ * Entry of the sections table.
+ */
+struct ContainerSection {
+    uint32_t type;
+    uint32_t reserved;
+    /** Offset of the section in bytes from the beginning of the file. Aligned to CONTAINER_SECTION_ALIGNMENT */
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * Decoded operation in the decoded section. Fields are naturally aligned, so each of them is read with a single load.
+ */
+struct ContainerOperation {
+    /** Byte offset of the operation in the code section */
+    int32_t offset;
+    /** Absolute byte offset of the jump destination, or -1 */
+    int32_t jumpTarget;
+    /** Index of the immediate operand in the constants section, or NO_CONSTANT */
+    uint32_t constantIndex;
+    unsigned char opcode;
+    unsigned char reg;
+    unsigned char reg2;
+    /** Status of the decoding (see decodeOperation) */
+    unsigned char status;
+    /** Size of the encoded operation in bytes */
+    unsigned char size;
+    unsigned char reserved[3];
+};
+
+/**
+ * Expected maximal depths of the stacks, given when the program was assembled. Zero depth means there is no hint.
+ */
+struct ContainerStackHint {
+    uint32_t operandStackDepth;
+    uint32_t callStackDepth;
+};
+
+/**
+ * Record of the labels section. It's followed by nameLength bytes of the label name (without ':' and terminating zero).
+ * Records are not aligned, so they are read with memcpy.
+ */
+struct ContainerLabel {
+    /** Byte offset of the label in the code section */
+    int32_t offset;
+    uint32_t nameLength;
+};
+
+static_assert(sizeof(ContainerHeader) == 24, "Container header must have no padding");
+static_assert(sizeof(ContainerSection) == 24, "Container section must have no padding");
+static_assert(sizeof(ContainerOperation) == 20, "Container operation must have no padding");
+static_assert(sizeof(ContainerStackHint) == 8, "Container stack hint must have no padding");
+static_assert(sizeof(ContainerLabel) == 8, "Container label must have no padding");
+
+/**
+ * Label of the source code that is written into the labels section.
+ */
+struct SourceLabel {
+    std::string name;
+    int offset;
+};
+
+/**
+ * Sections of the container that is read from memory. Sections point into the container memory.
+ */
+struct BytecodeContainer {
+    const unsigned char* code = nullptr;
+    int codeSize = 0;
+    const double* constants = nullptr;
+    uint32_t constantsNumber = 0;
+    /** Decoded operations, or nullptr, if container has no decoded section */
+    const ContainerOperation* operations = nullptr;
+    uint32_t operationsNumber = 0;
+    /** Depths from the stack hint section, or zeros, if container has no such section */
+    StackReserve stackHint;
+    /** Content of the labels section, or nullptr, if container has no such section */
+    const unsigned char* labels = nullptr;
+    size_t labelsSize = 0;
+};
+
+/**
+ * Checks if the given file content is the container (starts with the container signature).
+ * @param[in] data content of the file
+ * @param[in] size size of the content in bytes
+ * @return true, if the content is the container, false if it's the legacy assembly.
+ */
+bool isBytecodeContainer(const unsigned char* data, size_t size);
+
+/**
+ * Reads the sections of the container. Sections are not copied, and must be aligned in memory as in the file.
+ * @param[in]  data      content of the container file
+ * @param[in]  size      size of the content in bytes
+ * @param[out] container sections of the container
+ * @return 0, if container was read successfully, or ERR_INVALID_FILE, if container is invalid.
+ */
+unsigned char readBytecodeContainer(const unsigned char* data, size_t size, BytecodeContainer& container);
+
+/**
+ * Finds the label in the labels section of the container.
+ * @param[in] container container read by readBytecodeContainer
+ * @param[in] labelName name of the label without ':'
+ * @return byte offset of the label in the code, or -1, if there is no such label or container has no labels section.
+ */
+int findContainerLabel(const BytecodeContainer& container, const char* labelName);
+
+/**
+ * Writes the container with the given code, it's constants and decoded operations into the file.
+ * @param[out] output                container file
+ * @param[in]  code                  code encoded as in the legacy assembly file
+ * @param[in]  codeSize              size of the code in bytes
+ * @param[in]  withDecodedOperations shows if the decoded section is written
+ * @param[in]  stackHint             expected depths of the stacks. Stack hint section is written, if any is not zero
+ * @param[in]  labels                labels of the source code. Labels section is written, if there are any
+ * @return 0, if container was written successfully, or ERR_INVALID_FILE, if the file can't be written.
+ */
+unsigned char writeBytecodeContainer(FILE* output, const unsigned char* code, int codeSize,
+                                     bool withDecodedOperations = true, const StackReserve& stackHint = StackReserve(),
+                                     const std::vector<SourceLabel>& labels = std::vector<SourceLabel>());
+
+#endif // STACK_MACHINE_BYTECODE_CONTAINER_H
@@ -0,0 +1,185 @@
+/**
+ * @file
+ * @brief Implementation of read-only assembly images shared by stack machines.
+ */
+#include <cassert>
+#include <map>
+
+#include "bytecode-image.h"
+
+/**
+ * Identity of the assembly file. File that is changed or replaced gets the new identity.
+ */
+struct ImageKey {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    long long modificationTime;
+    long long changeTime;
+
+    bool operator<(const ImageKey& other) const {
+        if (device != other.device) return device < other.device;
+        if (inode != other.inode) return inode < other.inode;
+        if (size != other.size) return size < other.size;
+        if (modificationTime != other.modificationTime) return modificationTime < other.modificationTime;
+        return changeTime < other.changeTime;
+    }
+};
+
+static long long getNanoseconds(const timespec& time) {
+    return (long long)time.tv_sec * 1000000000ll + time.tv_nsec;
+}
+
+/**
+ * Maps the opened assembly file into memory and pre-faults it's pages. The file is invalid, if it's the container
+ * that can't be read.
+ * @param[in] fileDescriptor descriptor of the opened assembly file
+ * @param[in] fileSize       size of the assembly file in bytes
+ */
+BytecodeImage::BytecodeImage(int fileDescriptor, int fileSize) {
+    assert(fileSize > 0);
+
+    int flags = MAP_PRIVATE;
+    #ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+    #endif
+    void* dataPtr = mmap(nullptr, fileSize, PROT_READ, flags, fileDescriptor, 0);
+    if (dataPtr == MAP_FAILED) return;
+    #ifndef MAP_POPULATE
+        madvise(dataPtr, fileSize, MADV_WILLNEED);
+    #endif
+    mapping = dataPtr;
+    mappingSize = fileSize;
+
+    const unsigned char* data = static_cast<const unsigned char*>(dataPtr);
+    if (!isBytecodeContainer(data, fileSize)) {
+        assembly = data;
+        assemblySize = fileSize;
+    } else if (readBytecodeContainer(data, fileSize, container) == 0) {
+        assembly = container.code;
+        assemblySize = container.codeSize;
+    }
+}
+
+BytecodeImage::~BytecodeImage() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+/**
+ * Gets the image of the given assembly file. Images are cached by the file identity (device, inode, size and
+ * modification time), so the file that is loaded again while it's image is in use is neither mapped nor read again.
+ * Image is unmapped, when the last reference to it is dropped.
+ * @param[in] assemblyFileName assembly file name
+ * @return image of the file, or nullptr, if file can't be opened, is empty or can't be mapped.
+ */
+std::shared_ptr<const BytecodeImage> BytecodeImage::load(const char* assemblyFileName) {
+    assert(assemblyFileName != nullptr);
+
+    static std::mutex cacheMutex;
+    // Cache doesn't own images: they are freed as soon as no machine uses them
+    static std::map<ImageKey, std::weak_ptr<const BytecodeImage>> cache;
+
+    int assemblyFile = open(assemblyFileName, O_RDONLY);
+    if (assemblyFile < 0) return nullptr;
+
+    struct stat fileStat{};
+    if ((fstat(assemblyFile, &fileStat) < 0) || (fileStat.st_size == 0) || (fileStat.st_size > INT32_MAX)) {
+        close(assemblyFile);
+        return nullptr;
+    }
+    ImageKey key = {fileStat.st_dev, fileStat.st_ino, fileStat.st_size, getNanoseconds(fileStat.st_mtim),
+                    getNanoseconds(fileStat.st_ctim)};
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::shared_ptr<const BytecodeImage> image = cache[key].lock();
+    if (image == nullptr) {
+        for (auto entry = cache.begin(); entry != cache.end();) {
+            entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+        }
+
+        std::shared_ptr<BytecodeImage> newImage = std::make_shared<BytecodeImage>(assemblyFile, (int)fileStat.st_size);
+        if (newImage->assembly != nullptr) {
+            image = newImage;
+            cache[key] = image;
+        }
+    }
+
+    close(assemblyFile);
+    return image;
+}
+
+/**
+ * Decodes the operations of the assembly by the linear sweep from the beginning of the assembly.
+ * @param[in]  assembly     assembly to decode
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] operations   decoded operations in order of their offsets
+ */
+void predecodeAssembly(const unsigned char* assembly, int assemblySize, std::vector<PredecodedOperation>& operations) {
+    assert(assembly != nullptr);
+
+    int offset = 0;
+    while (offset < assemblySize) {
+        PredecodedOperation decoded {};
+        decoded.offset = offset;
+        decoded.status = decodeOperation(assembly, assemblySize, offset, decoded.operation);
+        operations.push_back(decoded);
+        offset += decoded.operation.size;
+    }
+}
+
+/**
+ * Gets operations of the assembly decoded by the linear sweep. Assembly is decoded on the first call (once).
+ * Operations of the container are taken from it's decoded section, if there is one.
+ * @return decoded operations in order of their offsets.
+ */
+const std::vector<PredecodedOperation>& BytecodeImage::getDecodedOperations() const {
+    std::call_once(decodeFlag, [this]() {
+        if (container.operations == nullptr) {
+            predecodeAssembly(assembly, assemblySize, decodedOperations);
+            return;
+        }
+
+        decodedOperations.resize(container.operationsNumber);
+        for (uint32_t i = 0; i < container.operationsNumber; ++i) {
+            const ContainerOperation& operation = container.operations[i];
+            PredecodedOperation& decoded = decodedOperations[i];
+            decoded.offset = operation.offset;
+            decoded.status = operation.status;
+            decoded.operation.opcode = operation.opcode;
+            decoded.operation.reg = operation.reg;
+            decoded.operation.reg2 = operation.reg2;
+            if (operation.constantIndex != NO_CONSTANT) {
+                decoded.operation.operand = container.constants[operation.constantIndex];
+            }
+            decoded.operation.jumpTarget = operation.jumpTarget;
+            decoded.operation.size = operation.size;
+        }
+    });
+    return decodedOperations;
+}
+
+/**
+ * Gets the result of the verification of the image (see verifyBytecode). Image is verified on the first call (once).
+ * @return verification of the image.
+ */
+const BytecodeVerification& BytecodeImage::getVerification() const {
+    std::call_once(verifyFlag, [this]() {
+        verifyBytecode(assembly, assemblySize, verification);
+    });
+    return verification;
+}
+
+/**
+ * Gets the expected depths of the stacks. Depths of the stack hint of the container are used, if it has one.
+ * Otherwise, operand stack depth is the maximal depth computed by the verifier, if it's known.
+ * @return expected depths of the stacks, or zeros if they are unknown.
+ */
+StackReserve BytecodeImage::getStackReserve() const {
+    StackReserve reserve = container.stackHint;
+    if ((reserve.operandStackDepth == 0) && (getVerification().maxStackDepth > 0)) {
+        reserve.operandStackDepth = (unsigned int)getVerification().maxStackDepth;
+    }
+    return reserve;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief Declaration of read-only assembly images shared by stack machines.
+ */
+#ifndef STACK_MACHINE_BYTECODE_IMAGE_H
+#define STACK_MACHINE_BYTECODE_IMAGE_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "stack-machine-utils.h"
+#include "bytecode-container.h"
+#include "bytecode-verifier.h"
+
+/**
+ * Operation of the assembly decoded by the linear sweep from the beginning of the assembly.
+ */
+struct PredecodedOperation {
+    /** Byte offset of the operation */
+    int offset;
+    /** Status of the decoding (see decodeOperation) */
+    unsigned char status;
+    DecodedOperation operation;
+};
+
+/**
+ * Decodes the operations of the assembly by the linear sweep from the beginning of the assembly.
+ * @param[in]  assembly     assembly to decode
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] operations   decoded operations in order of their offsets
+ */
+void predecodeAssembly(const unsigned char* assembly, int assemblySize, std::vector<PredecodedOperation>& operations);
+
+/**
+ * Assembly file mapped into memory as read-only. The image is immutable, so it's shared by all machines (including
+ * machines on different threads) that run the same file. Use BytecodeImage::load to get the image of the file.
+ * Both legacy assembly files and containers (see bytecode-container.h) are loaded. The assembly of the container is
+ * it's code section, which is used in place.
+ */
+class BytecodeImage {
+
+private:
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    const unsigned char* assembly = nullptr;
+    int assemblySize = -1;
+    /** Sections of the container, if the file is the container */
+    BytecodeContainer container;
+
+    mutable std::once_flag decodeFlag;
+    mutable std::vector<PredecodedOperation> decodedOperations;
+
+    mutable std::once_flag verifyFlag;
+    mutable BytecodeVerification verification;
+
+public:
+    /**
+     * Maps the opened assembly file into memory and pre-faults it's pages. The file is invalid, if it's the container
+     * that can't be read.
+     * @param[in] fileDescriptor descriptor of the opened assembly file
+     * @param[in] fileSize       size of the assembly file in bytes
+     */
+    BytecodeImage(int fileDescriptor, int fileSize);
+
+    ~BytecodeImage();
+
+    BytecodeImage(BytecodeImage& image) = delete;
+    BytecodeImage &operator=(const BytecodeImage&) = delete;
+
+    /**
+     * Gets the image of the given assembly file. Images are cached by the file identity (device, inode, size and
+     * modification time), so the file that is loaded again while it's image is in use is neither mapped nor read again.
+     * Image is unmapped, when the last reference to it is dropped.
+     * @param[in] assemblyFileName assembly file name
+     * @return image of the file, or nullptr, if file can't be opened, is empty, can't be mapped or is invalid container.
+     */
+    static std::shared_ptr<const BytecodeImage> load(const char* assemblyFileName);
+
+    const unsigned char* getAssembly() const {
+        return assembly;
+    }
+
+    int getAssemblySize() const {
+        return assemblySize;
+    }
+
+    /**
+     * Gets operations of the assembly decoded by the linear sweep. Assembly is decoded on the first call (once).
+     * Operations of the container are taken from it's decoded section, if there is one.
+     * @return decoded operations in order of their offsets.
+     */
+    const std::vector<PredecodedOperation>& getDecodedOperations() const;
+
+    /**
+     * Gets the result of the verification of the image (see verifyBytecode). Image is verified on the first call (once).
+     * @return verification of the image.
+     */
+    const BytecodeVerification& getVerification() const;
+
+    /**
+     * Gets the expected depths of the stacks. Depths of the stack hint of the container are used, if it has one.
+     * Otherwise, operand stack depth is the maximal depth computed by the verifier, if it's known.
+     * @return expected depths of the stacks, or zeros if they are unknown.
+     */
+    StackReserve getStackReserve() const;
+
+    /**
+     * Finds the label of the source code. Labels are kept only by the container (see LABELS_SECTION).
+     * @param[in] labelName name of the label without ':'
+     * @return byte offset of the label, or -1, if there is no such label or the file is not the container.
+     */
+    int getLabelOffset(const char* labelName) const {
+        return findContainerLabel(container, labelName);
+    }
+};
+
+#endif // STACK_MACHINE_BYTECODE_IMAGE_H
@@ -0,0 +1,320 @@
+/**
+ * @file
+ * @brief Implementation of the load-time verifier of assembly images.
+ */
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+#include "bytecode-verifier.h"
+#include "stack-machine-utils.h"
+
+using byte = unsigned char;
+
+/** Entry depth of the block that is not reached yet */
+constexpr static int UNREACHED_DEPTH = -2;
+/** Entry depth of the block that depends on the path the block is reached by */
+constexpr static int UNKNOWN_DEPTH = -1;
+
+/**
+ * Gets the effect of the valid operation on the operand stack. Integer stack isn't counted (see getIntegerStackEffect).
+ * @param[in]  opcode       operation code
+ * @param[out] poppedNumber number of values the operation needs on the stack
+ * @param[out] pushedNumber number of values the operation leaves on the stack instead of them
+ */
+void getOperationStackEffect(byte opcode, int& poppedNumber, int& pushedNumber) {
+    poppedNumber = 0;
+    pushedNumber = 0;
+    switch (opcode) {
+        case IN_OPCODE: case PUSH_OPCODE: case PUSHR_OPCODE: case PUSHM_OPCODE: case PUSHRM_OPCODE:
+        case PUSHR_PUSHR_MUL_OPCODE: case ITOF_OPCODE:
+            pushedNumber = 1; break;
+        case OUT_OPCODE: case POP_OPCODE: case POPR_OPCODE: case POPM_OPCODE: case POPRM_OPCODE: case FTOI_OPCODE:
+            poppedNumber = 1; break;
+        case ADD_OPCODE: case SUB_OPCODE: case MUL_OPCODE: case DIV_OPCODE: case POW_OPCODE:
+            poppedNumber = 2; pushedNumber = 1; break;
+        case SQRT_OPCODE: case DUP_ADD_OPCODE: case POPR_PUSHR_OPCODE:
+            poppedNumber = 1; pushedNumber = 1; break;
+        case DUP_OPCODE:
+            poppedNumber = 1; pushedNumber = 2; break;
+        case JMPE_OPCODE: case JMPNE_OPCODE: case JMPL_OPCODE: case JMPLE_OPCODE: case JMPG_OPCODE: case JMPGE_OPCODE:
+            poppedNumber = 2; break;
+        case VSUM_OPCODE:
+            poppedNumber = 2; pushedNumber = 1; break;
+        case VDOT_OPCODE:
+            poppedNumber = 3; pushedNumber = 1; break;
+        case VFILL_OPCODE: case VCOPY_OPCODE:
+            poppedNumber = 3; break;
+        case VADD_OPCODE: case VMUL_OPCODE:
+            poppedNumber = 4; break;
+        default:
+            // JMP, CALL, TAILCALL, RET, HLT and integer operations don't touch the operand stack
+            if (isFusedJumpOperation(opcode)) poppedNumber = 1;
+            break;
+    }
+}
+
+/**
+ * Gets the effect of the valid operation on the integer stack.
+ * @param[in]  opcode       operation code
+ * @param[out] poppedNumber number of values the operation needs on the integer stack
+ * @param[out] pushedNumber number of values the operation leaves on the integer stack instead of them
+ */
+void getIntegerStackEffect(byte opcode, int& poppedNumber, int& pushedNumber) {
+    poppedNumber = 0;
+    pushedNumber = 0;
+    switch (opcode) {
+        case IPUSH_OPCODE: case IPUSHR_OPCODE: case FTOI_OPCODE:
+            pushedNumber = 1; break;
+        case IPOP_OPCODE: case IPOPR_OPCODE: case ITOF_OPCODE:
+            poppedNumber = 1; break;
+        case IADD_OPCODE: case ISUB_OPCODE: case IMUL_OPCODE:
+            poppedNumber = 2; pushedNumber = 1; break;
+        case IJMPE_OPCODE: case IJMPNE_OPCODE: case IJMPL_OPCODE: case IJMPLE_OPCODE: case IJMPG_OPCODE:
+        case IJMPGE_OPCODE:
+            poppedNumber = 2; break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Checks if the operation has the jump destination.
+ * @param[in] opcode operation code
+ * @return true, if the operation is jump, CALL or CMP_IMM_JMP* operation, false otherwise.
+ */
+static bool hasJumpTarget(byte opcode) {
+    return isJumpOperation(opcode) || isFusedJumpOperation(opcode);
+}
+
+/**
+ * Checks if execution never continues with the next operation after the given one.
+ * @param[in] opcode operation code
+ * @return true, if the operation is JMP, TAILCALL, RET or HLT, false otherwise.
+ */
+static bool isTerminator(byte opcode) {
+    return (opcode == JMP_OPCODE) || (opcode == TAILCALL_OPCODE) || (opcode == RET_OPCODE) || (opcode == HLT_OPCODE);
+}
+
+/**
+ * Marks operations reachable from the beginning of the assembly and checks them.
+ * @param[in]  assembly         assembly to verify
+ * @param[in]  assemblySize     size of the assembly in bytes
+ * @param[in]  isOperationStart shows for each byte offset if an operation of the linear sweep starts at it
+ * @param[out] verification     verification to set the status and reachable offsets of
+ */
+static void markReachableOperations(const byte* assembly, int assemblySize, const std::vector<bool>& isOperationStart,
+                                    BytecodeVerification& verification) {
+    std::vector<bool>& isReachable = verification.reachableOffsets;
+    isReachable.assign(assemblySize, false);
+
+    bool isHltReachable = false;
+    std::vector<int> pending = {0};
+    isReachable[0] = true;
+    auto reach = [&pending, &isReachable](int offset) {
+        if (isReachable[offset]) return;
+        isReachable[offset] = true;
+        pending.push_back(offset);
+    };
+
+    while (!pending.empty()) {
+        int offset = pending.back();
+        pending.pop_back();
+
+        DecodedOperation operation;
+        byte opcode = decodeOperation(assembly, assemblySize, offset, operation);
+        if (isError(opcode)) {
+            verification.status = INVALID_OPERATION_REACHED;
+            verification.failedOffset = offset;
+            return;
+        }
+
+        if (opcode == HLT_OPCODE) isHltReachable = true;
+        if (hasJumpTarget(opcode)) {
+            int target = operation.jumpTarget;
+            if ((target < 0) || (target >= assemblySize) || !isOperationStart[target]) {
+                verification.status = INVALID_JUMP_TARGET;
+                verification.failedOffset = offset;
+                return;
+            }
+            reach(target);
+        }
+        if (isTerminator(opcode)) continue;
+
+        // Return of CALL lands on the next operation, so it's reachable too
+        if (offset + operation.size == assemblySize) {
+            verification.status = END_OF_ASSEMBLY_REACHED;
+            verification.failedOffset = offset;
+            return;
+        }
+        reach(offset + operation.size);
+    }
+
+    verification.status = isHltReachable ? VERIFIED : HLT_UNREACHABLE;
+}
+
+/**
+ * Basic block with stack growths relative to it's entry.
+ */
+struct BlockInfo {
+    int offset;
+    /** Byte offset of the operation after the last operation of the block */
+    int endOffset;
+    /** Last operation of the block */
+    DecodedOperation last;
+    int minGrowth;
+    int maxGrowth;
+    /** Change of the stack depth after the block */
+    int effect;
+};
+
+/**
+ * Finds the block that starts at the given byte offset.
+ * @param[in] blocks blocks in order of their offsets
+ * @param[in] offset byte offset of the beginning of the block
+ * @return index of the block.
+ */
+static int findBlock(const std::vector<BlockInfo>& blocks, int offset) {
+    auto block = std::lower_bound(blocks.begin(), blocks.end(), offset,
+                                  [](const BlockInfo& lhs, int rhs) { return lhs.offset < rhs; });
+    assert((block != blocks.end()) && (block->offset == offset));
+    return (int)(block - blocks.begin());
+}
+
+/**
+ * Splits reachable operations into basic blocks and computes depths of the operand stack in them.
+ * @param[in]      assembly     verified assembly
+ * @param[in]      assemblySize size of the assembly in bytes
+ * @param[in, out] verification verification with reachable offsets to add blocks to
+ */
+static void computeStackDepths(const byte* assembly, int assemblySize, BytecodeVerification& verification) {
+    // Only reachable operations are decoded: reachable offsets are visited in order, as in the linear sweep
+    const std::vector<bool>& isReachable = verification.reachableOffsets;
+    std::vector<bool> isLeader(assemblySize, false);
+    isLeader[0] = true;
+    DecodedOperation operation;
+    for (int offset = 0; offset < assemblySize; ++offset) {
+        if (!isReachable[offset]) continue;
+        decodeOperation(assembly, assemblySize, offset, operation);
+
+        // Operation after the jump and the target of the jump are reachable, so they are within the assembly
+        if (hasJumpTarget(operation.opcode)) isLeader[operation.jumpTarget] = true;
+        if ((hasJumpTarget(operation.opcode) || isTerminator(operation.opcode)) && (offset + operation.size < assemblySize)) {
+            isLeader[offset + operation.size] = true;
+        }
+    }
+
+    std::vector<BlockInfo> blocks;
+    int nextOffset = -1;
+    for (int offset = 0; offset < assemblySize; ++offset) {
+        if (!isReachable[offset]) continue;
+        decodeOperation(assembly, assemblySize, offset, operation);
+        // Block also starts after unreachable operations
+        if (isLeader[offset] || (offset != nextOffset)) blocks.push_back({offset, offset, operation, 0, 0, 0});
+        nextOffset = offset + operation.size;
+
+        BlockInfo& block = blocks.back();
+        int poppedNumber = 0, pushedNumber = 0;
+        getOperationStackEffect(operation.opcode, poppedNumber, pushedNumber);
+        block.endOffset = offset + operation.size;
+        block.last = operation;
+        block.minGrowth = std::min(block.minGrowth, block.effect - poppedNumber);
+        block.maxGrowth = std::max(block.maxGrowth, block.effect - poppedNumber + pushedNumber);
+        block.effect += pushedNumber - poppedNumber;
+    }
+
+    // Entry depths only go from unreached to known and then to unknown, so each block is processed at most twice
+    std::vector<int> entryDepths(blocks.size(), UNREACHED_DEPTH);
+    std::vector<int> pending;
+    auto enter = [&entryDepths, &pending](int blockIndex, int depth) {
+        int& entryDepth = entryDepths[blockIndex];
+        if ((entryDepth == depth) || (entryDepth == UNKNOWN_DEPTH)) return;
+        entryDepth = (entryDepth == UNREACHED_DEPTH) ? depth : UNKNOWN_DEPTH;
+        pending.push_back(blockIndex);
+    };
+    enter(0, 0);
+    while (!pending.empty()) {
+        int blockIndex = pending.back();
+        pending.pop_back();
+
+        const BlockInfo& block = blocks[blockIndex];
+        int depth = entryDepths[blockIndex];
+        // Underflow stops execution, so nothing is reached from the block with this depth
+        if ((depth != UNKNOWN_DEPTH) && (depth + block.minGrowth < 0)) continue;
+
+        int exitDepth = (depth == UNKNOWN_DEPTH) ? UNKNOWN_DEPTH : depth + block.effect;
+        if (hasJumpTarget(block.last.opcode)) enter(findBlock(blocks, block.last.jumpTarget), exitDepth);
+        if (isTerminator(block.last.opcode)) continue;
+        // Depth after the return from CALL depends on the function called
+        enter(findBlock(blocks, block.endOffset), (block.last.opcode == CALL_OPCODE) ? UNKNOWN_DEPTH : exitDepth);
+    }
+
+    verification.maxStackDepth = 0;
+    verification.blocks.reserve(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        VerifiedBlock block {blocks[i].offset, UNKNOWN_DEPTH, UNKNOWN_DEPTH, blocks[i].maxGrowth};
+        if (entryDepths[i] >= 0) {
+            block.entryStackDepth = entryDepths[i];
+            block.maxStackDepth = entryDepths[i] + block.maxStackGrowth;
+        }
+
+        if ((block.maxStackDepth == UNKNOWN_DEPTH) || (verification.maxStackDepth == UNKNOWN_DEPTH)) {
+            verification.maxStackDepth = UNKNOWN_DEPTH;
+        } else {
+            verification.maxStackDepth = std::max(verification.maxStackDepth, block.maxStackDepth);
+        }
+        verification.blocks.push_back(block);
+    }
+}
+
+/**
+ * Computes the minimal RAM size, that makes immediate addresses of reachable RAM operations valid.
+ * @param[in]      assembly     verified assembly
+ * @param[in]      assemblySize size of the assembly in bytes
+ * @param[in, out] verification verification with reachable offsets to set the required RAM size of
+ */
+static void computeRequiredRamSize(const byte* assembly, int assemblySize, BytecodeVerification& verification) {
+    DecodedOperation operation;
+    for (int offset = 0; offset < assemblySize; ++offset) {
+        if (!verification.isReachable(offset)) continue;
+        byte opcode = decodeOperation(assembly, assemblySize, offset, operation);
+        if ((opcode != PUSHM_OPCODE) && (opcode != POPM_OPCODE)) continue;
+
+        if ((operation.operand < 0) || (operation.operand >= INT_MAX)) {
+            verification.requiredRamSize = -1;
+            return;
+        }
+        verification.requiredRamSize = std::max(verification.requiredRamSize, (int)operation.operand + 1);
+    }
+}
+
+/**
+ * Verifies the assembly. Checks operations reachable from the beginning of the assembly: their codes, registers and
+ * immediates are valid, jumps land on the beginning of operations of the linear sweep, and execution can't run past
+ * the end. Also checks that HLT is reachable and computes depths of the operand stack (see VerifiedBlock).
+ * @param[in]  assembly     assembly to verify
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] verification result of the verification
+ */
+void verifyBytecode(const byte* assembly, int assemblySize, BytecodeVerification& verification) {
+    assert(assembly != nullptr || assemblySize <= 0);
+
+    verification = BytecodeVerification();
+    if (assemblySize <= 0) return;
+
+    // Operations are decoded from the assembly itself, so decoded section of the container is not trusted
+    std::vector<bool> isOperationStart(assemblySize, false);
+    DecodedOperation operation;
+    for (int offset = 0; offset < assemblySize; offset += operation.size) {
+        isOperationStart[offset] = true;
+        decodeOperation(assembly, assemblySize, offset, operation);
+    }
+
+    markReachableOperations(assembly, assemblySize, isOperationStart, verification);
+    if (!verification.isVerified()) {
+        verification.reachableOffsets.clear();
+        return;
+    }
+    computeStackDepths(assembly, assemblySize, verification);
+    computeRequiredRamSize(assembly, assemblySize, verification);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief Declaration of the load-time verifier of assembly images.
+ */
+#ifndef STACK_MACHINE_BYTECODE_VERIFIER_H
+#define STACK_MACHINE_BYTECODE_VERIFIER_H
+
+#include <vector>
+
+/**
+ * Result of the verification of the image.
+ */
+enum VerificationStatus {
+    VERIFIED                  = 0, /**< Image can be executed without operand and jump checks */
+    INVALID_OPERATION_REACHED = 1, /**< Reachable operation has invalid code, register or immediate, or is truncated */
+    INVALID_JUMP_TARGET       = 2, /**< Reachable jump lands out of the assembly or inside of an operation */
+    END_OF_ASSEMBLY_REACHED   = 3, /**< Execution can run past the last operation without HLT */
+    HLT_UNREACHABLE           = 4, /**< No HLT operation is reachable, so the program can't finish successfully */
+};
+
+/**
+ * Basic block of the reachable operations. Depths are -1, if they depend on the path the block is reached by
+ * (e.g. loop that pushes values) or follow a CALL operation.
+ */
+struct VerifiedBlock {
+    /** Byte offset of the first operation of the block */
+    int offset;
+    /** Depth of the operand stack when the block is entered */
+    int entryStackDepth;
+    /** Maximal depth of the operand stack while the block runs */
+    int maxStackDepth;
+    /** Maximal growth of the operand stack while the block runs, relative to the depth at the entry */
+    int maxStackGrowth;
+};
+
+/**
+ * Facts about the image proven by the verifier. Operations are reachable, if they can be executed starting from
+ * the beginning of the assembly (returns of CALL operations are assumed to land after them).
+ */
+struct BytecodeVerification {
+    VerificationStatus status = HLT_UNREACHABLE;
+    /** Byte offset of the operation that failed the verification, or -1 */
+    int failedOffset = -1;
+    /** Maximal depth of the operand stack, or -1 if depth of some reachable block is unknown */
+    int maxStackDepth = -1;
+    /**
+     * Minimal RAM size, in which immediate addresses of all reachable PUSH [addr] and POP [addr] operations are valid
+     * (0 if there are no such operations), or -1 if some of them is negative or too large for any RAM.
+     */
+    int requiredRamSize = 0;
+    /** Reachable blocks in order of their offsets */
+    std::vector<VerifiedBlock> blocks;
+    /** Shows for each byte offset if a reachable operation starts at it */
+    std::vector<bool> reachableOffsets;
+
+    bool isVerified() const {
+        return status == VERIFIED;
+    }
+
+    bool isReachable(int offset) const {
+        return (offset >= 0) && (offset < (int)reachableOffsets.size()) && reachableOffsets[offset];
+    }
+};
+
+/**
+ * Verifies the assembly. Checks operations reachable from the beginning of the assembly: their codes, registers and
+ * immediates are valid, jumps land on the beginning of operations of the linear sweep, and execution can't run past
+ * the end. Also checks that HLT is reachable and computes depths of the operand stack (see VerifiedBlock).
+ * @param[in]  assembly     assembly to verify
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] verification result of the verification
+ */
+void verifyBytecode(const unsigned char* assembly, int assemblySize, BytecodeVerification& verification);
+
+/**
+ * Gets the effect of the valid operation on the operand stack. Integer stack isn't counted (see getIntegerStackEffect).
+ * @param[in]  opcode       operation code
+ * @param[out] poppedNumber number of values the operation needs on the stack
+ * @param[out] pushedNumber number of values the operation leaves on the stack instead of them
+ */
+void getOperationStackEffect(unsigned char opcode, int& poppedNumber, int& pushedNumber);
+
+/**
+ * Gets the effect of the valid operation on the integer stack.
+ * @param[in]  opcode       operation code
+ * @param[out] poppedNumber number of values the operation needs on the integer stack
+ * @param[out] pushedNumber number of values the operation leaves on the integer stack instead of them
+ */
+void getIntegerStackEffect(unsigned char opcode, int& poppedNumber, int& pushedNumber);
+
+#endif // STACK_MACHINE_BYTECODE_VERIFIER_H
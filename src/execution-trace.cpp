@@ -0,0 +1,324 @@
+/**
+ * @file
+ * @brief Implementation of the execution trace recording and reading.
+ */
+#include <cassert>
+#include <cinttypes>
+#include "execution-trace.h"
+#include "machine-snapshot.h"
+
+TraceWriter::~TraceWriter() {
+    if (isOpen()) close(nullptr);
+}
+
+/**
+ * Creates the trace file, writes it's header and starts the background thread.
+ * @param[in] traceFileName trace file name
+ * @param[in] assembly      assembly bytes the program is run from
+ * @param[in] assemblySize  size of the assembly in bytes
+ * @return 0, if trace was opened, or ERR_INVALID_FILE, if the file can't be written.
+ */
+unsigned char TraceWriter::open(const char* traceFileName, const unsigned char* assembly, int assemblySize) {
+    assert(traceFileName != nullptr);
+    assert(!isOpen());
+
+    if ((assembly == nullptr) || (assemblySize < 0)) return ERR_INVALID_FILE;
+    file = fopen(traceFileName, "wb");
+    if (file == nullptr) return ERR_INVALID_FILE;
+
+    TraceHeader header {};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.headerSize = sizeof(TraceHeader);
+    header.assemblySize = (uint32_t)assemblySize;
+    header.assemblyHash = getAssemblyHash(assembly, (size_t)assemblySize);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        file = nullptr;
+        return ERR_INVALID_FILE;
+    }
+
+    activeBuffer.resize(TRACE_BUFFER_SIZE);
+    activeSize = 0;
+    pendingBuffer.resize(TRACE_BUFFER_SIZE);
+    pendingSize = 0;
+    isClosing = false;
+    isFailed = false;
+    writingThread = std::thread(&TraceWriter::writePendingBuffers, this);
+    return 0;
+}
+
+/**
+ * Writes the pending buffers into the file until the writer is closed. Runs in the background thread.
+ */
+void TraceWriter::writePendingBuffers() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this]() { return (pendingSize != 0) || isClosing; });
+        if (pendingSize == 0) return;
+
+        // Buffer isn't touched by the machine thread until pendingSize is cleared, so it's written without the lock
+        size_t size = pendingSize;
+        lock.unlock();
+        bool isWritten = (fwrite(pendingBuffer.data(), 1, size, file) == size);
+        lock.lock();
+
+        isFailed = isFailed || !isWritten;
+        pendingSize = 0;
+        condition.notify_all();
+    }
+}
+
+/**
+ * Hands the active buffer to the background thread, waiting until the previous one is written.
+ */
+void TraceWriter::swapBuffers() {
+    if (activeSize == 0) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]() { return pendingSize == 0; });
+    activeBuffer.swap(pendingBuffer);
+    pendingSize = activeSize;
+    activeSize = 0;
+    condition.notify_all();
+}
+
+/**
+ * Writes the TRACE_END record and the buffered records, stops the background thread and closes the file.
+ * @param[in] end final state of the machine, or nullptr to close the trace without TRACE_END record
+ * @return 0, if the whole trace was written, or ERR_INVALID_FILE, if writing has failed.
+ */
+unsigned char TraceWriter::close(const TraceEnd* end) {
+    assert(isOpen());
+
+    if (end != nullptr) append(TRACE_END, end, sizeof(TraceEnd));
+    swapBuffers();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isClosing = true;
+    }
+    condition.notify_all();
+    writingThread.join();
+
+    bool isWritten = !isFailed && (fclose(file) == 0);
+    if (isFailed) fclose(file);
+    file = nullptr;
+    return isWritten ? 0 : ERR_INVALID_FILE;
+}
+
+/**
+ * Reads the trace file.
+ * @param[in]  traceFileName trace file name
+ * @param[out] trace         read trace
+ * @return 0, if trace was read, or ERR_INVALID_FILE, if the file can't be read, is not a trace or is truncated in the
+ *         middle of a record.
+ */
+unsigned char readTrace(const char* traceFileName, ExecutionTrace& trace) {
+    assert(traceFileName != nullptr);
+
+    FILE* file = fopen(traceFileName, "rb");
+    if (file == nullptr) return ERR_INVALID_FILE;
+
+    std::vector<unsigned char> data;
+    unsigned char chunk[TRACE_BUFFER_SIZE];
+    size_t readSize = 0;
+    while ((readSize = fread(chunk, 1, sizeof(chunk), file)) != 0) data.insert(data.end(), chunk, chunk + readSize);
+    bool isRead = (ferror(file) == 0);
+    fclose(file);
+    if (!isRead || (data.size() < sizeof(TraceHeader))) return ERR_INVALID_FILE;
+
+    memcpy(&trace.header, data.data(), sizeof(TraceHeader));
+    if ((memcmp(trace.header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) || (trace.header.version != TRACE_VERSION) ||
+        (trace.header.headerSize != sizeof(TraceHeader))) {
+        return ERR_INVALID_FILE;
+    }
+
+    trace.records.clear();
+    trace.branches.clear();
+    trace.isFinished = false;
+    trace.end = TraceEnd();
+    size_t position = sizeof(TraceHeader);
+    while ((position < data.size()) && !trace.isFinished) {
+        TraceRecordKind kind = (TraceRecordKind)data[position++];
+        size_t size = (kind == TRACE_END) ? sizeof(TraceEnd) : sizeof(double);
+        if (((kind != TRACE_INPUT) && (kind != TRACE_OUTPUT) && (kind != TRACE_END) && (kind != TRACE_BRANCHES)) ||
+            (data.size() - position < size)) {
+            return ERR_INVALID_FILE;
+        }
+
+        if (kind == TRACE_END) {
+            memcpy(&trace.end, data.data() + position, size);
+            trace.isFinished = true;
+        } else if (kind == TRACE_BRANCHES) {
+            uint64_t outcomes = 0;
+            memcpy(&outcomes, data.data() + position, size);
+            trace.branches.push_back(outcomes);
+        } else {
+            TraceRecord record {kind, 0};
+            memcpy(&record.value, data.data() + position, size);
+            trace.records.push_back(record);
+        }
+        position += size;
+    }
+
+    // Only the last TRACE_BRANCHES record may be partially filled
+    uint64_t recordedNumber = (uint64_t)trace.branches.size() * TRACE_BRANCHES_PER_RECORD;
+    if (trace.isFinished && ((trace.end.branchesNumber > recordedNumber) ||
+                             (recordedNumber - trace.end.branchesNumber >= TRACE_BRANCHES_PER_RECORD))) {
+        return ERR_INVALID_FILE;
+    }
+    return 0;
+}
+
+/**
+ * Compares the outcome of the next jump with the recorded one.
+ * @param[in] pc      byte offset of the jump
+ * @param[in] isTaken shows if the jump was taken
+ */
+void BranchLog::compare(int pc, bool isTaken) {
+    if (isDiverged) return;
+
+    if (branchesNumber < expectedNumber) {
+        uint64_t recorded = (*expected)[branchesNumber / TRACE_BRANCHES_PER_RECORD];
+        bool isRecordedTaken = ((recorded >> (branchesNumber % TRACE_BRANCHES_PER_RECORD)) & 1u) != 0;
+        if (isRecordedTaken == isTaken) return;
+    } else if (!isExpectedComplete) {
+        // Jumps after the end of the cut trace are unknown
+        return;
+    }
+
+    isDiverged = true;
+    divergedOrdinal = branchesNumber;
+    divergedPc = pc;
+    isDivergedTaken = isTaken;
+}
+
+/**
+ * Logs the given number of taken jumps of the same operation.
+ * Compared outcomes are logged one by one, and written ones by the whole records, when it's possible.
+ * @param[in] pc     byte offset of the jump
+ * @param[in] number number of times the jump was taken
+ */
+void BranchLog::logTaken(int pc, uint64_t number) {
+    for (; (number > 0) && ((writer == nullptr) || (branchesNumber % TRACE_BRANCHES_PER_RECORD != 0)); --number) {
+        log(pc, true);
+    }
+    for (; number >= TRACE_BRANCHES_PER_RECORD; number -= TRACE_BRANCHES_PER_RECORD) {
+        writer->recordBranches(UINT64_MAX);
+        branchesNumber += TRACE_BRANCHES_PER_RECORD;
+    }
+    for (; number > 0; --number) {
+        log(pc, true);
+    }
+}
+
+/**
+ * Describes the first jump that differs from the recorded one, or the first jump after all recorded ones. Run that
+ * made fewer jumps is found by the final state (see TraceEnd::branchesNumber).
+ * @param[out] report file the difference is written into
+ * @return true, if all outcomes match the recorded ones, false otherwise.
+ */
+bool BranchLog::reportDivergence(FILE* report) const {
+    assert(report != nullptr);
+
+    if (isDiverged && (divergedOrdinal >= expectedNumber)) {
+        fprintf(report, "Branch #%" PRIu64 " at pc %d: unexpected conditional jump, the trace has only %" PRIu64
+                " of them\n", divergedOrdinal, divergedPc, expectedNumber);
+        return false;
+    }
+    if (isDiverged) {
+        fprintf(report, "Branch #%" PRIu64 " at pc %d: expected %s, got %s\n", divergedOrdinal, divergedPc,
+                isDivergedTaken ? "not taken" : "taken", isDivergedTaken ? "taken" : "not taken");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Checks if the values have the same bits, so NAN values and signed zeros are compared too.
+ */
+static bool isSameValue(double lhs, double rhs) {
+    return memcmp(&lhs, &rhs, sizeof(double)) == 0;
+}
+
+/**
+ * Compares the execution with the recorded trace and describes the first difference. Outcomes of conditional jumps
+ * are compared first, as the first jump that differs is where the execution left the recorded path.
+ * @param[in]  trace    recorded trace
+ * @param[in]  branches log the outcomes of the execution were compared by (see BranchLog)
+ * @param[in]  outputs  OUT values of the execution
+ * @param[in]  end      final state of the execution
+ * @param[out] report   file the first difference is written into
+ * @return true, if execution matches the trace, false otherwise.
+ */
+bool compareWithTrace(const ExecutionTrace& trace, const BranchLog& branches, const std::vector<double>& outputs,
+                      const TraceEnd& end, FILE* report) {
+    assert(report != nullptr);
+
+    if (!branches.reportDivergence(report)) return false;
+
+    size_t outputIndex = 0;
+    for (const TraceRecord& record : trace.records) {
+        if (record.kind != TRACE_OUTPUT) continue;
+        if (outputIndex == outputs.size()) {
+            fprintf(report, "OUT #%zu: expected %.17lg, but the program wrote only %zu values\n", outputIndex,
+                    record.value, outputs.size());
+            return false;
+        }
+        if (!isSameValue(record.value, outputs[outputIndex])) {
+            fprintf(report, "OUT #%zu: expected %.17lg, got %.17lg\n", outputIndex, record.value, outputs[outputIndex]);
+            return false;
+        }
+        ++outputIndex;
+    }
+    if (outputIndex != outputs.size()) {
+        fprintf(report, "OUT #%zu: unexpected value %.17lg, the trace has only %zu values\n", outputIndex,
+                outputs[outputIndex], outputIndex);
+        return false;
+    }
+
+    if (!trace.isFinished) {
+        fprintf(report, "Trace has no final state (recording was interrupted), only OUT values are compared\n");
+        return true;
+    }
+    if (trace.end.status != end.status) {
+        fprintf(report, "Exit status: expected %" PRIu32 ", got %" PRIu32 "\n", trace.end.status, end.status);
+        return false;
+    }
+    if (trace.end.pc != end.pc) {
+        fprintf(report, "Final pc: expected %" PRId32 ", got %" PRId32 "\n", trace.end.pc, end.pc);
+        return false;
+    }
+    for (unsigned int i = 0; i < REGISTERS_NUMBER; ++i) {
+        if (!isSameValue(trace.end.registers[i], end.registers[i])) {
+            fprintf(report, "Register %s: expected %.17lg, got %.17lg\n", getRegisterNameByNumber((unsigned char)i),
+                    trace.end.registers[i], end.registers[i]);
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < REGISTERS_NUMBER; ++i) {
+        if (trace.end.integerRegisters[i] != end.integerRegisters[i]) {
+            fprintf(report, "Register %s: expected %" PRId64 ", got %" PRId64 "\n",
+                    getIntegerRegisterNameByNumber((unsigned char)i), trace.end.integerRegisters[i],
+                    end.integerRegisters[i]);
+            return false;
+        }
+    }
+    if ((trace.end.operandStackSize != end.operandStackSize) || !isSameValue(trace.end.topValue, end.topValue)) {
+        fprintf(report, "Operand stack: expected %" PRIu64 " values with %.17lg on top, got %" PRIu64 " with %.17lg\n",
+                trace.end.operandStackSize, trace.end.topValue, end.operandStackSize, end.topValue);
+        return false;
+    }
+    if ((trace.end.integerStackSize != end.integerStackSize) || (trace.end.integerTopValue != end.integerTopValue)) {
+        fprintf(report, "Integer stack: expected %" PRIu64 " values with %" PRId64 " on top, got %" PRIu64 " with %"
+                PRId64 "\n", trace.end.integerStackSize, trace.end.integerTopValue, end.integerStackSize,
+                end.integerTopValue);
+        return false;
+    }
+    if (trace.end.branchesNumber != end.branchesNumber) {
+        fprintf(report, "Conditional jumps: expected %" PRIu64 ", the program made only %" PRIu64 "\n",
+                trace.end.branchesNumber, end.branchesNumber);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,323 @@
+/**
+ * @file
+ * @brief Declaration of the execution trace: binary log of the observable behaviour of the run (IN and OUT values,
+ * outcomes of conditional jumps and the final state of the machine), that is recorded by `run --trace` and
+ * re-executed by `replay`.
+ *
+ * Trace file is the TraceHeader followed by records. Every record starts with one byte of it's kind:
+ *     TRACE_INPUT and TRACE_OUTPUT are followed by the value (8 bytes, double),
+ *     TRACE_BRANCHES is followed by outcomes of the next 64 conditional jumps (8 bytes, bit i is set, if i-th of them
+ *     was taken). The last record before TRACE_END may hold fewer outcomes (see TraceEnd::branchesNumber),
+ *     TRACE_END is followed by TraceEnd and is the last record of the finished trace.
+ * Values are written as they are in memory (little-endian host is assumed, like in snapshot files).
+ */
+#ifndef STACK_MACHINE_EXECUTION_TRACE_H
+#define STACK_MACHINE_EXECUTION_TRACE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "stack-machine-utils.h"
+
+#define TRACE_VERSION 3u
+
+#ifndef TRACE_BUFFER_SIZE
+    /** Size of each of the two record buffers of the trace writer in bytes */
+    #define TRACE_BUFFER_SIZE (1u << 16u)
+#endif
+
+/** Signature of the trace file. It starts with the invalid operation code, so it's never run as the assembly */
+constexpr unsigned char TRACE_MAGIC[4] = {0xFF, 'S', 'M', 'T'};
+
+/**
+ * Header at the beginning of the trace file.
+ */
+struct TraceHeader {
+    unsigned char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t reserved;
+    /** Size and hash of the assembly the trace was recorded on (see getAssemblyHash). Trace is replayed only on it */
+    uint32_t assemblySize;
+    uint64_t assemblyHash;
+};
+
+static_assert(sizeof(TraceHeader) == 24, "Trace header must have no padding");
+
+/**
+ * Kinds of the trace records.
+ */
+enum TraceRecordKind : uint8_t {
+    TRACE_INPUT    = 1, /**< Value read by IN operation */
+    TRACE_OUTPUT   = 2, /**< Value written by OUT operation */
+    TRACE_END      = 3, /**< Final state of the machine */
+    TRACE_BRANCHES = 4, /**< Outcomes of conditional jumps */
+};
+
+/** Number of conditional jump outcomes in the TRACE_BRANCHES record */
+constexpr unsigned int TRACE_BRANCHES_PER_RECORD = 64;
+
+/**
+ * Final state of the machine, that doesn't depend on the engine the program was run on, also when the program
+ * finished with the error (pc is left as the reference engine leaves it).
+ */
+struct TraceEnd {
+    /** HLT_OPCODE or error code the program finished with */
+    uint32_t status;
+    int32_t pc;
+    uint64_t operandStackSize;
+    /** Value on top of the operand stack, or 0, if the stack is empty */
+    double topValue;
+    /** Number of conditional jumps the program made (outcomes in TRACE_BRANCHES records) */
+    uint64_t branchesNumber;
+    double registers[REGISTERS_NUMBER];
+    uint64_t integerStackSize;
+    /** Value on top of the integer stack, or 0, if the stack is empty */
+    int64_t integerTopValue;
+    int64_t integerRegisters[REGISTERS_NUMBER];
+};
+
+static_assert(sizeof(TraceEnd) == 48 + REGISTERS_NUMBER * (sizeof(double) + sizeof(int64_t)),
+              "Trace end must have no padding");
+
+/**
+ * Record of the trace, as it's read from the file.
+ */
+struct TraceRecord {
+    TraceRecordKind kind;
+    /** IN or OUT value */
+    double value;
+};
+
+/**
+ * Trace read from the file (see readTrace).
+ */
+struct ExecutionTrace {
+    TraceHeader header;
+    /** IN and OUT records in the order they were recorded */
+    std::vector<TraceRecord> records;
+    /** Outcomes of conditional jumps, TRACE_BRANCHES_PER_RECORD in each word (the first one in the lowest bit) */
+    std::vector<uint64_t> branches;
+    /** Shows if the trace has the TRACE_END record, e.g. it's not cut by the crash of the recording process */
+    bool isFinished;
+    TraceEnd end;
+};
+
+/**
+ * Writer of the trace file. Records are appended to the active buffer by the thread that runs the machine without
+ * any locks. When the buffer is full, it's handed to the background thread, that writes it into the file, and the
+ * second buffer becomes active, so the machine waits for the file only if the background thread is slower than it.
+ */
+class TraceWriter {
+
+private:
+    FILE* file = nullptr;
+
+    /** Buffer records are appended to, and it's size in bytes */
+    std::vector<unsigned char> activeBuffer;
+    size_t activeSize = 0;
+
+    /** Buffer handed to the background thread (guarded by mutex), and it's size in bytes */
+    std::vector<unsigned char> pendingBuffer;
+    size_t pendingSize = 0;
+    /** Shows if the writing thread should finish after the pending buffer is written (guarded by mutex) */
+    bool isClosing = false;
+    /** Shows if writing into the file has failed (guarded by mutex) */
+    bool isFailed = false;
+
+    std::mutex mutex;
+    /** Notified, when the pending buffer is given or taken, and when the writer is closing */
+    std::condition_variable condition;
+    std::thread writingThread;
+
+    /**
+     * Writes the pending buffers into the file until the writer is closed. Runs in the background thread.
+     */
+    void writePendingBuffers();
+
+    /**
+     * Hands the active buffer to the background thread, waiting until the previous one is written.
+     */
+    void swapBuffers();
+
+    /**
+     * Appends the record to the active buffer.
+     * @param[in] kind kind of the record
+     * @param[in] data data of the record
+     * @param[in] size size of the data in bytes (at most sizeof(TraceEnd))
+     */
+    void append(TraceRecordKind kind, const void* data, size_t size) {
+        if (activeBuffer.size() - activeSize < 1 + size) swapBuffers();
+        activeBuffer[activeSize] = kind;
+        memcpy(activeBuffer.data() + activeSize + 1, data, size);
+        activeSize += 1 + size;
+    }
+
+public:
+    TraceWriter() = default;
+
+    /**
+     * Closes the trace without the TRACE_END record, if it's still open.
+     */
+    ~TraceWriter();
+
+    TraceWriter(TraceWriter& writer) = delete;
+    TraceWriter &operator=(const TraceWriter&) = delete;
+
+    /**
+     * Creates the trace file, writes it's header and starts the background thread.
+     * @param[in] traceFileName trace file name
+     * @param[in] assembly      assembly bytes the program is run from
+     * @param[in] assemblySize  size of the assembly in bytes
+     * @return 0, if trace was opened, or ERR_INVALID_FILE, if the file can't be written.
+     */
+    unsigned char open(const char* traceFileName, const unsigned char* assembly, int assemblySize);
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    void recordInput(double value) {
+        append(TRACE_INPUT, &value, sizeof(value));
+    }
+
+    void recordOutput(double value) {
+        append(TRACE_OUTPUT, &value, sizeof(value));
+    }
+
+    void recordBranches(uint64_t outcomes) {
+        append(TRACE_BRANCHES, &outcomes, sizeof(outcomes));
+    }
+
+    /**
+     * Writes the TRACE_END record and the buffered records, stops the background thread and closes the file.
+     * @param[in] end final state of the machine, or nullptr to close the trace without TRACE_END record
+     * @return 0, if the whole trace was written, or ERR_INVALID_FILE, if writing has failed.
+     */
+    unsigned char close(const TraceEnd* end);
+};
+
+/**
+ * Log of conditional jump outcomes, that engines write every executed conditional jump into (see
+ * StackMachine::setBranchLog). Jump that fails on the empty stack has no outcome. When the trace is recorded, outcomes
+ * are written into the trace writer by TRACE_BRANCHES records. When it's replayed, they are compared with the recorded
+ * ones, and the first jump that differs is kept.
+ */
+class BranchLog {
+
+private:
+    /** Trace outcomes are written into, or nullptr, if they are compared */
+    TraceWriter* writer = nullptr;
+
+    /** Recorded outcomes and their number, if outcomes are compared */
+    const std::vector<uint64_t>* expected = nullptr;
+    uint64_t expectedNumber = 0;
+    /** Shows if the recorded outcomes are all outcomes of the run, e.g. the trace isn't cut */
+    bool isExpectedComplete = false;
+
+    /** Outcomes, that are not written yet (the first one in the lowest bit) */
+    uint64_t outcomes = 0;
+    /** Number of logged outcomes */
+    uint64_t branchesNumber = 0;
+
+    /** Shows if the logged outcome differs from the recorded one, or the jump was not recorded */
+    bool isDiverged = false;
+    /** Ordinal, pc and outcome of the first jump that differs */
+    uint64_t divergedOrdinal = 0;
+    int divergedPc = -1;
+    bool isDivergedTaken = false;
+
+    /**
+     * Compares the outcome of the next jump with the recorded one.
+     * @param[in] pc      byte offset of the jump
+     * @param[in] isTaken shows if the jump was taken
+     */
+    void compare(int pc, bool isTaken);
+
+public:
+    /**
+     * Creates the log that writes outcomes into the trace.
+     * @param[in] traceWriter open trace writer, that lives longer than the log
+     */
+    explicit BranchLog(TraceWriter& traceWriter) : writer(&traceWriter) {
+    }
+
+    /**
+     * Creates the log that compares outcomes with the recorded ones.
+     * @param[in] recorded   recorded outcomes (see ExecutionTrace::branches), that live longer than the log
+     * @param[in] number     number of the recorded outcomes
+     * @param[in] isComplete shows if the run has no outcomes after the recorded ones
+     */
+    BranchLog(const std::vector<uint64_t>& recorded, uint64_t number, bool isComplete) :
+        expected(&recorded), expectedNumber(number), isExpectedComplete(isComplete) {
+    }
+
+    /**
+     * Logs the outcome of the conditional jump.
+     * @param[in] pc      byte offset of the jump (of the fused operation, if the jump is fused)
+     * @param[in] isTaken shows if the jump was taken
+     */
+    void log(int pc, bool isTaken) {
+        if (expected != nullptr) compare(pc, isTaken);
+        outcomes |= (uint64_t)isTaken << (branchesNumber % TRACE_BRANCHES_PER_RECORD);
+        if (++branchesNumber % TRACE_BRANCHES_PER_RECORD != 0) return;
+
+        if (writer != nullptr) writer->recordBranches(outcomes);
+        outcomes = 0;
+    }
+
+    /**
+     * Logs the given number of taken jumps of the same operation.
+     * @param[in] pc     byte offset of the jump
+     * @param[in] number number of times the jump was taken
+     */
+    void logTaken(int pc, uint64_t number);
+
+    /**
+     * Writes outcomes, that don't fill the whole TRACE_BRANCHES record, into the trace.
+     */
+    void flush() {
+        if ((writer != nullptr) && (branchesNumber % TRACE_BRANCHES_PER_RECORD != 0)) writer->recordBranches(outcomes);
+    }
+
+    uint64_t getBranchesNumber() const {
+        return branchesNumber;
+    }
+
+    /**
+     * Describes the first jump that differs from the recorded one, or the first jump after all recorded ones. Run that
+     * made fewer jumps is found by the final state (see TraceEnd::branchesNumber).
+     * @param[out] report file the difference is written into
+     * @return true, if all outcomes match the recorded ones, false otherwise.
+     */
+    bool reportDivergence(FILE* report) const;
+};
+
+/**
+ * Reads the trace file.
+ * @param[in]  traceFileName trace file name
+ * @param[out] trace         read trace
+ * @return 0, if trace was read, or ERR_INVALID_FILE, if the file can't be read, is not a trace or is truncated in the
+ *         middle of a record.
+ */
+unsigned char readTrace(const char* traceFileName, ExecutionTrace& trace);
+
+/**
+ * Compares the execution with the recorded trace and describes the first difference. Outcomes of conditional jumps
+ * are compared first, as the first jump that differs is where the execution left the recorded path.
+ * @param[in]  trace    recorded trace
+ * @param[in]  branches log the outcomes of the execution were compared by (see BranchLog)
+ * @param[in]  outputs  OUT values of the execution
+ * @param[in]  end      final state of the execution
+ * @param[out] report   file the first difference is written into
+ * @return true, if execution matches the trace, false otherwise.
+ */
+bool compareWithTrace(const ExecutionTrace& trace, const BranchLog& branches, const std::vector<double>& outputs,
+                      const TraceEnd& end, FILE* report);
+
+#endif // STACK_MACHINE_EXECUTION_TRACE_H
@@ -10,10 +10,40 @@
 #include <cstdio>
 #include "environment.h"
 
-static FILE* _logFile = nullptr;
+/** Log file of the current thread. Every thread logs independently */
+static thread_local FILE* _logFile = nullptr;
 
 constexpr const char* defaultLogFileName = "log.txt";
 
+constexpr const char* defaultStackLogFileName = "stack-dump.txt";
+
+/**
+ * Gets the reference to the name of the file that stacks of the current thread are dumped into.
+ */
+inline const char*& _stackLogFileName() {
+    static thread_local const char* stackLogFileName = defaultStackLogFileName;
+    return stackLogFileName;
+}
+
+/**
+ * Gets the name of the file that stacks of the current thread are dumped into.
+ * @return name of the stack log file.
+ */
+inline const char* getStackLogFileName() {
+    return _stackLogFileName();
+}
+
+/**
+ * Sets the name of the file that stacks of the current thread are dumped into.
+ * Threads that work with stacks concurrently should use different files.
+ * @param[in] stackLogFileName name of the stack log file. Must stay valid while the thread uses it
+ */
+inline void setStackLogFileName(const char* stackLogFileName) {
+    assert(stackLogFileName != nullptr);
+
+    _stackLogFileName() = stackLogFileName;
+}
+
 /**
  * Closes the current log file.
  */
@@ -163,8 +163,8 @@ static long long getHash(TYPED_STACK(STACK_TYPE)* thiz);
 
 //----------------------------------------------------------------------------------------------------------------------
 
-/** Name of the stack log file */
-#define stackLogFileName "stack-dump.txt"
+/** Name of the stack log file of the current thread (see setStackLogFileName) */
+#define stackLogFileName getStackLogFileName()
 
 #define xstr(a) #a
 #define str(a) xstr(a)
@@ -332,7 +332,8 @@ void constructStack(TYPED_STACK(STACK_TYPE)* const thiz, size_t initialCapacity)
             dataCanariesAfter [i] = canaryValue;
         }
     #else
-        thiz->_data = new STACK_TYPE[initialCapacity];
+        // At least one element is allocated, so the data array of an empty stack is not null
+        thiz->_data = (STACK_TYPE*)calloc((initialCapacity == 0) ? 1 : initialCapacity, sizeof(STACK_TYPE));
     #endif
 
     #if STACK_SECURITY_LEVEL >= 3
@@ -384,15 +385,12 @@ void enlarge(TYPED_STACK(STACK_TYPE)* const thiz) {
                 dataCanariesBefore[i] = canaryValue;
                 dataCanariesAfter [i] = canaryValue;
             }
+
+            free(thiz->_data);
+            thiz->_data = newData;
         #else
-            auto newData = new STACK_TYPE[thiz->_capacity];
-            for (ssize_t i = 0; i < thiz->_size; ++i) {
-                newData[i] = thiz->_data[i];
-            }
+            thiz->_data = (STACK_TYPE*)realloc(thiz->_data, sizeof(STACK_TYPE) * thiz->_capacity);
         #endif
-
-        free(thiz->_data);
-        thiz->_data = newData;
     }
 
     #if STACK_SECURITY_LEVEL >= 3
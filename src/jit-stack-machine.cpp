@@ -0,0 +1,856 @@
+/**
+ * @file
+ * @brief Implementation of stack machine that compiles hot basic blocks to native x86-64 code.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "jit-stack-machine.h"
+#include "bytecode-verifier.h"
+
+using byte = unsigned char;
+
+/** Maximal number of operand stack values that compiled block keeps in XMM registers */
+constexpr static int STACK_SLOTS_NUMBER = 10;
+
+/** Maximal number of integer stack values that compiled block keeps in general purpose registers */
+constexpr static int INTEGER_SLOTS_NUMBER = 6;
+
+/** Size of the executable code region of one machine in bytes */
+constexpr static size_t CODE_REGION_SIZE = 1u << 20u;
+
+JitStackMachine::JitStackMachine(const char* assemblyFileName, unsigned int hotThreshold) :
+    StackMachine(assemblyFileName), hotThreshold(hotThreshold) {
+    initProfile();
+}
+
+JitStackMachine::JitStackMachine(std::shared_ptr<const BytecodeImage> image, unsigned int hotThreshold) :
+    StackMachine(std::move(image)), hotThreshold(hotThreshold) {
+    initProfile();
+}
+
+/**
+ * Allocates profiling data for the loaded assembly.
+ */
+void JitStackMachine::initProfile() {
+    if (assemblySize < 0) return;
+
+    blockIndexByOffset.assign(assemblySize, -1);
+    jumpsNumberByOffset.assign(assemblySize, 0);
+    isCompilationAttempted.assign(assemblySize, false);
+}
+
+JitStackMachine::~JitStackMachine() {
+    if (code != nullptr) {
+        munmap(code, codeCapacity);
+    }
+}
+
+/**
+ * Processes the jump operation and profiles it's destination, if jump is taken.
+ * @param[in] opcode     code of the jump operation to process
+ * @param[in] jumpOffset offset of the jump to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+byte JitStackMachine::processJumpOperation(byte opcode, int jumpOffset) {
+    int jumpPc = pc;
+    byte status = StackMachine::processJumpOperation(opcode, jumpOffset);
+    if (!isError(status) && (pc == jumpPc + jumpOffset)) profileJump(pc);
+    return status;
+}
+
+/**
+ * Processes the fused operation and profiles the destination of the fused jump, if it is taken.
+ * @param[in] opcode code of the fused operation to process
+ * @return given operation code, if operation processed successfully, or error code otherwise.
+ */
+byte JitStackMachine::processFusedOperation(byte opcode) {
+    int operandsPc = pc;
+    byte status = StackMachine::processFusedOperation(opcode);
+    if (isFusedJumpOperation(opcode) && !isError(status) && (pc != operandsPc + (int)(sizeof(double) + sizeof(int)))) {
+        profileJump(pc);
+    }
+    return status;
+}
+
+/**
+ * Executes operations starting from the current pc until HLT operation or an error is met.
+ * Compiled blocks are run instead of the operations they were compiled from.
+ * If stats are counted (see isCounted), the program is executed by StackMachine::execute.
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+ *         error code of the failed operation otherwise.
+ */
+byte JitStackMachine::execute() {
+    if (isCounted()) return StackMachine::execute();
+    if (budget.isLimited()) return executeBudgeted();
+
+    while (true) {
+        if ((pc >= 0) && (pc < assemblySize) && (blockIndexByOffset[pc] >= 0)) {
+            unsigned long long runs = ULLONG_MAX;
+            if (runBlock(blocks[blockIndexByOffset[pc]], runs)) continue;
+        }
+
+        byte opcode = processNextOperation();
+        if ((opcode == HLT_OPCODE) || isError(opcode)) return opcode;
+    }
+}
+
+/**
+ * Executes operations like execute() does, checking the budget. Compiled blocks are run only as many times
+ * as the rest of the budget allows, and the time limit is checked every TIME_CHECK_INTERVAL operations.
+ * @return the same as execute().
+ */
+byte JitStackMachine::executeBudgeted() {
+    unsigned long long remaining = getBudgetInstructions();
+    const unsigned long long deadline = getBudgetDeadline();
+    unsigned long long untilTimeCheck = 0;
+
+    while (true) {
+        if ((deadline != 0) && (untilTimeCheck == 0)) {
+            if (readMilliseconds() >= deadline) return ERR_BUDGET_EXHAUSTED;
+            untilTimeCheck = ExecutionBudget::TIME_CHECK_INTERVAL;
+        }
+        unsigned long long allowed = (deadline != 0) ? std::min(remaining, untilTimeCheck) : remaining;
+        if (allowed == 0) return ERR_BUDGET_EXHAUSTED;
+
+        unsigned long long executed = 0;
+        if ((pc >= 0) && (pc < assemblySize) && (blockIndexByOffset[pc] >= 0)) {
+            const CompiledBlock& block = blocks[blockIndexByOffset[pc]];
+            unsigned long long runs = allowed / (unsigned long long)block.operationsNumber;
+            if ((runs > 0) && runBlock(block, runs)) executed = runs * (unsigned long long)block.operationsNumber;
+        }
+        if (executed == 0) {
+            byte opcode = processNextOperation();
+            if ((opcode == HLT_OPCODE) || isError(opcode)) return opcode;
+            executed = 1;
+        }
+
+        remaining -= executed;
+        if (deadline != 0) untilTimeCheck -= executed;
+    }
+}
+
+/**
+ * Runs the compiled block starting at the current pc. If the branch log is set, outcomes of the conditional jump
+ * the block ends with are logged after it: every run but the last one jumped to the beginning of the block, and the
+ * last one jumped, if the block was left at the jump destination.
+ * @param[in]      block block to run
+ * @param[in, out] runs  maximal number of runs of the block (at least 1), replaced with the number of runs made
+ * @return true, if block was run, false if there is not enough values on the operand or integer stack for it.
+ */
+bool JitStackMachine::runBlock(const CompiledBlock& block, unsigned long long& runs) {
+    if (getStackSize(&stack) < block.inputsNumber) return false;
+    if (getStackSize(&integerStack) < block.integerInputsNumber) return false;
+
+    double inputs[STACK_SLOTS_NUMBER] = { };
+    double outputs[STACK_SLOTS_NUMBER] = { };
+    int64_t integerValues[INTEGER_SLOTS_NUMBER] = { };
+    for (int i = block.inputsNumber - 1; i >= 0; --i) {
+        inputs[i] = pop(&stack);
+    }
+    for (int i = block.integerInputsNumber - 1; i >= 0; --i) {
+        integerValues[i] = pop(&integerStack);
+    }
+
+    unsigned long long runsLeft = runs;
+    pc = block.function(registers, inputs, outputs, &runsLeft, integerRegisters, integerValues);
+    runs -= runsLeft;
+    if ((branchLog != nullptr) && (block.branchPc >= 0)) {
+        branchLog->logTaken(block.branchPc, runs - 1);
+        branchLog->log(block.branchPc, pc == block.branchTarget);
+    }
+
+    for (int i = 0; i < block.outputsNumber; ++i) {
+        push(&stack, outputs[i]);
+    }
+    for (int i = 0; i < block.integerOutputsNumber; ++i) {
+        push(&integerStack, integerValues[i]);
+    }
+    return true;
+}
+
+/**
+ * Accounts the taken jump to the given byte offset. Compiles the block starting there, if it becomes hot.
+ * @param[in] offset byte offset of the jump destination
+ */
+void JitStackMachine::profileJump(int offset) {
+    if ((offset < 0) || (offset >= assemblySize) || isCompilationAttempted[offset]) return;
+    if (++jumpsNumberByOffset[offset] < hotThreshold) return;
+
+    isCompilationAttempted[offset] = true;
+    jumpsNumberByOffset[offset] = 0;
+    compileBlock(offset);
+}
+
+/**
+ * Copies the given native code into the executable code region.
+ * The region is writable only while the code is copied.
+ * @param[in] nativeCode native code to copy
+ * @return address of the copied code, or nullptr if there is no space left.
+ */
+const byte* JitStackMachine::installCode(const std::vector<byte>& nativeCode) {
+    if (code == nullptr) {
+        void* region = mmap(nullptr, CODE_REGION_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) return nullptr;
+        code = static_cast<byte*>(region);
+        codeCapacity = CODE_REGION_SIZE;
+    }
+    if (codeSize + nativeCode.size() > codeCapacity) return nullptr;
+
+    if (mprotect(code, codeCapacity, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    byte* installed = code + codeSize;
+    memcpy(installed, nativeCode.data(), nativeCode.size());
+    codeSize += nativeCode.size();
+    if (mprotect(code, codeCapacity, PROT_READ | PROT_EXEC) != 0) return nullptr;
+
+    return installed;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Minimal x86-64 encoder for the instructions used in compiled blocks.
+ * XMM registers are given by their numbers, general purpose registers by their encoding.
+ */
+
+constexpr static int RAX = 0;
+constexpr static int RCX = 1;
+constexpr static int RDX = 2;
+constexpr static int RBX = 3;
+constexpr static int RBP = 5;
+constexpr static int RSI = 6;
+constexpr static int RDI = 7;
+constexpr static int R8  = 8;
+constexpr static int R9  = 9;
+constexpr static int R10 = 10;
+constexpr static int R11 = 11;
+constexpr static int R12 = 12;
+constexpr static int R13 = 13;
+constexpr static int R14 = 14;
+constexpr static int R15 = 15;
+
+/** General purpose registers with integer registers IAX..IDX. They are callee-saved */
+constexpr static int INTEGER_REGISTER_GPRS[REGISTERS_NUMBER] = { R12, R13, R14, R15 };
+
+/**
+ * General purpose registers with values of integer stack slots. Rdx, r8 and r9 hold arguments of the block, so they
+ * are saved on the stack first, and r9 is the last slot, so that integer inputs are loaded through it
+ */
+constexpr static int INTEGER_SLOT_GPRS[INTEGER_SLOTS_NUMBER] = { RBX, RBP, RCX, RDX, R8, R9 };
+
+/** Callee-saved registers the block uses, in the order they are pushed */
+constexpr static int SAVED_GPRS[] = { RBX, RBP, R12, R13, R14, R15 };
+
+/** First XMM register with the value of operand stack slot */
+constexpr static int FIRST_SLOT_XMM = REGISTERS_NUMBER;
+constexpr static int SCRATCH_XMM    = FIRST_SLOT_XMM + STACK_SLOTS_NUMBER;
+constexpr static int IMMEDIATE_XMM  = SCRATCH_XMM + 1;
+
+constexpr static byte JA_OPCODE  = 0x87;
+constexpr static byte JAE_OPCODE = 0x83;
+constexpr static byte JE_OPCODE  = 0x84;
+constexpr static byte JNE_OPCODE = 0x85;
+constexpr static byte JL_OPCODE  = 0x8C;
+constexpr static byte JGE_OPCODE = 0x8D;
+constexpr static byte JLE_OPCODE = 0x8E;
+constexpr static byte JG_OPCODE  = 0x8F;
+
+constexpr static byte MOVSD_LOAD_OPCODE  = 0x10;
+constexpr static byte MOVSD_STORE_OPCODE = 0x11;
+constexpr static byte MOVAPD_OPCODE      = 0x28;
+constexpr static byte UCOMISD_OPCODE     = 0x2E;
+constexpr static byte SQRTSD_OPCODE      = 0x51;
+constexpr static byte ADDSD_OPCODE       = 0x58;
+constexpr static byte MULSD_OPCODE       = 0x59;
+constexpr static byte SUBSD_OPCODE       = 0x5C;
+constexpr static byte DIVSD_OPCODE       = 0x5E;
+constexpr static byte CVTSI2SD_OPCODE    = 0x2A;
+constexpr static byte CVTTSD2SI_OPCODE   = 0x2C;
+
+constexpr static byte ADD_RM_OPCODE = 0x01;
+constexpr static byte SUB_RM_OPCODE = 0x29;
+constexpr static byte CMP_RM_OPCODE = 0x39;
+constexpr static byte MOV_RM_OPCODE = 0x89;
+constexpr static byte MOV_REG_OPCODE = 0x8B;
+
+static void emitInt(std::vector<byte>& code, int32_t value) {
+    byte bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    code.insert(code.end(), bytes, bytes + sizeof(value));
+}
+
+static void emitRex(std::vector<byte>& code, bool isWide, int reg, int rm) {
+    byte rex = 0x40u | (isWide ? 0x08u : 0u) | ((reg >= 8) ? 0x04u : 0u) | ((rm >= 8) ? 0x01u : 0u);
+    if (rex != 0x40u) code.push_back(rex);
+}
+
+static byte modRm(byte mod, int reg, int rm) {
+    return (byte)((mod << 6u) | ((reg & 7) << 3) | (rm & 7));
+}
+
+/**
+ * Emits SSE2 instruction with two XMM registers (e.g. addsd dst, src).
+ */
+static void emitSse(std::vector<byte>& code, byte prefix, byte opcode, int dst, int src) {
+    code.push_back(prefix);
+    emitRex(code, false, dst, src);
+    code.push_back(0x0F);
+    code.push_back(opcode);
+    code.push_back(modRm(3, dst, src));
+}
+
+/**
+ * Emits movsd load or store between XMM register and [base + displacement].
+ */
+static void emitSseMemory(std::vector<byte>& code, byte opcode, int xmm, int base, int displacement) {
+    code.push_back(0xF2);
+    emitRex(code, false, xmm, base);
+    code.push_back(0x0F);
+    code.push_back(opcode);
+    code.push_back(modRm(2, xmm, base));
+    emitInt(code, displacement);
+}
+
+static void emitScalar(std::vector<byte>& code, byte opcode, int dst, int src) {
+    emitSse(code, 0xF2, opcode, dst, src);
+}
+
+static void emitMove(std::vector<byte>& code, int dst, int src) {
+    if (dst != src) emitSse(code, 0x66, MOVAPD_OPCODE, dst, src);
+}
+
+static void emitCompare(std::vector<byte>& code, int lhs, int rhs) {
+    emitSse(code, 0x66, UCOMISD_OPCODE, lhs, rhs);
+}
+
+/**
+ * Emits loading of the given constant into XMM register through rax.
+ */
+static void emitConstant(std::vector<byte>& code, int xmm, double value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+
+    code.push_back(0x48); // mov rax, imm64
+    code.push_back(0xB8);
+    for (unsigned int i = 0; i < sizeof(bits); ++i) {
+        code.push_back((byte)(bits >> (8 * i)));
+    }
+
+    code.push_back(0x66); // movq xmm, rax
+    emitRex(code, true, xmm, RAX);
+    code.push_back(0x0F);
+    code.push_back(0x6E);
+    code.push_back(modRm(3, xmm, RAX));
+}
+
+/**
+ * Emits clearing of the sign bit of XMM register through rax.
+ */
+static void emitAbs(std::vector<byte>& code, int xmm) {
+    code.push_back(0x66); // movq rax, xmm
+    emitRex(code, true, xmm, RAX);
+    code.push_back(0x0F);
+    code.push_back(0x7E);
+    code.push_back(modRm(3, xmm, RAX));
+
+    const byte btr[] = { 0x48, 0x0F, 0xBA, 0xF0, 0x3F }; // btr rax, 63
+    code.insert(code.end(), btr, btr + sizeof(btr));
+
+    code.push_back(0x66); // movq xmm, rax
+    emitRex(code, true, xmm, RAX);
+    code.push_back(0x0F);
+    code.push_back(0x6E);
+    code.push_back(modRm(3, xmm, RAX));
+}
+
+static void emitMoveEax(std::vector<byte>& code, int value) {
+    code.push_back(0xB8);
+    emitInt(code, value);
+}
+
+/**
+ * Emits jump (conditional, if condition opcode is not zero) with a displacement to be patched.
+ * @return position of the displacement in the code.
+ */
+static int emitJump(std::vector<byte>& code, byte conditionOpcode) {
+    if (conditionOpcode != 0) {
+        code.push_back(0x0F);
+        code.push_back(conditionOpcode);
+    } else {
+        code.push_back(0xE9);
+    }
+    emitInt(code, 0);
+    return (int)code.size() - (int)sizeof(int32_t);
+}
+
+static void patchJump(std::vector<byte>& code, int displacementPosition, int destination) {
+    int32_t displacement = destination - (displacementPosition + (int)sizeof(int32_t));
+    memcpy(code.data() + displacementPosition, &displacement, sizeof(displacement));
+}
+
+/**
+ * Emits comparison of lhs and rhs for the given conditional jump.
+ * Comparisons are false for NaN operands, as in StackMachine::processJumpOperation.
+ * @return opcode of the conditional jump that is taken if the condition is met.
+ */
+static byte emitJumpCondition(std::vector<byte>& code, byte jumpOpcode, int lhs, int rhs) {
+    switch (jumpOpcode) {
+        case JMPL_OPCODE:  emitCompare(code, rhs, lhs); return JA_OPCODE;
+        case JMPLE_OPCODE: emitCompare(code, rhs, lhs); return JAE_OPCODE;
+        case JMPG_OPCODE:  emitCompare(code, lhs, rhs); return JA_OPCODE;
+        case JMPGE_OPCODE: emitCompare(code, lhs, rhs); return JAE_OPCODE;
+        default:
+            break;
+    }
+
+    assert((jumpOpcode == JMPE_OPCODE) || (jumpOpcode == JMPNE_OPCODE));
+    emitMove(code, SCRATCH_XMM, lhs);
+    emitScalar(code, SUBSD_OPCODE, SCRATCH_XMM, rhs);
+    emitAbs(code, SCRATCH_XMM);
+    emitConstant(code, IMMEDIATE_XMM, COMPARE_EPS);
+    if (jumpOpcode == JMPE_OPCODE) {
+        emitCompare(code, IMMEDIATE_XMM, SCRATCH_XMM);
+        return JA_OPCODE;
+    }
+    emitCompare(code, SCRATCH_XMM, IMMEDIATE_XMM);
+    return JAE_OPCODE;
+}
+
+/**
+ * Emits 64-bit instruction with two general purpose registers in the form "op rm, reg" (e.g. add rm, reg).
+ */
+static void emitInteger(std::vector<byte>& code, byte opcode, int rm, int reg) {
+    emitRex(code, true, reg, rm);
+    code.push_back(opcode);
+    code.push_back(modRm(3, reg, rm));
+}
+
+/**
+ * Emits 64-bit move between general purpose register and [base + displacement]: load into the register
+ * (mov reg, [base + displacement]) or store from it (mov [base + displacement], reg). Base must not be rsp or r12.
+ */
+static void emitMoveMemory(std::vector<byte>& code, byte opcode, int reg, int base, int displacement = 0) {
+    emitRex(code, true, reg, base);
+    code.push_back(opcode);
+    code.push_back(modRm(2, reg, base));
+    emitInt(code, displacement);
+}
+
+/**
+ * Emits loading of the given 64-bit constant into the general purpose register (mov gpr, imm64).
+ */
+static void emitMoveImmediate(std::vector<byte>& code, int gpr, uint64_t value) {
+    emitRex(code, true, 0, gpr);
+    code.push_back((byte)(0xB8 + (gpr & 7)));
+    for (unsigned int i = 0; i < sizeof(value); ++i) {
+        code.push_back((byte)(value >> (8 * i)));
+    }
+}
+
+static void emitPush(std::vector<byte>& code, int gpr) {
+    emitRex(code, false, 0, gpr);
+    code.push_back((byte)(0x50 + (gpr & 7)));
+}
+
+static void emitPop(std::vector<byte>& code, int gpr) {
+    emitRex(code, false, 0, gpr);
+    code.push_back((byte)(0x58 + (gpr & 7)));
+}
+
+static void emitDecrement(std::vector<byte>& code, int gpr) {
+    emitRex(code, true, 0, gpr);
+    code.push_back(0xFF);
+    code.push_back(modRm(3, 1, gpr));
+}
+
+/**
+ * Emits conversion of XMM register to the integer operand in the general purpose register (see toIntegerOperand).
+ * cvttsd2si gives INT64_MIN for NAN and values out of int64 range, so only this result is checked against the bits
+ * of -2^63 (the only value that is converted to INT64_MIN), and it's replaced with 0 otherwise. Rax and rsi are used.
+ */
+static void emitToInteger(std::vector<byte>& code, int gpr, int xmm) {
+    code.push_back(0xF2); // cvttsd2si gpr, xmm
+    emitRex(code, true, gpr, xmm);
+    code.push_back(0x0F);
+    code.push_back(CVTTSD2SI_OPCODE);
+    code.push_back(modRm(3, gpr, xmm));
+
+    // cmp gpr, 1 overflows only for INT64_MIN
+    emitRex(code, true, 0, gpr);
+    code.push_back(0x83);
+    code.push_back(modRm(3, 7, gpr));
+    code.push_back(0x01);
+    code.push_back(0x71); // jno done
+    code.push_back(0);
+    const int checkStart = (int)code.size();
+
+    code.push_back(0x66); // movq rax, xmm
+    emitRex(code, true, xmm, RAX);
+    code.push_back(0x0F);
+    code.push_back(0x7E);
+    code.push_back(modRm(3, xmm, RAX));
+    double minValue = -9223372036854775808.0;
+    uint64_t minBits = 0;
+    memcpy(&minBits, &minValue, sizeof(minBits));
+    emitMoveImmediate(code, RSI, minBits);
+    emitInteger(code, CMP_RM_OPCODE, RAX, RSI);
+    code.push_back(0x74); // je done
+    code.push_back(0);
+    const int zeroStart = (int)code.size();
+    emitRex(code, false, gpr, gpr); // xor gpr32, gpr32
+    code.push_back(0x31);
+    code.push_back(modRm(3, gpr, gpr));
+
+    code[zeroStart - 1] = (byte)((int)code.size() - zeroStart);
+    code[checkStart - 1] = (byte)((int)code.size() - checkStart);
+}
+
+/**
+ * Emits the integer arithmetic operation (see applyIntegerArithmetic) on general purpose registers. Result wraps
+ * around and is stored in lhs.
+ */
+static void emitIntegerArithmetic(std::vector<byte>& code, byte opcode, int lhs, int rhs) {
+    switch (opcode) {
+        case IADD_OPCODE: emitInteger(code, ADD_RM_OPCODE, lhs, rhs); break;
+        case ISUB_OPCODE: emitInteger(code, SUB_RM_OPCODE, lhs, rhs); break;
+        default: // imul lhs, rhs
+            emitRex(code, true, lhs, rhs);
+            code.push_back(0x0F);
+            code.push_back(0xAF);
+            code.push_back(modRm(3, lhs, rhs));
+            break;
+    }
+}
+
+/**
+ * Emits comparison of general purpose registers lhs and rhs for the given integer conditional jump.
+ * @return opcode of the conditional jump that is taken if the condition is met.
+ */
+static byte emitIntegerJumpCondition(std::vector<byte>& code, byte jumpOpcode, int lhs, int rhs) {
+    emitInteger(code, CMP_RM_OPCODE, lhs, rhs);
+    switch (jumpOpcode) {
+        case IJMPE_OPCODE:  return JE_OPCODE;
+        case IJMPNE_OPCODE: return JNE_OPCODE;
+        case IJMPL_OPCODE:  return JL_OPCODE;
+        case IJMPLE_OPCODE: return JLE_OPCODE;
+        case IJMPG_OPCODE:  return JG_OPCODE;
+        default:
+            assert(jumpOpcode == IJMPGE_OPCODE);
+            return JGE_OPCODE;
+    }
+}
+
+/**
+ * Gets the effect of the operation on the operand stack. Effect on the integer stack is given by getIntegerStackEffect.
+ * @param[in]  opcode        operation code
+ * @param[out] poppedNumber  number of values popped by the operation
+ * @param[out] pushedNumber  number of values pushed by the operation
+ * @return true, if the operation can be compiled, false otherwise.
+ */
+static bool getStackEffect(byte opcode, int& poppedNumber, int& pushedNumber) {
+    switch (opcode) {
+        case PUSH_OPCODE: case PUSHR_OPCODE: case PUSHR_PUSHR_MUL_OPCODE:
+            poppedNumber = 0; pushedNumber = 1; return true;
+        case POP_OPCODE: case POPR_OPCODE:
+            poppedNumber = 1; pushedNumber = 0; return true;
+        case ADD_OPCODE: case SUB_OPCODE: case MUL_OPCODE: case DIV_OPCODE:
+            poppedNumber = 2; pushedNumber = 1; return true;
+        case SQRT_OPCODE: case DUP_ADD_OPCODE: case POPR_PUSHR_OPCODE:
+            poppedNumber = 1; pushedNumber = 1; return true;
+        case DUP_OPCODE:
+            poppedNumber = 1; pushedNumber = 2; return true;
+        case ITOF_OPCODE:
+            poppedNumber = 0; pushedNumber = 1; return true;
+        case FTOI_OPCODE:
+            poppedNumber = 1; pushedNumber = 0; return true;
+        case JMP_OPCODE: case IPUSH_OPCODE: case IPUSHR_OPCODE: case IPOP_OPCODE: case IPOPR_OPCODE: case IADD_OPCODE:
+        case ISUB_OPCODE: case IMUL_OPCODE: case IJMPE_OPCODE: case IJMPNE_OPCODE: case IJMPL_OPCODE:
+        case IJMPLE_OPCODE: case IJMPG_OPCODE: case IJMPGE_OPCODE:
+            poppedNumber = 0; pushedNumber = 0; return true;
+        case JMPE_OPCODE: case JMPNE_OPCODE: case JMPL_OPCODE: case JMPLE_OPCODE: case JMPG_OPCODE: case JMPGE_OPCODE:
+            poppedNumber = 2; pushedNumber = 0; return true;
+        default:
+            if (isFusedJumpOperation(opcode)) {
+                poppedNumber = 1; pushedNumber = 0; return true;
+            }
+            return false;
+    }
+}
+
+static int slotXmm(int slot) {
+    assert((slot >= 0) && (slot < STACK_SLOTS_NUMBER));
+    return FIRST_SLOT_XMM + slot;
+}
+
+static int slotGpr(int slot) {
+    assert((slot >= 0) && (slot < INTEGER_SLOTS_NUMBER));
+    return INTEGER_SLOT_GPRS[slot];
+}
+
+/**
+ * Compiles the basic block starting at the given byte offset.
+ * @param[in] offset byte offset of the first operation of the block
+ * @return true, if block was compiled, false otherwise.
+ */
+bool JitStackMachine::compileBlock(int offset) {
+    assert((offset >= 0) && (offset < assemblySize));
+
+    // Select operations of the block, so that all stack values it touches fit into slots
+    std::vector<DecodedOperation> operations;
+    int height = 0, minHeight = 0, maxHeight = 0;
+    int integerHeight = 0, integerMinHeight = 0, integerMaxHeight = 0;
+    int nextOffset = offset;
+    int branchPc = -1;
+    while (nextOffset < assemblySize) {
+        DecodedOperation operation;
+        if (isError(decodeOperation(assembly, assemblySize, nextOffset, operation))) break;
+
+        int poppedNumber = 0, pushedNumber = 0;
+        if (!getStackEffect(operation.opcode, poppedNumber, pushedNumber)) break;
+
+        bool isJump = isJumpOperation(operation.opcode) || isFusedJumpOperation(operation.opcode);
+        // Invalid jump is left for the interpreter to report
+        if (isJump && ((operation.jumpTarget < 0) || (operation.jumpTarget >= assemblySize))) break;
+        // Block left after the conditional jump to the next operation doesn't show if it was taken, so it's outcome
+        // can be logged only by the interpreter
+        bool isConditional = isJump && (operation.opcode != JMP_OPCODE);
+        if (isConditional && (operation.jumpTarget == nextOffset + operation.size)) break;
+
+        int newMinHeight = std::min(minHeight, height - poppedNumber);
+        int newMaxHeight = std::max(maxHeight, height - poppedNumber + pushedNumber);
+        if (newMaxHeight - newMinHeight > STACK_SLOTS_NUMBER) break;
+
+        int integerPoppedNumber = 0, integerPushedNumber = 0;
+        getIntegerStackEffect(operation.opcode, integerPoppedNumber, integerPushedNumber);
+        int newIntegerMinHeight = std::min(integerMinHeight, integerHeight - integerPoppedNumber);
+        int newIntegerMaxHeight = std::max(integerMaxHeight, integerHeight - integerPoppedNumber + integerPushedNumber);
+        if (newIntegerMaxHeight - newIntegerMinHeight > INTEGER_SLOTS_NUMBER) break;
+
+        minHeight = newMinHeight;
+        maxHeight = newMaxHeight;
+        height += pushedNumber - poppedNumber;
+        integerMinHeight = newIntegerMinHeight;
+        integerMaxHeight = newIntegerMaxHeight;
+        integerHeight += integerPushedNumber - integerPoppedNumber;
+        operations.push_back(operation);
+        if (isConditional) branchPc = nextOffset;
+        nextOffset += operation.size;
+        if (isJump) break;
+    }
+    if (operations.empty()) return false;
+
+    const int inputsNumber = -minHeight;
+    const int outputsNumber = inputsNumber + height;
+    const int integerInputsNumber = -integerMinHeight;
+    const int integerOutputsNumber = integerInputsNumber + integerHeight;
+
+    // Pointer to the runs counter is kept in r10 and the counter itself in r11, as rcx is an integer slot.
+    // Pointers to outputs, integer registers and integer values are saved on the stack until the block is left
+    std::vector<byte> nativeCode;
+    for (int gpr : SAVED_GPRS) {
+        emitPush(nativeCode, gpr);
+    }
+    emitPush(nativeCode, RDX);
+    emitPush(nativeCode, R8);
+    emitPush(nativeCode, R9);
+    emitInteger(nativeCode, MOV_RM_OPCODE, R10, RCX);
+    emitMoveMemory(nativeCode, MOV_REG_OPCODE, R11, R10);
+    for (int i = 0; i < (int)REGISTERS_NUMBER; ++i) {
+        emitSseMemory(nativeCode, MOVSD_LOAD_OPCODE, i, RDI, i * (int)sizeof(double));
+    }
+    for (int i = 0; i < inputsNumber; ++i) {
+        emitSseMemory(nativeCode, MOVSD_LOAD_OPCODE, slotXmm(i), RSI, i * (int)sizeof(double));
+    }
+    for (int i = 0; i < (int)REGISTERS_NUMBER; ++i) {
+        emitMoveMemory(nativeCode, MOV_REG_OPCODE, INTEGER_REGISTER_GPRS[i], R8, i * (int)sizeof(int64_t));
+    }
+    for (int i = 0; i < integerInputsNumber; ++i) {
+        emitMoveMemory(nativeCode, MOV_REG_OPCODE, slotGpr(i), R9, i * (int)sizeof(int64_t));
+    }
+    const int bodyPosition = (int)nativeCode.size();
+
+    int depth = inputsNumber;
+    int integerDepth = integerInputsNumber;
+    std::vector<int> exitJumps;
+    std::vector<int> loopJumps;
+    for (const DecodedOperation& operation : operations) {
+        switch (operation.opcode) {
+            case PUSH_OPCODE:
+                emitConstant(nativeCode, slotXmm(depth++), operation.operand);
+                break;
+            case PUSHR_OPCODE:
+                emitMove(nativeCode, slotXmm(depth++), operation.reg);
+                break;
+            case POP_OPCODE:
+                --depth;
+                break;
+            case POPR_OPCODE:
+                emitMove(nativeCode, operation.reg, slotXmm(--depth));
+                break;
+            case ADD_OPCODE: case SUB_OPCODE: case MUL_OPCODE: case DIV_OPCODE: {
+                byte instruction = (operation.opcode == ADD_OPCODE) ? ADDSD_OPCODE :
+                                   (operation.opcode == SUB_OPCODE) ? SUBSD_OPCODE :
+                                   (operation.opcode == MUL_OPCODE) ? MULSD_OPCODE : DIVSD_OPCODE;
+                emitScalar(nativeCode, instruction, slotXmm(depth - 2), slotXmm(depth - 1));
+                --depth;
+                break;
+            }
+            case IPUSH_OPCODE:
+                emitMoveImmediate(nativeCode, slotGpr(integerDepth++), (uint64_t)operation.integerOperand);
+                break;
+            case IPUSHR_OPCODE:
+                emitInteger(nativeCode, MOV_RM_OPCODE, slotGpr(integerDepth++), INTEGER_REGISTER_GPRS[operation.reg]);
+                break;
+            case IPOP_OPCODE:
+                --integerDepth;
+                break;
+            case IPOPR_OPCODE:
+                emitInteger(nativeCode, MOV_RM_OPCODE, INTEGER_REGISTER_GPRS[operation.reg], slotGpr(--integerDepth));
+                break;
+            case ITOF_OPCODE:
+                nativeCode.push_back(0xF2); // cvtsi2sd xmm, gpr
+                emitRex(nativeCode, true, slotXmm(depth), slotGpr(integerDepth - 1));
+                nativeCode.push_back(0x0F);
+                nativeCode.push_back(CVTSI2SD_OPCODE);
+                nativeCode.push_back(modRm(3, slotXmm(depth), slotGpr(integerDepth - 1)));
+                ++depth;
+                --integerDepth;
+                break;
+            case FTOI_OPCODE:
+                emitToInteger(nativeCode, slotGpr(integerDepth), slotXmm(depth - 1));
+                --depth;
+                ++integerDepth;
+                break;
+            case IADD_OPCODE: case ISUB_OPCODE: case IMUL_OPCODE:
+                emitIntegerArithmetic(nativeCode, operation.opcode, slotGpr(integerDepth - 2),
+                                      slotGpr(integerDepth - 1));
+                --integerDepth;
+                break;
+            case SQRT_OPCODE:
+                emitScalar(nativeCode, SQRTSD_OPCODE, slotXmm(depth - 1), slotXmm(depth - 1));
+                break;
+            case DUP_OPCODE:
+                emitMove(nativeCode, slotXmm(depth), slotXmm(depth - 1));
+                ++depth;
+                break;
+            case PUSHR_PUSHR_MUL_OPCODE:
+                emitMove(nativeCode, slotXmm(depth), operation.reg);
+                emitScalar(nativeCode, MULSD_OPCODE, slotXmm(depth), operation.reg2);
+                ++depth;
+                break;
+            case DUP_ADD_OPCODE:
+                emitScalar(nativeCode, ADDSD_OPCODE, slotXmm(depth - 1), slotXmm(depth - 1));
+                break;
+            case POPR_PUSHR_OPCODE:
+                emitMove(nativeCode, operation.reg, slotXmm(depth - 1));
+                break;
+            default: {
+                assert(isJumpOperation(operation.opcode) || isFusedJumpOperation(operation.opcode));
+
+                byte condition = 0;
+                if (isFusedJumpOperation(operation.opcode)) {
+                    emitConstant(nativeCode, IMMEDIATE_XMM, operation.operand);
+                    --depth;
+                    condition = emitJumpCondition(nativeCode, getFusedJumpOpcode(operation.opcode), slotXmm(depth),
+                                                  IMMEDIATE_XMM);
+                } else if (isIntegerJumpOperation(operation.opcode)) {
+                    integerDepth -= 2;
+                    condition = emitIntegerJumpCondition(nativeCode, operation.opcode, slotGpr(integerDepth),
+                                                         slotGpr(integerDepth + 1));
+                } else if (operation.opcode != JMP_OPCODE) {
+                    depth -= 2;
+                    condition = emitJumpCondition(nativeCode, operation.opcode, slotXmm(depth), slotXmm(depth + 1));
+                }
+
+                // Jump to the beginning of the block with the same layout of stacks stays in native code, while runs
+                // are left
+                if ((operation.jumpTarget == offset) && (outputsNumber == inputsNumber) &&
+                    (integerOutputsNumber == integerInputsNumber)) {
+                    loopJumps.push_back(emitJump(nativeCode, condition));
+                } else {
+                    emitMoveEax(nativeCode, operation.jumpTarget);
+                    exitJumps.push_back(emitJump(nativeCode, condition));
+                }
+                break;
+            }
+        }
+    }
+    assert(depth == outputsNumber);
+    assert(integerDepth == integerOutputsNumber);
+
+    // Block is left at the operation after it's last operation (fallthrough of the ending jump)
+    emitMoveEax(nativeCode, nextOffset);
+    for (int exitJump : exitJumps) {
+        patchJump(nativeCode, exitJump, (int)nativeCode.size());
+    }
+    emitDecrement(nativeCode, R11);
+    const int storePosition = (int)nativeCode.size();
+    emitMoveMemory(nativeCode, MOV_RM_OPCODE, R11, R10);
+    for (int i = 0; i < (int)REGISTERS_NUMBER; ++i) {
+        emitSseMemory(nativeCode, MOVSD_STORE_OPCODE, i, RDI, i * (int)sizeof(double));
+    }
+    // Eax holds the byte offset to continue with, so saved pointers are popped into rsi
+    emitPop(nativeCode, RSI);
+    for (int i = 0; i < integerOutputsNumber; ++i) {
+        emitMoveMemory(nativeCode, MOV_RM_OPCODE, slotGpr(i), RSI, i * (int)sizeof(int64_t));
+    }
+    emitPop(nativeCode, RSI);
+    for (int i = 0; i < (int)REGISTERS_NUMBER; ++i) {
+        emitMoveMemory(nativeCode, MOV_RM_OPCODE, INTEGER_REGISTER_GPRS[i], RSI, i * (int)sizeof(int64_t));
+    }
+    emitPop(nativeCode, RSI);
+    for (int i = 0; i < outputsNumber; ++i) {
+        emitSseMemory(nativeCode, MOVSD_STORE_OPCODE, slotXmm(i), RSI, i * (int)sizeof(double));
+    }
+    for (int i = (int)(sizeof(SAVED_GPRS) / sizeof(SAVED_GPRS[0])) - 1; i >= 0; --i) {
+        emitPop(nativeCode, SAVED_GPRS[i]);
+    }
+    nativeCode.push_back(0xC3); // ret
+
+    // Taken jump to the beginning accounts the finished run, and the block is left at it's beginning if no runs are left
+    if (!loopJumps.empty()) {
+        for (int loopJump : loopJumps) {
+            patchJump(nativeCode, loopJump, (int)nativeCode.size());
+        }
+        emitDecrement(nativeCode, R11);
+        patchJump(nativeCode, emitJump(nativeCode, JNE_OPCODE), bodyPosition);
+        emitMoveEax(nativeCode, offset);
+        patchJump(nativeCode, emitJump(nativeCode, 0), storePosition);
+    }
+
+    const byte* installed = installCode(nativeCode);
+    if (installed == nullptr) return false;
+
+    CompiledBlock block {};
+    block.function = reinterpret_cast<CompiledFunction>(const_cast<byte*>(installed));
+    block.inputsNumber = inputsNumber;
+    block.outputsNumber = outputsNumber;
+    block.integerInputsNumber = integerInputsNumber;
+    block.integerOutputsNumber = integerOutputsNumber;
+    block.operationsNumber = (int)operations.size();
+    block.branchPc = branchPc;
+    block.branchTarget = operations.back().jumpTarget;
+    blockIndexByOffset[offset] = (int)blocks.size();
+    blocks.push_back(block);
+    return true;
+}
+
+#else
+
+/**
+ * Native code generation is supported only on x86-64, so blocks are never compiled.
+ * @param[in] offset byte offset of the first operation of the block
+ * @return false.
+ */
+bool JitStackMachine::compileBlock(int offset) {
+    (void)offset;
+    return false;
+}
+
+#endif
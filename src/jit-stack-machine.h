@@ -0,0 +1,188 @@
+/**
+ * @file
+ * @brief Declaration of stack machine that compiles hot basic blocks to native x86-64 code.
+ */
+#ifndef STACK_MACHINE_JIT_STACK_MACHINE_H
+#define STACK_MACHINE_JIT_STACK_MACHINE_H
+
+#include <vector>
+#include "stack-machine.h"
+
+#ifndef JIT_HOT_THRESHOLD
+/**
+ * Number of taken jumps to the same destination after which the basic block starting there is compiled.
+ */
+#define JIT_HOT_THRESHOLD 64u
+#endif
+
+/**
+ * Stack machine that profiles destinations of taken jumps and compiles hot basic blocks to native SSE2 code.
+ *
+ * Compiled block consists of arithmetic, register and stack operations (PUSH, POP, ADD, SUB, MUL, DIV, SQRT, DUP
+ * and their fused forms, integer operations) and ends with a jump or before the first operation that can't be compiled
+ * (IN, OUT, CALL, RET, RAM access, etc). Registers AX..DX are kept in XMM0..XMM3, and values that block pushes or pops
+ * are kept in XMM4..XMM13 while the block runs. Integer registers IAX..IDX are kept in R12..R15, and integer stack
+ * values in six other general purpose registers, so integer loops run without conversions to double. Block that ends
+ * with a jump to it's own beginning loops in native code, counting it's runs, so that the budget of the execution
+ * is charged exactly.
+ *
+ * Compiled blocks have no error paths: block is entered only if the operand and integer stacks have enough values,
+ * otherwise the operation is processed by the interpreter. Therefore behaviour is identical to StackMachine.
+ * Outcomes of the conditional jump the block ends with are logged, when the block is left (see runBlock).
+ * On platforms other than x86-64 nothing is compiled.
+ */
+class JitStackMachine : public StackMachine {
+
+private:
+    /**
+     * Signature of the compiled block.
+     * @param[in, out] registers values of registers AX..DX
+     * @param[in]      inputs    values that block pops from the operand stack (the deepest first)
+     * @param[out]     outputs   values that block leaves on the operand stack (the deepest first)
+     * @param[in, out] runs      maximal number of runs of the block (at least 1), decreased by the number of runs made.
+     *                           Block that loops in native code leaves the loop when no runs are left
+     * @param[in, out] integerRegisters values of integer registers IAX..IDX
+     * @param[in, out] integerValues    values that block pops from the integer stack (the deepest first), replaced with
+     *                                  values that it leaves on the integer stack
+     * @return byte offset of the operation to continue with.
+     */
+    using CompiledFunction = int (*)(double* registers, const double* inputs, double* outputs,
+                                     unsigned long long* runs, int64_t* integerRegisters, int64_t* integerValues);
+
+    struct CompiledBlock {
+        CompiledFunction function;
+        /** Number of values popped from the operand stack before the block starts */
+        int inputsNumber;
+        /** Number of values pushed to the operand stack after the block finishes */
+        int outputsNumber;
+        /** Number of values popped from the integer stack before the block starts */
+        int integerInputsNumber;
+        /** Number of values pushed to the integer stack after the block finishes */
+        int integerOutputsNumber;
+        /** Number of operations the block is compiled from. Each run of the block executes all of them */
+        int operationsNumber;
+        /** Byte offset of the conditional jump the block ends with, or -1 if it doesn't end with one */
+        int branchPc;
+        /** Byte offset the conditional jump the block ends with jumps to */
+        int branchTarget;
+    };
+
+    /** Index of the compiled block by the byte offset of it's first operation, or -1 if there is no such block */
+    std::vector<int> blockIndexByOffset;
+
+    std::vector<CompiledBlock> blocks;
+
+    /** Number of taken jumps to each byte offset. Reset after compilation attempt */
+    std::vector<unsigned int> jumpsNumberByOffset;
+
+    /** Shows if compilation of the block starting at the byte offset was already attempted */
+    std::vector<bool> isCompilationAttempted;
+
+    /** Executable memory region with the native code of compiled blocks */
+    unsigned char* code = nullptr;
+    /** Size of the code region in bytes */
+    size_t codeCapacity = 0;
+    /** Number of bytes used in the code region */
+    size_t codeSize = 0;
+
+    const unsigned int hotThreshold;
+
+    /**
+     * Accounts the taken jump to the given byte offset. Compiles the block starting there, if it becomes hot.
+     * @param[in] offset byte offset of the jump destination
+     */
+    void profileJump(int offset);
+
+    /**
+     * Compiles the basic block starting at the given byte offset.
+     * @param[in] offset byte offset of the first operation of the block
+     * @return true, if block was compiled, false otherwise.
+     */
+    bool compileBlock(int offset);
+
+    /**
+     * Copies the given native code into the executable code region.
+     * @param[in] nativeCode native code to copy
+     * @return address of the copied code, or nullptr if there is no space left.
+     */
+    const unsigned char* installCode(const std::vector<unsigned char>& nativeCode);
+
+    /**
+     * Runs the compiled block starting at the current pc. If the branch log is set, outcomes of the conditional jump
+     * the block ends with are logged after it: every run but the last one jumped to the beginning of the block, and the
+     * last one jumped, if the block was left at the jump destination.
+     * @param[in]      block block to run
+     * @param[in, out] runs  maximal number of runs of the block (at least 1), replaced with the number of runs made
+     * @return true, if block was run, false if there is not enough values on the operand or integer stack for it.
+     */
+    bool runBlock(const CompiledBlock& block, unsigned long long& runs);
+
+    /**
+     * Executes operations like execute() does, checking the budget. Compiled blocks are run only as many times
+     * as the rest of the budget allows, and the time limit is checked every TIME_CHECK_INTERVAL operations.
+     * @return the same as execute().
+     */
+    unsigned char executeBudgeted();
+
+    /**
+     * Allocates profiling data for the loaded assembly.
+     */
+    void initProfile();
+
+public:
+    /**
+     * Loads the given assembly file.
+     * @param[in] assemblyFileName assembly file name
+     * @param[in] hotThreshold     number of taken jumps to the same destination after which the block is compiled
+     */
+    explicit JitStackMachine(const char* assemblyFileName, unsigned int hotThreshold = JIT_HOT_THRESHOLD);
+
+    /**
+     * Uses the given image of the assembly file.
+     * @param[in] image        image of the assembly file, or nullptr if the file is invalid
+     * @param[in] hotThreshold number of taken jumps to the same destination after which the block is compiled
+     */
+    explicit JitStackMachine(std::shared_ptr<const BytecodeImage> image, unsigned int hotThreshold = JIT_HOT_THRESHOLD);
+
+    ~JitStackMachine();
+
+    JitStackMachine(JitStackMachine& stackMachine) = delete;
+    JitStackMachine &operator=(const JitStackMachine&) = delete;
+
+    /**
+     * Gets the number of compiled blocks.
+     * @return number of compiled blocks.
+     */
+    int getCompiledBlocksNumber() const {
+        return (int)blocks.size();
+    }
+
+    /**
+     * Processes the jump operation and profiles it's destination, if jump is taken.
+     * @param[in] opcode     code of the jump operation to process
+     * @param[in] jumpOffset offset of the jump to process
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+     */
+    unsigned char processJumpOperation(unsigned char opcode, int jumpOffset) override;
+
+    /**
+     * Processes the fused operation and profiles the destination of the fused jump, if it is taken.
+     * @param[in] opcode code of the fused operation to process
+     * @return given operation code, if operation processed successfully, or error code otherwise.
+     */
+    unsigned char processFusedOperation(unsigned char opcode) override;
+
+    /**
+     * Executes operations starting from the current pc until HLT operation or an error is met.
+     * Compiled blocks are run instead of the operations they were compiled from.
+     * If stats are counted (see isCounted), the program is executed by StackMachine::execute.
+     * @return HLT_OPCODE, if program finished successfully;
+     *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+     *         error code of the failed operation otherwise.
+     */
+    unsigned char execute() override;
+};
+
+#endif // STACK_MACHINE_JIT_STACK_MACHINE_H
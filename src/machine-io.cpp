@@ -0,0 +1,334 @@
+/**
+ * @file
+ * @brief Implementation of input and output of values for IN and OUT operations of the stack machine.
+ */
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "execution-trace.h"
+#include "machine-io.h"
+
+/** Maximal length of the text value that is parsed with strtod, when it doesn't fit the fast path */
+static constexpr size_t MAX_SLOW_TEXT_VALUE_LENGTH = 511;
+
+/** Maximal length of the formatted text value with the line break */
+static constexpr size_t MAX_FORMATTED_VALUE_LENGTH = 64;
+
+/** Powers of 10 that are exactly representable as double */
+static const double exactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool isSpace(char c) {
+    return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+static bool isDigit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+/**
+ * Parses the text value with strtod.
+ * @param[in] begin beginning of the text value
+ * @param[in] end   end of the text value
+ * @return parsed value, or NAN if text is not a number.
+ */
+static double parseDoubleSlow(const char* begin, const char* end) {
+    char text[MAX_SLOW_TEXT_VALUE_LENGTH + 1] = "";
+    size_t length = (size_t)(end - begin);
+    if (length > MAX_SLOW_TEXT_VALUE_LENGTH) length = MAX_SLOW_TEXT_VALUE_LENGTH;
+    memcpy(text, begin, length);
+
+    char* parsedEnd = nullptr;
+    double value = strtod(text, &parsedEnd);
+    return (parsedEnd == text) ? NAN : value;
+}
+
+/**
+ * Parses the text value. Decimal values with at most 15 significant digits and small exponent are parsed
+ * without strtod and locale (result is still correctly rounded), other values are passed to strtod.
+ * @param[in] begin beginning of the text value
+ * @param[in] end   end of the text value
+ * @return parsed value, or NAN if text is not a number.
+ */
+static double parseDouble(const char* begin, const char* end) {
+    assert(begin != nullptr);
+    assert(end != nullptr);
+
+    const char* current = begin;
+    bool isNegative = false;
+    if ((current != end) && ((*current == '-') || (*current == '+'))) isNegative = (*current++ == '-');
+
+    uint64_t mantissa = 0;
+    int significantDigitsNumber = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    for (; (current != end) && isDigit(*current); ++current) {
+        mantissa = mantissa * 10 + (uint64_t)(*current - '0');
+        if (mantissa != 0) ++significantDigitsNumber;
+        hasDigits = true;
+        if (significantDigitsNumber > 15) return parseDoubleSlow(begin, end);
+    }
+    if ((current != end) && (*current == '.')) {
+        for (++current; (current != end) && isDigit(*current); ++current) {
+            mantissa = mantissa * 10 + (uint64_t)(*current - '0');
+            if (mantissa != 0) ++significantDigitsNumber;
+            --exponent;
+            hasDigits = true;
+            if (significantDigitsNumber > 15) return parseDoubleSlow(begin, end);
+        }
+    }
+    if (!hasDigits) return parseDoubleSlow(begin, end);
+
+    if ((current != end) && ((*current == 'e') || (*current == 'E'))) {
+        ++current;
+        bool isExponentNegative = false;
+        if ((current != end) && ((*current == '-') || (*current == '+'))) isExponentNegative = (*current++ == '-');
+        if ((current == end) || !isDigit(*current)) return parseDoubleSlow(begin, end);
+
+        int exponentValue = 0;
+        for (; (current != end) && isDigit(*current); ++current) {
+            exponentValue = exponentValue * 10 + (*current - '0');
+            if (exponentValue > 1000) return parseDoubleSlow(begin, end);
+        }
+        exponent += isExponentNegative ? -exponentValue : exponentValue;
+    }
+    if (current != end) return parseDoubleSlow(begin, end);
+    if ((exponent < -22) || (exponent > 22)) return parseDoubleSlow(begin, end);
+
+    // Mantissa and power of 10 are both exact, so the single multiplication or division is rounded correctly
+    double value = (double)mantissa;
+    value = (exponent < 0) ? value / exactPowersOf10[-exponent] : value * exactPowersOf10[exponent];
+    return isNegative ? -value : value;
+}
+
+/**
+ * Formats the value followed by the line break, the same way as "%lg\n" format does.
+ * Integral values with at most 6 digits (that "%lg" prints without exponent and point) are formatted without snprintf.
+ * @param[out] destination buffer with at least MAX_FORMATTED_VALUE_LENGTH bytes
+ * @param[in]  value       value to format
+ * @return number of written characters.
+ */
+static size_t formatDouble(char* destination, double value) {
+    assert(destination != nullptr);
+
+    if (!((value > -1e6) && (value < 1e6)) || std::islessgreater(value, (double)(int)value)) {
+        return (size_t)snprintf(destination, MAX_FORMATTED_VALUE_LENGTH, "%lg\n", value);
+    }
+
+    char digits[8] = "";
+    int digitsNumber = 0;
+    int integer = (int)value;
+    unsigned int absolute = (integer < 0) ? (unsigned int)-integer : (unsigned int)integer;
+    do {
+        digits[digitsNumber++] = (char)('0' + absolute % 10);
+        absolute /= 10;
+    } while (absolute != 0);
+
+    size_t length = 0;
+    if (std::signbit(value)) destination[length++] = '-';
+    while (digitsNumber != 0) destination[length++] = digits[--digitsNumber];
+    destination[length++] = '\n';
+    return length;
+}
+
+static uint64_t toLittleEndian(uint64_t value) {
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return __builtin_bswap64(value);
+    #else
+        return value;
+    #endif
+}
+
+MachineIO::~MachineIO() {
+    flush();
+}
+
+/**
+ * Sets the mode and streams. Buffered output of the previous mode is flushed, unread buffered input is dropped.
+ * @param[in] ioMode      I/O mode
+ * @param[in] inputFile   file with IN values
+ * @param[in] outputFile  file for OUT values
+ */
+void MachineIO::setMode(IOMode ioMode, FILE* inputFile, FILE* outputFile) {
+    assert(inputFile != nullptr);
+    assert(outputFile != nullptr);
+
+    flush();
+
+    mode = ioMode;
+    input = inputFile;
+    output = outputFile;
+    inputPosition = 0;
+    inputSize = 0;
+    inputValues = nullptr;
+    outputValues = nullptr;
+    if ((mode != INTERACTIVE_IO) && inputBuffer.empty()) {
+        inputBuffer.resize(IO_BUFFER_SIZE);
+        outputBuffer.resize(IO_BUFFER_SIZE);
+    }
+}
+
+/**
+ * Sets the memory mode: IN values are taken from the given array, OUT values are appended to the given vector.
+ * Buffered output of the previous mode is flushed. Array and vector must live until another mode is set.
+ * @param[in]  values       IN values
+ * @param[in]  valuesNumber number of IN values
+ * @param[out] outputs      vector for OUT values
+ */
+void MachineIO::setMemory(const double* values, size_t valuesNumber, std::vector<double>* outputs) {
+    assert((values != nullptr) || (valuesNumber == 0));
+    assert(outputs != nullptr);
+
+    flush();
+
+    mode = MEMORY_IO;
+    inputValues = values;
+    inputValuesNumber = valuesNumber;
+    inputValuesPosition = 0;
+    outputValues = outputs;
+}
+
+/**
+ * Refills the input buffer, keeping unread bytes at it's beginning.
+ * @return true, if at least one byte was read, false if the end of input is reached.
+ */
+bool MachineIO::fillInputBuffer() {
+    assert(inputPosition <= inputSize);
+
+    if (inputPosition != 0) {
+        memmove(inputBuffer.data(), inputBuffer.data() + inputPosition, inputSize - inputPosition);
+        inputSize -= inputPosition;
+        inputPosition = 0;
+    }
+    if (inputSize == inputBuffer.size()) return false;
+
+    size_t readSize = fread(inputBuffer.data() + inputSize, 1, inputBuffer.size() - inputSize, input);
+    inputSize += readSize;
+    return readSize != 0;
+}
+
+/**
+ * Reads the next text value from the input buffer.
+ * @return read value, or NAN if there are no values left or value is invalid.
+ */
+double MachineIO::readText() {
+    while (true) {
+        if ((inputPosition == inputSize) && !fillInputBuffer()) return NAN;
+        if (!isSpace(inputBuffer[inputPosition])) break;
+        ++inputPosition;
+    }
+
+    size_t end = inputPosition;
+    while (true) {
+        if (end == inputSize) {
+            size_t shift = inputPosition;
+            if (!fillInputBuffer()) break;
+            end -= shift;
+        }
+        if (isSpace(inputBuffer[end])) break;
+        ++end;
+    }
+
+    double value = parseDouble(inputBuffer.data() + inputPosition, inputBuffer.data() + end);
+    inputPosition = end;
+    return value;
+}
+
+/**
+ * Reads the next binary value from the input buffer.
+ * @return read value, or NAN if there are no values left.
+ */
+double MachineIO::readBinary() {
+    uint64_t bits = 0;
+    while (inputSize - inputPosition < sizeof(bits)) {
+        if (!fillInputBuffer()) return NAN;
+    }
+
+    memcpy(&bits, inputBuffer.data() + inputPosition, sizeof(bits));
+    inputPosition += sizeof(bits);
+    bits = toLittleEndian(bits);
+
+    double value = NAN;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Reads the value in the current mode.
+ * @return read value, or NAN if there are no values left or value is invalid.
+ */
+double MachineIO::readValue() {
+    switch (mode) {
+        case TEXT_IO:
+            return readText();
+        case BINARY_IO:
+            return readBinary();
+        case MEMORY_IO:
+            return (inputValuesPosition < inputValuesNumber) ? inputValues[inputValuesPosition++] : NAN;
+        case INTERACTIVE_IO:
+        default: {
+            double value = NAN;
+            fprintf(output, "> ");
+            fscanf(input, "%lg", &value);
+            return value;
+        }
+    }
+}
+
+/**
+ * Reads the value for IN operation.
+ * @return read value, or NAN if there are no values left or value is invalid.
+ */
+double MachineIO::read() {
+    double value = readValue();
+    if (trace != nullptr) trace->recordInput(value);
+    return value;
+}
+
+/**
+ * Writes the value of OUT operation.
+ * @param[in] value value to write
+ */
+void MachineIO::write(double value) {
+    if (trace != nullptr) trace->recordOutput(value);
+
+    switch (mode) {
+        case TEXT_IO:
+            if (outputBuffer.size() - outputSize < MAX_FORMATTED_VALUE_LENGTH) flush();
+            outputSize += formatDouble(outputBuffer.data() + outputSize, value);
+            break;
+        case BINARY_IO: {
+            uint64_t bits = 0;
+            memcpy(&bits, &value, sizeof(bits));
+            bits = toLittleEndian(bits);
+
+            if (outputBuffer.size() - outputSize < sizeof(bits)) flush();
+            memcpy(outputBuffer.data() + outputSize, &bits, sizeof(bits));
+            outputSize += sizeof(bits);
+            break;
+        }
+        case MEMORY_IO:
+            outputValues->push_back(value);
+            break;
+        case INTERACTIVE_IO:
+        default:
+            fprintf(output, "%lg\n", value);
+            break;
+    }
+}
+
+/**
+ * Writes the buffered output to the output file.
+ */
+void MachineIO::flush() {
+    if (mode == MEMORY_IO) return;
+
+    if (outputSize != 0) fwrite(outputBuffer.data(), 1, outputSize, output);
+    outputSize = 0;
+    fflush(output);
+}
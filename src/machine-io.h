@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @brief Declaration of input and output of values for IN and OUT operations of the stack machine.
+ */
+#ifndef STACK_MACHINE_MACHINE_IO_H
+#define STACK_MACHINE_MACHINE_IO_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#ifndef IO_BUFFER_SIZE
+    /** Size of input and output buffers of the non-interactive I/O modes in bytes */
+    #define IO_BUFFER_SIZE (1u << 16u)
+#endif
+
+class TraceWriter;
+
+/**
+ * Modes of the IN and OUT operations.
+ */
+enum IOMode {
+    INTERACTIVE_IO = 1, /**< Prompt before each IN, values are read with scanf and written with printf (default) */
+    TEXT_IO        = 2, /**< No prompt, text values are read and written through large buffers */
+    BINARY_IO      = 3, /**< Values are read and written as raw little-endian doubles through large buffers */
+    MEMORY_IO      = 4, /**< Values are read from the array and appended to the vector (see MachineIO::setMemory) */
+};
+
+/**
+ * Source of IN values and destination of OUT values of the stack machine.
+ * Values that can't be read (end of input, invalid text) are read as NAN.
+ */
+class MachineIO {
+
+private:
+    IOMode mode = INTERACTIVE_IO;
+    FILE* input = stdin;
+    FILE* output = stdout;
+
+    /** Buffers of the non-interactive modes. Allocated when such mode is set */
+    std::vector<char> inputBuffer;
+    size_t inputPosition = 0;
+    size_t inputSize = 0;
+
+    std::vector<char> outputBuffer;
+    size_t outputSize = 0;
+
+    /** Values of the memory mode */
+    const double* inputValues = nullptr;
+    size_t inputValuesNumber = 0;
+    size_t inputValuesPosition = 0;
+    std::vector<double>* outputValues = nullptr;
+
+    /** Trace IN and OUT values are recorded into, or nullptr */
+    TraceWriter* trace = nullptr;
+
+    /**
+     * Refills the input buffer, keeping unread bytes at it's beginning.
+     * @return true, if at least one byte was read, false if the end of input is reached.
+     */
+    bool fillInputBuffer();
+
+    /**
+     * Reads the next text value from the input buffer.
+     * @return read value, or NAN if there are no values left or value is invalid.
+     */
+    double readText();
+
+    /**
+     * Reads the next binary value from the input buffer.
+     * @return read value, or NAN if there are no values left.
+     */
+    double readBinary();
+
+    /**
+     * Reads the value in the current mode.
+     * @return read value, or NAN if there are no values left or value is invalid.
+     */
+    double readValue();
+
+public:
+    MachineIO() = default;
+
+    /**
+     * Flushes the buffered output.
+     */
+    ~MachineIO();
+
+    MachineIO(MachineIO& io) = delete;
+    MachineIO &operator=(const MachineIO&) = delete;
+
+    /**
+     * Sets the mode and streams. Buffered output of the previous mode is flushed, unread buffered input is dropped.
+     * @param[in] ioMode      I/O mode
+     * @param[in] inputFile   file with IN values
+     * @param[in] outputFile  file for OUT values
+     */
+    void setMode(IOMode ioMode, FILE* inputFile, FILE* outputFile);
+
+    /**
+     * Sets the memory mode: IN values are taken from the given array, OUT values are appended to the given vector.
+     * Buffered output of the previous mode is flushed. Array and vector must live until another mode is set.
+     * @param[in]  values       IN values
+     * @param[in]  valuesNumber number of IN values
+     * @param[out] outputs      vector for OUT values
+     */
+    void setMemory(const double* values, size_t valuesNumber, std::vector<double>* outputs);
+
+    IOMode getMode() const {
+        return mode;
+    }
+
+    /**
+     * Sets the trace every following IN and OUT value is recorded into. Trace is kept, when the mode is changed.
+     * @param[in] traceWriter open trace writer, that lives until another trace is set, or nullptr to stop recording
+     */
+    void setTrace(TraceWriter* traceWriter) {
+        trace = traceWriter;
+    }
+
+    /**
+     * Reads the value for IN operation.
+     * @return read value, or NAN if there are no values left or value is invalid.
+     */
+    double read();
+
+    /**
+     * Writes the value of OUT operation.
+     * @param[in] value value to write
+     */
+    void write(double value);
+
+    /**
+     * Writes the buffered output to the output file.
+     */
+    void flush();
+};
+
+#endif // STACK_MACHINE_MACHINE_IO_H
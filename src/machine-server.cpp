@@ -0,0 +1,704 @@
+/**
+ * @file
+ * @brief Implementation of the server that keeps programs resident and runs them on requests received over a socket.
+ */
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "machine-server.h"
+#include "threaded-stack-machine.h"
+#include "jit-stack-machine.h"
+
+/** Maximal number of bytes read from one connection at a time, so busy connections don't delay other ones */
+static constexpr size_t MAX_RECEIVE_SIZE = 1u << 20u;
+
+/** Number of pending response bytes, after which the connection is not read until the peer reads them */
+static constexpr size_t MAX_PENDING_OUTPUT = 1u << 20u;
+
+/** Number of queued and running requests of one connection, after which it's requests are not queued */
+static constexpr size_t MAX_PENDING_REQUESTS = 256;
+
+/** Maximal number of events handled by one wait */
+static constexpr int MAX_EVENTS = 64;
+
+/** Maximal length of the line of the programs file */
+static constexpr size_t MAX_PROGRAMS_LINE_LENGTH = 512;
+
+static uint64_t toLittleEndian(uint64_t value) {
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return __builtin_bswap64(value);
+    #else
+        return value;
+    #endif
+}
+
+static uint32_t toLittleEndian(uint32_t value) {
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return __builtin_bswap32(value);
+    #else
+        return value;
+    #endif
+}
+
+static uint32_t readUint32(const char* data) {
+    uint32_t value = 0;
+    memcpy(&value, data, sizeof(value));
+    return toLittleEndian(value);
+}
+
+static void appendUint32(std::vector<char>& buffer, uint32_t value) {
+    value = toLittleEndian(value);
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+/**
+ * Creates the machine of the given engine that runs the given image.
+ * @param[in] engine execution engine
+ * @param[in] image  image of the assembly file
+ * @return created machine.
+ */
+static std::unique_ptr<StackMachine> createMachine(ExecutionEngine engine,
+                                                   const std::shared_ptr<const BytecodeImage>& image) {
+    switch (engine) {
+        case THREADED_ENGINE:    return std::unique_ptr<StackMachine>(new ThreadedStackMachine(image, false));
+        case TOS_CACHING_ENGINE: return std::unique_ptr<StackMachine>(new ThreadedStackMachine(image, true));
+        case JIT_ENGINE:         return std::unique_ptr<StackMachine>(new JitStackMachine(image));
+        case REFERENCE_ENGINE:
+        default:                 return std::unique_ptr<StackMachine>(new StackMachine(image));
+    }
+}
+
+/**
+ * Appends the encoded response to the buffer.
+ * @param[in, out] buffer       buffer to append to
+ * @param[in]      status       status of the request
+ * @param[in]      outputValues OUT values of the request
+ */
+static void appendResponse(std::vector<char>& buffer, int status, const std::vector<double>& outputValues) {
+    appendUint32(buffer, (uint32_t)status);
+    appendUint32(buffer, (uint32_t)outputValues.size());
+    for (double value : outputValues) {
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+        bits = toLittleEndian(bits);
+        const char* bytes = reinterpret_cast<const char*>(&bits);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(bits));
+    }
+}
+
+/**
+ * Registers the event in epoll for reading.
+ * @param[in] epollFd epoll instance
+ * @param[in] fd      event to register
+ */
+static void addReadEvent(int epollFd, int fd) {
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/**
+ * Creates the server with the given execution options of every request and starts it's workers. I/O options
+ * are ignored: IN values are taken from the request, OUT values are sent in the response.
+ * @param[in] runOptions    execution options
+ * @param[in] workersNumber number of threads that run requests, or 0 to use the number of hardware threads
+ */
+MachineServer::MachineServer(const RunOptions& runOptions, unsigned int workersNumber) : options(runOptions) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    answeredFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((epollFd >= 0) && (stopFd >= 0) && (answeredFd >= 0)) {
+        addReadEvent(epollFd, stopFd);
+        addReadEvent(epollFd, answeredFd);
+    }
+
+    if (workersNumber == 0) workersNumber = std::thread::hardware_concurrency();
+    if (workersNumber == 0) workersNumber = 1;
+    for (unsigned int i = 0; i < workersNumber; ++i) {
+        workers.emplace_back(&MachineServer::runWorker, this);
+    }
+}
+
+/**
+ * Stops the workers, waiting for the running requests, and closes all connections and sockets.
+ */
+MachineServer::~MachineServer() {
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex);
+        isStopping = true;
+    }
+    requestsCondition.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& connection : connections) {
+        close(connection.first);
+    }
+    if (listenFd >= 0) close(listenFd);
+    if (!socketPath.empty()) unlink(socketPath.c_str());
+    if (answeredFd >= 0) close(answeredFd);
+    if (stopFd >= 0) close(stopFd);
+    if (epollFd >= 0) close(epollFd);
+}
+
+/**
+ * Loads the program. Programs are identified by the order they were added in, starting from 0.
+ * @param[in] assemblyFileName assembly file name
+ * @return 0, if program was loaded, or ERR_INVALID_FILE, if the file is invalid.
+ */
+int MachineServer::addProgram(const char* assemblyFileName) {
+    assert(assemblyFileName != nullptr);
+
+    Program program;
+    program.image = BytecodeImage::load(assemblyFileName);
+    if (program.image == nullptr) return ERR_INVALID_FILE;
+
+    programs.push_back(std::move(program));
+    return 0;
+}
+
+/**
+ * Takes an idle machine of the program, or creates a new one, if there is no idle machine.
+ * @param[in] program program to run
+ * @return machine, that is ready to run the program.
+ */
+std::unique_ptr<StackMachine> MachineServer::acquireMachine(Program& program) {
+    std::unique_ptr<StackMachine> machine;
+    {
+        std::lock_guard<std::mutex> lock(machinesMutex);
+        if (!program.idleMachines.empty()) {
+            machine = std::move(program.idleMachines.back());
+            program.idleMachines.pop_back();
+        }
+    }
+
+    if (machine != nullptr) {
+        machine->reset();
+        return machine;
+    }
+    machine = createMachine(options.engine, program.image);
+    machine->getRam().resize(options.ramSize);
+    machine->getRam().setAccessCycles(options.ramAccessCycles);
+    machine->reserveStacks(options.stackReserve);
+    machine->setBudget(options.budget);
+    return machine;
+}
+
+/**
+ * Runs the program once on one of it's resident machines. Can be called from any thread.
+ * @param[in]  programId    id of the program
+ * @param[in]  inputs       IN values
+ * @param[in]  inputsNumber number of IN values
+ * @param[out] outputValues OUT values
+ * @return 0, if program finished successfully;
+ *         ERR_INVALID_FILE, if there is no program with this id;
+ *         error code of the program otherwise.
+ */
+int MachineServer::runRequest(uint32_t programId, const double* inputs, size_t inputsNumber,
+                              std::vector<double>& outputValues) {
+    outputValues.clear();
+    if (programId >= programs.size()) return ERR_INVALID_FILE;
+
+    Program& program = programs[programId];
+    std::unique_ptr<StackMachine> machine = acquireMachine(program);
+    if (machine->getAssemblySize() < 0) return ERR_INVALID_FILE;
+
+    // Memory mode is left set after the run, it's arrays are replaced by the next request
+    machine->getIO().setMemory(inputs, inputsNumber, &outputValues);
+    unsigned char exitCode = machine->execute();
+
+    std::lock_guard<std::mutex> lock(machinesMutex);
+    program.idleMachines.push_back(std::move(machine));
+    return (exitCode == HLT_OPCODE) ? 0 : exitCode;
+}
+
+/**
+ * Runs queued requests until the server is destroyed.
+ */
+void MachineServer::runWorker() {
+    std::vector<double> outputValues;
+    while (true) {
+        std::shared_ptr<Request> request;
+        {
+            std::unique_lock<std::mutex> lock(requestsMutex);
+            requestsCondition.wait(lock, [this]() { return isStopping || !queuedRequests.empty(); });
+            if (isStopping) return;
+
+            request = std::move(queuedRequests.front());
+            queuedRequests.pop_front();
+            if (request->isCancelled) continue;
+        }
+
+        int status = runRequest(request->programId, request->inputs.data(), request->inputs.size(), outputValues);
+        appendResponse(request->response, status, outputValues);
+        {
+            std::lock_guard<std::mutex> lock(requestsMutex);
+            request->isDone = true;
+            answeredFds.push_back(request->fd);
+        }
+        uint64_t increment = 1;
+        ssize_t writtenSize = write(answeredFd, &increment, sizeof(increment));
+        (void)writtenSize;
+    }
+}
+
+/**
+ * Creates the Unix socket bound to the given path.
+ * @param[in] path path of the socket. Existing file is replaced
+ * @return socket, or -1 if it can't be created.
+ */
+static int bindUnixSocket(const char* path) {
+    sockaddr_un address {};
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Creates the TCP socket bound to the given address.
+ * @param[in] hostAndPort "PORT" for the loopback interface or "HOST:PORT" for the given IPv4 address
+ * @return socket, or -1 if address is invalid or socket can't be created.
+ */
+static int bindTcpSocket(const char* hostAndPort) {
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const char* port = hostAndPort;
+    const char* colon = strrchr(hostAndPort, ':');
+    if (colon != nullptr) {
+        std::string host(hostAndPort, colon);
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) return -1;
+        port = colon + 1;
+    }
+    char* portEnd = nullptr;
+    unsigned long portNumber = strtoul(port, &portEnd, 10);
+    if ((portEnd == port) || (*portEnd != '\0') || (portNumber > 65535)) return -1;
+    address.sin_port = htons((uint16_t)portNumber);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int isReused = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &isReused, sizeof(isReused));
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Starts listening on the given address.
+ * @param[in] address "unix:PATH" for the Unix socket (existing file is replaced), "tcp:PORT" for the TCP socket
+ *                    on the loopback interface or "tcp:HOST:PORT" for the TCP socket on the given IPv4 address
+ * @return 0, if server listens, or ERR_INVALID_FILE, if the address is invalid or can't be listened on.
+ */
+int MachineServer::listen(const char* address) {
+    assert(address != nullptr);
+    if ((epollFd < 0) || (stopFd < 0) || (listenFd >= 0)) return ERR_INVALID_FILE;
+
+    int fd = -1;
+    if (strncmp(address, "unix:", strlen("unix:")) == 0) {
+        fd = bindUnixSocket(address + strlen("unix:"));
+        if (fd >= 0) socketPath = address + strlen("unix:");
+    } else if (strncmp(address, "tcp:", strlen("tcp:")) == 0) {
+        fd = bindTcpSocket(address + strlen("tcp:"));
+    }
+    if (fd < 0) return ERR_INVALID_FILE;
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if ((::listen(fd, SOMAXCONN) < 0) || (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)) {
+        close(fd);
+        return ERR_INVALID_FILE;
+    }
+    listenFd = fd;
+    return 0;
+}
+
+/**
+ * Serves the already connected socket (e.g. one end of the socket pair). Server takes ownership of the socket.
+ * @param[in] fd connected socket
+ * @return 0, if connection is added, or ERR_INVALID_FILE, if the socket can't be served.
+ */
+int MachineServer::addConnection(int fd) {
+    assert(fd >= 0);
+    if (epollFd < 0) {
+        close(fd);
+        return ERR_INVALID_FILE;
+    }
+
+    // Responses are written at once, so they are sent without waiting for more data
+    int isNoDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &isNoDelay, sizeof(isNoDelay));
+
+    Connection& connection = connections[fd];
+    updateEvents(fd, connection);
+    if (connection.isFailed) {
+        closeConnection(fd);
+        return ERR_INVALID_FILE;
+    }
+    return 0;
+}
+
+/**
+ * Accepts all pending connections of the listening socket.
+ */
+void MachineServer::acceptConnections() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        addConnection(fd);
+    }
+}
+
+void MachineServer::closeConnection(int fd) {
+    auto found = connections.find(fd);
+    if (found != connections.end()) {
+        std::lock_guard<std::mutex> lock(requestsMutex);
+        for (const std::shared_ptr<Request>& request : found->second.requests) {
+            request->isCancelled = true;
+        }
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+/**
+ * Reads all available bytes from the connection.
+ * @param[in]      fd         socket of the connection
+ * @param[in, out] connection connection to read into
+ */
+void MachineServer::receive(int fd, Connection& connection) {
+    if (connection.inputPosition == connection.input.size()) {
+        connection.input.clear();
+        connection.inputPosition = 0;
+    }
+
+    size_t receivedSize = 0;
+    while (!connection.isPeerClosed && (receivedSize < MAX_RECEIVE_SIZE)) {
+        size_t size = connection.input.size();
+        connection.input.resize(size + IO_BUFFER_SIZE);
+        ssize_t readSize = recv(fd, connection.input.data() + size, IO_BUFFER_SIZE, 0);
+        connection.input.resize(size + ((readSize > 0) ? (size_t)readSize : 0));
+
+        if (readSize > 0) {
+            receivedSize += (size_t)readSize;
+        } else if (readSize == 0) {
+            connection.isPeerClosed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) connection.isFailed = true;
+            break;
+        }
+    }
+}
+
+/**
+ * Writes the pending responses to the connection, as many as the socket accepts.
+ * @param[in]      fd         socket of the connection
+ * @param[in, out] connection connection to write from
+ */
+void MachineServer::send(int fd, Connection& connection) {
+    while (connection.outputPosition < connection.output.size()) {
+        ssize_t writtenSize = ::send(fd, connection.output.data() + connection.outputPosition,
+                                     connection.output.size() - connection.outputPosition, MSG_NOSIGNAL);
+        if (writtenSize >= 0) {
+            connection.outputPosition += (size_t)writtenSize;
+        } else if (errno != EINTR) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) connection.isFailed = true;
+            break;
+        }
+    }
+
+    if (connection.outputPosition == connection.output.size()) {
+        connection.output.clear();
+        connection.outputPosition = 0;
+    }
+}
+
+/**
+ * Queues complete requests received from the connection, while it has not too many pending requests and responses.
+ * @param[in]      fd         socket of the connection
+ * @param[in, out] connection connection to process
+ * @return false, if the connection has sent an invalid request, true otherwise.
+ */
+bool MachineServer::queueRequests(int fd, Connection& connection) {
+    std::vector<std::shared_ptr<Request>> requests;
+    bool isValid = true;
+    while ((connection.requests.size() + requests.size() < MAX_PENDING_REQUESTS) &&
+           (connection.output.size() - connection.outputPosition < MAX_PENDING_OUTPUT)) {
+        size_t availableSize = connection.input.size() - connection.inputPosition;
+        if (availableSize < SERVER_MESSAGE_HEADER_SIZE) break;
+
+        const char* requestData = connection.input.data() + connection.inputPosition;
+        uint32_t programId = readUint32(requestData);
+        uint32_t inputsNumber = readUint32(requestData + sizeof(uint32_t));
+        if (inputsNumber > MAX_REQUEST_INPUTS) {
+            isValid = false;
+            break;
+        }
+        size_t requestSize = SERVER_MESSAGE_HEADER_SIZE + inputsNumber * sizeof(double);
+        if (availableSize < requestSize) break;
+
+        std::shared_ptr<Request> request = std::make_shared<Request>();
+        request->fd = fd;
+        request->programId = programId;
+        request->inputs.resize(inputsNumber);
+        for (uint32_t i = 0; i < inputsNumber; ++i) {
+            uint64_t bits = 0;
+            memcpy(&bits, requestData + SERVER_MESSAGE_HEADER_SIZE + i * sizeof(double), sizeof(bits));
+            bits = toLittleEndian(bits);
+            memcpy(&request->inputs[i], &bits, sizeof(bits));
+        }
+        connection.inputPosition += requestSize;
+        requests.push_back(std::move(request));
+    }
+
+    if (!requests.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(requestsMutex);
+            queuedRequests.insert(queuedRequests.end(), requests.begin(), requests.end());
+        }
+        requestsCondition.notify_all();
+        connection.requests.insert(connection.requests.end(), requests.begin(), requests.end());
+    }
+    return isValid;
+}
+
+/**
+ * Appends responses of the finished requests to the output of the connection, until the first unfinished request.
+ * @param[in, out] connection connection to process
+ */
+void MachineServer::takeResponses(Connection& connection) {
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    while (!connection.requests.empty() && connection.requests.front()->isDone) {
+        const std::vector<char>& response = connection.requests.front()->response;
+        connection.output.insert(connection.output.end(), response.begin(), response.end());
+        connection.requests.pop_front();
+    }
+}
+
+/**
+ * Registers the connection in epoll with events it needs: reading, while it's output is not too large and the
+ * peer hasn't closed it's side, and writing, while it has pending responses.
+ * @param[in]      fd         socket of the connection
+ * @param[in, out] connection connection to register
+ */
+void MachineServer::updateEvents(int fd, Connection& connection) {
+    size_t pendingOutputSize = connection.output.size() - connection.outputPosition;
+    uint32_t events = 0;
+    if (!connection.isPeerClosed && (pendingOutputSize < MAX_PENDING_OUTPUT) &&
+        (connection.requests.size() < MAX_PENDING_REQUESTS)) {
+        events |= EPOLLIN;
+    }
+    if (pendingOutputSize != 0) events |= EPOLLOUT;
+    if (connection.isRegistered && (events == connection.events)) return;
+
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = fd;
+    int operation = connection.isRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epollFd, operation, fd, &event) < 0) {
+        connection.isFailed = true;
+        return;
+    }
+    connection.isRegistered = true;
+    connection.events = events;
+}
+
+/**
+ * Queues requests, sends responses and updates events of the connection.
+ * Closes the connection, if it's finished or failed.
+ * @param[in] fd socket of the connection
+ */
+void MachineServer::processConnection(int fd) {
+    auto found = connections.find(fd);
+    if (found == connections.end()) return;
+    Connection& connection = found->second;
+
+    while (!connection.isFailed) {
+        takeResponses(connection);
+        send(fd, connection);
+        // Requests that were left, because there were too many pending ones, are queued as soon as they're answered
+        size_t requestsNumber = connection.requests.size();
+        if (!queueRequests(fd, connection)) connection.isFailed = true;
+        if (connection.requests.size() == requestsNumber) break;
+    }
+
+    if (connection.inputPosition > connection.input.size() / 2) {
+        connection.input.erase(connection.input.begin(), connection.input.begin() + connection.inputPosition);
+        connection.inputPosition = 0;
+    }
+
+    // Incomplete request of the closed connection is dropped
+    bool isFinished = connection.isPeerClosed && connection.requests.empty() &&
+                      (connection.outputPosition == connection.output.size());
+    if (!connection.isFailed && !isFinished) updateEvents(fd, connection);
+    if (connection.isFailed || isFinished) closeConnection(fd);
+}
+
+/**
+ * Handles the readiness of the connection: receives requests, queues them and sends responses.
+ * Closes the connection, if it's finished or failed.
+ * @param[in] fd     socket of the connection
+ * @param[in] events ready events
+ */
+void MachineServer::serveConnection(int fd, uint32_t events) {
+    auto found = connections.find(fd);
+    if (found == connections.end()) return;
+
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) receive(fd, found->second);
+    processConnection(fd);
+}
+
+/**
+ * Processes connections, which requests were finished by workers.
+ * Socket of the closed connection may be reused by a new one, which is then just processed once more.
+ */
+void MachineServer::processAnsweredConnections() {
+    uint64_t counter = 0;
+    ssize_t readSize = read(answeredFd, &counter, sizeof(counter));
+    (void)readSize;
+
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex);
+        fds.swap(answeredFds);
+    }
+    std::sort(fds.begin(), fds.end());
+    fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+    for (int fd : fds) {
+        processConnection(fd);
+    }
+}
+
+/**
+ * Runs the event loop until stop() is called or, if the server doesn't listen, until all connections are closed.
+ * @return 0, if the loop was stopped, or ERR_INVALID_FILE, if waiting for events has failed.
+ */
+int MachineServer::serve() {
+    if ((epollFd < 0) || (stopFd < 0) || (answeredFd < 0)) return ERR_INVALID_FILE;
+
+    epoll_event events[MAX_EVENTS] {};
+    while ((listenFd >= 0) || !connections.empty()) {
+        int eventsNumber = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (eventsNumber < 0) {
+            if (errno == EINTR) continue;
+            return ERR_INVALID_FILE;
+        }
+
+        for (int i = 0; i < eventsNumber; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == stopFd) {
+                uint64_t counter = 0;
+                ssize_t readSize = read(stopFd, &counter, sizeof(counter));
+                (void)readSize;
+                return 0;
+            }
+            if (fd == listenFd) {
+                acceptConnections();
+            } else if (fd == answeredFd) {
+                processAnsweredConnections();
+            } else {
+                serveConnection(fd, events[i].events);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Stops the event loop. Can be called from any thread or a signal handler.
+ */
+void MachineServer::stop() {
+    uint64_t increment = 1;
+    ssize_t writtenSize = write(stopFd, &increment, sizeof(increment));
+    (void)writtenSize;
+}
+
+/** Server that is stopped by SIGINT and SIGTERM */
+static MachineServer* interruptedServer = nullptr;
+
+static void stopInterruptedServer(int) {
+    if (interruptedServer != nullptr) interruptedServer->stop();
+}
+
+/**
+ * Serves requests to the programs listed in the programs file (one assembly file name per line, empty lines and lines
+ * starting with '#' are skipped, program id is the index of it's line among the listed ones) on the given address
+ * until the process is interrupted (SIGINT or SIGTERM).
+ * @param[in] programsFileName programs file name
+ * @param[in] address          address to listen on (see MachineServer::listen)
+ * @param[in] options          execution options of every request
+ * @param[in] workersNumber    number of threads that run requests, or 0 to use the number of hardware threads
+ * @return 0, if server was stopped, or ERR_INVALID_FILE, if programs can't be loaded or address can't be listened on.
+ */
+int serve(const char* programsFileName, const char* address, const RunOptions& options, unsigned int workersNumber) {
+    assert(programsFileName != nullptr);
+    assert(address != nullptr);
+
+    FILE* programsFile = fopen(programsFileName, "r");
+    if (programsFile == nullptr) return ERR_INVALID_FILE;
+
+    MachineServer server(options, workersNumber);
+    char line[MAX_PROGRAMS_LINE_LENGTH] = "";
+    while (fgets(line, sizeof(line), programsFile) != nullptr) {
+        char assemblyFileName[MAX_PROGRAMS_LINE_LENGTH] = "";
+        if ((sscanf(line, "%511s", assemblyFileName) != 1) || (assemblyFileName[0] == '#')) continue;
+
+        if (server.addProgram(assemblyFileName) != 0) {
+            fprintf(stderr, "Can't load program %s\n", assemblyFileName);
+            fclose(programsFile);
+            return ERR_INVALID_FILE;
+        }
+    }
+    fclose(programsFile);
+
+    if (server.listen(address) != 0) {
+        fprintf(stderr, "Can't listen on %s\n", address);
+        return ERR_INVALID_FILE;
+    }
+    fprintf(stderr, "Serving %zu programs on %s\n", server.getProgramsNumber(), address);
+
+    interruptedServer = &server;
+    signal(SIGINT, stopInterruptedServer);
+    signal(SIGTERM, stopInterruptedServer);
+    int exitCode = server.serve();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    interruptedServer = nullptr;
+    return exitCode;
+}
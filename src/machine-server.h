@@ -0,0 +1,265 @@
+/**
+ * @file
+ * @brief Declaration of the server that keeps programs resident and runs them on requests received over a socket.
+ *
+ * Protocol (all numbers are little-endian): client sends requests, each of them is
+ *     uint32 programId, uint32 inputsNumber, inputsNumber doubles (IN values);
+ * server answers every request in the order they were received with
+ *     uint32 status (0 or error code of the program), uint32 outputsNumber, outputsNumber doubles (OUT values).
+ * Client doesn't need to wait for the response before sending the next request (requests are pipelined).
+ */
+#ifndef STACK_MACHINE_MACHINE_SERVER_H
+#define STACK_MACHINE_MACHINE_SERVER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stack-machine.h"
+#include "bytecode-image.h"
+
+/** Maximal number of IN values in a single request. Connection that sends more is closed */
+constexpr uint32_t MAX_REQUEST_INPUTS = 1u << 20u;
+
+/** Size of the request and response headers in bytes */
+constexpr size_t SERVER_MESSAGE_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+/**
+ * Server that runs requests on resident machines. Programs are mapped into memory once, when they are added, and
+ * each program has a pool of machines: machine is created, when no idle one is left for the request, and is reset
+ * in place (see StackMachine::reset) before every following one, so the threaded engines decode the program and JIT
+ * engine compiles it only once per machine.
+ *
+ * Connections are served by the single-threaded event loop (epoll), and requests are run by the pool of worker
+ * threads, so a long request delays only the worker that runs it. Workers notify the event loop about the finished
+ * requests through the eventfd, and responses of each connection are sent in the order of it's requests.
+ */
+class MachineServer {
+
+private:
+    struct Program {
+        std::shared_ptr<const BytecodeImage> image;
+        /** Machines of the program, that are not running a request. Guarded by machinesMutex */
+        std::vector<std::unique_ptr<StackMachine>> idleMachines;
+    };
+
+    struct Request {
+        /** Socket of the connection that has sent the request */
+        int fd = -1;
+        uint32_t programId = 0;
+        std::vector<double> inputs;
+        /** Encoded response. Written by the worker before the request is marked as done */
+        std::vector<char> response;
+        /** Shows if the response is ready. Guarded by requestsMutex */
+        bool isDone = false;
+        /** Shows if the connection was closed, so the request isn't run. Guarded by requestsMutex */
+        bool isCancelled = false;
+    };
+
+    struct Connection {
+        /** Received bytes, that are not processed yet, start at inputPosition */
+        std::vector<char> input;
+        size_t inputPosition = 0;
+        /** Responses, that are not sent yet, start at outputPosition */
+        std::vector<char> output;
+        size_t outputPosition = 0;
+        /** Requests, that are queued or running, in the order they were received */
+        std::deque<std::shared_ptr<Request>> requests;
+        /** Shows if the peer has closed it's side. Pending requests are still answered */
+        bool isPeerClosed = false;
+        /** Shows if reading or writing has failed */
+        bool isFailed = false;
+        /** Events the connection is registered in epoll with. Empty set of events keeps it registered */
+        uint32_t events = 0;
+        /** Shows if the connection is registered in epoll */
+        bool isRegistered = false;
+    };
+
+    RunOptions options;
+    std::vector<Program> programs;
+    std::mutex machinesMutex;
+
+    std::vector<std::thread> workers;
+    /** Guards the queue of requests, the finished requests and the states of requests */
+    std::mutex requestsMutex;
+    std::condition_variable requestsCondition;
+    /** Requests that wait for a worker */
+    std::deque<std::shared_ptr<Request>> queuedRequests;
+    /** Sockets of connections, which requests were finished since the event loop has taken them */
+    std::vector<int> answeredFds;
+    /** Shows if workers must exit */
+    bool isStopping = false;
+
+    int epollFd = -1;
+    /** Listening socket, or -1 if connections are only added by addConnection */
+    int listenFd = -1;
+    /** Path of the listening Unix socket, that is removed with the server, or empty string */
+    std::string socketPath;
+    /** Event that stops the event loop (see stop) */
+    int stopFd = -1;
+    /** Event that workers signal, when they finish requests */
+    int answeredFd = -1;
+    std::map<int, Connection> connections;
+
+    /**
+     * Takes an idle machine of the program, or creates a new one, if there is no idle machine.
+     * @param[in] program program to run
+     * @return machine, that is ready to run the program.
+     */
+    std::unique_ptr<StackMachine> acquireMachine(Program& program);
+
+    /**
+     * Runs queued requests until the server is destroyed.
+     */
+    void runWorker();
+
+    /**
+     * Reads all available bytes from the connection.
+     * @param[in]      fd         socket of the connection
+     * @param[in, out] connection connection to read into
+     */
+    static void receive(int fd, Connection& connection);
+
+    /**
+     * Writes the pending responses to the connection, as many as the socket accepts.
+     * @param[in]      fd         socket of the connection
+     * @param[in, out] connection connection to write from
+     */
+    static void send(int fd, Connection& connection);
+
+    /**
+     * Queues complete requests received from the connection, while it has not too many pending requests and responses.
+     * @param[in]      fd         socket of the connection
+     * @param[in, out] connection connection to process
+     * @return false, if the connection has sent an invalid request, true otherwise.
+     */
+    bool queueRequests(int fd, Connection& connection);
+
+    /**
+     * Appends responses of the finished requests to the output of the connection, until the first unfinished request.
+     * @param[in, out] connection connection to process
+     */
+    void takeResponses(Connection& connection);
+
+    /**
+     * Queues requests, sends responses and updates events of the connection.
+     * Closes the connection, if it's finished or failed.
+     * @param[in] fd socket of the connection
+     */
+    void processConnection(int fd);
+
+    /**
+     * Processes connections, which requests were finished by workers.
+     */
+    void processAnsweredConnections();
+
+    /**
+     * Registers the connection in epoll with events it needs: reading, while it has not too many pending requests
+     * and responses and the peer hasn't closed it's side, and writing, while it has pending responses.
+     * @param[in]      fd         socket of the connection
+     * @param[in, out] connection connection to register
+     */
+    void updateEvents(int fd, Connection& connection);
+
+    /**
+     * Handles the readiness of the connection: receives requests, queues them and sends responses.
+     * Closes the connection, if it's finished or failed.
+     * @param[in] fd     socket of the connection
+     * @param[in] events ready events
+     */
+    void serveConnection(int fd, uint32_t events);
+
+    /**
+     * Accepts all pending connections of the listening socket.
+     */
+    void acceptConnections();
+
+    void closeConnection(int fd);
+
+public:
+    /**
+     * Creates the server with the given execution options of every request and starts it's workers. I/O options
+     * are ignored: IN values are taken from the request, OUT values are sent in the response.
+     * @param[in] runOptions    execution options
+     * @param[in] workersNumber number of threads that run requests, or 0 to use the number of hardware threads
+     */
+    explicit MachineServer(const RunOptions& runOptions, unsigned int workersNumber = 0);
+
+    /**
+     * Stops the workers, waiting for the running requests, and closes all connections and sockets.
+     */
+    ~MachineServer();
+
+    MachineServer(MachineServer& server) = delete;
+    MachineServer &operator=(const MachineServer&) = delete;
+
+    /**
+     * Loads the program. Programs are identified by the order they were added in, starting from 0.
+     * Programs must be added before the requests are run.
+     * @param[in] assemblyFileName assembly file name
+     * @return 0, if program was loaded, or ERR_INVALID_FILE, if the file is invalid.
+     */
+    int addProgram(const char* assemblyFileName);
+
+    size_t getProgramsNumber() const {
+        return programs.size();
+    }
+
+    /**
+     * Runs the program once on one of it's resident machines. Can be called from any thread.
+     * @param[in]  programId    id of the program
+     * @param[in]  inputs       IN values
+     * @param[in]  inputsNumber number of IN values
+     * @param[out] outputValues OUT values
+     * @return 0, if program finished successfully;
+     *         ERR_INVALID_FILE, if there is no program with this id;
+     *         error code of the program otherwise.
+     */
+    int runRequest(uint32_t programId, const double* inputs, size_t inputsNumber, std::vector<double>& outputValues);
+
+    /**
+     * Starts listening on the given address.
+     * @param[in] address "unix:PATH" for the Unix socket (existing file is replaced), "tcp:PORT" for the TCP socket
+     *                    on the loopback interface or "tcp:HOST:PORT" for the TCP socket on the given IPv4 address
+     * @return 0, if server listens, or ERR_INVALID_FILE, if the address is invalid or can't be listened on.
+     */
+    int listen(const char* address);
+
+    /**
+     * Serves the already connected socket (e.g. one end of the socket pair). Server takes ownership of the socket.
+     * @param[in] fd connected socket
+     * @return 0, if connection is added, or ERR_INVALID_FILE, if the socket can't be served.
+     */
+    int addConnection(int fd);
+
+    /**
+     * Runs the event loop until stop() is called or, if the server doesn't listen, until all connections are closed.
+     * @return 0, if the loop was stopped, or ERR_INVALID_FILE, if waiting for events has failed.
+     */
+    int serve();
+
+    /**
+     * Stops the event loop. Can be called from any thread or a signal handler.
+     */
+    void stop();
+};
+
+/**
+ * Serves requests to the programs listed in the programs file (one assembly file name per line, empty lines and lines
+ * starting with '#' are skipped, program id is the index of it's line among the listed ones) on the given address
+ * until the process is interrupted (SIGINT or SIGTERM).
+ * @param[in] programsFileName programs file name
+ * @param[in] address          address to listen on (see MachineServer::listen)
+ * @param[in] options          execution options of every request
+ * @param[in] workersNumber    number of threads that run requests, or 0 to use the number of hardware threads
+ * @return 0, if server was stopped, or ERR_INVALID_FILE, if programs can't be loaded or address can't be listened on.
+ */
+int serve(const char* programsFileName, const char* address, const RunOptions& options, unsigned int workersNumber = 0);
+
+#endif // STACK_MACHINE_MACHINE_SERVER_H
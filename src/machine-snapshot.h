@@ -0,0 +1,87 @@
+/**
+ * @file
+ * @brief Declaration of the snapshot file format: full state of the stack machine (see StackMachine::saveSnapshot).
+ */
+#ifndef STACK_MACHINE_MACHINE_SNAPSHOT_H
+#define STACK_MACHINE_MACHINE_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "stack-machine-utils.h"
+
+#define SNAPSHOT_VERSION 2u
+
+/** Alignment of the RAM and stacks values in the snapshot file, so they are aligned in the mapped file */
+#define SNAPSHOT_SECTION_ALIGNMENT 64u
+
+/** Signature of the snapshot file. It starts with the invalid operation code, so it's never run as the assembly */
+constexpr unsigned char SNAPSHOT_MAGIC[4] = {0xFF, 'S', 'M', 'S'};
+
+/**
+ * Header at the beginning of the snapshot file. It's followed by RAM values, operand stack values, integer stack values
+ * and call stack values (stacks bottom first), each aligned to SNAPSHOT_SECTION_ALIGNMENT (see getSnapshotLayout).
+ */
+struct SnapshotHeader {
+    unsigned char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    int32_t pc;
+    uint32_t ramSize;
+    /** Size and hash of the assembly the snapshot was taken of. Snapshot is restored only into the same assembly */
+    uint64_t assemblySize;
+    uint64_t assemblyHash;
+    uint64_t operandStackSize;
+    uint64_t callStackSize;
+    double registers[REGISTERS_NUMBER];
+    uint64_t integerStackSize;
+    int64_t integerRegisters[REGISTERS_NUMBER];
+};
+
+static_assert(sizeof(SnapshotHeader) == 56 + REGISTERS_NUMBER * (sizeof(double) + sizeof(int64_t)),
+              "Snapshot header must have no padding");
+
+/**
+ * Offsets of the values in the snapshot file.
+ */
+struct SnapshotLayout {
+    uint64_t ramOffset;
+    uint64_t operandStackOffset;
+    uint64_t integerStackOffset;
+    uint64_t callStackOffset;
+    uint64_t fileSize;
+};
+
+/**
+ * Calculates offsets of the values in the snapshot file with the given header.
+ * @param[in] header header of the snapshot
+ * @return layout of the snapshot file.
+ */
+inline SnapshotLayout getSnapshotLayout(const SnapshotHeader& header) {
+    auto align = [](uint64_t offset) {
+        return (offset + SNAPSHOT_SECTION_ALIGNMENT - 1) / SNAPSHOT_SECTION_ALIGNMENT * SNAPSHOT_SECTION_ALIGNMENT;
+    };
+
+    SnapshotLayout layout {};
+    layout.ramOffset = align(header.headerSize);
+    layout.operandStackOffset = align(layout.ramOffset + header.ramSize * sizeof(double));
+    layout.integerStackOffset = align(layout.operandStackOffset + header.operandStackSize * sizeof(double));
+    layout.callStackOffset = align(layout.integerStackOffset + header.integerStackSize * sizeof(int64_t));
+    layout.fileSize = layout.callStackOffset + header.callStackSize * sizeof(int);
+    return layout;
+}
+
+/**
+ * Calculates the hash of the assembly (64-bit FNV-1a), that ties the snapshot to the assembly it was taken of.
+ * @param[in] assembly     assembly bytes
+ * @param[in] assemblySize size of the assembly in bytes
+ * @return hash of the assembly.
+ */
+inline uint64_t getAssemblyHash(const unsigned char* assembly, size_t assemblySize) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < assemblySize; ++i) {
+        hash = (hash ^ assembly[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif // STACK_MACHINE_MACHINE_SNAPSHOT_H
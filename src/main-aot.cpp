@@ -0,0 +1,12 @@
+/**
+ * @file
+ */
+#include "arg-parser.h"
+#include "aot-compiler.h"
+
+int main(int argc, char* argv[]) {
+    arguments args = parseArgs(argc, argv, AOT);
+    int exitCode = compileAheadOfTime(args.inputFile, args.outputFile, args.aotOptions);
+    printErrorMessageForExitCode(exitCode);
+    return exitCode;
+}
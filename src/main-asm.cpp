@@ -7,7 +7,7 @@
 
 int main(int argc, char* argv[]) {
     arguments args = parseArgs(argc, argv, ASM);
-    int exitCode = assemble(args.inputFile, args.outputFile);
+    int exitCode = assemble(args.inputFile, args.outputFile, args.assemblyOptions);
     printErrorMessageForExitCode(exitCode);
     return exitCode;
 }
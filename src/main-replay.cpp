@@ -0,0 +1,15 @@
+/**
+ * @file
+ */
+#include "arg-parser.h"
+#include "stack-machine.h"
+#include "stack-machine-utils.h"
+
+int main(int argc, char* argv[]) {
+    arguments args = parseArgs(argc, argv, REPLAY);
+    args.runOptions.replayFileName = args.outputFile;
+    int exitCode = run(args.inputFile, args.runOptions);
+    if (exitCode == 0) printf("Execution matches the trace\n");
+    printErrorMessageForExitCode(exitCode);
+    return exitCode;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file
+ */
+#include "arg-parser.h"
+#include "parallel-runner.h"
+#include "stack-machine-utils.h"
+
+int main(int argc, char* argv[]) {
+    arguments args = parseArgs(argc, argv, RUN_BATCH);
+
+    std::vector<Job> jobs;
+    int exitCode = readJobs(args.inputFile, jobs);
+    if (exitCode != 0) {
+        printErrorMessageForExitCode(exitCode);
+        return exitCode;
+    }
+
+    return runJobs(jobs, args.runOptions, args.threadsNumber);
+}
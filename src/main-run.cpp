@@ -2,12 +2,15 @@
  * @file
  */
 #include "arg-parser.h"
+#include "machine-server.h"
 #include "stack-machine.h"
 #include "stack-machine-utils.h"
 
 int main(int argc, char* argv[]) {
     arguments args = parseArgs(argc, argv, RUN);
-    int exitCode = run(args.inputFile);
+    int exitCode = (args.runOptions.serveAddress != nullptr)
+                   ? serve(args.inputFile, args.runOptions.serveAddress, args.runOptions, args.threadsNumber)
+                   : run(args.inputFile, args.runOptions);
     printErrorMessageForExitCode(exitCode);
     return exitCode;
 }
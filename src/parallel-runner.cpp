@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @brief Implementation of the runner that executes many programs in parallel.
+ */
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "parallel-runner.h"
+#include "bytecode-image.h"
+
+/** Maximal length of the manifest line */
+static constexpr size_t MAX_MANIFEST_LINE_LENGTH = 3 * maxJobFileNameLength + 16;
+
+/**
+ * Jobs of one worker thread. Owner takes jobs from the front, other workers steal them from the back.
+ */
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<size_t> jobIndices;
+};
+
+/**
+ * Reads the jobs from the manifest file. Each line of the manifest describes one job: program, input and output file
+ * names separated by whitespaces. Empty lines and lines starting with '#' are skipped.
+ * @param[in]  manifestFileName manifest file name
+ * @param[out] jobs             read jobs
+ * @return 0, if manifest was read successfully, or ERR_INVALID_FILE, if it can't be opened or has invalid line.
+ */
+int readJobs(const char* manifestFileName, std::vector<Job>& jobs) {
+    assert(manifestFileName != nullptr);
+
+    FILE* manifest = fopen(manifestFileName, "r");
+    if (manifest == nullptr) return ERR_INVALID_FILE;
+
+    int exitCode = 0;
+    size_t lineNumber = 0;
+    char line[MAX_MANIFEST_LINE_LENGTH] = "";
+    while (fgets(line, sizeof(line), manifest) != nullptr) {
+        ++lineNumber;
+
+        char* lineBegin = line;
+        while ((*lineBegin == ' ') || (*lineBegin == '\t')) ++lineBegin;
+        if ((*lineBegin == '\0') || (*lineBegin == '\n') || (*lineBegin == '\r') || (*lineBegin == '#')) continue;
+
+        Job job {};
+        char extra[2] = "";
+        int fieldsNumber = sscanf(lineBegin, "%255s %255s %255s %1s", job.programFileName, job.inputFileName,
+                                  job.outputFileName, extra);
+        if (fieldsNumber != 3) {
+            fprintf(stderr, "Invalid manifest line %zu: expected program, input and output file names\n", lineNumber);
+            exitCode = ERR_INVALID_FILE;
+            break;
+        }
+        jobs.push_back(job);
+    }
+
+    fclose(manifest);
+    return exitCode;
+}
+
+/**
+ * Takes the next job for the worker: from the front of it's own queue, or from the back of other queue.
+ * @param[in, out] queues      queues of all workers
+ * @param[in]      workerIndex index of the worker
+ * @param[out]     jobIndex    index of the taken job
+ * @return true, if job was taken, false if there are no jobs left.
+ */
+static bool takeJob(std::vector<WorkerQueue>& queues, size_t workerIndex, size_t& jobIndex) {
+    {
+        WorkerQueue& queue = queues[workerIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobIndices.empty()) {
+            jobIndex = queue.jobIndices.front();
+            queue.jobIndices.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); ++i) {
+        WorkerQueue& victim = queues[(workerIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobIndices.empty()) {
+            jobIndex = victim.jobIndices.back();
+            victim.jobIndices.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs jobs until there are no jobs left in all queues (jobs are never added to the queues while workers run).
+ * @param[in]      workerIndex index of the worker
+ * @param[in, out] queues      queues of all workers
+ * @param[in, out] jobs        all jobs
+ * @param[in]      images      image of the program of each job
+ * @param[in]      options     execution options of each job
+ */
+static void runWorker(size_t workerIndex, std::vector<WorkerQueue>& queues, std::vector<Job>& jobs,
+                      const std::vector<std::shared_ptr<const BytecodeImage>>& images, const RunOptions& options) {
+    const char* previousStackLogFileName = getStackLogFileName();
+    char workerStackLogFileName[64] = "";
+    snprintf(workerStackLogFileName, sizeof(workerStackLogFileName), "stack-dump-%zu.txt", workerIndex);
+    setStackLogFileName(workerStackLogFileName);
+
+    size_t jobIndex = 0;
+    while (takeJob(queues, workerIndex, jobIndex)) {
+        Job& job = jobs[jobIndex];
+        RunOptions jobOptions = options;
+        jobOptions.ioInputFileName = job.inputFileName;
+        jobOptions.ioOutputFileName = job.outputFileName;
+        job.exitCode = run(images[jobIndex], jobOptions);
+    }
+
+    setStackLogFileName(previousStackLogFileName);
+}
+
+/**
+ * Runs the jobs on the given number of threads. Each thread runs it's own machines, and takes jobs of other threads
+ * when it's own jobs are finished (work stealing). Programs are mapped into memory once and shared by all threads.
+ * Exit code of each job is stored in it, failed jobs are reported to stderr.
+ * @param[in, out] jobs          jobs to run
+ * @param[in]      options       execution options of each job (I/O file names are taken from jobs)
+ * @param[in]      threadsNumber number of threads, or 0 to use the number of hardware threads
+ * @return 0, if all jobs finished successfully, or exit code of the first (in manifest order) failed job.
+ */
+int runJobs(std::vector<Job>& jobs, const RunOptions& options, unsigned int threadsNumber) {
+    assert(options.lanes == 0);
+
+    if (threadsNumber == 0) threadsNumber = std::thread::hardware_concurrency();
+    if (threadsNumber == 0) threadsNumber = 1;
+    if (threadsNumber > jobs.size()) threadsNumber = (unsigned int)jobs.size();
+
+    // Images are loaded before workers start and are kept until all jobs finish, so each program is mapped once
+    std::vector<std::shared_ptr<const BytecodeImage>> images(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        images[i] = BytecodeImage::load(jobs[i].programFileName);
+    }
+
+    // Contiguous ranges of jobs are given to workers, so stolen jobs are the farthest from the current job of the owner
+    std::vector<WorkerQueue> queues(threadsNumber);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        queues[i * threadsNumber / jobs.size()].jobIndices.push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threadsNumber; ++i) {
+        workers.emplace_back(runWorker, i, std::ref(queues), std::ref(jobs), std::cref(images), std::cref(options));
+    }
+    if (threadsNumber != 0) runWorker(0, queues, jobs, images, options);
+    for (std::thread& worker : workers) worker.join();
+
+    int exitCode = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].exitCode == 0) continue;
+
+        fprintf(stderr, "Job %zu (%s): ", i + 1, jobs[i].programFileName);
+        printErrorMessageForExitCode(jobs[i].exitCode);
+        if (exitCode == 0) exitCode = jobs[i].exitCode;
+    }
+    return exitCode;
+}
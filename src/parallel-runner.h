@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Declaration of the runner that executes many programs in parallel.
+ */
+#ifndef STACK_MACHINE_PARALLEL_RUNNER_H
+#define STACK_MACHINE_PARALLEL_RUNNER_H
+
+#include <cstddef>
+#include <vector>
+#include "stack-machine.h"
+
+constexpr size_t maxJobFileNameLength = 256;
+
+/**
+ * Single program execution: program is run with IN values read from the input file and OUT values written into the
+ * output file (see RunOptions::ioMode).
+ */
+struct Job {
+    char programFileName[maxJobFileNameLength];
+    char inputFileName[maxJobFileNameLength];
+    char outputFileName[maxJobFileNameLength];
+    /** Exit code of the finished job */
+    int exitCode;
+};
+
+/**
+ * Reads the jobs from the manifest file. Each line of the manifest describes one job: program, input and output file
+ * names separated by whitespaces. Empty lines and lines starting with '#' are skipped.
+ * @param[in]  manifestFileName manifest file name
+ * @param[out] jobs             read jobs
+ * @return 0, if manifest was read successfully, or ERR_INVALID_FILE, if it can't be opened or has invalid line.
+ */
+int readJobs(const char* manifestFileName, std::vector<Job>& jobs);
+
+/**
+ * Runs the jobs on the given number of threads. Each thread runs it's own machines, and takes jobs of other threads
+ * when it's own jobs are finished (work stealing). Programs are mapped into memory once and shared by all threads.
+ * Exit code of each job is stored in it, failed jobs are reported to stderr.
+ * @param[in, out] jobs          jobs to run
+ * @param[in]      options       execution options of each job (I/O file names are taken from jobs)
+ * @param[in]      threadsNumber number of threads, or 0 to use the number of hardware threads
+ * @return 0, if all jobs finished successfully, or exit code of the first (in manifest order) failed job.
+ */
+int runJobs(std::vector<Job>& jobs, const RunOptions& options, unsigned int threadsNumber = 0);
+
+#endif // STACK_MACHINE_PARALLEL_RUNNER_H
@@ -0,0 +1,297 @@
+/**
+ * @file
+ * @brief Implementation of stack machine that profiles executed operations and jumps.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+#include "profiling-stack-machine.h"
+
+using byte = unsigned char;
+
+/**
+ * Reads the cycle counter: time stamp counter on x86, monotonic clock in nanoseconds elsewhere.
+ * @return current value of the counter.
+ */
+static inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec time {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+#endif
+}
+
+ProfilingStackMachine::ProfilingStackMachine(const char* assemblyFileName) : StackMachine(assemblyFileName) {
+    initProfile();
+}
+
+ProfilingStackMachine::ProfilingStackMachine(std::shared_ptr<const BytecodeImage> image) :
+    StackMachine(std::move(image)) {
+    initProfile();
+}
+
+/**
+ * Allocates profiling data for the loaded assembly.
+ */
+void ProfilingStackMachine::initProfile() {
+    if (assemblySize < 0) return;
+
+    // One more entry for the operation read past the end of the assembly (it fails as an invalid operation)
+    profileByOffset.assign(assemblySize + 1, OperationProfile());
+}
+
+/**
+ * Accounts the outcome of the jump operation being processed.
+ * @param[in] isTaken shows if the jump was taken
+ */
+void ProfilingStackMachine::profileJump(bool isTaken) {
+    OperationProfile& profile = profileByOffset[operationPc];
+    if (isTaken) {
+        ++profile.jumpsTaken;
+    } else {
+        ++profile.jumpsNotTaken;
+    }
+}
+
+/**
+ * Processes the jump operation and accounts whether it was taken.
+ * @param[in] opcode     code of the jump operation to process
+ * @param[in] jumpOffset offset of the jump to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+byte ProfilingStackMachine::processJumpOperation(byte opcode, int jumpOffset) {
+    int jumpPc = pc;
+    byte status = StackMachine::processJumpOperation(opcode, jumpOffset);
+    // Jump that failed before the comparison (stack underflow) has no outcome
+    bool isTaken = (pc == jumpPc + jumpOffset);
+    if (!isError(status) || isTaken) profileJump(isTaken);
+    return status;
+}
+
+/**
+ * Processes the fused operation and accounts whether the fused jump was taken.
+ * @param[in] opcode code of the fused operation to process
+ * @return given operation code, if operation processed successfully, or error code otherwise.
+ */
+byte ProfilingStackMachine::processFusedOperation(byte opcode) {
+    int operandsPc = pc;
+    byte status = StackMachine::processFusedOperation(opcode);
+    if (isFusedJumpOperation(opcode)) {
+        bool isTaken = (pc != operandsPc + (int)(sizeof(double) + sizeof(int)));
+        if (!isError(status) || isTaken) profileJump(isTaken);
+    }
+    return status;
+}
+
+/**
+ * Executes operations starting from the current pc until HLT operation or an error is met.
+ * Every operation is timed and counted.
+ * @return HLT_OPCODE, if program finished successfully, or error code of the failed operation.
+ */
+byte ProfilingStackMachine::execute() {
+    while (true) {
+        operationPc = pc;
+        byte opcode = (pc < assemblySize) ? assembly[pc] : ERR_INVALID_OPERATION;
+
+        uint64_t start = readCycleCounter();
+        byte status = processNextOperation();
+        uint64_t cycles = readCycleCounter() - start;
+
+        OperationProfile& offsetProfile = profileByOffset[operationPc];
+        ++offsetProfile.executions;
+        offsetProfile.cycles += cycles;
+        OperationProfile& opcodeProfile = profileByOpcode[opcode];
+        ++opcodeProfile.executions;
+        opcodeProfile.cycles += cycles;
+
+        if ((status == HLT_OPCODE) || isError(status)) return status;
+    }
+}
+
+/**
+ * Writes the name of the operation with the given code, showing the kind of it's operand (e.g. "PUSH [reg]").
+ * @param[out] name   buffer to write the name into
+ * @param[in]  opcode code of the operation
+ */
+static void writeOperationName(char* name, byte opcode) {
+    const char* operationName = getOperationNameByOpcode(opcode);
+    if (operationName == nullptr) {
+        sprintf(name, "0x%02X", opcode);
+        return;
+    }
+    if (isFusedOperation(opcode) || isJumpOperation(opcode) || (getOperationArityByOpcode(opcode) != 1)) {
+        strcpy(name, operationName);
+        return;
+    }
+
+    const char* operand = ((opcode & IS_REG_OP_MASK) != 0) ? "reg" : "imm";
+    if ((opcode & IS_RAM_OP_MASK) != 0) {
+        sprintf(name, "%s [%s]", operationName, operand);
+    } else {
+        sprintf(name, "%s %s", operationName, operand);
+    }
+}
+
+/**
+ * Writes the location of the operation in the disassembly: line number and the offset from the closest label.
+ * @param[out] location buffer to write the location into
+ * @param[in]  lines    lines of the disassembly sorted by offset
+ * @param[in]  offset   byte offset of the operation
+ * @return line of the operation, or nullptr if operation has no line in the disassembly.
+ */
+static const DisassemblyLine* writeLocation(char* location, const std::vector<DisassemblyLine>& lines, int offset) {
+    auto line = std::lower_bound(lines.begin(), lines.end(), offset,
+                                 [](const DisassemblyLine& lhs, int lineOffset) { return lhs.offset < lineOffset; });
+    if ((line == lines.end()) || (line->offset != offset)) {
+        strcpy(location, "-");
+        return nullptr;
+    }
+
+    if (line->labelNumber < 0) {
+        sprintf(location, "+%d", offset);
+    } else if (line->labelOffset == offset) {
+        sprintf(location, "L%d", line->labelNumber);
+    } else {
+        sprintf(location, "L%d+%d", line->labelNumber, offset - line->labelOffset);
+    }
+    return &*line;
+}
+
+/**
+ * Gets the share of the part in the total in percents.
+ * @param[in] part  part of the total
+ * @param[in] total total
+ * @return share in percents.
+ */
+static double getShare(uint64_t part, uint64_t total) {
+    return (total == 0) ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+/**
+ * Gets the text of the operation in the disassembly. Fused operation is written as a line per original operation,
+ * so it's lines are joined with "; ".
+ * @param[in] lines     lines of the disassembly sorted by offset
+ * @param[in] line      line of the operation
+ * @param[in] lineTexts texts of the disassembly lines by their numbers
+ * @return text of the operation.
+ */
+static std::string getOperationText(const std::vector<DisassemblyLine>& lines, const DisassemblyLine* line,
+                                    const std::vector<const char*>& lineTexts) {
+    if ((line == nullptr) || (line->lineNumber >= lineTexts.size())) return "-";
+
+    unsigned int lastLineNumber = (unsigned int)lineTexts.size() - 1;
+    if (line + 1 != lines.data() + lines.size()) lastLineNumber = line[1].lineNumber - 1;
+
+    std::string text = lineTexts[line->lineNumber];
+    for (unsigned int lineNumber = line->lineNumber + 1; lineNumber <= lastLineNumber; ++lineNumber) {
+        // Label of the next operation
+        if (strchr(lineTexts[lineNumber], ':') != nullptr) break;
+        text += "; ";
+        text += lineTexts[lineNumber];
+    }
+    return text;
+}
+
+/**
+ * Writes the profile report: operations by their codes, hot spots and jumps outcomes. Operations are located
+ * by the lines and labels of the program disassembly (see disassemble).
+ * @param[out] output         file to write report into
+ * @param[in]  hotSpotsNumber maximal number of the hottest operations in the report
+ * @return 0, if report was written successfully, or ERR_INVALID_FILE otherwise.
+ */
+byte ProfilingStackMachine::writeReport(FILE* output, unsigned int hotSpotsNumber) const {
+    assert(output != nullptr);
+
+    // Program is disassembled the same way as by the disassembler, so the lines and labels match it's output
+    std::vector<DisassemblyLine> lines;
+    char* disassembly = nullptr;
+    size_t disassemblySize = 0;
+    FILE* disassemblyStream = open_memstream(&disassembly, &disassemblySize);
+    if (disassemblyStream == nullptr) return ERR_INVALID_FILE;
+    if (assemblySize > 0) disassemble(assembly, assemblySize, disassemblyStream, &lines);
+    fclose(disassemblyStream);
+
+    std::vector<const char*> lineTexts = {nullptr};
+    for (char* text = disassembly; (text != nullptr) && (*text != '\0');) {
+        lineTexts.push_back(text);
+        char* newline = strchr(text, '\n');
+        if (newline == nullptr) break;
+        *newline = '\0';
+        text = newline + 1;
+    }
+
+    uint64_t totalExecutions = 0;
+    uint64_t totalCycles = 0;
+    for (const OperationProfile& profile : profileByOpcode) {
+        totalExecutions += profile.executions;
+        totalCycles += profile.cycles;
+    }
+    fprintf(output, "Profile: %llu operations, %llu cycles\n", (unsigned long long)totalExecutions,
+            (unsigned long long)totalCycles);
+
+    char name[32] = "";
+    fprintf(output, "\nOperations:\n%-16s %14s %16s %10s %8s\n", "operation", "executions", "cycles", "cycles/op", "share");
+    std::vector<int> opcodes;
+    for (int opcode = 0; opcode < 256; ++opcode) {
+        if (profileByOpcode[opcode].executions != 0) opcodes.push_back(opcode);
+    }
+    std::sort(opcodes.begin(), opcodes.end(), [this](int lhs, int rhs) {
+        return profileByOpcode[lhs].cycles > profileByOpcode[rhs].cycles;
+    });
+    for (int opcode : opcodes) {
+        const OperationProfile& profile = profileByOpcode[opcode];
+        writeOperationName(name, (byte)opcode);
+        fprintf(output, "%-16s %14llu %16llu %10.1f %7.2f%%\n", name, (unsigned long long)profile.executions,
+                (unsigned long long)profile.cycles, (double)profile.cycles / (double)profile.executions,
+                getShare(profile.cycles, totalCycles));
+    }
+
+    std::vector<int> offsets;
+    std::vector<int> jumpOffsets;
+    for (int offset = 0; offset < (int)profileByOffset.size(); ++offset) {
+        if (profileByOffset[offset].executions != 0) offsets.push_back(offset);
+        if (profileByOffset[offset].jumpsTaken + profileByOffset[offset].jumpsNotTaken != 0) {
+            jumpOffsets.push_back(offset);
+        }
+    }
+    std::sort(offsets.begin(), offsets.end(), [this](int lhs, int rhs) {
+        return profileByOffset[lhs].cycles > profileByOffset[rhs].cycles;
+    });
+    if (offsets.size() > hotSpotsNumber) offsets.resize(hotSpotsNumber);
+
+    char location[32] = "";
+    fprintf(output, "\nHot spots:\n%8s %6s %-12s %14s %16s %8s  %s\n", "offset", "line", "location", "executions",
+            "cycles", "share", "operation");
+    for (int offset : offsets) {
+        const OperationProfile& profile = profileByOffset[offset];
+        const DisassemblyLine* line = writeLocation(location, lines, offset);
+        fprintf(output, "%8d %6u %-12s %14llu %16llu %7.2f%%  %s\n", offset, (line != nullptr) ? line->lineNumber : 0,
+                location, (unsigned long long)profile.executions, (unsigned long long)profile.cycles,
+                getShare(profile.cycles, totalCycles), getOperationText(lines, line, lineTexts).c_str());
+    }
+
+    fprintf(output, "\nJumps:\n%8s %6s %-12s %14s %14s %8s  %s\n", "offset", "line", "location", "taken", "not taken",
+            "taken", "operation");
+    for (int offset : jumpOffsets) {
+        const OperationProfile& profile = profileByOffset[offset];
+        const DisassemblyLine* line = writeLocation(location, lines, offset);
+        fprintf(output, "%8d %6u %-12s %14llu %14llu %7.2f%%  %s\n", offset, (line != nullptr) ? line->lineNumber : 0,
+                location, (unsigned long long)profile.jumpsTaken, (unsigned long long)profile.jumpsNotTaken,
+                getShare(profile.jumpsTaken, profile.jumpsTaken + profile.jumpsNotTaken),
+                getOperationText(lines, line, lineTexts).c_str());
+    }
+
+    free(disassembly);
+    return ferror(output) ? ERR_INVALID_FILE : 0;
+}
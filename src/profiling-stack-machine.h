@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Declaration of stack machine that profiles executed operations and jumps.
+ */
+#ifndef STACK_MACHINE_PROFILING_STACK_MACHINE_H
+#define STACK_MACHINE_PROFILING_STACK_MACHINE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "stack-machine.h"
+
+/**
+ * Execution profile of the operation, or of all operations with the same code.
+ */
+struct OperationProfile {
+    /** Number of executions */
+    uint64_t executions = 0;
+    /** Cycles spent on all executions (time stamp counter cycles on x86-64, nanoseconds elsewhere) */
+    uint64_t cycles = 0;
+    /** Number of executions of the jump operation that took the jump */
+    uint64_t jumpsTaken = 0;
+    /** Number of executions of the conditional jump operation that didn't take the jump */
+    uint64_t jumpsNotTaken = 0;
+};
+
+/**
+ * Stack machine that counts executions and cycles of every operation (by it's byte offset and by it's code),
+ * and outcomes of every jump. Operations are processed by AssemblyMachine::processNextOperation with all checks,
+ * so the behaviour is identical to StackMachine. Machines of other engines are not affected by profiling at all.
+ */
+class ProfilingStackMachine : public StackMachine {
+
+private:
+    /** Profiles of operations by their byte offsets */
+    std::vector<OperationProfile> profileByOffset;
+
+    /** Profiles of operations by their codes */
+    OperationProfile profileByOpcode[256];
+
+    /** Byte offset of the operation being processed */
+    int operationPc = 0;
+
+    /**
+     * Allocates profiling data for the loaded assembly.
+     */
+    void initProfile();
+
+    /**
+     * Accounts the outcome of the jump operation being processed.
+     * @param[in] isTaken shows if the jump was taken
+     */
+    void profileJump(bool isTaken);
+
+public:
+    explicit ProfilingStackMachine(const char* assemblyFileName);
+
+    /**
+     * Uses the given image of the assembly file.
+     * @param[in] image image of the assembly file, or nullptr if the file is invalid
+     */
+    explicit ProfilingStackMachine(std::shared_ptr<const BytecodeImage> image);
+
+    ProfilingStackMachine(ProfilingStackMachine& stackMachine) = delete;
+    ProfilingStackMachine &operator=(const ProfilingStackMachine&) = delete;
+
+    /**
+     * Gets the profile of the operation located at the given byte offset.
+     * @param[in] offset byte offset of the operation
+     * @return profile of the operation.
+     */
+    const OperationProfile& getOffsetProfile(int offset) const {
+        return profileByOffset[offset];
+    }
+
+    /**
+     * Gets the profile of all operations with the given code.
+     * @param[in] opcode code of the operation
+     * @return profile of the operations.
+     */
+    const OperationProfile& getOpcodeProfile(unsigned char opcode) const {
+        return profileByOpcode[opcode];
+    }
+
+    /**
+     * Processes the jump operation and accounts whether it was taken.
+     * @param[in] opcode     code of the jump operation to process
+     * @param[in] jumpOffset offset of the jump to process
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+     */
+    unsigned char processJumpOperation(unsigned char opcode, int jumpOffset) override;
+
+    /**
+     * Processes the fused operation and accounts whether the fused jump was taken.
+     * @param[in] opcode code of the fused operation to process
+     * @return given operation code, if operation processed successfully, or error code otherwise.
+     */
+    unsigned char processFusedOperation(unsigned char opcode) override;
+
+    /**
+     * Executes operations starting from the current pc until HLT operation or an error is met.
+     * Every operation is timed and counted.
+     * @return HLT_OPCODE, if program finished successfully, or error code of the failed operation.
+     */
+    unsigned char execute() override;
+
+    /**
+     * Writes the profile report: operations by their codes, hot spots and jumps outcomes. Operations are located
+     * by the lines and labels of the program disassembly (see disassemble).
+     * @param[out] output         file to write report into
+     * @param[in]  hotSpotsNumber maximal number of the hottest operations in the report
+     * @return 0, if report was written successfully, or ERR_INVALID_FILE otherwise.
+     */
+    unsigned char writeReport(FILE* output, unsigned int hotSpotsNumber = 20) const;
+};
+
+#endif // STACK_MACHINE_PROFILING_STACK_MACHINE_H
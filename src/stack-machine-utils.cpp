@@ -2,12 +2,16 @@
  * @file
  * @brief Implementation of stack machine helper functions.
  */
+#include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
 #include "stack-machine-utils.h"
+#include "bytecode-image.h"
 
 using byte = unsigned char;
 
@@ -21,37 +25,29 @@ union intAsBytes {
     byte bytes[sizeof(int)];
 };
 
-AssemblyMachine::AssemblyMachine(const char* assemblyFileName) {
-    assert(assemblyFileName != nullptr);
+union int64AsBytes {
+    int64_t intValue;
+    byte bytes[sizeof(int64_t)];
+};
 
-    FILE* assemblyFile = fopen(assemblyFileName, "rb");
-    if (assemblyFile == nullptr) return;
+AssemblyMachine::AssemblyMachine(const char* assemblyFileName) :
+    AssemblyMachine(BytecodeImage::load(assemblyFileName)) {
+}
 
-    struct stat fileStat{};
-    fstat(fileno(assemblyFile), &fileStat);
-    if ((fstat(fileno(assemblyFile), &fileStat) < 0) || (fileStat.st_size == 0)) {
-        fclose(assemblyFile);
-        return;
-    }
+AssemblyMachine::AssemblyMachine(std::shared_ptr<const BytecodeImage> image) : image(std::move(image)) {
+    if (this->image == nullptr) return;
 
-    assemblySize = fileStat.st_size;
-    void* dataPtr = mmap(nullptr, assemblySize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(assemblyFile), 0);
-    fclose(assemblyFile);
-    if (dataPtr == MAP_FAILED) {
-        assemblySize = -1;
-        return;
-    }
-    assembly = static_cast<unsigned char*>(dataPtr);
+    assembly = this->image->getAssembly();
+    assemblySize = this->image->getAssemblySize();
 
     registers = (double*)calloc(REGISTERS_NUMBER, sizeof(double));
+    integerRegisters = (int64_t*)calloc(REGISTERS_NUMBER, sizeof(int64_t));
     pc = 0;
 }
 
 AssemblyMachine::~AssemblyMachine() {
     free(registers);
-    if (assembly != nullptr) {
-        munmap(assembly, assemblySize);
-    }
+    free(integerRegisters);
 }
 
 /**
@@ -71,12 +67,22 @@ byte AssemblyMachine::getNextOperation() {
  * @return operand read.
  */
 double AssemblyMachine::getNextOperand() {
-    doubleAsBytes doubleBytes { 0 };
-    for (byte& b : doubleBytes.bytes) {
-        b = assembly[pc];
-        pc += sizeof(byte);
-    }
-    return doubleBytes.doubleValue;
+    // Operands are not aligned in the assembly, so they are copied with a single unaligned load
+    double operand = 0;
+    memcpy(&operand, assembly + pc, sizeof(operand));
+    pc += sizeof(operand);
+    return operand;
+}
+
+/**
+ * Reads the next int64 operand (of IPUSH) from assembly machine. Increases pc by the number of bytes read.
+ * @return operand read.
+ */
+int64_t AssemblyMachine::getNextIntegerOperand() {
+    int64_t operand = 0;
+    memcpy(&operand, assembly + pc, sizeof(operand));
+    pc += sizeof(operand);
+    return operand;
 }
 
 /**
@@ -97,12 +103,10 @@ byte AssemblyMachine::getNextRegister() {
  * @return jump offset.
  */
 int AssemblyMachine::getNextJumpOffset() {
-    intAsBytes intBytes { 0 };
-    for (byte& b : intBytes.bytes) {
-        b = assembly[pc];
-        pc += sizeof(byte);
-    }
-    return intBytes.intValue;
+    int jumpOffset = 0;
+    memcpy(&jumpOffset, assembly + pc, sizeof(jumpOffset));
+    pc += sizeof(jumpOffset);
+    return jumpOffset;
 }
 
 /**
@@ -119,10 +123,13 @@ byte AssemblyMachine::processNextOperation() {
 
     if (opcode == ERR_INVALID_OPERATION) return ERR_INVALID_OPERATION;
 
+    if (isFusedOperation(opcode)) return processFusedOperation(opcode);
+
     if (getOperationArityByOpcode(opcode) == 1) {
         if ((opcode & IS_REG_OP_MASK) != 0) {
             byte reg = getNextRegister();
             if (reg == ERR_INVALID_REGISTER) return ERR_INVALID_REGISTER;
+            if (isIntegerRegisterOperation(opcode)) return processIntegerOperation(opcode, integerRegisters[reg]);
             double& operand = registers[reg];
             return processOperation(opcode, operand);
         } else {
@@ -131,6 +138,9 @@ byte AssemblyMachine::processNextOperation() {
                 // sizeof(offset) is subtracted, because pc is calculated ahead (with offset size)
                 jumpOffset -= (int)sizeof(jumpOffset);
                 return processJumpOperation(opcode, jumpOffset);
+            } else if (opcode == IPUSH_OPCODE) {
+                int64_t operand = getNextIntegerOperand();
+                return processIntegerOperation(opcode, operand);
             } else {
                 double operand = getNextOperand();
                 if (!std::isfinite(operand)) return ERR_INVALID_OPERATION;
@@ -142,14 +152,30 @@ byte AssemblyMachine::processNextOperation() {
     }
 }
 
+/**
+ * Calculates the FNV-1a hash of the label name.
+ * @param[in] name   name of the label
+ * @param[in] length length of the name
+ * @return hash of the name.
+ */
+static uint32_t getLabelNameHash(const char* name, unsigned int length) {
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < length; ++i) {
+        hash = (hash ^ (byte)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
 LabelTable::LabelTable(const LabelTable& labelTable) {
-    for (auto entry : labelTable.labels) {
-        addLabel(entry.first, entry.second);
+    for (auto& label : labelTable.slots) {
+        if (label.name != nullptr) addLabel(label.name, label.offset);
     }
 }
 
 void LabelTable::swap(LabelTable& other) {
-    std::swap(labels, other.labels);
+    names.swap(other.names);
+    std::swap(slots, other.slots);
+    std::swap(labelsNumber, other.labelsNumber);
 }
 
 LabelTable& LabelTable::operator=(LabelTable other) {
@@ -157,39 +183,239 @@ LabelTable& LabelTable::operator=(LabelTable other) {
     return *this;
 }
 
+/**
+ * Finds the slot of the label with the given name, or the empty slot, where such label should be put.
+ * @param[in] name       name of the label
+ * @param[in] nameLength length of the name
+ * @param[in] nameHash   hash of the name
+ * @return index of the slot.
+ */
+size_t LabelTable::findSlot(const char* name, unsigned int nameLength, uint32_t nameHash) const {
+    assert(!slots.empty());
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = nameHash & mask; ; i = (i + 1) & mask) {
+        const Label& label = slots[i];
+        if (label.name == nullptr) return i;
+        if ((label.nameHash == nameHash) && (label.nameLength == nameLength) &&
+            (memcmp(label.name, name, nameLength) == 0)) return i;
+    }
+}
+
+/**
+ * Doubles the number of slots of the hash table.
+ */
+void LabelTable::grow() {
+    std::vector<Label> oldSlots(slots.empty() ? MIN_CAPACITY : slots.size() * 2, Label{nullptr, 0, 0, 0});
+    std::swap(slots, oldSlots);
+
+    for (auto& label : oldSlots) {
+        if (label.name != nullptr) slots[findSlot(label.name, label.nameLength, label.nameHash)] = label;
+    }
+}
+
 /**
  * Gets the label offset by it's name.
  * @param[in] labelName name of the label to find
  * @return label offset, or -1, if there is no label with the given name.
  */
-int LabelTable::getLabelOffset(char* labelName) {
-    if (labels.count(labelName) == 0) return -1;
-    return labels[labelName];
+int LabelTable::getLabelOffset(const char* labelName) const {
+    assert(labelName != nullptr);
+
+    if (slots.empty()) return -1;
+
+    unsigned int nameLength = (unsigned int)strlen(labelName);
+    const Label& label = slots[findSlot(labelName, nameLength, getLabelNameHash(labelName, nameLength))];
+    if (label.name == nullptr) return -1;
+    return (int)label.offset;
 }
 
 byte LabelTable::addLabel(const char* line, unsigned int labelOffset) {
-    char* labelName = (char*)calloc(MAX_LINE_LENGTH, sizeof(char));
-    for (unsigned int i = 0; i < MAX_LINE_LENGTH; ++i) {
-        if ((line[i] == ':') || (line[i] == '\0')) {
-            labelName[i] = '\0';
-            break;
+    assert(line != nullptr);
+
+    unsigned int nameLength = 0;
+    while ((nameLength < MAX_LINE_LENGTH - 1) && (line[nameLength] != ':') && (line[nameLength] != '\0')) {
+        ++nameLength;
+    }
+
+    // At least half of the slots are kept empty, so probe sequences stay short
+    if (2 * (labelsNumber + 1) > slots.size()) grow();
+
+    uint32_t nameHash = getLabelNameHash(line, nameLength);
+    Label& label = slots[findSlot(line, nameLength, nameHash)];
+    if (label.name != nullptr) return ERR_INVALID_LABEL;
+
+    label = {names.copyString(line, nameLength), nameLength, nameHash, labelOffset};
+    ++labelsNumber;
+    return 0;
+}
+
+/**
+ * Writes byte into the assembly buffer.
+ * @param[in] b byte to write
+ */
+void AssemblyBuffer::write(byte b) {
+    bytes.push_back(b);
+}
+
+/**
+ * Writes double operand into the assembly buffer.
+ * @param[in] value operand to write
+ */
+void AssemblyBuffer::write(double value) {
+    doubleAsBytes doubleBytes{value};
+    bytes.insert(bytes.end(), doubleBytes.bytes, doubleBytes.bytes + sizeof(value));
+}
+
+/**
+ * Writes int operand into the assembly buffer.
+ * @param[in] value operand to write
+ */
+void AssemblyBuffer::write(int value) {
+    intAsBytes intBytes{value};
+    bytes.insert(bytes.end(), intBytes.bytes, intBytes.bytes + sizeof(value));
+}
+
+/**
+ * Writes int64 operand into the assembly buffer.
+ * @param[in] value operand to write
+ */
+void AssemblyBuffer::write(int64_t value) {
+    int64AsBytes intBytes{value};
+    bytes.insert(bytes.end(), intBytes.bytes, intBytes.bytes + sizeof(value));
+}
+
+/**
+ * Creates the fixup for the jump to the label that is not defined yet.
+ * @param[in] labelName name of the label
+ * @return index of the created fixup.
+ */
+int AssemblyBuffer::addLabelFixup(const char* labelName) {
+    assert(labelName != nullptr);
+
+    fixups.push_back({labelNames.copyString(labelName, strnlen(labelName, MAX_LINE_LENGTH - 1)), -1});
+    return (int)fixups.size() - 1;
+}
+
+/**
+ * Writes the placeholder of the jump offset to the label of the given fixup. The offset is written in resolveFixups.
+ * @param[in] fixupIndex index of the fixup (see addLabelFixup)
+ */
+void AssemblyBuffer::writeLabelFixup(int fixupIndex) {
+    assert((fixupIndex >= 0) && (fixupIndex < (int)fixups.size()));
+
+    fixups[fixupIndex].operandOffset = getSize();
+    write(0);
+}
+
+/**
+ * Writes jump offsets to the labels of fixups that are found in the given label table. Resolved fixups are removed.
+ * @param[in] labelTable  label table with info about labels
+ * @param[in] labelsShift offset of the label table labels relative to the beginning of this buffer
+ * @return 0, if all fixups are resolved, or ERR_INVALID_LABEL, if there are fixups left.
+ */
+byte AssemblyBuffer::resolveFixups(const LabelTable& labelTable, int labelsShift) {
+    size_t fixupsLeft = 0;
+    for (auto& fixup : fixups) {
+        assert(fixup.operandOffset >= 0);
+
+        int labelOffset = labelTable.getLabelOffset(fixup.labelName);
+        if (labelOffset < 0) {
+            fixups[fixupsLeft++] = fixup;
+            continue;
         }
-        labelName[i] = line[i];
+
+        // Jump offset is relative to the beginning of the operand, the same as for the jumps to the defined labels
+        intAsBytes intBytes{labelOffset + labelsShift - fixup.operandOffset};
+        memcpy(bytes.data() + fixup.operandOffset, intBytes.bytes, sizeof(int));
     }
+    fixups.resize(fixupsLeft);
+
+    return fixups.empty() ? 0 : ERR_INVALID_LABEL;
+}
+
+/**
+ * Flushes this buffer content into the given file with a single write. All data is cleared.
+ * @param[out] output assembly file to flush buffer into
+ * @return 0, if flushing completed successfully, or ERR_INVALID_FILE, if the file can't be written.
+ */
+byte AssemblyBuffer::flushToFile(FILE* output) {
+    assert(output != nullptr);
+
+    size_t written = fwrite(bytes.data(), sizeof(byte), bytes.size(), output);
+    byte statusCode = (written == bytes.size()) ? 0 : ERR_INVALID_FILE;
+    bytes.clear();
+    return statusCode;
+}
+
+/**
+ * Appends the string to the write buffer.
+ * @param[in] string string to append
+ * @param[in] length length of the string
+ */
+void DisassemblyBuffer::appendText(const char* string, size_t length) {
+    assert(string != nullptr);
+
+    text.insert(text.end(), string, string + length);
+}
+
+/**
+ * Writes the content of the write buffer into the file.
+ */
+void DisassemblyBuffer::flushText() {
+    assert(output != nullptr);
 
-    if (labels.count(labelName) != 0) {
-        free(labelName);
-        return ERR_INVALID_LABEL;
+    if (fwrite(text.data(), sizeof(char), text.size(), output) != text.size()) hasWriteFailed = true;
+    text.clear();
+}
+
+/**
+ * Ends the current line (if any) and writes the labels of the current offset before the next line.
+ */
+void DisassemblyBuffer::startLine() {
+    assert(output != nullptr);
+
+    if (isLineOpen) {
+        appendText("\n", 1);
+        isLineOpen = false;
     }
+    if (text.size() > WRITE_BUFFER_SIZE - 2 * MAX_LINE_LENGTH) flushText();
 
-    labels[labelName] = labelOffset;
-    return 0;
+    // Labels that are passed point to the middle of the operation
+    while ((nextLabel < labels.size()) && (labels[nextLabel].offset < currentByteOffset)) {
+        hasInvalidLabels = true;
+        ++nextLabel;
+    }
+    if ((nextLabel < labels.size()) && (labels[nextLabel].offset == currentByteOffset)) {
+        lastLabel = &labels[nextLabel];
+        char labelLine[MAX_LINE_LENGTH];
+        appendText(labelLine, sprintf(labelLine, "L%u:\n", labels[nextLabel++].number));
+        ++linesNumber;
+    }
 }
 
-LabelTable::~LabelTable() {
-    for (auto entry : labels) {
-        free(entry.first);
+/**
+ * Ends collecting of jump targets and starts writing lines into the given file.
+ * @param[out] disassemblyFile disassembly file to write lines into
+ */
+void DisassemblyBuffer::startOutput(FILE* disassemblyFile) {
+    assert(disassemblyFile != nullptr);
+    assert(output == nullptr);
+
+    labels.reserve(labelNumbers.size());
+    for (auto& entry : labelNumbers) {
+        labels.push_back({entry.first, entry.second});
     }
+    std::unordered_map<unsigned int, unsigned int>().swap(labelNumbers);
+    std::sort(labels.begin(), labels.end(), [](const Label& lhs, const Label& rhs) {
+        return lhs.offset < rhs.offset;
+    });
+
+    output = disassemblyFile;
+    text.reserve(WRITE_BUFFER_SIZE);
+    currentByteOffset = 0;
+    linesNumber = 0;
+    lastLabel = nullptr;
 }
 
 /**
@@ -199,9 +425,38 @@ LabelTable::~LabelTable() {
 void DisassemblyBuffer::writeOperation(const char* operation) {
     assert(operation != nullptr);
 
-    char* line = (char*)calloc(MAX_LINE_LENGTH, sizeof(char));
-    strcpy(line, operation);
-    lines.emplace_back(line, sizeof(byte));
+    if (output != nullptr) {
+        startLine();
+        appendText(operation);
+        isLineOpen = true;
+        ++linesNumber;
+
+        if (lineMap != nullptr) {
+            DisassemblyLine line {(int)currentByteOffset, linesNumber, -1, 0};
+            if (lastLabel != nullptr) {
+                line.labelNumber = (int)lastLabel->number;
+                line.labelOffset = (int)lastLabel->offset;
+            }
+            lineMap->push_back(line);
+        }
+    }
+    currentByteOffset += sizeof(byte);
+}
+
+/**
+ * Writes the next operation of the fused operation expansion into the disassembly buffer.
+ * Labels can't be placed inside the fused operation.
+ * @param[in] operation operation name to write
+ */
+void DisassemblyBuffer::writeFusedOperationPart(const char* operation) {
+    assert(operation != nullptr);
+
+    if (output == nullptr) return;
+    assert(isLineOpen);
+
+    appendText("\n", 1);
+    appendText(operation);
+    ++linesNumber;
 }
 
 /**
@@ -210,14 +465,31 @@ void DisassemblyBuffer::writeOperation(const char* operation) {
  * @param[in] isRamOperation shows if an operand is a RAM address
  */
 void DisassemblyBuffer::writeOperand(double operand, bool isRamOperation) {
-    char line[MAX_LINE_LENGTH];
-    if (isRamOperation) {
-        sprintf(line, " [%lg]", operand);
-    } else {
-        sprintf(line, " %lg", operand);
+    if (output != nullptr) {
+        assert(isLineOpen);
+
+        char line[MAX_LINE_LENGTH];
+        if (isRamOperation) {
+            appendText(line, sprintf(line, " [%lg]", operand));
+        } else {
+            appendText(line, sprintf(line, " %lg", operand));
+        }
     }
-    strcat(lines.back().first, line);
-    lines.back().second += sizeof(double);
+    currentByteOffset += sizeof(double);
+}
+
+/**
+ * Writes int64 operand (of IPUSH) into the disassembly buffer.
+ * @param[in] operand operand to write
+ */
+void DisassemblyBuffer::writeIntegerOperand(int64_t operand) {
+    if (output != nullptr) {
+        assert(isLineOpen);
+
+        char line[MAX_LINE_LENGTH];
+        appendText(line, sprintf(line, " %lld", (long long)operand));
+    }
+    currentByteOffset += sizeof(int64_t);
 }
 
 /**
@@ -228,83 +500,285 @@ void DisassemblyBuffer::writeOperand(double operand, bool isRamOperation) {
 void DisassemblyBuffer::writeRegister(const char* regName, bool isRamOperation) {
     assert(regName != nullptr);
 
-    strcat(lines.back().first, " ");
-    if (isRamOperation) strcat(lines.back().first, "[");
-    strcat(lines.back().first, regName);
-    if (isRamOperation) strcat(lines.back().first, "]");
-    lines.back().second += sizeof(byte);
+    if (output != nullptr) {
+        assert(isLineOpen);
+
+        appendText(" ", 1);
+        if (isRamOperation) appendText("[", 1);
+        appendText(regName);
+        if (isRamOperation) appendText("]", 1);
+    }
+    currentByteOffset += sizeof(byte);
 }
 
 /**
- * Creates and writes jump label (as argument of JMP or similar operation) into the disassembly buffer.
- * Jump labels are created from offsets, and then put into disassembly file in flushToFile method.
+ * Writes jump label (as argument of JMP or similar operation) into the disassembly buffer.
+ * Until the output is started, only the jump target is collected.
  * @param[in] labelOffset jump label offset
  */
 void DisassemblyBuffer::writeJumpLabelArgument(int labelOffset) {
     assert(labelOffset >= 0);
 
-    strcat(lines.back().first, " ");
-    strcat(lines.back().first, getLabelByOffset(labelOffset));
-    lines.back().second += sizeof(int);
+    if (output == nullptr) {
+        labelNumbers.emplace((unsigned int)labelOffset, (unsigned int)labelNumbers.size());
+    } else {
+        assert(isLineOpen);
+
+        auto label = std::lower_bound(labels.begin(), labels.end(), (unsigned int)labelOffset,
+                                      [](const Label& lhs, unsigned int offset) { return lhs.offset < offset; });
+        assert((label != labels.end()) && (label->offset == (unsigned int)labelOffset));
+
+        char argument[MAX_LINE_LENGTH];
+        appendText(argument, sprintf(argument, " L%u", label->number));
+    }
+    currentByteOffset += sizeof(int);
 }
 
 /**
- * Returns the label name by it's offset. If there's no label with the given offset, the new one is created.
- * @param[in] labelOffset offset of the label to get
- * @return name of the label.
+ * Flushes the rest of this buffer content into the file.
+ * @return 0, if flushing completed successfully;
+ *         ERR_INVALID_LABEL, if any of the labels was invalid;
+ *         ERR_INVALID_FILE, if the file can't be written.
  */
-const char* DisassemblyBuffer::getLabelByOffset(int labelOffset) {
-    assert(labelOffset >= 0);
+byte DisassemblyBuffer::flushToFile() {
+    assert(output != nullptr);
 
-    if (labels.count(labelOffset) == 0) {
-        char* labelName = (char*)calloc(MAX_LABEL_LENGTH, sizeof(char));
-        unsigned int labelsNumber = labels.size();
-        sprintf(labelName, "L%u", labelsNumber);
-        labels[labelOffset] = labelName;
-    }
-    return labels[labelOffset];
+    startLine();
+    flushText();
+
+    if (hasWriteFailed) return ERR_INVALID_FILE;
+    // If there are any labels left after the code, then they are invalid, because they point to an empty fragment
+    if (hasInvalidLabels || (nextLabel < labels.size())) return ERR_INVALID_LABEL;
+
+    return 0;
 }
 
 /**
- * Flushes this buffer content into the given file. All data is cleared.
- * @param[out] output disassembly file to flush buffer into
- * @return 0, if flushing completed successfully, or ERR_INVALID_LABEL, if any of the labels was invalid.
+ * Kind of the operation in the operations table.
  */
-byte DisassemblyBuffer::flushToFile(FILE* output) {
-    assert(output != nullptr);
+enum OperationKind {
+    /** Operation that is written in the source code by it's name */
+    MNEMONIC_OPERATION = 1,
+    /** Register or RAM variant of the mnemonic operation (chosen by the operand) */
+    OPERAND_VARIANT    = 2,
+    /** Fused operation (superinstruction), which is emitted by the assembler only */
+    FUSED_OPERATION    = 3,
+};
 
-    int currentByteOffset = 0;
-    for (auto& i : lines) {
-        if (labels.count(currentByteOffset) != 0) {
-            char* label = labels[currentByteOffset];
-            fprintf(output, "%s:\n", label);
-            free(label);
-            labels.erase(currentByteOffset);
-        }
+/**
+ * Description of the operation: all per-opcode properties used by the assembler, disassembler and machines.
+ */
+struct OperationInfo {
+    const char* name = nullptr;
+    byte opcode = ERR_INVALID_OPERATION;
+    /** Number of operands, or ERR_INVALID_OPERATION for fused operations (their operands are read by machines) */
+    byte arity = ERR_INVALID_OPERATION;
+    OperationKind kind = MNEMONIC_OPERATION;
+    bool isJump = false;
+};
 
-        char* line = i.first;
-        fprintf(output, "%s\n", line);
-        currentByteOffset += i.second;
-        free(line);
+/** All operations. Adding the operation means adding it's entry here */
+static constexpr OperationInfo OPERATIONS[] = {
+    // name             opcode                  arity                  kind                isJump
+    {"IN",              IN_OPCODE,              0,                     MNEMONIC_OPERATION, false},
+    {"OUT",             OUT_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"POP",             POP_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"PUSH",            PUSH_OPCODE,            1,                     MNEMONIC_OPERATION, false},
+    {"IPOP",            IPOP_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"IPUSH",           IPUSH_OPCODE,           1,                     MNEMONIC_OPERATION, false},
+    {"ITOF",            ITOF_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"FTOI",            FTOI_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"ADD",             ADD_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"SUB",             SUB_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"MUL",             MUL_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"DIV",             DIV_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"SQRT",            SQRT_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"DUP",             DUP_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"POW",             POW_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"HLT",             HLT_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"JMP",             JMP_OPCODE,             1,                     MNEMONIC_OPERATION, true },
+    {"JMPNE",           JMPNE_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"JMPE",            JMPE_OPCODE,            1,                     MNEMONIC_OPERATION, true },
+    {"JMPL",            JMPL_OPCODE,            1,                     MNEMONIC_OPERATION, true },
+    {"JMPLE",           JMPLE_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"JMPG",            JMPG_OPCODE,            1,                     MNEMONIC_OPERATION, true },
+    {"JMPGE",           JMPGE_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"RET",             RET_OPCODE,             0,                     MNEMONIC_OPERATION, false},
+    {"CALL",            CALL_OPCODE,            1,                     MNEMONIC_OPERATION, true },
+    {"TAILCALL",        TAILCALL_OPCODE,        1,                     MNEMONIC_OPERATION, true },
+    {"IADD",            IADD_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"ISUB",            ISUB_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"IMUL",            IMUL_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"IJMPNE",          IJMPNE_OPCODE,          1,                     MNEMONIC_OPERATION, true },
+    {"IJMPE",           IJMPE_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"IJMPL",           IJMPL_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"IJMPLE",          IJMPLE_OPCODE,          1,                     MNEMONIC_OPERATION, true },
+    {"IJMPG",           IJMPG_OPCODE,           1,                     MNEMONIC_OPERATION, true },
+    {"IJMPGE",          IJMPGE_OPCODE,          1,                     MNEMONIC_OPERATION, true },
+    {"VADD",            VADD_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"VMUL",            VMUL_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"VSUM",            VSUM_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"VDOT",            VDOT_OPCODE,            0,                     MNEMONIC_OPERATION, false},
+    {"VFILL",           VFILL_OPCODE,           0,                     MNEMONIC_OPERATION, false},
+    {"VCOPY",           VCOPY_OPCODE,           0,                     MNEMONIC_OPERATION, false},
+    {"PUSH",            PUSHR_OPCODE,           1,                     OPERAND_VARIANT,    false},
+    {"PUSH",            PUSHM_OPCODE,           1,                     OPERAND_VARIANT,    false},
+    {"PUSH",            PUSHRM_OPCODE,          1,                     OPERAND_VARIANT,    false},
+    {"POP",             POPR_OPCODE,            1,                     OPERAND_VARIANT,    false},
+    {"POP",             POPM_OPCODE,            1,                     OPERAND_VARIANT,    false},
+    {"POP",             POPRM_OPCODE,           1,                     OPERAND_VARIANT,    false},
+    {"IPUSH",           IPUSHR_OPCODE,          1,                     OPERAND_VARIANT,    false},
+    {"IPOP",            IPOPR_OPCODE,           1,                     OPERAND_VARIANT,    false},
+    {"CMP_IMM_JMPNE",   CMP_IMM_JMPNE_OPCODE,   ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"CMP_IMM_JMPE",    CMP_IMM_JMPE_OPCODE,    ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"CMP_IMM_JMPL",    CMP_IMM_JMPL_OPCODE,    ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"CMP_IMM_JMPLE",   CMP_IMM_JMPLE_OPCODE,   ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"CMP_IMM_JMPG",    CMP_IMM_JMPG_OPCODE,    ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"CMP_IMM_JMPGE",   CMP_IMM_JMPGE_OPCODE,   ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"PUSHR_PUSHR_MUL", PUSHR_PUSHR_MUL_OPCODE, ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"DUP_ADD",         DUP_ADD_OPCODE,         ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+    {"POPR_PUSHR",      POPR_PUSHR_OPCODE,      ERR_INVALID_OPERATION, FUSED_OPERATION,    false},
+};
+
+/** Register names by their numbers */
+static constexpr const char* REGISTER_NAMES[] = {"AX", "BX", "CX", "DX"};
+static_assert(sizeof(REGISTER_NAMES) / sizeof(REGISTER_NAMES[0]) == REGISTERS_NUMBER, "Each register needs a name");
+
+/** Integer register names by their numbers */
+static constexpr const char* INTEGER_REGISTER_NAMES[] = {"IAX", "IBX", "ICX", "IDX"};
+static_assert(sizeof(INTEGER_REGISTER_NAMES) / sizeof(INTEGER_REGISTER_NAMES[0]) == REGISTERS_NUMBER,
+              "Each integer register needs a name");
+
+/**
+ * Operations table indexed by the operation code. Entries of invalid operation codes have no name.
+ */
+struct OpcodeTable {
+    OperationInfo operations[256];
+};
+
+static constexpr OpcodeTable makeOpcodeTable() {
+    OpcodeTable table {};
+    for (const OperationInfo& operation : OPERATIONS) {
+        table.operations[operation.opcode] = operation;
     }
-    lines.clear();
+    return table;
+}
 
-    if (labels.count(currentByteOffset) != 0) {
-        char* label = labels[currentByteOffset];
-        fprintf(output, "%s:\n", label);
-        free(label);
-        labels.erase(currentByteOffset);
+static constexpr bool hasUniqueOpcodes() {
+    for (size_t i = 0; i < sizeof(OPERATIONS) / sizeof(OPERATIONS[0]); ++i) {
+        for (size_t j = i + 1; j < sizeof(OPERATIONS) / sizeof(OPERATIONS[0]); ++j) {
+            if (OPERATIONS[i].opcode == OPERATIONS[j].opcode) return false;
+        }
     }
+    return true;
+}
 
-    // If there are any labels left after the code, then they are invalid, because they point to an empty fragment
-    if (!labels.empty()) {
-        for (auto entry : labels) {
-            free(entry.second);
+static_assert(hasUniqueOpcodes(), "Operation codes must be unique");
+
+static constexpr OpcodeTable OPCODE_TABLE = makeOpcodeTable();
+
+/** Number of slots in the name hash table (power of 2) */
+constexpr static unsigned int NAME_HASH_TABLE_BITS = 7u;
+constexpr static unsigned int NAME_HASH_TABLE_SIZE = 1u << NAME_HASH_TABLE_BITS;
+
+/**
+ * Perfect hash table of names (mnemonics or registers): each name has it's own slot, so the name is found by a single
+ * string comparison.
+ */
+struct NameHashTable {
+    /** Seed of the hash function, or 0 if no seed without collisions was found */
+    uint32_t seed = 0;
+    const char* names[NAME_HASH_TABLE_SIZE] = {};
+    byte values[NAME_HASH_TABLE_SIZE] = {};
+};
+
+/**
+ * Names and their values that are put into the name hash table.
+ */
+struct NameList {
+    const char* names[NAME_HASH_TABLE_SIZE] = {};
+    byte values[NAME_HASH_TABLE_SIZE] = {};
+    size_t size = 0;
+};
+
+/**
+ * Gets the slot of the name in the name hash table (FNV-1a hash with the given seed as the offset basis).
+ * @param[in] name name to hash
+ * @param[in] seed seed of the hash function
+ * @return index of the slot.
+ */
+static constexpr unsigned int getNameSlot(const char* name, uint32_t seed) {
+    uint32_t hash = seed;
+    for (; *name != '\0'; ++name) {
+        hash = (hash ^ (byte)*name) * 16777619u;
+    }
+    return hash >> (32u - NAME_HASH_TABLE_BITS);
+}
+
+/**
+ * Builds the name hash table, looking for the hash function seed which maps all names into distinct slots.
+ * @param[in] list names and their values
+ * @return name hash table, or the table with zero seed, if there is no such seed.
+ */
+static constexpr NameHashTable makeNameHashTable(const NameList& list) {
+    for (uint32_t seed = 2166136261u; seed != 2166136261u + 100000u; ++seed) {
+        NameHashTable table {};
+        bool hasCollisions = false;
+        for (size_t i = 0; (i < list.size) && !hasCollisions; ++i) {
+            unsigned int slot = getNameSlot(list.names[i], seed);
+            hasCollisions = (table.names[slot] != nullptr);
+            table.names[slot] = list.names[i];
+            table.values[slot] = list.values[i];
+        }
+        if (!hasCollisions) {
+            table.seed = seed;
+            return table;
         }
-        return ERR_INVALID_LABEL;
     }
+    return NameHashTable();
+}
 
-    return 0;
+static constexpr NameList getMnemonics() {
+    NameList list {};
+    for (const OperationInfo& operation : OPERATIONS) {
+        if (operation.kind != MNEMONIC_OPERATION) continue;
+        list.names[list.size] = operation.name;
+        list.values[list.size] = operation.opcode;
+        ++list.size;
+    }
+    return list;
+}
+
+static constexpr NameList getRegisterNames(const char* const (&names)[REGISTERS_NUMBER]) {
+    NameList list {};
+    for (const char* regName : names) {
+        list.names[list.size] = regName;
+        list.values[list.size] = (byte)list.size;
+        ++list.size;
+    }
+    return list;
+}
+
+static constexpr NameHashTable MNEMONICS_TABLE = makeNameHashTable(getMnemonics());
+static constexpr NameHashTable REGISTERS_TABLE = makeNameHashTable(getRegisterNames(REGISTER_NAMES));
+static constexpr NameHashTable INTEGER_REGISTERS_TABLE = makeNameHashTable(getRegisterNames(INTEGER_REGISTER_NAMES));
+
+static_assert(MNEMONICS_TABLE.seed != 0, "Mnemonics must be unique and fit into the name hash table");
+static_assert(REGISTERS_TABLE.seed != 0, "Register names must be unique and fit into the name hash table");
+static_assert(INTEGER_REGISTERS_TABLE.seed != 0,
+              "Integer register names must be unique and fit into the name hash table");
+
+/**
+ * Finds the value of the name in the given name hash table.
+ * @param[in] table    name hash table
+ * @param[in] name     name to find
+ * @param[in] notFound value to return, if there is no such name
+ * @return value of the name, or notFound value.
+ */
+static byte findName(const NameHashTable& table, const char* name, byte notFound) {
+    unsigned int slot = getNameSlot(name, table.seed);
+    if ((table.names[slot] == nullptr) || (strcmp(table.names[slot], name) != 0)) return notFound;
+    return table.values[slot];
 }
 
 /**
@@ -315,28 +789,7 @@ byte DisassemblyBuffer::flushToFile(FILE* output) {
 byte getOpcodeByOperationName(const char* operation) {
     assert(operation != nullptr);
 
-    if (strcmp(operation, "IN"   ) == 0) return IN_OPCODE   ;
-    if (strcmp(operation, "OUT"  ) == 0) return OUT_OPCODE  ;
-    if (strcmp(operation, "POP"  ) == 0) return POP_OPCODE  ;
-    if (strcmp(operation, "PUSH" ) == 0) return PUSH_OPCODE ;
-    if (strcmp(operation, "ADD"  ) == 0) return ADD_OPCODE  ;
-    if (strcmp(operation, "SUB"  ) == 0) return SUB_OPCODE  ;
-    if (strcmp(operation, "MUL"  ) == 0) return MUL_OPCODE  ;
-    if (strcmp(operation, "DIV"  ) == 0) return DIV_OPCODE  ;
-    if (strcmp(operation, "SQRT" ) == 0) return SQRT_OPCODE ;
-    if (strcmp(operation, "DUP"  ) == 0) return DUP_OPCODE  ;
-    if (strcmp(operation, "POW"  ) == 0) return POW_OPCODE  ;
-    if (strcmp(operation, "HLT"  ) == 0) return HLT_OPCODE  ;
-    if (strcmp(operation, "JMP"  ) == 0) return JMP_OPCODE  ;
-    if (strcmp(operation, "JMPNE") == 0) return JMPNE_OPCODE;
-    if (strcmp(operation, "JMPE" ) == 0) return JMPE_OPCODE ;
-    if (strcmp(operation, "JMPL" ) == 0) return JMPL_OPCODE ;
-    if (strcmp(operation, "JMPLE") == 0) return JMPLE_OPCODE;
-    if (strcmp(operation, "JMPG" ) == 0) return JMPG_OPCODE ;
-    if (strcmp(operation, "JMPGE") == 0) return JMPGE_OPCODE;
-    if (strcmp(operation, "RET"  ) == 0) return RET_OPCODE  ;
-    if (strcmp(operation, "CALL" ) == 0) return CALL_OPCODE ;
-    return ERR_INVALID_OPERATION;
+    return findName(MNEMONICS_TABLE, operation, ERR_INVALID_OPERATION);
 }
 
 /**
@@ -345,30 +798,7 @@ byte getOpcodeByOperationName(const char* operation) {
  * @return operation name, or nullptr if operation is invalid.
  */
 const char* getOperationNameByOpcode(byte opcode) {
-    switch (opcode) {
-        case IN_OPCODE:    return "IN"   ;
-        case OUT_OPCODE:   return "OUT"  ;
-        case POP_OPCODE:   case POPR_OPCODE:  case POPM_OPCODE:  case POPRM_OPCODE:  return "POP" ;
-        case PUSH_OPCODE:  case PUSHR_OPCODE: case PUSHM_OPCODE: case PUSHRM_OPCODE: return "PUSH";
-        case ADD_OPCODE:   return "ADD"  ;
-        case SUB_OPCODE:   return "SUB"  ;
-        case MUL_OPCODE:   return "MUL"  ;
-        case DIV_OPCODE:   return "DIV"  ;
-        case SQRT_OPCODE:  return "SQRT" ;
-        case DUP_OPCODE:   return "DUP"  ;
-        case POW_OPCODE:   return "POW"  ;
-        case HLT_OPCODE:   return "HLT"  ;
-        case JMP_OPCODE:   return "JMP"  ;
-        case JMPNE_OPCODE: return "JMPNE";
-        case JMPE_OPCODE:  return "JMPE" ;
-        case JMPL_OPCODE:  return "JMPL" ;
-        case JMPLE_OPCODE: return "JMPLE";
-        case JMPG_OPCODE:  return "JMPG" ;
-        case JMPGE_OPCODE: return "JMPGE";
-        case RET_OPCODE:   return "RET"  ;
-        case CALL_OPCODE:  return "CALL" ;
-        default: return nullptr;
-    }
+    return OPCODE_TABLE.operations[opcode].name;
 }
 
 /**
@@ -377,39 +807,7 @@ const char* getOperationNameByOpcode(byte opcode) {
  * @return arity of the operation, or ERR_INVALID_OPERATION if operation is invalid.
  */
 byte getOperationArityByOpcode(byte opcode) {
-    switch (opcode) {
-        case IN_OPCODE:
-        case OUT_OPCODE:
-        case POP_OPCODE:
-        case ADD_OPCODE:
-        case SUB_OPCODE:
-        case MUL_OPCODE:
-        case DIV_OPCODE:
-        case SQRT_OPCODE:
-        case DUP_OPCODE:
-        case POW_OPCODE:
-        case RET_OPCODE:
-        case HLT_OPCODE:
-            return 0;
-        case PUSH_OPCODE:
-        case PUSHR_OPCODE:
-        case PUSHM_OPCODE:
-        case PUSHRM_OPCODE:
-        case POPR_OPCODE:
-        case POPM_OPCODE:
-        case POPRM_OPCODE:
-        case JMP_OPCODE:
-        case JMPNE_OPCODE:
-        case JMPE_OPCODE:
-        case JMPL_OPCODE:
-        case JMPLE_OPCODE:
-        case JMPG_OPCODE:
-        case JMPGE_OPCODE:
-        case CALL_OPCODE:
-            return 1;
-        default:
-            return ERR_INVALID_OPERATION;
-    }
+    return OPCODE_TABLE.operations[opcode].arity;
 }
 
 /**
@@ -420,11 +818,7 @@ byte getOperationArityByOpcode(byte opcode) {
 byte getRegisterNumberByName(const char* regName) {
     assert(regName != nullptr);
 
-    if (strcmp(regName, "AX") == 0) return 0;
-    if (strcmp(regName, "BX") == 0) return 1;
-    if (strcmp(regName, "CX") == 0) return 2;
-    if (strcmp(regName, "DX") == 0) return 3;
-    return ERR_INVALID_REGISTER;
+    return findName(REGISTERS_TABLE, regName, ERR_INVALID_REGISTER);
 }
 
 /**
@@ -433,13 +827,29 @@ byte getRegisterNumberByName(const char* regName) {
  * @return register name, or nullptr if register is invalid.
  */
 const char* getRegisterNameByNumber(byte regNumber) {
-    switch (regNumber) {
-        case 0: return "AX";
-        case 1: return "BX";
-        case 2: return "CX";
-        case 3: return "DX";
-        default: return nullptr;
-    }
+    if (regNumber >= REGISTERS_NUMBER) return nullptr;
+    return REGISTER_NAMES[regNumber];
+}
+
+/**
+ * Gets the integer register number by it's name.
+ * @param[in] regName name of the integer register
+ * @return register number, or ERR_INVALID_REGISTER if integer register is invalid.
+ */
+byte getIntegerRegisterNumberByName(const char* regName) {
+    assert(regName != nullptr);
+
+    return findName(INTEGER_REGISTERS_TABLE, regName, ERR_INVALID_REGISTER);
+}
+
+/**
+ * Gets the integer register name by it's number.
+ * @param[in] regNumber number of the integer register
+ * @return register name, or nullptr if register is invalid.
+ */
+const char* getIntegerRegisterNameByNumber(byte regNumber) {
+    if (regNumber >= REGISTERS_NUMBER) return nullptr;
+    return INTEGER_REGISTER_NAMES[regNumber];
 }
 
 /**
@@ -504,6 +914,26 @@ double parseOperand(char*& line) {
     return operand;
 }
 
+/**
+ * Converts the given token to the int64 operand. Only decimal integers, that fit into int64, are converted.
+ * @param[in]  token token to convert
+ * @param[out] value converted value
+ * @return true, if the token is an integer literal, false otherwise.
+ */
+bool toIntegerLiteral(const char* token, int64_t& value) {
+    assert(token != nullptr);
+
+    const char* digits = ((*token == '-') || (*token == '+')) ? token + 1 : token;
+    if (!isdigit((byte)*digits)) return false;
+
+    errno = 0;
+    char* endptr = nullptr;
+    long long literal = strtoll(token, &endptr, 10);
+    if ((*endptr != '\0') || (errno == ERANGE)) return false;
+    value = literal;
+    return true;
+}
+
 /**
  * Parses first possible register from the given string.
  * Note that the given string is also modified (pointer moved to the next token).
@@ -562,74 +992,285 @@ bool asRamAccess(char*& token) {
  * @return true, if the given operation is jump operation, false otherwise.
  */
 bool isJumpOperation(byte opcode) {
-    return opcode == JMP_OPCODE   ||
-           opcode == JMPNE_OPCODE ||
-           opcode == JMPE_OPCODE  ||
-           opcode == JMPL_OPCODE  ||
-           opcode == JMPLE_OPCODE ||
-           opcode == JMPG_OPCODE  ||
-           opcode == JMPGE_OPCODE ||
-           opcode == CALL_OPCODE;
+    return OPCODE_TABLE.operations[opcode].isJump;
 }
 
 /**
- * Reads the next operation from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Checks if the given opcode is the fused operation (superinstruction).
+ * @param[in] opcode operation code to check
+ * @return true, if the given operation is fused operation, false otherwise.
+ */
+bool isFusedOperation(byte opcode) {
+    return (OPCODE_TABLE.operations[opcode].name != nullptr) && (OPCODE_TABLE.operations[opcode].kind == FUSED_OPERATION);
+}
+
+/**
+ * Checks if the given opcode is the fused comparison with immediate and conditional jump (CMP_IMM_JMP* operation).
+ * @param[in] opcode operation code to check
+ * @return true, if the given operation is CMP_IMM_JMP* operation, false otherwise.
+ */
+bool isFusedJumpOperation(byte opcode) {
+    return (opcode >= CMP_IMM_JMPNE_OPCODE) && (opcode <= CMP_IMM_JMPGE_OPCODE);
+}
+
+/**
+ * Gets the conditional jump operation fused into the given CMP_IMM_JMP* operation.
+ * @param[in] opcode code of the CMP_IMM_JMP* operation
+ * @return code of the conditional jump operation.
+ */
+byte getFusedJumpOpcode(byte opcode) {
+    assert(isFusedJumpOperation(opcode));
+
+    return opcode - CMP_IMM_JMPNE_OPCODE + JMPNE_OPCODE;
+}
+
+/**
+ * Gets the CMP_IMM_JMP* operation that fuses PUSH of an immediate with the given conditional jump.
+ * @param[in] jumpOpcode code of the conditional jump operation
+ * @return code of the CMP_IMM_JMP* operation, or ERR_INVALID_OPERATION if there is no such operation.
+ */
+byte getFusedJumpOpcodeByJump(byte jumpOpcode) {
+    if ((jumpOpcode < JMPNE_OPCODE) || (jumpOpcode > JMPGE_OPCODE)) return ERR_INVALID_OPERATION;
+    return jumpOpcode - JMPNE_OPCODE + CMP_IMM_JMPNE_OPCODE;
+}
+
+/**
+ * Checks if the conditional jump with the given operands is taken.
+ * @param[in] opcode code of the jump operation (JMP and CALL are always taken)
+ * @param[in] lhs    left hand side operand of the comparison
+ * @param[in] rhs    right hand side operand of the comparison
+ * @return true, if jump is taken, false otherwise.
+ */
+bool isJumpTaken(byte opcode, double lhs, double rhs) {
+    assert(isJumpOperation(opcode));
+
+    switch (opcode) {
+        case JMPE_OPCODE:  return fabs(lhs - rhs) <  COMPARE_EPS;
+        case JMPNE_OPCODE: return fabs(lhs - rhs) >= COMPARE_EPS;
+        case JMPL_OPCODE:  return lhs <  rhs;
+        case JMPLE_OPCODE: return lhs <= rhs;
+        case JMPG_OPCODE:  return lhs >  rhs;
+        case JMPGE_OPCODE: return lhs >= rhs;
+        default:           return true;
+    }
+}
+
+/**
+ * Checks if the given operation code is actually an error code.
+ * @param[in] opcode operation code to check
+ * @return true, if the operation code is error code, false otherwise.
+ */
+bool isError(byte opcode) {
+    return opcode == ERR_INVALID_OPERATION ||
+           opcode == ERR_INVALID_REGISTER  ||
+           opcode == ERR_STACK_UNDERFLOW   ||
+           opcode == ERR_INVALID_LABEL     ||
+           opcode == ERR_INVALID_FILE      ||
+           opcode == ERR_INVALID_RAM_ADDRESS ||
+           opcode == ERR_BUDGET_EXHAUSTED  ||
+           opcode == ERR_TRACE_MISMATCH;
+}
+
+/**
+ * Decodes the fused operation located at the given offset of the assembly.
+ * Operands are validated in the same order as StackMachine::processFusedOperation reads them.
+ * @param[in]  assembly     assembly to decode operation from
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[in]  offset       byte offset of the operation to decode
+ * @param[out] operation    decoded operation with opcode and size of one byte already set
+ * @return operation code, if operation was decoded successfully, or error code, if operation is invalid.
+ */
+static byte decodeFusedOperation(const byte* assembly, int assemblySize, int offset, DecodedOperation& operation) {
+    byte opcode = operation.opcode;
+    const byte* operands = assembly + offset + sizeof(byte);
+
+    int operandsSize = 0;
+    if (isFusedJumpOperation(opcode))          operandsSize = sizeof(double) + sizeof(int);
+    else if (opcode == PUSHR_PUSHR_MUL_OPCODE) operandsSize = 2 * sizeof(byte);
+    else if (opcode == POPR_PUSHR_OPCODE)      operandsSize = sizeof(byte);
+    if (offset + (int)sizeof(byte) + operandsSize > assemblySize) return ERR_INVALID_OPERATION;
+    operation.size += operandsSize;
+
+    if (isFusedJumpOperation(opcode)) {
+        memcpy(&operation.operand, operands, sizeof(operation.operand));
+        if (!std::isfinite(operation.operand)) return ERR_INVALID_OPERATION;
+
+        int jumpOffset = 0;
+        memcpy(&jumpOffset, operands + sizeof(double), sizeof(jumpOffset));
+        // Jump offset is calculated relative to the beginning of the offset itself
+        operation.jumpTarget = offset + (int)(sizeof(byte) + sizeof(double)) + jumpOffset;
+    } else if (opcode == PUSHR_PUSHR_MUL_OPCODE) {
+        operation.reg = operands[0];
+        if (operation.reg >= REGISTERS_NUMBER) return ERR_INVALID_REGISTER;
+        operation.reg2 = operands[1];
+        if (operation.reg2 >= REGISTERS_NUMBER) return ERR_INVALID_REGISTER;
+    } else if (opcode == POPR_PUSHR_OPCODE) {
+        operation.reg = operands[0];
+        if (operation.reg >= REGISTERS_NUMBER) return ERR_INVALID_REGISTER;
+    }
+    return opcode;
+}
+
+/**
+ * Decodes the operation located at the given offset of the assembly.
+ * Performs the same validation that is done by AssemblyMachine::processNextOperation before operation is processed.
+ * @param[in]  assembly     assembly to decode operation from
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[in]  offset       byte offset of the operation to decode
+ * @param[out] operation    decoded operation. Size is set even if operation is invalid (but at least to one byte)
+ * @return operation code, if operation was decoded successfully;
+ *         ERR_INVALID_OPERATION, if operation code or immediate operand is invalid, or operation is truncated;
+ *         ERR_INVALID_REGISTER, if register number is invalid.
+ */
+byte decodeOperation(const byte* assembly, int assemblySize, int offset, DecodedOperation& operation) {
+    assert(assembly != nullptr);
+    assert((offset >= 0) && (offset < assemblySize));
+
+    operation = DecodedOperation();
+    operation.opcode = assembly[offset];
+    operation.size = sizeof(byte);
+
+    byte opcode = operation.opcode;
+    if (isFusedOperation(opcode)) return decodeFusedOperation(assembly, assemblySize, offset, operation);
+    if (getOperationArityByOpcode(opcode) != 1) {
+        return (getOperationArityByOpcode(opcode) == 0) ? opcode : ERR_INVALID_OPERATION;
+    }
+
+    const byte* operand = assembly + offset + sizeof(byte);
+    int operandSize = 0;
+    if ((opcode & IS_REG_OP_MASK) != 0) {
+        operandSize = sizeof(byte);
+    } else if (isJumpOperation(opcode)) {
+        operandSize = sizeof(int);
+    } else if (opcode == IPUSH_OPCODE) {
+        operandSize = sizeof(int64_t);
+    } else {
+        operandSize = sizeof(double);
+    }
+    if (offset + (int)sizeof(byte) + operandSize > assemblySize) return ERR_INVALID_OPERATION;
+    operation.size += operandSize;
+
+    if ((opcode & IS_REG_OP_MASK) != 0) {
+        operation.reg = *operand;
+        if (operation.reg >= REGISTERS_NUMBER) return ERR_INVALID_REGISTER;
+    } else if (isJumpOperation(opcode)) {
+        int jumpOffset = 0;
+        memcpy(&jumpOffset, operand, sizeof(jumpOffset));
+        // Jump offset is calculated relative to the beginning of the offset itself
+        operation.jumpTarget = offset + (int)sizeof(byte) + jumpOffset;
+    } else if (opcode == IPUSH_OPCODE) {
+        memcpy(&operation.integerOperand, operand, sizeof(operation.integerOperand));
+    } else {
+        memcpy(&operation.operand, operand, sizeof(operation.operand));
+        if (!std::isfinite(operation.operand)) return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Reads the next byte from assembly. Bytes after the end of assembly are read as 0xFF, as with fgetc past end of file.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
+ * @param[in, out] currentByteOffset current offset in bytes
+ * @return byte read.
+ */
+static byte asmReadByte(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    byte b = (currentByteOffset < assemblySize) ? assembly[currentByteOffset] : (byte)EOF;
+    ++currentByteOffset;
+    return b;
+}
+
+/**
+ * Reads the next operation from assembly. Increases offset by the number of bytes read.
+ * As with reading past the end of file, bytes after the end of assembly are read as 0xFF.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return operation code of the operation read.
  */
-byte asmReadOperation(FILE* input, int& currentByteOffset) {
-    assert(input != nullptr);
+byte asmReadOperation(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    assert(assembly != nullptr || assemblySize == 0);
 
-    currentByteOffset += sizeof(byte);
-    return fgetc(input);
+    return asmReadByte(assembly, assemblySize, currentByteOffset);
 }
 
 /**
- * Reads the next double operand from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next double operand from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return operand read.
  */
-double asmReadOperand(FILE* input, int& currentByteOffset) {
-    assert(input != nullptr);
+double asmReadOperand(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    assert(assembly != nullptr || assemblySize == 0);
 
-    currentByteOffset += sizeof(double);
     doubleAsBytes doubleBytes { 0 };
-    for (byte& b : doubleBytes.bytes) {
-        b = fgetc(input);
+    if (currentByteOffset + (int)sizeof(double) <= assemblySize) {
+        memcpy(doubleBytes.bytes, assembly + currentByteOffset, sizeof(double));
+        currentByteOffset += sizeof(double);
+    } else {
+        for (byte& b : doubleBytes.bytes) {
+            b = asmReadByte(assembly, assemblySize, currentByteOffset);
+        }
     }
     return doubleBytes.doubleValue;
 }
 
 /**
- * Reads the next register from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next int64 operand from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
+ * @param[in, out] currentByteOffset current offset in bytes
+ * @return operand read.
+ */
+int64_t asmReadIntegerOperand(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    assert(assembly != nullptr || assemblySize == 0);
+
+    int64AsBytes intBytes { 0 };
+    if (currentByteOffset + (int)sizeof(int64_t) <= assemblySize) {
+        memcpy(intBytes.bytes, assembly + currentByteOffset, sizeof(int64_t));
+        currentByteOffset += sizeof(int64_t);
+    } else {
+        for (byte& b : intBytes.bytes) {
+            b = asmReadByte(assembly, assemblySize, currentByteOffset);
+        }
+    }
+    return intBytes.intValue;
+}
+
+/**
+ * Reads the next register from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return register number read, or ERR_INVALID_REGISTER, if register number is invalid.
  */
-byte asmReadRegister(FILE* input, int& currentByteOffset) {
-    assert(input != nullptr);
+byte asmReadRegister(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    assert(assembly != nullptr || assemblySize == 0);
 
-    currentByteOffset += sizeof(byte);
-    byte reg = fgetc(input);
+    byte reg = asmReadByte(assembly, assemblySize, currentByteOffset);
     if (reg >= REGISTERS_NUMBER) return ERR_INVALID_REGISTER;
     return reg;
 }
 
 /**
- * Reads the next jump offset from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next jump offset from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return jump offset.
  */
-int asmReadJumpOffset(FILE* input, int& currentByteOffset) {
-    assert(input != nullptr);
+int asmReadJumpOffset(const byte* assembly, int assemblySize, int& currentByteOffset) {
+    assert(assembly != nullptr || assemblySize == 0);
 
-    currentByteOffset += sizeof(int);
     intAsBytes intBytes { 0 };
-    for (byte& b : intBytes.bytes) {
-        b = fgetc(input);
+    if (currentByteOffset + (int)sizeof(int) <= assemblySize) {
+        memcpy(intBytes.bytes, assembly + currentByteOffset, sizeof(int));
+        currentByteOffset += sizeof(int);
+    } else {
+        for (byte& b : intBytes.bytes) {
+            b = asmReadByte(assembly, assemblySize, currentByteOffset);
+        }
     }
     return intBytes.intValue;
 }
@@ -716,5 +1357,9 @@ void printErrorMessageForExitCode(int exitCode) {
         fprintf(stderr, "Invalid file name or path\n");
     } else if (exitCode == ERR_INVALID_RAM_ADDRESS) {
         fprintf(stderr, "Invalid RAM address\n");
+    } else if (exitCode == ERR_BUDGET_EXHAUSTED) {
+        fprintf(stderr, "Execution budget exhausted\n");
+    } else if (exitCode == ERR_TRACE_MISMATCH) {
+        fprintf(stderr, "Execution differs from the trace\n");
     }
 }
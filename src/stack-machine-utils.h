@@ -5,14 +5,21 @@
 #ifndef STACK_MACHINE_STACK_MACHINE_UTILS_H
 #define STACK_MACHINE_STACK_MACHINE_UTILS_H
 
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
-#include <map>
+#include <memory>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
+#include "arena.h"
+
+#if defined(__x86_64__)
+    #include <emmintrin.h>
+#endif
 
 #define IN_OPCODE    0b00000001u
 #define OUT_OPCODE   0b00000010u
@@ -36,15 +43,52 @@
 
 #define RET_OPCODE   0b00110000u
 #define CALL_OPCODE  0b00110001u
+#define TAILCALL_OPCODE 0b00110101u // CALL label, RET: jumps to the label, the callee returns to the caller's caller
+
+// Integer operations. They work on the integer stack of int64 values, that is separate from the operand stack
+#define IPOP_OPCODE   0b00000110u
+#define IPUSH_OPCODE  0b00000111u // int64 immediate
+#define ITOF_OPCODE   0b00001111u // moves the integer top to the operand stack as double
+#define FTOI_OPCODE   0b00010000u // moves the operand stack top to the integer stack (see toIntegerOperand)
+#define IADD_OPCODE   0b00110010u
+#define ISUB_OPCODE   0b00110011u
+#define IMUL_OPCODE   0b00110100u
+#define IJMPNE_OPCODE 0b00101010u // !=
+#define IJMPE_OPCODE  0b00101011u // ==
+#define IJMPL_OPCODE  0b00101100u // <
+#define IJMPLE_OPCODE 0b00101101u // <=
+#define IJMPG_OPCODE  0b00101110u // >
+#define IJMPGE_OPCODE 0b00101111u // >=
+
+// Vector operations over RAM ranges. Addresses and count of elements are popped from the stack (count is on top)
+#define VADD_OPCODE  0b00111000u // dst, lhs, rhs, count: RAM[dst + i] = RAM[lhs + i] + RAM[rhs + i]
+#define VMUL_OPCODE  0b00111001u // dst, lhs, rhs, count: RAM[dst + i] = RAM[lhs + i] * RAM[rhs + i]
+#define VSUM_OPCODE  0b00111010u // src, count: push sum of RAM[src + i]
+#define VDOT_OPCODE  0b00111011u // lhs, rhs, count: push sum of RAM[lhs + i] * RAM[rhs + i]
+#define VFILL_OPCODE 0b00111100u // dst, value, count: RAM[dst + i] = value
+#define VCOPY_OPCODE 0b00111101u // dst, src, count: RAM[dst + i] = RAM[src + i]
 
 #define HLT_OPCODE   0b00000000u
 
+// Fused operations (superinstructions). Emitted by the assembler with -O flag instead of the operations sequence
+#define CMP_IMM_JMPNE_OPCODE   0b00010010u // PUSH imm, JMPNE label
+#define CMP_IMM_JMPE_OPCODE    0b00010011u // PUSH imm, JMPE  label
+#define CMP_IMM_JMPL_OPCODE    0b00010100u // PUSH imm, JMPL  label
+#define CMP_IMM_JMPLE_OPCODE   0b00010101u // PUSH imm, JMPLE label
+#define CMP_IMM_JMPG_OPCODE    0b00010110u // PUSH imm, JMPG  label
+#define CMP_IMM_JMPGE_OPCODE   0b00010111u // PUSH imm, JMPGE label
+#define PUSHR_PUSHR_MUL_OPCODE 0b00011000u // PUSH reg1, PUSH reg2, MUL
+#define DUP_ADD_OPCODE         0b00011001u // DUP, ADD
+#define POPR_PUSHR_OPCODE      0b00011010u // POP reg, PUSH reg (the same register)
+
 #define ERR_INVALID_OPERATION   0b11111111u
 #define ERR_INVALID_REGISTER    0b11111110u
 #define ERR_STACK_UNDERFLOW     0b11111101u
 #define ERR_INVALID_LABEL       0b11111100u
 #define ERR_INVALID_FILE        0b11111011u
 #define ERR_INVALID_RAM_ADDRESS 0b11111010u
+#define ERR_BUDGET_EXHAUSTED    0b11111001u
+#define ERR_TRACE_MISMATCH      0b11111000u
 
 #define REGISTERS_NUMBER 4u
 #define IS_REG_OP_MASK 0b10000000u
@@ -56,21 +100,40 @@
 #define POPR_OPCODE   (POP_OPCODE  | IS_REG_OP_MASK)
 #define POPM_OPCODE   (POP_OPCODE  | IS_RAM_OP_MASK)
 #define POPRM_OPCODE  (POP_OPCODE  | IS_REG_OP_MASK | IS_RAM_OP_MASK)
+// Register operand of IPUSH and IPOP is the number of the integer register
+#define IPUSHR_OPCODE (IPUSH_OPCODE | IS_REG_OP_MASK)
+#define IPOPR_OPCODE  (IPOP_OPCODE  | IS_REG_OP_MASK)
 
 #define COMPARE_EPS 1e-9
 
+class BytecodeImage;
+
 class AssemblyMachine {
 
 protected:
     double* registers = nullptr;
+    /** Integer registers (IAX..IDX), that are read and written by IPUSH and IPOP */
+    int64_t* integerRegisters = nullptr;
     int pc = -1;
-    unsigned char* assembly = nullptr;
+    const unsigned char* assembly = nullptr;
     int assemblySize = -1;
+    /** Image the assembly belongs to. The image is shared with other machines that run the same file */
+    std::shared_ptr<const BytecodeImage> image;
 
 public:
+    /**
+     * Loads the given assembly file (see BytecodeImage::load).
+     * @param[in] assemblyFileName assembly file name
+     */
     explicit AssemblyMachine(const char* assemblyFileName);
 
-    ~AssemblyMachine();
+    /**
+     * Uses the given image of the assembly file.
+     * @param[in] image image of the assembly file, or nullptr if the file is invalid
+     */
+    explicit AssemblyMachine(std::shared_ptr<const BytecodeImage> image);
+
+    virtual ~AssemblyMachine();
 
     AssemblyMachine(AssemblyMachine& assemblyMachine) = delete;
     AssemblyMachine &operator=(const AssemblyMachine&) = delete;
@@ -79,6 +142,14 @@ public:
         return assemblySize;
     }
 
+    const unsigned char* getAssembly() const {
+        return assembly;
+    }
+
+    const std::shared_ptr<const BytecodeImage>& getImage() const {
+        return image;
+    }
+
     /**
      * Reads the next operation from assembly machine. Increases pc by the number of bytes read.
      * @param[in, out] assemblyMachine assembly machine to read operation from
@@ -93,6 +164,12 @@ public:
      */
     double getNextOperand();
 
+    /**
+     * Reads the next int64 operand (of IPUSH) from assembly machine. Increases pc by the number of bytes read.
+     * @return operand read.
+     */
+    int64_t getNextIntegerOperand();
+
     /**
      * Reads the next register from assembly machine. Increases pc by the number of bytes read.
      * @param[in, out] assemblyMachine stack machine to read register from
@@ -122,6 +199,14 @@ public:
      */
     virtual unsigned char processOperation(unsigned char opcode, double& operand) = 0;
 
+    /**
+     * Processes the operation with the integer operand: IPUSH of the immediate, IPUSH or IPOP of the integer register.
+     * @param[in]      opcode  code of the operation to process
+     * @param[in, out] operand operand to process
+     * @return given operation code or error code, if operation was invalid.
+     */
+    virtual unsigned char processIntegerOperation(unsigned char opcode, int64_t& operand) = 0;
+
     /**
      * Processes the jump operation.
      * @param[in] opcode     code of the jump operation to process
@@ -130,6 +215,13 @@ public:
      */
     virtual unsigned char processJumpOperation(unsigned char opcode, int jumpOffset) = 0;
 
+    /**
+     * Processes the fused operation. Operands of the operation are read by the implementation.
+     * @param[in] opcode code of the fused operation to process
+     * @return given operation code or error code, if operation was invalid.
+     */
+    virtual unsigned char processFusedOperation(unsigned char opcode) = 0;
+
     /**
      * Processes the next operation.
      * @return processed operation code or error code, if operation was invalid.
@@ -137,19 +229,72 @@ public:
     unsigned char processNextOperation();
 };
 
+/** Maximal number of values that are reserved in the operand or call stack before program runs */
+#define MAX_STACK_RESERVE (1u << 20)
+
 /**
- * Associative table for code labels. Stores labels' names and offsets.
+ * Expected maximal depths of the operand and call stacks. Stacks are allocated with this capacity, so they don't grow
+ * while program runs. Zero depth means that nothing is reserved.
+ */
+struct StackReserve {
+    unsigned int operandStackDepth = 0;
+    unsigned int callStackDepth = 0;
+};
+
+/**
+ * Operation decoded from the assembly.
+ */
+struct DecodedOperation {
+    /** Operation code */
+    unsigned char opcode = ERR_INVALID_OPERATION;
+    /** Register number (for register operations) */
+    unsigned char reg = 0;
+    /** Second register number (for PUSHR_PUSHR_MUL operation) */
+    unsigned char reg2 = 0;
+    /** Immediate operand: value or RAM address (for non-register single operand operations and CMP_IMM_JMP* operations) */
+    double operand = 0;
+    /** Immediate int64 operand (for IPUSH operation) */
+    int64_t integerOperand = 0;
+    /** Absolute byte offset of the jump destination (for jump and CMP_IMM_JMP* operations) */
+    int jumpTarget = -1;
+    /** Size of the encoded operation in bytes */
+    int size = 0;
+};
+
+/**
+ * Associative table for code labels. Stores labels' names and offsets in the flat hash table with open addressing.
+ * Names are stored in the arena, so they are released all at once with the table.
  */
 class LabelTable {
     constexpr static unsigned int MAX_LINE_LENGTH = 256u;
-
-    struct keyCompare {
-        bool operator()(char* a, char* b) const {
-            return strcmp(a, b) < 0;
-        }
+    constexpr static size_t MIN_CAPACITY = 64u;
+
+    struct Label {
+        /** Name of the label, or nullptr for the empty slot */
+        const char* name;
+        unsigned int nameLength;
+        uint32_t nameHash;
+        unsigned int offset;
     };
 
-    std::map<char*, unsigned int, keyCompare> labels;
+    Arena names;
+    /** Slots of the hash table. Size is a power of 2, and at least half of the slots are empty */
+    std::vector<Label> slots;
+    size_t labelsNumber = 0;
+
+    /**
+     * Finds the slot of the label with the given name, or the empty slot, where such label should be put.
+     * @param[in] name       name of the label
+     * @param[in] nameLength length of the name
+     * @param[in] nameHash   hash of the name
+     * @return index of the slot.
+     */
+    size_t findSlot(const char* name, unsigned int nameLength, uint32_t nameHash) const;
+
+    /**
+     * Doubles the number of slots of the hash table.
+     */
+    void grow();
 
 public:
     LabelTable() = default;
@@ -165,7 +310,7 @@ public:
      * @param[in] labelName name of the label to find
      * @return label offset, or -1, if there is no label with the given name.
      */
-    int getLabelOffset(char* labelName);
+    int getLabelOffset(const char* labelName) const;
 
     /**
      * Creates new label from the given name and offset.
@@ -174,36 +319,210 @@ public:
      * @return 0, if label was created successfully, or ERR_INVALID_LABEL, if label with the given name already exists.
      */
     unsigned char addLabel(const char* line, unsigned int labelOffset);
+};
 
-    ~LabelTable();
+/**
+ * Buffer for assembly file. Stores the encoded operations and jumps to labels that are not defined yet (fixups), which
+ * are patched when all labels are known, so the source code is assembled in a single pass.
+ */
+class AssemblyBuffer {
+    constexpr static unsigned int MAX_LINE_LENGTH = 256u;
+
+    /** Jump to the label. Offset of it's operand is unknown (-1) until the jump is written */
+    struct LabelFixup {
+        const char* labelName;
+        int operandOffset;
+    };
+
+    std::vector<unsigned char> bytes;
+    std::vector<LabelFixup> fixups;
+    /** Names of the fixups labels */
+    Arena labelNames;
+
+public:
+    AssemblyBuffer() = default;
+
+    AssemblyBuffer(AssemblyBuffer& assemblyBuffer) = delete;
+    AssemblyBuffer &operator=(const AssemblyBuffer&) = delete;
+
+    /**
+     * Gets the size of the assembly written into the buffer.
+     * @return size of the assembly in bytes.
+     */
+    int getSize() const {
+        return (int)bytes.size();
+    }
+
+    /**
+     * Writes byte into the assembly buffer.
+     * @param[in] b byte to write
+     */
+    void write(unsigned char b);
+
+    /**
+     * Writes double operand into the assembly buffer.
+     * @param[in] value operand to write
+     */
+    void write(double value);
+
+    /**
+     * Writes int operand into the assembly buffer.
+     * @param[in] value operand to write
+     */
+    void write(int value);
+
+    /**
+     * Writes int64 operand into the assembly buffer.
+     * @param[in] value operand to write
+     */
+    void write(int64_t value);
+
+    /**
+     * Creates the fixup for the jump to the label that is not defined yet.
+     * @param[in] labelName name of the label
+     * @return index of the created fixup.
+     */
+    int addLabelFixup(const char* labelName);
+
+    /**
+     * Writes the placeholder of the jump offset to the label of the given fixup. The offset is written in resolveFixups.
+     * @param[in] fixupIndex index of the fixup (see addLabelFixup)
+     */
+    void writeLabelFixup(int fixupIndex);
+
+    /**
+     * Writes jump offsets to the labels of fixups that are found in the given label table. Resolved fixups are removed.
+     * @param[in] labelTable  label table with info about labels
+     * @param[in] labelsShift offset of the label table labels relative to the beginning of this buffer
+     * @return 0, if all fixups are resolved, or ERR_INVALID_LABEL, if there are fixups left.
+     */
+    unsigned char resolveFixups(const LabelTable& labelTable, int labelsShift = 0);
+
+    /**
+     * Flushes this buffer content into the given file with a single write. All data is cleared.
+     * @param[out] output assembly file to flush buffer into
+     * @return 0, if flushing completed successfully, or ERR_INVALID_FILE, if the file can't be written.
+     */
+    unsigned char flushToFile(FILE* output);
 };
 
 /**
- * Buffer for disassembly file. Stores lines of code and labels to be inserted in this code.
+ * Line of the disassembly written for the operation.
+ */
+struct DisassemblyLine {
+    /** Byte offset of the operation */
+    int offset;
+    /** Number of the line in the disassembly (starting from 1). Fused operation takes a line per original operation */
+    unsigned int lineNumber;
+    /** Number of the closest label before the operation (label is named "L<number>"), or -1 if there is no such label */
+    int labelNumber;
+    /** Byte offset of the closest label before the operation */
+    int labelOffset;
+};
+
+/**
+ * Buffer for disassembly file. Assembly is disassembled in two passes: the first one only collects jump targets
+ * (labels), and the second one writes lines of code and labels into the file through the write buffer.
+ * So the memory used depends on the number of labels, not on the size of the program.
  */
 class DisassemblyBuffer {
     constexpr static unsigned int MAX_LINE_LENGTH = 256u;
-    constexpr static unsigned int MAX_LABEL_LENGTH = 12u; // 1 ('L') + 10 (max int length) + 1 ('\0')
+    constexpr static size_t WRITE_BUFFER_SIZE = 1u << 20u;
 
-    /** Contains lines to output in the file with the offset delta associated with this line **/
-    std::vector<std::pair<char*, int>> lines;
+    struct Label {
+        unsigned int offset;
+        /** Labels are named in order of their first references */
+        unsigned int number;
+    };
 
-    /** Contains labels mapped by their offset **/
-    std::map<unsigned int, char*> labels;
+    /** Numbers of labels by their offsets, while jump targets are collected */
+    std::unordered_map<unsigned int, unsigned int> labelNumbers;
+    /** Labels sorted by their offsets, while lines are written */
+    std::vector<Label> labels;
+    /** Index of the next label to be written */
+    size_t nextLabel = 0;
+    bool hasInvalidLabels = false;
+
+    /** Disassembly file, or nullptr, while jump targets are collected */
+    FILE* output = nullptr;
+    std::vector<char> text;
+    bool isLineOpen = false;
+    bool hasWriteFailed = false;
+    /** Offset of the next operation in bytes */
+    unsigned int currentByteOffset = 0;
+
+    /** Lines of the written operations, or nullptr if they are not collected */
+    std::vector<DisassemblyLine>* lineMap = nullptr;
+    /** Number of lines written */
+    unsigned int linesNumber = 0;
+    /** Label written last, or nullptr if there is no such label */
+    const Label* lastLabel = nullptr;
+
+    /**
+     * Appends the string to the write buffer.
+     * @param[in] string string to append
+     * @param[in] length length of the string
+     */
+    void appendText(const char* string, size_t length);
+
+    /**
+     * Appends the null terminated string to the write buffer.
+     * @param[in] string string to append
+     */
+    void appendText(const char* string) {
+        appendText(string, strlen(string));
+    }
+
+    /**
+     * Ends the current line (if any) and writes the labels of the current offset before the next line.
+     */
+    void startLine();
+
+    /**
+     * Writes the content of the write buffer into the file.
+     */
+    void flushText();
 
 public:
+    /**
+     * Ends collecting of jump targets and starts writing lines into the given file.
+     * @param[out] disassemblyFile disassembly file to write lines into
+     */
+    void startOutput(FILE* disassemblyFile);
+
+    /**
+     * Collects the lines of the operations written after the output is started into the given vector.
+     * @param[out] lines vector to append lines to, or nullptr to stop collecting
+     */
+    void setLineMap(std::vector<DisassemblyLine>* lines) {
+        lineMap = lines;
+    }
+
     /**
      * Writes operation name into the disassembly buffer.
      * @param[in] operation operation name to write
      */
     void writeOperation(const char* operation);
 
+    /**
+     * Writes the next operation of the fused operation expansion into the disassembly buffer.
+     * Labels can't be placed inside the fused operation.
+     * @param[in] operation operation name to write
+     */
+    void writeFusedOperationPart(const char* operation);
+
     /**
      * Writes double operand into the disassembly buffer.
      * @param[in] operand operand to write
      */
     void writeOperand(double operand, bool isRamOperation);
 
+    /**
+     * Writes int64 operand (of IPUSH) into the disassembly buffer.
+     * @param[in] operand operand to write
+     */
+    void writeIntegerOperand(int64_t operand);
+
     /**
      * Writes register name into the disassembly buffer.
      * @param[in] regName register name to write
@@ -211,25 +530,19 @@ public:
     void writeRegister(const char* regName, bool isRamOperation);
 
     /**
-     * Creates and writes jump label (as argument of JMP or similar operation) into the disassembly buffer.
-     * Jump labels are created from offsets, and then put into disassembly file in flushToFile method.
+     * Writes jump label (as argument of JMP or similar operation) into the disassembly buffer.
+     * Until the output is started, only the jump target is collected.
      * @param[in] labelOffset jump label offset
      */
     void writeJumpLabelArgument(int labelOffset);
 
     /**
-     * Returns the label name by it's offset. If there's no label with the given offset, the new one is created.
-     * @param[in] labelOffset offset of the label to get
-     * @return name of the label.
+     * Flushes the rest of this buffer content into the file.
+     * @return 0, if flushing completed successfully;
+     *         ERR_INVALID_LABEL, if any of the labels was invalid;
+     *         ERR_INVALID_FILE, if the file can't be written.
      */
-    const char* getLabelByOffset(int labelOffset);
-
-    /**
-     * Flushes this buffer content into the given file. All data is cleared.
-     * @param[out] output disassembly file to flush buffer into
-     * @return 0, if flushing completed successfully, or ERR_INVALID_LABEL, if any of the labels was invalid.
-     */
-    unsigned char flushToFile(FILE* output);
+    unsigned char flushToFile();
 };
 
 /**
@@ -267,6 +580,29 @@ unsigned char getRegisterNumberByName(const char* regName);
  */
 const char* getRegisterNameByNumber(unsigned char regNumber);
 
+/**
+ * Gets the integer register number by it's name.
+ * @param[in] regName name of the integer register
+ * @return register number, or ERR_INVALID_REGISTER if integer register is invalid.
+ */
+unsigned char getIntegerRegisterNumberByName(const char* regName);
+
+/**
+ * Gets the integer register name by it's number.
+ * @param[in] regNumber number of the integer register
+ * @return register name, or nullptr if register is invalid.
+ */
+const char* getIntegerRegisterNameByNumber(unsigned char regNumber);
+
+/**
+ * Checks if the given opcode reads or writes the integer register (IPUSH or IPOP of the register).
+ * @param[in] opcode operation code to check
+ * @return true, if the register operand of the operation is the integer register, false otherwise.
+ */
+inline bool isIntegerRegisterOperation(unsigned char opcode) {
+    return (opcode == IPUSHR_OPCODE) || (opcode == IPOPR_OPCODE);
+}
+
 /**
  * Gets the next token (char sequence between space characters) from the given string.
  * Note that the given string is also modified (pointer moved to the next token).
@@ -291,6 +627,14 @@ unsigned char parseOperation(char*& line);
  */
 double parseOperand(char*& line);
 
+/**
+ * Converts the given token to the int64 operand. Only decimal integers, that fit into int64, are converted.
+ * @param[in]  token token to convert
+ * @param[out] value converted value
+ * @return true, if the token is an integer literal, false otherwise.
+ */
+bool toIntegerLiteral(const char* token, int64_t& value);
+
 /**
  * Parses first possible register from the given string. Note that the given string is also modified (pointer moved to the next instruction).
  * @param[in, out] line string to parse register from
@@ -321,36 +665,172 @@ bool asRamAccess(char*& token);
 bool isJumpOperation(unsigned char opcode);
 
 /**
- * Reads the next operation from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Checks if the given opcode is the fused operation (superinstruction).
+ * @param[in] opcode operation code to check
+ * @return true, if the given operation is fused operation, false otherwise.
+ */
+bool isFusedOperation(unsigned char opcode);
+
+/**
+ * Checks if the given opcode is the fused comparison with immediate and conditional jump (CMP_IMM_JMP* operation).
+ * @param[in] opcode operation code to check
+ * @return true, if the given operation is CMP_IMM_JMP* operation, false otherwise.
+ */
+bool isFusedJumpOperation(unsigned char opcode);
+
+/**
+ * Gets the conditional jump operation fused into the given CMP_IMM_JMP* operation.
+ * @param[in] opcode code of the CMP_IMM_JMP* operation
+ * @return code of the conditional jump operation.
+ */
+unsigned char getFusedJumpOpcode(unsigned char opcode);
+
+/**
+ * Gets the CMP_IMM_JMP* operation that fuses PUSH of an immediate with the given conditional jump.
+ * @param[in] jumpOpcode code of the conditional jump operation
+ * @return code of the CMP_IMM_JMP* operation, or ERR_INVALID_OPERATION if there is no such operation.
+ */
+unsigned char getFusedJumpOpcodeByJump(unsigned char jumpOpcode);
+
+/**
+ * Checks if the conditional jump with the given operands is taken.
+ * @param[in] opcode code of the jump operation (JMP and CALL are always taken)
+ * @param[in] lhs    left hand side operand of the comparison
+ * @param[in] rhs    right hand side operand of the comparison
+ * @return true, if jump is taken, false otherwise.
+ */
+bool isJumpTaken(unsigned char opcode, double lhs, double rhs);
+
+/**
+ * Checks if the integer conditional jump with the given operands is taken. Integers are compared exactly.
+ * @param[in] opcode code of the integer jump operation (IJMPE, IJMPNE, IJMPL, IJMPLE, IJMPG or IJMPGE)
+ * @param[in] lhs    left hand side operand of the comparison
+ * @param[in] rhs    right hand side operand of the comparison
+ * @return true, if jump is taken, false otherwise.
+ */
+inline bool isIntegerJumpTaken(unsigned char opcode, int64_t lhs, int64_t rhs) {
+    switch (opcode) {
+        case IJMPE_OPCODE:  return lhs == rhs;
+        case IJMPNE_OPCODE: return lhs != rhs;
+        case IJMPL_OPCODE:  return lhs <  rhs;
+        case IJMPLE_OPCODE: return lhs <= rhs;
+        case IJMPG_OPCODE:  return lhs >  rhs;
+        default:            return lhs >= rhs;
+    }
+}
+
+/**
+ * Checks if the given opcode is the integer conditional jump (IJMP* operation).
+ * @param[in] opcode operation code to check
+ * @return true, if the given operation is integer conditional jump, false otherwise.
+ */
+inline bool isIntegerJumpOperation(unsigned char opcode) {
+    return (opcode >= IJMPNE_OPCODE) && (opcode <= IJMPGE_OPCODE);
+}
+
+/**
+ * Converts the operand stack value to the integer stack value (FTOI): value is truncated towards zero, NAN and values
+ * out of int64 range give 0. Defined here, so the dispatch loops of all engines inline it.
+ * @param[in] value operand stack value
+ * @return integer value.
+ */
+inline int64_t toIntegerOperand(double value) {
+#if defined(__x86_64__)
+    // cvttsd2si gives INT64_MIN for NAN and values out of range, so only this result is checked. It's also the result
+    // of -2^63 itself, that is in range
+    int64_t integer = _mm_cvttsd_si64(_mm_set_sd(value));
+    if (__builtin_expect(integer != INT64_MIN, 1)) return integer;
+    return ((value >= -9223372036854775808.0) && (value <= -9223372036854775808.0)) ? integer : 0;
+#else
+    // Both bounds are powers of 2, so they are exact doubles. NAN fails both comparisons
+    if (!((value >= -9223372036854775808.0) && (value < 9223372036854775808.0))) return 0;
+    return (int64_t)value;
+#endif
+}
+
+/**
+ * Applies the integer arithmetic operation. Result wraps around on int64 overflow.
+ * @param[in] opcode code of the integer operation (IADD, ISUB or IMUL)
+ * @param[in] lhs    left hand side operand
+ * @param[in] rhs    right hand side operand
+ * @return result of the operation.
+ */
+inline int64_t applyIntegerArithmetic(unsigned char opcode, int64_t lhs, int64_t rhs) {
+    // Unsigned arithmetic wraps around without undefined behavior
+    uint64_t result = 0;
+    switch (opcode) {
+        case IADD_OPCODE: result = (uint64_t)lhs + (uint64_t)rhs; break;
+        case ISUB_OPCODE: result = (uint64_t)lhs - (uint64_t)rhs; break;
+        default:          result = (uint64_t)lhs * (uint64_t)rhs; break;
+    }
+    return (int64_t)result;
+}
+
+/**
+ * Checks if the given operation code is actually an error code.
+ * @param[in] opcode operation code to check
+ * @return true, if the operation code is error code, false otherwise.
+ */
+bool isError(unsigned char opcode);
+
+/**
+ * Decodes the operation located at the given offset of the assembly.
+ * Performs the same validation that is done by AssemblyMachine::processNextOperation before operation is processed.
+ * @param[in]  assembly     assembly to decode operation from
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[in]  offset       byte offset of the operation to decode
+ * @param[out] operation    decoded operation. Size is set even if operation is invalid (but at least to one byte)
+ * @return operation code, if operation was decoded successfully;
+ *         ERR_INVALID_OPERATION, if operation code or immediate operand is invalid, or operation is truncated;
+ *         ERR_INVALID_REGISTER, if register number is invalid.
+ */
+unsigned char decodeOperation(const unsigned char* assembly, int assemblySize, int offset, DecodedOperation& operation);
+
+/**
+ * Reads the next operation from assembly. Increases offset by the number of bytes read.
+ * As with reading past the end of file, bytes after the end of assembly are read as 0xFF.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return operation code of the operation read.
  */
-unsigned char asmReadOperation(FILE* input, int& currentByteOffset);
+unsigned char asmReadOperation(const unsigned char* assembly, int assemblySize, int& currentByteOffset);
+
+/**
+ * Reads the next double operand from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
+ * @param[in, out] currentByteOffset current offset in bytes
+ * @return operand read.
+ */
+double asmReadOperand(const unsigned char* assembly, int assemblySize, int& currentByteOffset);
 
 /**
- * Reads the next double operand from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next int64 operand from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return operand read.
  */
-double asmReadOperand(FILE* input, int& currentByteOffset);
+int64_t asmReadIntegerOperand(const unsigned char* assembly, int assemblySize, int& currentByteOffset);
 
 /**
- * Reads the next register from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next register from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return register number read, or ERR_INVALID_REGISTER, if register number is invalid.
  */
-unsigned char asmReadRegister(FILE* input, int& currentByteOffset);
+unsigned char asmReadRegister(const unsigned char* assembly, int assemblySize, int& currentByteOffset);
 
 /**
- * Reads the next jump offset from assembly file. Increases offset by the number of bytes read.
- * @param[in]      input             assembly file
+ * Reads the next jump offset from assembly. Increases offset by the number of bytes read.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
  * @param[in, out] currentByteOffset current offset in bytes
  * @return jump offset.
  */
-int asmReadJumpOffset(FILE* input, int& currentByteOffset);
+int asmReadJumpOffset(const unsigned char* assembly, int assemblySize, int& currentByteOffset);
 
 /**
  * Removes leading and trailing space characters (whitespaces, '\\n', '\\t', etc) from the given C-string. Note that the given string is also changed.
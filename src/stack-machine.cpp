@@ -7,44 +7,533 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <new>
+#include <thread>
 
 #include "stack-machine.h"
+#include "threaded-stack-machine.h"
+#include "jit-stack-machine.h"
+#include "vector-stack-machine.h"
+#include "profiling-stack-machine.h"
+#include "bytecode-image.h"
+#include "bytecode-container.h"
+#include "machine-snapshot.h"
 
 using byte = unsigned char;
 
-union doubleAsBytes {
-    double doubleValue;
-    byte bytes[sizeof(double)];
-};
+/** Memory smaller than this is cleared by writing zeros, larger one is returned to the kernel */
+constexpr static size_t RAM_CLEAR_WRITE_LIMIT = 64 * 1024;
 
-double RAM::getAt(int pos) const {
-    usleep(DELAY_MICROSECONDS);
-    doubleAsBytes doubleBytes { 0 };
-    for (byte& b : doubleBytes.bytes) {
-        b = memory[pos];
-        pos += sizeof(byte);
-    }
-    return doubleBytes.doubleValue;
+static size_t getPageSize() {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+RAM::RAM(int addressesNumber) {
+    resize(addressesNumber);
+}
+
+RAM::~RAM() {
+    if (mapping != nullptr) munmap(mapping, mappingSize);
+}
+
+/**
+ * Replaces the memory with the zero-filled memory of the given size. Spent virtual cycles are reset.
+ * @param[in] addressesNumber number of addresses (from 0 to MAX_SIZE)
+ * @return true, if memory was mapped, false otherwise (memory is left without addresses).
+ */
+bool RAM::resize(int addressesNumber) {
+    if (mapping != nullptr) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    memory = nullptr;
+    size = 0;
+    cycles = 0;
+    if ((addressesNumber < 0) || (addressesNumber > MAX_SIZE)) return false;
+    if (addressesNumber == 0) return true;
+
+    size_t pageSize = getPageSize();
+    size_t valuesSize = (size_t)addressesNumber * sizeof(double);
+    size_t pagesSize = (valuesSize + pageSize - 1) / pageSize * pageSize;
+    // Address space is only reserved: pages are zero-filled on the first touch and don't need swap until then
+    void* region = mmap(nullptr, pagesSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) return false;
+
+    mapping = region;
+    mappingSize = pagesSize;
+    memory = static_cast<double*>(region);
+    size = addressesNumber;
+    return true;
+}
+
+double RAM::getAt(int pos) {
+    assert((pos >= 0) && (pos < size));
+
+    cycles += accessCycles;
+    return memory[pos];
 }
 
 void RAM::setAt(int pos, double value) {
-    usleep(DELAY_MICROSECONDS);
-    doubleAsBytes doubleBytes { value };
-    for (byte b : doubleBytes.bytes) {
-        memory[pos] = b;
-        pos += sizeof(byte);
+    assert((pos >= 0) && (pos < size));
+
+    cycles += accessCycles;
+    memory[pos] = value;
+}
+
+/**
+ * Copies values of all addresses from the given array. Access is not accounted by the timing model.
+ * @param[in] values getSize() values to copy
+ */
+void RAM::loadMemory(const double* values) {
+    assert(values != nullptr);
+
+    if (size != 0) memcpy(memory, values, (size_t)size * sizeof(double));
+}
+
+/**
+ * Sets all addresses to zero and resets the spent virtual cycles. Pages of the large memory are returned to the
+ * kernel instead of being written, so clearing costs as much as the memory that was used.
+ */
+void RAM::clear() {
+    cycles = 0;
+    size_t valuesSize = (size_t)size * sizeof(double);
+    if (valuesSize <= RAM_CLEAR_WRITE_LIMIT) {
+        if (size != 0) memset(memory, 0, valuesSize);
+        return;
+    }
+
+    // Dropped pages of the private anonymous mapping are zero-filled again on the next touch
+    if (madvise(mapping, mappingSize, MADV_DONTNEED) != 0) memset(memory, 0, valuesSize);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+    /** Kernel is compiled for AVX2 and for the baseline target, and the variant is chosen by the CPU at load time */
+    #define RAM_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+    #define RAM_KERNEL
+#endif
+
+// GCC vector extension type. Kernels process RAM by 4 values (a single AVX register)
+typedef double RamLanes __attribute__((vector_size(4 * sizeof(double))));
+constexpr static int RAM_LANES = sizeof(RamLanes) / sizeof(double);
+
+RAM_KERNEL static void addKernel(double* destination, const double* lhs, const double* rhs, int count) {
+    int i = 0;
+    for (; i + RAM_LANES <= count; i += RAM_LANES) {
+        RamLanes lhsLanes, rhsLanes;
+        memcpy(&lhsLanes, lhs + i, sizeof(lhsLanes));
+        memcpy(&rhsLanes, rhs + i, sizeof(rhsLanes));
+        lhsLanes += rhsLanes;
+        memcpy(destination + i, &lhsLanes, sizeof(lhsLanes));
+    }
+    for (; i < count; ++i) destination[i] = lhs[i] + rhs[i];
+}
+
+RAM_KERNEL static void multiplyKernel(double* destination, const double* lhs, const double* rhs, int count) {
+    int i = 0;
+    for (; i + RAM_LANES <= count; i += RAM_LANES) {
+        RamLanes lhsLanes, rhsLanes;
+        memcpy(&lhsLanes, lhs + i, sizeof(lhsLanes));
+        memcpy(&rhsLanes, rhs + i, sizeof(rhsLanes));
+        lhsLanes *= rhsLanes;
+        memcpy(destination + i, &lhsLanes, sizeof(lhsLanes));
+    }
+    for (; i < count; ++i) destination[i] = lhs[i] * rhs[i];
+}
+
+/**
+ * Sums the values with two vector accumulators, so that independent additions overlap in the pipeline.
+ */
+RAM_KERNEL static double sumKernel(const double* values, int count) {
+    RamLanes first = {0, 0, 0, 0}, second = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 2 * RAM_LANES <= count; i += 2 * RAM_LANES) {
+        RamLanes firstValues, secondValues;
+        memcpy(&firstValues, values + i, sizeof(firstValues));
+        memcpy(&secondValues, values + i + RAM_LANES, sizeof(secondValues));
+        first += firstValues;
+        second += secondValues;
+    }
+    first += second;
+    double sum = (first[0] + first[1]) + (first[2] + first[3]);
+    for (; i < count; ++i) sum += values[i];
+    return sum;
+}
+
+RAM_KERNEL static double dotKernel(const double* lhs, const double* rhs, int count) {
+    RamLanes first = {0, 0, 0, 0}, second = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 2 * RAM_LANES <= count; i += 2 * RAM_LANES) {
+        RamLanes firstLhs, firstRhs, secondLhs, secondRhs;
+        memcpy(&firstLhs, lhs + i, sizeof(firstLhs));
+        memcpy(&firstRhs, rhs + i, sizeof(firstRhs));
+        memcpy(&secondLhs, lhs + i + RAM_LANES, sizeof(secondLhs));
+        memcpy(&secondRhs, rhs + i + RAM_LANES, sizeof(secondRhs));
+        first += firstLhs * firstRhs;
+        second += secondLhs * secondRhs;
     }
+    first += second;
+    double sum = (first[0] + first[1]) + (first[2] + first[3]);
+    for (; i < count; ++i) sum += lhs[i] * rhs[i];
+    return sum;
+}
+
+/**
+ * Gets the source values of the kernel that writes the destination range. Kernels read and write several values at
+ * once, so the source, that partially overlaps the destination, is copied to be read before it's overwritten.
+ * @param[in]  memory      values of the memory
+ * @param[in]  destination first address of the destination range
+ * @param[in]  source      first address of the source range
+ * @param[in]  count       number of addresses in the ranges
+ * @param[out] copy        storage of the copied values
+ * @return pointer to the source values.
+ */
+static const double* getKernelSource(const double* memory, int destination, int source, int count,
+                                     std::vector<double>& copy) {
+    bool isPartialOverlap = (source != destination) && (source < destination + count) && (destination < source + count);
+    if (!isPartialOverlap) return memory + source;
+
+    copy.assign(memory + source, memory + source + count);
+    return copy.data();
+}
+
+/**
+ * Checks if the range of addresses given by the operation operands is inside the memory.
+ * Address and count are truncated to integers, as addresses of PUSH [addr] and POP [addr] are.
+ * @param[in] address first address of the range
+ * @param[in] count   number of addresses in the range
+ * @return true, if the range is valid (empty range at any address inside the memory is valid), false otherwise.
+ */
+bool RAM::isValidRange(double address, double count) const {
+    // Comparisons with NaN are false, so NaN operands are invalid too
+    if (!((address >= 0) && (address < size) && (count >= 0) && (count <= size))) return false;
+    return (long long)address + (long long)count <= size;
+}
+
+void RAM::add(int destination, int lhs, int rhs, int count) {
+    assert((destination >= 0) && (lhs >= 0) && (rhs >= 0) && (count >= 0));
+    assert((destination + count <= size) && (lhs + count <= size) && (rhs + count <= size));
+
+    std::vector<double> lhsCopy, rhsCopy;
+    addKernel(memory + destination, getKernelSource(memory, destination, lhs, count, lhsCopy),
+              getKernelSource(memory, destination, rhs, count, rhsCopy), count);
+    cycles += 3ull * count * accessCycles;
+}
+
+void RAM::multiply(int destination, int lhs, int rhs, int count) {
+    assert((destination >= 0) && (lhs >= 0) && (rhs >= 0) && (count >= 0));
+    assert((destination + count <= size) && (lhs + count <= size) && (rhs + count <= size));
+
+    std::vector<double> lhsCopy, rhsCopy;
+    multiplyKernel(memory + destination, getKernelSource(memory, destination, lhs, count, lhsCopy),
+                   getKernelSource(memory, destination, rhs, count, rhsCopy), count);
+    cycles += 3ull * count * accessCycles;
+}
+
+double RAM::sum(int source, int count) {
+    assert((source >= 0) && (count >= 0) && (source + count <= size));
+
+    cycles += (unsigned long long)count * accessCycles;
+    return sumKernel(memory + source, count);
+}
+
+double RAM::dot(int lhs, int rhs, int count) {
+    assert((lhs >= 0) && (rhs >= 0) && (count >= 0));
+    assert((lhs + count <= size) && (rhs + count <= size));
+
+    cycles += 2ull * count * accessCycles;
+    return dotKernel(memory + lhs, memory + rhs, count);
+}
+
+double RAM::sumValues(const double* values, int count) {
+    assert(count >= 0);
+
+    return sumKernel(values, count);
+}
+
+double RAM::dotValues(const double* lhs, const double* rhs, int count) {
+    assert(count >= 0);
+
+    return dotKernel(lhs, rhs, count);
+}
+
+void RAM::fill(int destination, double value, int count) {
+    assert((destination >= 0) && (count >= 0) && (destination + count <= size));
+
+    std::fill_n(memory + destination, count, value);
+    cycles += (unsigned long long)count * accessCycles;
+}
+
+void RAM::copy(int destination, int source, int count) {
+    assert((destination >= 0) && (source >= 0) && (count >= 0));
+    assert((destination + count <= size) && (source + count <= size));
+
+    memmove(memory + destination, memory + source, count * sizeof(double));
+    cycles += 2ull * count * accessCycles;
 }
 
 StackMachine::StackMachine(const char* assemblyFileName) : AssemblyMachine(assemblyFileName) {
     constructStack(&stack);
+    constructStack(&integerStack);
+    constructStack(&callStack);
+    if (image != nullptr) reserveStacks(image->getStackReserve());
+}
+
+StackMachine::StackMachine(std::shared_ptr<const BytecodeImage> image) : AssemblyMachine(std::move(image)) {
+    constructStack(&stack);
+    constructStack(&integerStack);
     constructStack(&callStack);
-    ram = RAM();
+    if (this->image != nullptr) reserveStacks(this->image->getStackReserve());
 }
 
 StackMachine::~StackMachine() {
     destructStack(&stack);
+    destructStack(&integerStack);
+    destructStack(&callStack);
+    free(operationSlots);
+}
+
+/**
+ * Reserves the capacity of the operand and call stacks, so they don't grow until the given depths are reached.
+ * Capacity is never decreased, and is reserved only in empty stacks. Depths are limited by MAX_STACK_RESERVE.
+ * @param[in] reserve depths to reserve
+ */
+void StackMachine::reserveStacks(const StackReserve& reserve) {
+    ssize_t operandStackDepth = std::min(reserve.operandStackDepth, MAX_STACK_RESERVE);
+    if ((getStackSize(&stack) == 0) && (::getStackCapacity(&stack) < operandStackDepth)) {
+        destructStack(&stack);
+        constructStack(&stack, operandStackDepth);
+    }
+
+    ssize_t callStackDepth = std::min(reserve.callStackDepth, MAX_STACK_RESERVE);
+    if ((getStackSize(&callStack) == 0) && (::getStackCapacity(&callStack) < callStackDepth)) {
+        destructStack(&callStack);
+        constructStack(&callStack, callStackDepth);
+    }
+}
+
+/**
+ * Gets the capacity of the operand and call stacks.
+ * @return numbers of values the stacks hold without growing.
+ */
+StackReserve StackMachine::getStackCapacity() {
+    StackReserve capacity;
+    capacity.operandStackDepth = (unsigned int)::getStackCapacity(&stack);
+    capacity.callStackDepth = (unsigned int)::getStackCapacity(&callStack);
+    return capacity;
+}
+
+/**
+ * Gets the state of the machine, that is recorded at the end of the execution trace (see execution-trace.h).
+ * @param[in] status HLT_OPCODE or error code the program finished with
+ * @return pc, registers and operand stack of the machine.
+ */
+TraceEnd StackMachine::getTraceEnd(byte status) {
+    TraceEnd end {};
+    end.status = status;
+    end.pc = pc;
+    ssize_t stackSize = getStackSize(&stack);
+    end.operandStackSize = (stackSize > 0) ? (uint64_t)stackSize : 0;
+    end.topValue = (stackSize > 0) ? top(&stack) : 0;
+    if (registers != nullptr) memcpy(end.registers, registers, sizeof(end.registers));
+    ssize_t integerStackSize = getStackSize(&integerStack);
+    end.integerStackSize = (integerStackSize > 0) ? (uint64_t)integerStackSize : 0;
+    end.integerTopValue = (integerStackSize > 0) ? top(&integerStack) : 0;
+    if (integerRegisters != nullptr) memcpy(end.integerRegisters, integerRegisters, sizeof(end.integerRegisters));
+    return end;
+}
+
+/**
+ * Returns the machine to the state it had before the program was run: pc, registers, RAM, stats and all stacks
+ * are cleared in place. Capacity of the stacks and the decoded (or compiled) program are kept, so the machine can
+ * run the program again without being created anew. Budget, I/O mode and RAM access cost are not changed.
+ */
+void StackMachine::reset() {
+    if (assemblySize < 0) return;
+
+    pc = 0;
+    memset(registers, 0, REGISTERS_NUMBER * sizeof(double));
+    memset(integerRegisters, 0, REGISTERS_NUMBER * sizeof(int64_t));
+    ram.clear();
+    resetStats();
+    // Values are popped, so the hash of the hardened stack stays valid and the capacity is kept
+    while (getStackSize(&stack) > 0) pop(&stack);
+    while (getStackSize(&integerStack) > 0) pop(&integerStack);
+    while (getStackSize(&callStack) > 0) pop(&callStack);
+    returnRingSize = 0;
+}
+
+/**
+ * Executes operations by the reference dispatch loop until pc reaches the given offset or the program is finished.
+ * @param[in]  offset byte offset of the operation to stop before
+ * @param[out] status HLT_OPCODE or error code, if the program finished before reaching the offset
+ * @return true, if pc reached the offset, false if the program finished.
+ */
+bool StackMachine::executeUntil(int offset, byte& status) {
+    while (pc != offset) {
+        status = processNextOperation();
+        if ((status == HLT_OPCODE) || isError(status)) return false;
+    }
+    return true;
+}
+
+/**
+ * Writes the full state of the machine (pc, registers, RAM, operand, integer and call stacks) into the snapshot file
+ * (see machine-snapshot.h).
+ * @param[in] snapshotFileName snapshot file name
+ * @return 0, if snapshot was written successfully, or ERR_INVALID_FILE, if the file can't be written.
+ */
+byte StackMachine::saveSnapshot(const char* snapshotFileName) {
+    assert(snapshotFileName != nullptr);
+    if (assemblySize < 0) return ERR_INVALID_FILE;
+
+    SnapshotHeader header {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(header);
+    header.pc = pc;
+    header.ramSize = (uint32_t)ram.getSize();
+    header.assemblySize = (uint64_t)assemblySize;
+    header.assemblyHash = getAssemblyHash(assembly, assemblySize);
+    header.operandStackSize = (uint64_t)getStackSize(&stack);
+    header.callStackSize = (uint64_t)getCallDepth();
+    memcpy(header.registers, registers, sizeof(header.registers));
+    header.integerStackSize = (uint64_t)getStackSize(&integerStack);
+    memcpy(header.integerRegisters, integerRegisters, sizeof(header.integerRegisters));
+    SnapshotLayout layout = getSnapshotLayout(header);
+
+    FILE* output = fopen(snapshotFileName, "wb");
+    if (output == nullptr) return ERR_INVALID_FILE;
+
+    static const byte padding[SNAPSHOT_SECTION_ALIGNMENT] = {};
+    uint64_t ramEnd = layout.ramOffset + header.ramSize * sizeof(double);
+    uint64_t operandStackEnd = layout.operandStackOffset + header.operandStackSize * sizeof(double);
+    uint64_t integerStackEnd = layout.integerStackOffset + header.integerStackSize * sizeof(int64_t);
+
+    fwrite(&header, sizeof(header), 1, output);
+    fwrite(padding, sizeof(byte), layout.ramOffset - sizeof(header), output);
+    if (header.ramSize != 0) fwrite(ram.getMemory(), sizeof(double), header.ramSize, output);
+    fwrite(padding, sizeof(byte), layout.operandStackOffset - ramEnd, output);
+    if (header.operandStackSize != 0) fwrite(getStackData(&stack), sizeof(double), header.operandStackSize, output);
+    fwrite(padding, sizeof(byte), layout.integerStackOffset - operandStackEnd, output);
+    if (header.integerStackSize != 0) {
+        fwrite(getStackData(&integerStack), sizeof(int64_t), header.integerStackSize, output);
+    }
+    fwrite(padding, sizeof(byte), layout.callStackOffset - integerStackEnd, output);
+    // Addresses of the return ring are the innermost ones, so they follow the heap call stack
+    if (getStackSize(&callStack) != 0) fwrite(getStackData(&callStack), sizeof(int), getStackSize(&callStack), output);
+    for (int i = 0; i < returnRingSize; ++i) {
+        fwrite(&returnRing[(returnRingStart + i) & (RETURN_RING_SIZE - 1)], sizeof(int), 1, output);
+    }
+
+    bool isWritten = (ferror(output) == 0);
+    if (fclose(output) != 0) isWritten = false;
+    return isWritten ? 0 : ERR_INVALID_FILE;
+}
+
+/**
+ * Checks that the snapshot can be restored into the machine with the given assembly.
+ * @param[in] header       header of the snapshot
+ * @param[in] fileSize     size of the snapshot file in bytes
+ * @param[in] assembly     assembly of the machine
+ * @param[in] assemblySize size of the assembly in bytes
+ * @return true, if snapshot is valid and was taken of the same assembly, false otherwise.
+ */
+static bool isSnapshotValid(const SnapshotHeader& header, size_t fileSize, const byte* assembly, int assemblySize) {
+    if ((memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) || (header.version != SNAPSHOT_VERSION)) {
+        return false;
+    }
+    if ((header.headerSize < sizeof(header)) || (header.ramSize > (uint32_t)RAM::MAX_SIZE)) return false;
+    if ((header.assemblySize != (uint64_t)assemblySize) ||
+        (header.assemblyHash != getAssemblyHash(assembly, assemblySize))) return false;
+    if ((header.pc < 0) || (header.pc >= assemblySize)) return false;
+    // Sizes are limited before the layout is calculated, so offsets don't overflow
+    if ((header.operandStackSize > fileSize / sizeof(double)) ||
+        (header.integerStackSize > fileSize / sizeof(int64_t)) || (header.callStackSize > fileSize / sizeof(int))) {
+        return false;
+    }
+    return getSnapshotLayout(header).fileSize <= fileSize;
+}
+
+/**
+ * Restores the state of the machine from the snapshot file. The file is mapped copy-on-write, and values are
+ * copied from the mapping as they are, without parsing.
+ * @param[in] snapshotFileName snapshot file name
+ * @return 0, if snapshot was restored successfully, or ERR_INVALID_FILE, if the file can't be read, is invalid or
+ *         was taken of another assembly. RAM takes the size of the snapshot. State of the machine is not
+ *         changed, if the snapshot isn't restored, except RAM, that is left empty, if it can't be resized.
+ */
+byte StackMachine::restoreSnapshot(const char* snapshotFileName) {
+    assert(snapshotFileName != nullptr);
+    if (assemblySize < 0) return ERR_INVALID_FILE;
+
+    int input = open(snapshotFileName, O_RDONLY);
+    if (input < 0) return ERR_INVALID_FILE;
+    struct stat inputStat {};
+    if ((fstat(input, &inputStat) < 0) || ((size_t)inputStat.st_size < sizeof(SnapshotHeader))) {
+        close(input);
+        return ERR_INVALID_FILE;
+    }
+    size_t fileSize = inputStat.st_size;
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, input, 0);
+    close(input);
+    if (mapping == MAP_FAILED) return ERR_INVALID_FILE;
+
+    const byte* data = static_cast<const byte*>(mapping);
+    SnapshotHeader header {};
+    memcpy(&header, data, sizeof(header));
+    if (!isSnapshotValid(header, fileSize, assembly, assemblySize)) {
+        munmap(mapping, fileSize);
+        return ERR_INVALID_FILE;
+    }
+
+    // Verified images return without checks, so return addresses must be reachable operations
+    bool isVerified = (image != nullptr) && image->getVerification().isVerified();
+    SnapshotLayout layout = getSnapshotLayout(header);
+    const int* returnAddresses = reinterpret_cast<const int*>(data + layout.callStackOffset);
+    for (uint64_t i = 0; i < header.callStackSize; ++i) {
+        if ((returnAddresses[i] < 0) || (returnAddresses[i] >= assemblySize) ||
+            (isVerified && !image->getVerification().isReachable(returnAddresses[i]))) {
+            munmap(mapping, fileSize);
+            return ERR_INVALID_FILE;
+        }
+    }
+
+    // RAM takes the size of the snapshot, so the program continues with the memory it was configured with
+    if (((int)header.ramSize != ram.getSize()) && !ram.resize((int)header.ramSize)) {
+        munmap(mapping, fileSize);
+        return ERR_INVALID_FILE;
+    }
+
+    pc = header.pc;
+    memcpy(registers, header.registers, sizeof(header.registers));
+    memcpy(integerRegisters, header.integerRegisters, sizeof(header.integerRegisters));
+    ram.loadMemory(reinterpret_cast<const double*>(data + layout.ramOffset));
+
+    // Values are pushed, so the hash of the hardened stack stays valid
+    const double* operandValues = reinterpret_cast<const double*>(data + layout.operandStackOffset);
+    destructStack(&stack);
+    constructStack(&stack, header.operandStackSize);
+    for (uint64_t i = 0; i < header.operandStackSize; ++i) {
+        push(&stack, operandValues[i]);
+    }
+    const int64_t* integerValues = reinterpret_cast<const int64_t*>(data + layout.integerStackOffset);
+    destructStack(&integerStack);
+    constructStack(&integerStack, header.integerStackSize);
+    for (uint64_t i = 0; i < header.integerStackSize; ++i) {
+        push(&integerStack, integerValues[i]);
+    }
     destructStack(&callStack);
+    constructStack(&callStack, header.callStackSize);
+    for (uint64_t i = 0; i < header.callStackSize; ++i) {
+        push(&callStack, returnAddresses[i]);
+    }
+    returnRingSize = 0;
+
+    munmap(mapping, fileSize);
+    return 0;
 }
 
 /**
@@ -60,15 +549,152 @@ byte StackMachine::processOperation(byte opcode) {
     assert(assembly != nullptr);
     assert(registers != nullptr);
 
+    return applyOperation(opcode);
+}
+
+/**
+ * Processes the single operand operation.
+ * @param[in]      opcode  code of the operation to process
+ * @param[in, out] operand operand to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
+ *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size.
+ */
+byte StackMachine::processOperation(byte opcode, double& operand) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+    assert(assembly != nullptr);
+    assert(registers != nullptr);
+
+    return applyOperation(opcode, operand);
+}
+
+/**
+ * Processes the operation with the integer operand.
+ * @param[in]      opcode  code of the operation to process (IPUSH, IPUSHR or IPOPR)
+ * @param[in, out] operand immediate operand or integer register
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty integer stack.
+ */
+byte StackMachine::processIntegerOperation(byte opcode, int64_t& operand) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+    assert(assembly != nullptr);
+    assert(integerRegisters != nullptr);
+
+    return applyIntegerOperation(opcode, operand);
+}
+
+/**
+ * Processes the jump operation.
+ * @param[in] opcode     code of the jump operation to process
+ * @param[in] jumpOffset offset of the jump to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+byte StackMachine::processJumpOperation(byte opcode, int jumpOffset) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+    assert(assembly != nullptr);
+    assert(registers != nullptr);
+    assert(isJumpOperation(opcode));
+
+    return applyJumpOperation<true>(opcode, jumpOffset);
+}
+
+/**
+ * Processes the fused operation. Result is the same as of the operations sequence it was fused from.
+ * @param[in] opcode code of the fused operation to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code, immediate operand or jump offset was invalid;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+byte StackMachine::processFusedOperation(byte opcode) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+    assert(assembly != nullptr);
+    assert(registers != nullptr);
+
+    return applyFusedOperation<true>(opcode);
+}
+
+/**
+ * Reads the value of the given type from the verified assembly. Increases pc by the size of the value.
+ * @param[in]      assembly assembly to read value from
+ * @param[in, out] pc       byte offset of the value
+ * @return value read.
+ */
+template <typename T>
+static T readVerifiedValue(const byte* assembly, int& pc) {
+    T value {};
+    memcpy(&value, assembly + pc, sizeof(value));
+    pc += sizeof(value);
+    return value;
+}
+
+/**
+ * Processes the next operation of the verified image (see bytecode-verifier.h). The operation is reachable, so
+ * it's operands and jump destination are known to be valid and aren't checked.
+ * @return processed operation code or error code, if operation failed on the stack or RAM access.
+ */
+byte StackMachine::processVerifiedOperation() {
+    byte opcode = readVerifiedValue<byte>(assembly, pc);
+
+    switch (opcode) {
+        case PUSHR_OPCODE: case PUSHRM_OPCODE: case POPR_OPCODE: case POPRM_OPCODE:
+            return applyOperation(opcode, registers[readVerifiedValue<byte>(assembly, pc)]);
+        case PUSH_OPCODE: {
+            double operand = readVerifiedValue<double>(assembly, pc);
+            return applyOperation(opcode, operand);
+        }
+        case IPUSHR_OPCODE: case IPOPR_OPCODE:
+            return applyIntegerOperation(opcode, integerRegisters[readVerifiedValue<byte>(assembly, pc)]);
+        case IPUSH_OPCODE: {
+            int64_t operand = readVerifiedValue<int64_t>(assembly, pc);
+            return applyIntegerOperation(opcode, operand);
+        }
+        case PUSHM_OPCODE: case POPM_OPCODE: {
+            double address = readVerifiedValue<double>(assembly, pc);
+            if (!areImmediateAddressesValid) return applyOperation(opcode, address);
+
+            if (opcode == PUSHM_OPCODE) {
+                push(&stack, ram.getAt((int)address));
+                return opcode;
+            }
+            if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+            ram.setAt((int)address, pop(&stack));
+            return opcode;
+        }
+        case JMP_OPCODE: case JMPNE_OPCODE: case JMPE_OPCODE: case JMPL_OPCODE: case JMPLE_OPCODE: case JMPG_OPCODE:
+        case JMPGE_OPCODE: case CALL_OPCODE: case TAILCALL_OPCODE: case IJMPNE_OPCODE: case IJMPE_OPCODE:
+        case IJMPL_OPCODE: case IJMPLE_OPCODE: case IJMPG_OPCODE: case IJMPGE_OPCODE:
+            // sizeof(offset) is subtracted, because pc is calculated ahead (with offset size)
+            return applyJumpOperation<false>(opcode, readVerifiedValue<int>(assembly, pc) - (int)sizeof(int));
+        case CMP_IMM_JMPNE_OPCODE: case CMP_IMM_JMPE_OPCODE: case CMP_IMM_JMPL_OPCODE: case CMP_IMM_JMPLE_OPCODE:
+        case CMP_IMM_JMPG_OPCODE: case CMP_IMM_JMPGE_OPCODE: case PUSHR_PUSHR_MUL_OPCODE: case DUP_ADD_OPCODE:
+        case POPR_PUSHR_OPCODE:
+            return applyFusedOperation<false>(opcode);
+        default:
+            return applyOperation(opcode);
+    }
+}
+
+/**
+ * Applies the no-operand operation to the machine state.
+ * @param[in] opcode code of the operation to apply
+ * @return the same as processOperation(opcode).
+ */
+byte StackMachine::applyOperation(byte opcode) {
     if (opcode == IN_OPCODE) {
-        double inputValue = NAN;
-        printf("> ");
-        scanf("%lg", &inputValue);
-        push(&stack, inputValue);
+        push(&stack, io.read());
     } else if (opcode == OUT_OPCODE) {
         if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
 
-        printf("%lg\n", pop(&stack));
+        io.write(pop(&stack));
     } else if (opcode == POP_OPCODE) {
         if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
 
@@ -105,331 +731,1671 @@ byte StackMachine::processOperation(byte opcode) {
     } else if (opcode == DUP_OPCODE) {
         if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
 
-        push(&stack, top(&stack));
-    } else if (opcode == POW_OPCODE) {
-        if (getStackSize(&stack) < 2) return ERR_STACK_UNDERFLOW;
+        push(&stack, top(&stack));
+    } else if (opcode == POW_OPCODE) {
+        if (getStackSize(&stack) < 2) return ERR_STACK_UNDERFLOW;
+
+        double rhs = pop(&stack);
+        double lhs = pop(&stack);
+        push(&stack, pow(lhs, rhs));
+    } else if (opcode == IPOP_OPCODE) {
+        if (getStackSize(&integerStack) < 1) return ERR_STACK_UNDERFLOW;
+
+        pop(&integerStack);
+    } else if (opcode == ITOF_OPCODE) {
+        if (getStackSize(&integerStack) < 1) return ERR_STACK_UNDERFLOW;
+
+        push(&stack, (double)pop(&integerStack));
+    } else if (opcode == FTOI_OPCODE) {
+        if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+
+        push(&integerStack, toIntegerOperand(pop(&stack)));
+    } else if ((opcode == IADD_OPCODE) || (opcode == ISUB_OPCODE) || (opcode == IMUL_OPCODE)) {
+        if (getStackSize(&integerStack) < 2) return ERR_STACK_UNDERFLOW;
+
+        int64_t rhs = pop(&integerStack);
+        int64_t lhs = pop(&integerStack);
+        push(&integerStack, applyIntegerArithmetic(opcode, lhs, rhs));
+    } else if ((opcode >= VADD_OPCODE) && (opcode <= VCOPY_OPCODE)) {
+        return applyVectorOperation(opcode);
+    } else if (opcode == RET_OPCODE) {
+        int returnAddress = 0;
+        if (!popReturnAddress(returnAddress)) return ERR_STACK_UNDERFLOW;
+
+        pc = returnAddress;
+    } else if (opcode == HLT_OPCODE) {
+        /* Do nothing */
+    } else {
+        return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Pops operands of the vector operation (VADD, VMUL, VSUM, VDOT, VFILL or VCOPY) and applies it to RAM.
+ * @param[in] opcode code of the vector operation to apply
+ * @return given operation code, if operation processed successfully;
+ *         ERR_STACK_UNDERFLOW, if there are not enough operands on the stack;
+ *         ERR_INVALID_RAM_ADDRESS, if any range exceeds RAM size.
+ */
+byte StackMachine::applyVectorOperation(byte opcode) {
+    int operandsNumber = 3;
+    if ((opcode == VADD_OPCODE) || (opcode == VMUL_OPCODE)) operandsNumber = 4;
+    if (opcode == VSUM_OPCODE) operandsNumber = 2;
+    if (getStackSize(&stack) < operandsNumber) return ERR_STACK_UNDERFLOW;
+
+    // Operands are pushed in the order they are listed, so count is on top
+    double operands[4] = {};
+    for (int i = operandsNumber - 1; i >= 0; --i) {
+        operands[i] = pop(&stack);
+    }
+    double count = operands[operandsNumber - 1];
+    if (!ram.isValidRange(0, count)) return ERR_INVALID_RAM_ADDRESS;
+    int elementsNumber = (int)count;
+
+    unsigned long long reads = 0;
+    unsigned long long writes = 0;
+    switch (opcode) {
+        case VADD_OPCODE:
+        case VMUL_OPCODE:
+            if (!ram.isValidRange(operands[0], count) || !ram.isValidRange(operands[1], count) ||
+                !ram.isValidRange(operands[2], count)) {
+                return ERR_INVALID_RAM_ADDRESS;
+            }
+
+            if (opcode == VADD_OPCODE) {
+                ram.add((int)operands[0], (int)operands[1], (int)operands[2], elementsNumber);
+            } else {
+                ram.multiply((int)operands[0], (int)operands[1], (int)operands[2], elementsNumber);
+            }
+            reads = 2ull * elementsNumber;
+            writes = elementsNumber;
+            break;
+        case VSUM_OPCODE:
+            if (!ram.isValidRange(operands[0], count)) return ERR_INVALID_RAM_ADDRESS;
+
+            push(&stack, ram.sum((int)operands[0], elementsNumber));
+            reads = elementsNumber;
+            break;
+        case VDOT_OPCODE:
+            if (!ram.isValidRange(operands[0], count) || !ram.isValidRange(operands[1], count)) {
+                return ERR_INVALID_RAM_ADDRESS;
+            }
+
+            push(&stack, ram.dot((int)operands[0], (int)operands[1], elementsNumber));
+            reads = 2ull * elementsNumber;
+            break;
+        case VFILL_OPCODE:
+            if (!ram.isValidRange(operands[0], count)) return ERR_INVALID_RAM_ADDRESS;
+
+            ram.fill((int)operands[0], operands[1], elementsNumber);
+            writes = elementsNumber;
+            break;
+        case VCOPY_OPCODE:
+            if (!ram.isValidRange(operands[0], count) || !ram.isValidRange(operands[1], count)) {
+                return ERR_INVALID_RAM_ADDRESS;
+            }
+
+            ram.copy((int)operands[0], (int)operands[1], elementsNumber);
+            reads = elementsNumber;
+            writes = elementsNumber;
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+
+    if (isCounted()) {
+        stats.ramReads += reads;
+        stats.ramWrites += writes;
+    }
+    return opcode;
+}
+
+/**
+ * Applies the single operand operation to the machine state.
+ * @param[in]      opcode  code of the operation to apply
+ * @param[in, out] operand operand of the operation
+ * @return the same as processOperation(opcode, operand).
+ */
+byte StackMachine::applyOperation(byte opcode, double& operand) {
+    switch (opcode) {
+        case PUSH_OPCODE:
+        case PUSHR_OPCODE:
+            push(&stack, operand);
+            break;
+        case PUSHM_OPCODE:
+        case PUSHRM_OPCODE:
+            if (!ram.isValidAddress(operand)) return ERR_INVALID_RAM_ADDRESS;
+            push(&stack, ram.getAt((int)operand));
+            break;
+        case POPR_OPCODE:
+            if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+            operand = pop(&stack);
+            break;
+        case POPM_OPCODE:
+        case POPRM_OPCODE:
+            if (!ram.isValidAddress(operand)) return ERR_INVALID_RAM_ADDRESS;
+            if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+            ram.setAt((int)operand, pop(&stack));
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Applies the operation with the integer operand to the machine state.
+ * @param[in]      opcode  code of the operation to apply
+ * @param[in, out] operand integer operand of the operation
+ * @return the same as processIntegerOperation(opcode, operand).
+ */
+byte StackMachine::applyIntegerOperation(byte opcode, int64_t& operand) {
+    switch (opcode) {
+        case IPUSH_OPCODE:
+        case IPUSHR_OPCODE:
+            push(&integerStack, operand);
+            break;
+        case IPOPR_OPCODE:
+            if (getStackSize(&integerStack) < 1) return ERR_STACK_UNDERFLOW;
+            operand = pop(&integerStack);
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Applies the jump operation to the machine state.
+ * @tparam    IS_CHECKED shows if the jump destination is checked to be within the assembly
+ * @param[in] opcode     code of the jump operation to apply
+ * @param[in] jumpOffset offset of the jump
+ * @return the same as processJumpOperation(opcode, jumpOffset).
+ */
+template <bool IS_CHECKED>
+byte StackMachine::applyJumpOperation(byte opcode, int jumpOffset) {
+    bool isConditional = (opcode != JMP_OPCODE && opcode != CALL_OPCODE && opcode != TAILCALL_OPCODE);
+    bool isTaken = true;
+    if (isIntegerJumpOperation(opcode)) {
+        if (getStackSize(&integerStack) < 2) return ERR_STACK_UNDERFLOW;
+        int64_t rhs = pop(&integerStack);
+        int64_t lhs = pop(&integerStack);
+        isTaken = isIntegerJumpTaken(opcode, lhs, rhs);
+    } else if (isConditional) {
+        if (getStackSize(&stack) < 2) return ERR_STACK_UNDERFLOW;
+        double rhs = pop(&stack);
+        double lhs = pop(&stack);
+        isTaken = isJumpTaken(opcode, lhs, rhs);
+    }
+    // Pc is already moved past the jump
+    if (isConditional && (branchLog != nullptr)) branchLog->log(pc - (int)(sizeof(byte) + sizeof(int)), isTaken);
+    if (!isTaken) return opcode;
+    if (opcode == CALL_OPCODE) pushReturnAddress(pc);
+
+    pc += jumpOffset;
+    if (IS_CHECKED && (pc < 0 || pc >= assemblySize)) return ERR_INVALID_OPERATION;
+    return opcode;
+}
+
+/**
+ * Reads operands of the fused operation and applies it to the machine state.
+ * @tparam    IS_CHECKED shows if registers, immediate operand and jump destination are checked
+ * @param[in] opcode     code of the fused operation to apply
+ * @return the same as processFusedOperation(opcode).
+ */
+template <bool IS_CHECKED>
+byte StackMachine::applyFusedOperation(byte opcode) {
+    DecodedOperation operation;
+    operation.opcode = opcode;
+    if (isFusedJumpOperation(opcode)) {
+        operation.operand = IS_CHECKED ? getNextOperand() : readVerifiedValue<double>(assembly, pc);
+        if (IS_CHECKED && !std::isfinite(operation.operand)) return ERR_INVALID_OPERATION;
+        int jumpOffset = IS_CHECKED ? getNextJumpOffset() : readVerifiedValue<int>(assembly, pc);
+        // sizeof(offset) is subtracted, because pc is calculated ahead (with offset size)
+        operation.jumpTarget = pc - (int)sizeof(jumpOffset) + jumpOffset;
+    } else if (opcode == PUSHR_PUSHR_MUL_OPCODE) {
+        operation.reg = IS_CHECKED ? getNextRegister() : readVerifiedValue<byte>(assembly, pc);
+        if (IS_CHECKED && (operation.reg == ERR_INVALID_REGISTER)) return ERR_INVALID_REGISTER;
+        operation.reg2 = IS_CHECKED ? getNextRegister() : readVerifiedValue<byte>(assembly, pc);
+        if (IS_CHECKED && (operation.reg2 == ERR_INVALID_REGISTER)) return ERR_INVALID_REGISTER;
+    } else if (opcode == POPR_PUSHR_OPCODE) {
+        operation.reg = IS_CHECKED ? getNextRegister() : readVerifiedValue<byte>(assembly, pc);
+        if (IS_CHECKED && (operation.reg == ERR_INVALID_REGISTER)) return ERR_INVALID_REGISTER;
+    }
+    return applyDecodedFusedOperation<IS_CHECKED>(operation);
+}
+
+/**
+ * Applies the decoded fused operation to the machine state. Pc is already moved past the operation.
+ * @tparam    IS_CHECKED shows if the jump destination is checked to be within the assembly
+ * @param[in] operation  decoded fused operation with valid registers and immediate operand
+ * @return the same as processFusedOperation(opcode).
+ */
+template <bool IS_CHECKED>
+byte StackMachine::applyDecodedFusedOperation(const DecodedOperation& operation) {
+    byte opcode = operation.opcode;
+    if (isFusedJumpOperation(opcode)) {
+        if (getStackSize(&stack) < 1) {
+            // PUSH and the conditional jump the operation is fused from fail with the immediate left on the stack
+            push(&stack, operation.operand);
+            return ERR_STACK_UNDERFLOW;
+        }
+        double lhs = pop(&stack);
+        bool isTaken = isJumpTaken(getFusedJumpOpcode(opcode), lhs, operation.operand);
+        if (branchLog != nullptr) branchLog->log(pc - (int)(sizeof(byte) + sizeof(double) + sizeof(int)), isTaken);
+        if (!isTaken) return opcode;
+
+        pc = operation.jumpTarget;
+        if (IS_CHECKED && (pc < 0 || pc >= assemblySize)) return ERR_INVALID_OPERATION;
+        return opcode;
+    }
+
+    switch (opcode) {
+        case PUSHR_PUSHR_MUL_OPCODE:
+            push(&stack, registers[operation.reg] * registers[operation.reg2]);
+            break;
+        case DUP_ADD_OPCODE: {
+            if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+
+            double value = pop(&stack);
+            push(&stack, value + value);
+            break;
+        }
+        case POPR_PUSHR_OPCODE:
+            if (getStackSize(&stack) < 1) return ERR_STACK_UNDERFLOW;
+
+            registers[operation.reg] = top(&stack);
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Processes the operation at pc through the operation cache. The operation is decoded and validated on it's first
+ * execution, and the following executions take it's opcode, operand, register and absolute jump destination from
+ * the cache entry instead of reading and checking the encoded bytes again.
+ * @return processed operation code or error code, if operation was invalid or failed.
+ */
+byte StackMachine::processCachedOperation() {
+    if (pc >= assemblySize) return ERR_INVALID_OPERATION;
+    if (operationSlots[pc] == 0) {
+        DecodedOperation decoded;
+        byte status = decodeOperation(assembly, assemblySize, pc, decoded);
+        // Invalid operation isn't cached, it finishes the program anyway
+        if (isError(status)) return status;
+
+        operationCache.push_back(decoded);
+        operationSlots[pc] = (int32_t)operationCache.size();
+    }
+
+    const DecodedOperation& operation = operationCache[operationSlots[pc] - 1];
+
+    byte opcode = operation.opcode;
+    pc += operation.size;
+    switch (opcode) {
+        case PUSHR_OPCODE: case PUSHRM_OPCODE: case POPR_OPCODE: case POPRM_OPCODE:
+            return applyOperation(opcode, registers[operation.reg]);
+        case PUSH_OPCODE: case PUSHM_OPCODE: case POPM_OPCODE: {
+            double operand = operation.operand;
+            return applyOperation(opcode, operand);
+        }
+        case IPUSHR_OPCODE: case IPOPR_OPCODE:
+            return applyIntegerOperation(opcode, integerRegisters[operation.reg]);
+        case IPUSH_OPCODE: {
+            int64_t operand = operation.integerOperand;
+            return applyIntegerOperation(opcode, operand);
+        }
+        case JMP_OPCODE: case JMPNE_OPCODE: case JMPE_OPCODE: case JMPL_OPCODE: case JMPLE_OPCODE: case JMPG_OPCODE:
+        case JMPGE_OPCODE: case CALL_OPCODE: case TAILCALL_OPCODE: case IJMPNE_OPCODE: case IJMPE_OPCODE:
+        case IJMPL_OPCODE: case IJMPLE_OPCODE: case IJMPG_OPCODE: case IJMPGE_OPCODE:
+            return applyJumpOperation<true>(opcode, operation.jumpTarget - pc);
+        case CMP_IMM_JMPNE_OPCODE: case CMP_IMM_JMPE_OPCODE: case CMP_IMM_JMPL_OPCODE: case CMP_IMM_JMPLE_OPCODE:
+        case CMP_IMM_JMPG_OPCODE: case CMP_IMM_JMPGE_OPCODE: case PUSHR_PUSHR_MUL_OPCODE: case DUP_ADD_OPCODE:
+        case POPR_PUSHR_OPCODE:
+            return applyDecodedFusedOperation<true>(operation);
+        default:
+            return applyOperation(opcode);
+    }
+}
+
+/**
+ * Allocates zeroed slots of the operation cache for every byte offset of the code, if they are not allocated yet.
+ */
+void StackMachine::allocateOperationSlots() {
+    if ((operationSlots == nullptr) && (assemblySize > 0)) {
+        operationSlots = (int32_t*)calloc((size_t)assemblySize, sizeof(int32_t));
+        if (operationSlots == nullptr) throw std::bad_alloc();
+    }
+}
+
+/**
+ * Checks if immediate addresses of RAM operations of the verified image are inside RAM.
+ * @return true, if image is verified and it's immediate addresses are valid, false otherwise.
+ */
+bool StackMachine::hasValidImmediateAddresses() const {
+    if ((image == nullptr) || !image->getVerification().isVerified()) return false;
+
+    int requiredRamSize = image->getVerification().requiredRamSize;
+    return (requiredRamSize >= 0) && (requiredRamSize <= ram.getSize());
+}
+
+/**
+ * Executes operations starting from the current pc until HLT operation or an error is met.
+ * Verified images (see bytecode-verifier.h) are executed without checks of operands and jump destinations,
+ * other ones are executed through the operation cache (see processCachedOperation).
+ * If stats are counted (see isCounted) or the budget is limited, operations are executed by executeCounted.
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+ *         error code of the failed operation otherwise.
+ */
+byte StackMachine::execute() {
+    if (isCounted() || budget.isLimited()) return executeCounted(getBudgetInstructions(), getBudgetDeadline());
+
+    byte opcode = 0;
+    if ((image != nullptr) && image->getVerification().isVerified() && image->getVerification().isReachable(pc)) {
+        areImmediateAddressesValid = hasValidImmediateAddresses();
+        do {
+            opcode = processVerifiedOperation();
+        } while (opcode != HLT_OPCODE && !isError(opcode));
+
+        return opcode;
+    }
+
+    allocateOperationSlots();
+    do {
+        opcode = processCachedOperation();
+    } while (opcode != HLT_OPCODE && !isError(opcode));
+
+    return opcode;
+}
+
+/**
+ * Reads the monotonic clock.
+ * @return time in milliseconds.
+ */
+unsigned long long StackMachine::readMilliseconds() {
+    timespec time {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (unsigned long long)time.tv_sec * 1000u + (unsigned long long)time.tv_nsec / 1000000u;
+}
+
+/**
+ * Executes operations like execute() does, checking the budget before every operation.
+ * Stats are counted, if counting is turned on.
+ * @param[in] instructions maximal number of operations to execute, or ULLONG_MAX if it's not limited
+ * @param[in] deadline     time to stop the execution at (see getBudgetDeadline), or 0 if it's not limited
+ * @return the same as execute().
+ */
+byte StackMachine::executeCounted(unsigned long long instructions, unsigned long long deadline) {
+    bool isVerified = (image != nullptr) && image->getVerification().isVerified() &&
+                      image->getVerification().isReachable(pc);
+    if (!isVerified) allocateOperationSlots();
+    areImmediateAddressesValid = isVerified && hasValidImmediateAddresses();
+
+    for (unsigned long long executed = 0; ; ++executed) {
+        if (executed == instructions) return ERR_BUDGET_EXHAUSTED;
+        if ((deadline != 0) && (executed % ExecutionBudget::TIME_CHECK_INTERVAL == 0) &&
+            (readMilliseconds() >= deadline)) {
+            return ERR_BUDGET_EXHAUSTED;
+        }
+
+        int operationPc = pc;
+        byte opcode = isVerified ? processVerifiedOperation() : processCachedOperation();
+        if (isError(opcode)) return opcode;
+
+        if (isCountingStats) countOperation(opcode, operationPc);
+        if (opcode == HLT_OPCODE) return opcode;
+    }
+}
+
+/**
+ * Accounts the executed operation in the stats.
+ * @param[in] opcode       code of the executed operation
+ * @param[in] operationPc  byte offset of the executed operation
+ */
+void StackMachine::countOperation(byte opcode, int operationPc) {
+    ++stats.instructions;
+    switch (opcode) {
+        case PUSHM_OPCODE: case PUSHRM_OPCODE:
+            ++stats.ramReads;
+            break;
+        case POPM_OPCODE: case POPRM_OPCODE:
+            ++stats.ramWrites;
+            break;
+        case CALL_OPCODE: case TAILCALL_OPCODE:
+            ++stats.calls;
+            ++stats.jumpsTaken;
+            break;
+        case JMP_OPCODE:
+            ++stats.jumpsTaken;
+            break;
+        case JMPNE_OPCODE: case JMPE_OPCODE: case JMPL_OPCODE: case JMPLE_OPCODE: case JMPG_OPCODE: case JMPGE_OPCODE:
+        case IJMPNE_OPCODE: case IJMPE_OPCODE: case IJMPL_OPCODE: case IJMPLE_OPCODE: case IJMPG_OPCODE:
+        case IJMPGE_OPCODE:
+            // Jump to the next operation is not distinguished from the not taken one: pc is the same
+            if (pc != operationPc + (int)(sizeof(byte) + sizeof(int))) ++stats.jumpsTaken;
+            break;
+        case CMP_IMM_JMPNE_OPCODE: case CMP_IMM_JMPE_OPCODE: case CMP_IMM_JMPL_OPCODE: case CMP_IMM_JMPLE_OPCODE:
+        case CMP_IMM_JMPG_OPCODE: case CMP_IMM_JMPGE_OPCODE:
+            if (pc != operationPc + (int)(sizeof(byte) + sizeof(double) + sizeof(int))) ++stats.jumpsTaken;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Operation parsed from the source code line.
+ */
+struct ParsedOperation {
+    byte opcode;
+    byte reg;
+    /** Second register (for PUSHR_PUSHR_MUL operation) */
+    byte reg2;
+    double operand;
+    /** Immediate int64 operand (of IPUSH, or of PUSH of the integer literal, that can become IPUSH) */
+    int64_t integerOperand;
+    /** Shows if the immediate operand of PUSH is an integer literal */
+    bool isIntegerLiteral;
+    /** Absolute byte offset of the jump label (for labels defined before the jump) */
+    int labelOffset;
+    /** Index of the fixup for the jump label that is not defined yet, or -1 if the label offset is known */
+    int labelFixup = -1;
+};
+
+/**
+ * Type of the value on the stack, that is inferred by the assembler.
+ */
+enum ValueType : byte {
+    /** Value is made and consumed only by the operations, that take values of both types */
+    UNKNOWN_TYPE = 0,
+    INTEGER_TYPE = 1,
+    FLOAT_TYPE   = 2,
+};
+
+/**
+ * Type inference of the operations between two labels. Integer and operand stacks are simulated as a single stack of
+ * type variables in the order the values are pushed, and each pop takes the topmost value that can have the type the
+ * operation needs. Operations that take values of both types (PUSH of the integer literal, POP, ADD, SUB, MUL and
+ * conditional jumps) unify the variables of their operands, and become integer operations, if their type is integer.
+ */
+class TypeInference {
+    /** Parents of the type variables in the disjoint set forest */
+    std::vector<int> parents;
+    /** Types of the type variables, that are valid for the roots of the forest */
+    std::vector<ValueType> types;
+    /** Type variables of the values on the simulated stack, bottom first */
+    std::vector<int> stack;
+
+public:
+    /**
+     * Makes the new type variable.
+     * @param[in] type type of the variable
+     * @return type variable.
+     */
+    int makeVariable(ValueType type) {
+        parents.push_back((int)parents.size());
+        types.push_back(type);
+        return parents.back();
+    }
+
+    /**
+     * Finds the root of the type variable, that holds the type of all variables unified with it.
+     * @param[in] variable type variable
+     * @return root type variable.
+     */
+    int find(int variable) {
+        while (parents[variable] != variable) {
+            parents[variable] = parents[parents[variable]];
+            variable = parents[variable];
+        }
+        return variable;
+    }
+
+    ValueType getType(int variable) {
+        return types[find(variable)];
+    }
+
+    /**
+     * Unifies two type variables, so they have the same type. Type of lhs wins, if both are known.
+     * @param[in] lhs first type variable
+     * @param[in] rhs second type variable
+     */
+    void unify(int lhs, int rhs) {
+        int lhsRoot = find(lhs), rhsRoot = find(rhs);
+        if (lhsRoot == rhsRoot) return;
+        if (types[lhsRoot] == UNKNOWN_TYPE) types[lhsRoot] = types[rhsRoot];
+        parents[rhsRoot] = lhsRoot;
+    }
+
+    void push(int variable) {
+        stack.push_back(variable);
+    }
+
+    /**
+     * Pops the topmost value, that can have the given type, and gives it this type. If there is no such value, the
+     * value is pushed by the operations before the label, so it gets the new type variable.
+     * @param[in] type type the operation needs, or UNKNOWN_TYPE, if it takes the value of any type
+     * @return type variable of the popped value.
+     */
+    int pop(ValueType type) {
+        for (size_t i = stack.size(); i > 0; --i) {
+            int variable = stack[i - 1];
+            ValueType variableType = getType(variable);
+            if ((type != UNKNOWN_TYPE) && (variableType != UNKNOWN_TYPE) && (variableType != type)) continue;
+
+            stack.erase(stack.begin() + (i - 1));
+            if (variableType == UNKNOWN_TYPE) types[find(variable)] = type;
+            return variable;
+        }
+        return makeVariable(type);
+    }
+
+    /**
+     * Forgets the values on the simulated stack, when values after the operation are not known (after the jump).
+     */
+    void clearStack() {
+        stack.clear();
+    }
+
+    /**
+     * Forgets all type variables and values.
+     */
+    void clear() {
+        parents.clear();
+        types.clear();
+        stack.clear();
+    }
+};
+
+/**
+ * Simulates the operation on the stack of the type inference.
+ * @param[in]      operation parsed operation
+ * @param[in, out] inference type inference of the operations before the operation
+ * @return type variable of the operands of the operation, if it takes values of both types, or -1 otherwise.
+ */
+static int inferOperationType(const ParsedOperation& operation, TypeInference& inference) {
+    byte opcode = operation.opcode;
+    if ((opcode == PUSH_OPCODE) && operation.isIntegerLiteral) {
+        int variable = inference.makeVariable(UNKNOWN_TYPE);
+        inference.push(variable);
+        return variable;
+    }
+    if (opcode == POP_OPCODE) return inference.pop(UNKNOWN_TYPE);
+    if ((opcode == ADD_OPCODE) || (opcode == SUB_OPCODE) || (opcode == MUL_OPCODE) ||
+        (getFusedJumpOpcodeByJump(opcode) != ERR_INVALID_OPERATION)) {
+        int rhs = inference.pop(UNKNOWN_TYPE);
+        inference.unify(rhs, inference.pop(inference.getType(rhs)));
+        if (!isJumpOperation(opcode)) inference.push(rhs);
+        return rhs;
+    }
+
+    int poppedNumber = 0, pushedNumber = 0, integerPoppedNumber = 0, integerPushedNumber = 0;
+    getOperationStackEffect(opcode, poppedNumber, pushedNumber);
+    getIntegerStackEffect(opcode, integerPoppedNumber, integerPushedNumber);
+    for (int i = 0; i < poppedNumber; ++i) inference.pop(FLOAT_TYPE);
+    for (int i = 0; i < integerPoppedNumber; ++i) inference.pop(INTEGER_TYPE);
+    for (int i = 0; i < pushedNumber; ++i) inference.push(inference.makeVariable(FLOAT_TYPE));
+    for (int i = 0; i < integerPushedNumber; ++i) inference.push(inference.makeVariable(INTEGER_TYPE));
+
+    // Callee of CALL can leave any values on the stacks
+    if ((opcode == JMP_OPCODE) || (opcode == CALL_OPCODE) || (opcode == TAILCALL_OPCODE) || (opcode == RET_OPCODE) ||
+        (opcode == HLT_OPCODE)) {
+        inference.clearStack();
+    }
+    return -1;
+}
+
+/**
+ * Replaces the operation by the integer one, if the inferred type of it's operands is integer.
+ * @param[in, out] operation operation that takes values of both types
+ */
+static void applyInferredType(ParsedOperation& operation) {
+    switch (operation.opcode) {
+        case PUSH_OPCODE:
+            operation.opcode = IPUSH_OPCODE;
+            break;
+        case POP_OPCODE:
+            operation.opcode = IPOP_OPCODE;
+            break;
+        case ADD_OPCODE: case SUB_OPCODE: case MUL_OPCODE:
+            operation.opcode = operation.opcode - ADD_OPCODE + IADD_OPCODE;
+            break;
+        default:
+            operation.opcode = operation.opcode - JMPNE_OPCODE + IJMPNE_OPCODE;
+            break;
+    }
+}
+
+/** Number of operations that fusion pass looks at before the first of them is written */
+constexpr static int FUSION_WINDOW_SIZE = 4;
+
+/**
+ * Parses the operation from the given source code line. Jumps to labels that are not defined yet get fixups.
+ * @param[in, out] line           source code line (not a label)
+ * @param[in]      labelTable     label table with info about labels defined before the line
+ * @param[in, out] assemblyBuffer assembly buffer to create fixups in
+ * @param[out]     operation      parsed operation
+ * @return 0, if operation was parsed successfully;
+ *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_REGISTER, if invalid register was met.
+ */
+static byte parseSourceLine(char* line, LabelTable& labelTable, AssemblyBuffer& assemblyBuffer,
+                            ParsedOperation& operation) {
+    byte opcode = parseOperation(line);
+    if (opcode == ERR_INVALID_OPERATION) return ERR_INVALID_OPERATION;
+
+    // TODO: Clean up somehow
+    char* operandToken = getNextToken(line);
+    if (asRamAccess(operandToken)) opcode |= IS_RAM_OP_MASK;
+    byte integerReg = getIntegerRegisterNumberByName(operandToken);
+    if (integerReg != ERR_INVALID_REGISTER) {
+        // Integer registers are operands of PUSH and POP, that are the same as IPUSH and IPOP for them
+        if ((opcode == PUSH_OPCODE) || (opcode == IPUSH_OPCODE)) {
+            opcode = IPUSHR_OPCODE;
+        } else if ((opcode == POP_OPCODE) || (opcode == IPOP_OPCODE)) {
+            opcode = IPOPR_OPCODE;
+        } else {
+            return ERR_INVALID_OPERATION;
+        }
+        operation.reg = integerReg;
+    } else if (getRegisterNumberByName(operandToken) != ERR_INVALID_REGISTER) {
+        if ((opcode == IPUSH_OPCODE) || (opcode == IPOP_OPCODE)) return ERR_INVALID_REGISTER;
+        opcode |= IS_REG_OP_MASK;
+        if (getOperationArityByOpcode(opcode) == ERR_INVALID_OPERATION) return ERR_INVALID_OPERATION;
+
+        operation.reg = parseRegister(operandToken);
+        if (operation.reg == ERR_INVALID_REGISTER) return ERR_INVALID_REGISTER;
+    } else if (getOperationArityByOpcode(opcode) == 1) {
+        if (isJumpOperation(opcode)) {
+            operation.labelOffset = labelTable.getLabelOffset(operandToken);
+            if (operation.labelOffset < 0) operation.labelFixup = assemblyBuffer.addLabelFixup(operandToken);
+        } else if (opcode == IPUSH_OPCODE) {
+            if (!toIntegerLiteral(operandToken, operation.integerOperand)) return ERR_INVALID_OPERATION;
+        } else {
+            operation.isIntegerLiteral = (opcode == PUSH_OPCODE) && toIntegerLiteral(operandToken,
+                                                                                     operation.integerOperand);
+            operation.operand = parseOperand(operandToken);
+            if (!std::isfinite(operation.operand)) return ERR_INVALID_OPERATION;
+        }
+    }
+    operation.opcode = opcode;
+    return 0;
+}
+
+/**
+ * Writes jump offset to the label of the given operation into the assembly buffer.
+ * @param[in, out] assemblyBuffer assembly buffer
+ * @param[in]      operation      jump operation
+ */
+static void writeJumpOffset(AssemblyBuffer& assemblyBuffer, const ParsedOperation& operation) {
+    if (operation.labelFixup >= 0) {
+        assemblyBuffer.writeLabelFixup(operation.labelFixup);
+    } else {
+        assemblyBuffer.write(operation.labelOffset - assemblyBuffer.getSize());
+    }
+}
+
+/**
+ * Writes the given operation into the assembly buffer.
+ * @param[in, out] assemblyBuffer assembly buffer
+ * @param[in]      operation      operation to write
+ */
+static void writeParsedOperation(AssemblyBuffer& assemblyBuffer, const ParsedOperation& operation) {
+    byte opcode = operation.opcode;
+    assemblyBuffer.write(opcode);
+
+    if (isFusedJumpOperation(opcode)) {
+        assemblyBuffer.write(operation.operand);
+        writeJumpOffset(assemblyBuffer, operation);
+    } else if (opcode == PUSHR_PUSHR_MUL_OPCODE) {
+        assemblyBuffer.write(operation.reg);
+        assemblyBuffer.write(operation.reg2);
+    } else if (opcode == POPR_PUSHR_OPCODE) {
+        assemblyBuffer.write(operation.reg);
+    } else if (isFusedOperation(opcode)) {
+        return;
+    } else if ((opcode & IS_REG_OP_MASK) != 0) {
+        assemblyBuffer.write(operation.reg);
+    } else if (getOperationArityByOpcode(opcode) == 1) {
+        if (isJumpOperation(opcode)) {
+            writeJumpOffset(assemblyBuffer, operation);
+        } else if (opcode == IPUSH_OPCODE) {
+            assemblyBuffer.write(operation.integerOperand);
+        } else {
+            assemblyBuffer.write(operation.operand);
+        }
+    }
+}
+
+/**
+ * Fuses operations in the beginning of the given sequence into a single superinstruction.
+ * @param[in]  operations      operations sequence
+ * @param[in]  operationsCount number of operations in the sequence
+ * @param[out] fused           resulting superinstruction
+ * @return number of fused operations, or 0, if operations can't be fused.
+ */
+static int fuseOperations(const ParsedOperation* operations, int operationsCount, ParsedOperation& fused) {
+    fused = ParsedOperation();
+    if (operationsCount < 2) return 0;
+
+    const ParsedOperation& first  = operations[0];
+    const ParsedOperation& second = operations[1];
+
+    if ((operationsCount >= 3) && (first.opcode == PUSHR_OPCODE) && (second.opcode == PUSHR_OPCODE) &&
+        (operations[2].opcode == MUL_OPCODE)) {
+        fused.opcode = PUSHR_PUSHR_MUL_OPCODE;
+        fused.reg    = first.reg;
+        fused.reg2   = second.reg;
+        return 3;
+    }
+    if ((first.opcode == PUSH_OPCODE) && (getFusedJumpOpcodeByJump(second.opcode) != ERR_INVALID_OPERATION)) {
+        fused.opcode      = getFusedJumpOpcodeByJump(second.opcode);
+        fused.operand     = first.operand;
+        fused.labelOffset = second.labelOffset;
+        fused.labelFixup  = second.labelFixup;
+        return 2;
+    }
+    if ((first.opcode == DUP_OPCODE) && (second.opcode == ADD_OPCODE)) {
+        fused.opcode = DUP_ADD_OPCODE;
+        return 2;
+    }
+    if ((first.opcode == POPR_OPCODE) && (second.opcode == PUSHR_OPCODE) && (first.reg == second.reg)) {
+        fused.opcode = POPR_PUSHR_OPCODE;
+        fused.reg    = first.reg;
+        return 2;
+    }
+    if ((first.opcode == CALL_OPCODE) && (second.opcode == RET_OPCODE)) {
+        // Callee returns right to the caller's caller, so the call doesn't grow the call stack
+        fused = first;
+        fused.opcode = TAILCALL_OPCODE;
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * Writes operations from the beginning of the fusion window (fused, if possible) and removes them from the window.
+ * Operations are written until the window is not full, or until it's empty, if flushAll is set.
+ * @param[in, out] assemblyBuffer assembly buffer
+ * @param[in, out] window         operations that are not written yet
+ * @param[in, out] windowSize     number of operations in the window
+ * @param[in]      flushAll       shows if all operations should be written
+ */
+static void flushFusionWindow(AssemblyBuffer& assemblyBuffer, ParsedOperation* window, int& windowSize,
+                              bool flushAll) {
+    while ((windowSize >= FUSION_WINDOW_SIZE) || (flushAll && (windowSize > 0))) {
+        ParsedOperation fused {};
+        int fusedCount = fuseOperations(window, windowSize, fused);
+
+        // Pair is not fused, if it's second operation starts a longer superinstruction
+        ParsedOperation longerFused {};
+        if ((fusedCount == 2) && (fuseOperations(window + 1, windowSize - 1, longerFused) > 2)) fusedCount = 0;
+
+        if (fusedCount == 0) {
+            fused = window[0];
+            fusedCount = 1;
+        }
+        writeParsedOperation(assemblyBuffer, fused);
+
+        windowSize -= fusedCount;
+        memmove(window, window + fusedCount, windowSize * sizeof(ParsedOperation));
+    }
+}
+
+/**
+ * Operations between two labels. They are typed (see TypeInference) before they are fused and written.
+ */
+struct OperationBlock {
+    std::vector<ParsedOperation> operations;
+    /** Type variables of the operations, that take values of both types, or -1 for other operations */
+    std::vector<int> typeVariables;
+    TypeInference inference;
+};
+
+/**
+ * Writes operations of the block with their inferred types (fused, if it's set) and clears the block.
+ * @param[in, out] assemblyBuffer assembly buffer
+ * @param[in, out] block          operations of the block
+ * @param[in]      fuseOperations shows if operations are fused
+ */
+static void writeOperationBlock(AssemblyBuffer& assemblyBuffer, OperationBlock& block, bool fuseOperations) {
+    ParsedOperation window[FUSION_WINDOW_SIZE] = {};
+    int windowSize = 0;
+    for (size_t i = 0; i < block.operations.size(); ++i) {
+        ParsedOperation& operation = block.operations[i];
+        int typeVariable = block.typeVariables[i];
+        bool isInteger = (typeVariable >= 0) && (block.inference.getType(typeVariable) == INTEGER_TYPE);
+        if (isInteger) applyInferredType(operation);
+
+        window[windowSize++] = operation;
+        flushFusionWindow(assemblyBuffer, window, windowSize, !fuseOperations);
+    }
+    flushFusionWindow(assemblyBuffer, window, windowSize, true);
+
+    block.operations.clear();
+    block.typeVariables.clear();
+    block.inference.clear();
+}
+
+/** Maximal length of the source code line. Longer lines are split, as fgets does */
+constexpr static unsigned int MAX_SOURCE_LINE_LENGTH = 256u;
+
+/** Minimal size of the source code chunk that is worth assembling on a separate thread */
+constexpr static size_t MIN_SOURCE_CHUNK_SIZE = 256u * 1024u;
+
+/**
+ * Label defined in the source code chunk.
+ */
+struct ChunkLabel {
+    /** Label name in the source code (ends with ':') */
+    const char* name;
+    /** Offset of the label from the beginning of the chunk assembly */
+    int offset;
+};
+
+/**
+ * Part of the source code that is assembled independently of other parts. Chunks begin at label lines, so the chunk
+ * assembly matches the same part of the whole source assembly, except for jumps to labels of other chunks, which are
+ * left as fixups.
+ */
+struct SourceChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    AssemblyBuffer assemblyBuffer;
+    LabelTable labelTable;
+    /** Labels of the chunk in order of their definition */
+    std::vector<ChunkLabel> labels;
+    /** Status of the chunk assembly (the first error in the chunk) */
+    byte statusCode = 0;
+    /** Shows if the last line of the chunk is a label (dangling label at the end of the code is an error) */
+    bool endsWithLabel = false;
+    /** Shows if the chunk defines a label that is already defined by one of the previous chunks */
+    bool redefinesLabel = false;
+    /** ERR_INVALID_LABEL, if there are jumps to labels that are not defined in any chunk, or 0 otherwise */
+    byte fixupsStatusCode = 0;
+    /** Offset of the chunk assembly in the whole assembly */
+    int baseOffset = 0;
+};
+
+/**
+ * Reads the next line of the source code into the given buffer, the same way as fgets does.
+ * @param[in]  position   position of the line in the source code
+ * @param[in]  end        end of the source code
+ * @param[out] line       buffer of MAX_SOURCE_LINE_LENGTH characters to read line into
+ * @return position of the next line.
+ */
+static const char* readSourceLine(const char* position, const char* end, char* line) {
+    size_t maxLength = std::min((size_t)(end - position), (size_t)MAX_SOURCE_LINE_LENGTH - 1);
+    const char* newline = (const char*)memchr(position, '\n', maxLength);
+    size_t length = (newline != nullptr) ? (size_t)(newline - position + 1) : maxLength;
+
+    memcpy(line, position, length);
+    line[length] = '\0';
+    return position + length;
+}
+
+/**
+ * Checks if the source code line at the given position is a label.
+ * @param[in] position position of the line in the source code
+ * @param[in] end      end of the source code
+ * @return true, if the line is a label, false otherwise.
+ */
+static bool isLabelLine(const char* position, const char* end) {
+    char lineBuffer[MAX_SOURCE_LINE_LENGTH] = "";
+    readSourceLine(position, end, lineBuffer);
+    char* line = lineBuffer;
+    return isLabel(trim(line));
+}
+
+/**
+ * Assembles the source code chunk into it's assembly buffer in a single pass. Labels are put into the chunk label
+ * table as they are met, and jumps to labels defined later in the chunk are patched when the whole chunk is read.
+ * @param[in, out] chunk   source code chunk
+ * @param[in]      options assembly options
+ */
+static void assembleChunk(SourceChunk& chunk, const AssemblyOptions& options) {
+    byte statusCode = 0;
+    AssemblyBuffer& assemblyBuffer = chunk.assemblyBuffer;
+
+    OperationBlock block;
+
+    char lineOriginPtr[MAX_SOURCE_LINE_LENGTH] = "";
+    const char* position = chunk.begin;
+    while (position < chunk.end) {
+        const char* lineBegin = position;
+        position = readSourceLine(position, chunk.end, lineOriginPtr);
+
+        char* line = lineOriginPtr;
+        if ((strlen(trim(line)) == 0)) continue;
+
+        if (isLabel(line)) {
+            // Operations are never fused or typed across labels, because label can be a jump destination
+            writeOperationBlock(assemblyBuffer, block, options.fuseOperations);
+            if (chunk.labelTable.addLabel(line, assemblyBuffer.getSize()) == ERR_INVALID_LABEL) { statusCode = ERR_INVALID_LABEL; break; }
+            chunk.labels.push_back({lineBegin + (line - lineOriginPtr), assemblyBuffer.getSize()});
+        } else {
+            ParsedOperation operation {};
+            statusCode = parseSourceLine(line, chunk.labelTable, assemblyBuffer, operation);
+            if (statusCode != 0) break;
+
+            block.typeVariables.push_back(inferOperationType(operation, block.inference));
+            block.operations.push_back(operation);
+        }
+    }
+    if (statusCode == 0) writeOperationBlock(assemblyBuffer, block, options.fuseOperations);
+    chunk.endsWithLabel = isLabel(lineOriginPtr);
+    if ((statusCode != 0) && chunk.endsWithLabel) statusCode = ERR_INVALID_LABEL;
+
+    chunk.statusCode = statusCode;
+    // Operations after the error are not written, so their fixups can't be resolved
+    if (statusCode == 0) chunk.fixupsStatusCode = assemblyBuffer.resolveFixups(chunk.labelTable);
+}
+
+/**
+ * Links the chunk with other chunks: checks that it's labels are not defined by the previous chunks and patches
+ * jumps to labels of other chunks. Chunks are linked in parallel, but only the given chunk is changed.
+ * @param[in, out] chunks     all chunks of the source code (assembled and placed, see assembleChunk)
+ * @param[in]      chunkIndex index of the chunk to link
+ */
+static void linkChunk(std::vector<SourceChunk>& chunks, size_t chunkIndex) {
+    SourceChunk& chunk = chunks[chunkIndex];
 
-        double rhs = pop(&stack);
-        double lhs = pop(&stack);
-        push(&stack, pow(lhs, rhs));
-    } else if (opcode == RET_OPCODE) {
-        if (getStackSize(&callStack) < 1) return ERR_STACK_UNDERFLOW;
+    char labelName[MAX_SOURCE_LINE_LENGTH] = "";
+    for (const ChunkLabel& label : chunk.labels) {
+        size_t labelNameLength = strchr(label.name, ':') - label.name;
+        memcpy(labelName, label.name, labelNameLength);
+        labelName[labelNameLength] = '\0';
 
-        int returnAddress = pop(&callStack);
-        pc = returnAddress;
-    } else if (opcode == HLT_OPCODE) {
-        /* Do nothing */
-    } else {
-        return ERR_INVALID_OPERATION;
+        for (size_t i = 0; (i < chunkIndex) && !chunk.redefinesLabel; ++i) {
+            chunk.redefinesLabel = (chunks[i].labelTable.getLabelOffset(labelName) >= 0);
+        }
+        if (chunk.redefinesLabel) return;
+    }
+
+    for (size_t i = 0; (i < chunks.size()) && (chunk.statusCode == 0) && (chunk.fixupsStatusCode != 0); ++i) {
+        if (i == chunkIndex) continue;
+        chunk.fixupsStatusCode = chunk.assemblyBuffer.resolveFixups(chunks[i].labelTable,
+                                                                    chunks[i].baseOffset - chunk.baseOffset);
     }
-    return opcode;
 }
 
 /**
- * Processes the single operand operation.
- * @param[in]      opcode  code of the operation to process
- * @param[in, out] operand operand to process
- * @return given operation code, if operation processed successfully;
- *         ERR_INVALID_OPERATION, if operation code was invalid;
- *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
- *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size.
+ * Calls the given function for each chunk index, chunks are processed in parallel (one thread per chunk).
+ * @param[in] chunksNumber number of chunks
+ * @param[in] function     function to call
  */
-byte StackMachine::processOperation(byte opcode, double& operand) {
-    assert(assemblySize >= 0);
-    assert((pc >= 0) && (pc <= assemblySize));
-    assert(assembly != nullptr);
-    assert(registers != nullptr);
-
-    switch (opcode) {
-        case PUSH_OPCODE:
-        case PUSHR_OPCODE:
-            push(&stack, operand);
-            break;
-        case PUSHM_OPCODE:
-        case PUSHRM_OPCODE:
-            if ((operand < 0) || ((int)operand >= ram.SIZE)) return ERR_INVALID_RAM_ADDRESS;
-            push(&stack, ram.getAt((int)operand));
-            break;
-        case POPR_OPCODE:
-            operand = pop(&stack);
-            break;
-        case POPM_OPCODE:
-        case POPRM_OPCODE:
-            if ((operand < 0) || ((int)operand >= ram.SIZE)) return ERR_INVALID_RAM_ADDRESS;
-            ram.setAt((int)operand, pop(&stack));
-            break;
-        default:
-            return ERR_INVALID_OPERATION;
+template <typename ChunkFunction>
+static void forEachChunk(size_t chunksNumber, ChunkFunction function) {
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunksNumber; ++i) {
+        workers.emplace_back(function, i);
     }
-    return opcode;
+    if (chunksNumber != 0) function(0);
+    for (std::thread& worker : workers) worker.join();
 }
 
 /**
- * Processes the jump operation.
- * @param[in] opcode     code of the jump operation to process
- * @param[in] jumpOffset offset of the jump to process
- * @return given operation code, if operation processed successfully;
- *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
- *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ * Splits the source code into chunks at label lines, because operations are never fused or typed across labels.
+ * @param[in] source       source code
+ * @param[in] sourceSize   size of the source code
+ * @param[in] chunksNumber desired number of chunks
+ * @return beginnings of the chunks followed by the end of the source code.
  */
-byte StackMachine::processJumpOperation(byte opcode, int jumpOffset) {
-    assert(assemblySize >= 0);
-    assert((pc >= 0) && (pc <= assemblySize));
-    assert(assembly != nullptr);
-    assert(registers != nullptr);
-    assert(isJumpOperation(opcode));
+static std::vector<const char*> splitSource(const char* source, size_t sourceSize, size_t chunksNumber) {
+    const char* end = source + sourceSize;
+    std::vector<const char*> bounds = {source};
+    for (size_t i = 1; i < chunksNumber; ++i) {
+        const char* bound = source + sourceSize * i / chunksNumber;
+        if (bound <= bounds.back()) continue;
 
-    double lhs = NAN, rhs = NAN;
-    if (opcode != JMP_OPCODE && opcode != CALL_OPCODE) {
-        if (getStackSize(&stack) < 2) return ERR_STACK_UNDERFLOW;
-        rhs = pop(&stack); lhs = pop(&stack);
-    }
-    switch (opcode) {
-        case JMPE_OPCODE:
-            if (fabs(lhs - rhs) < COMPARE_EPS) break;
-            return opcode;
-        case JMPNE_OPCODE:
-            if (fabs(lhs - rhs) >= COMPARE_EPS) break;
-            return opcode;
-        case JMPL_OPCODE:
-            if (lhs < rhs) break;
-            return opcode;
-        case JMPLE_OPCODE:
-            if (lhs <= rhs) break;
-            return opcode;
-        case JMPG_OPCODE:
-            if (lhs > rhs) break;
-            return opcode;
-        case JMPGE_OPCODE:
-            if (lhs >= rhs) break;
-            return opcode;
-        case CALL_OPCODE:
-            push(&callStack, pc);
-            break;
-        case JMP_OPCODE:
-            break;
-        default:
-            return ERR_INVALID_OPERATION;
+        // Chunk begins after the line break, so it's first line is read as the first fgets line
+        while ((bound < end) && (bound[-1] != '\n')) ++bound;
+        while ((bound < end) && !isLabelLine(bound, end)) {
+            const char* newline = (const char*)memchr(bound, '\n', end - bound);
+            bound = (newline != nullptr) ? newline + 1 : end;
+        }
+        if (bound < end) bounds.push_back(bound);
     }
-    pc += jumpOffset;
-    if (pc < 0 || pc >= assemblySize) return ERR_INVALID_OPERATION;
-    return opcode;
+    bounds.push_back(end);
+    return bounds;
 }
 
 /**
- * If output file is nullptr, then this function resolves labels and puts info into label table.
- * Otherwise, assembles the given source code file into the assembly file.
- * @param[in]      input      source code file
- * @param[in]      output     resulting assembly file
- * @param[in, out] labelTable label table with info about labels
- * @return 0, if assembly/labels resolving finished successfully;
+ * Assembles the source code into the given file. The source code is split into chunks, which are assembled and linked
+ * in parallel. The result is the same as of the assembly of the whole source code at once.
+ * @param[in]  source     source code
+ * @param[in]  sourceSize size of the source code
+ * @param[out] output     resulting assembly file
+ * @param[in]  options    assembly options
+ * @param[out] labels     vector to append labels of the source code to, or nullptr
+ * @return 0, if assembly finished successfully;
  *         ERR_INVALID_OPERATION, if invalid operation was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
- *         ERR_INVALID_LABEL, if invalid label was met.
+ *         ERR_INVALID_LABEL, if invalid label was met;
+ *         ERR_INVALID_FILE, if the assembly can't be written.
  */
-static byte assemble(FILE* input, FILE* output, LabelTable& labelTable) {
-    bool isResolvingLabels = (output == nullptr);
+static byte assemble(const char* source, size_t sourceSize, FILE* output, const AssemblyOptions& options,
+                     std::vector<SourceLabel>* labels = nullptr) {
+    size_t chunksNumber = options.threadsNumber;
+    if (chunksNumber == 0) chunksNumber = std::thread::hardware_concurrency();
+    chunksNumber = std::max((size_t)1, std::min(chunksNumber, sourceSize / MIN_SOURCE_CHUNK_SIZE));
 
-    byte statusCode = 0;
-    int currentByteOffset = 0;
+    std::vector<const char*> bounds = splitSource(source, sourceSize, chunksNumber);
+    std::vector<SourceChunk> chunks(bounds.size() - 1);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].begin = bounds[i];
+        chunks[i].end = bounds[i + 1];
+    }
 
-    constexpr static unsigned int MAX_LINE_LENGTH = 256u;
-    char* const lineOriginPtr = (char*)calloc(MAX_LINE_LENGTH, sizeof(char));
-    char* line = lineOriginPtr;
-    while (fgets(line, MAX_LINE_LENGTH, input)) {
-        if ((strlen(trim(line)) == 0)) {
-            line = lineOriginPtr;
-            continue;
-        }
+    forEachChunk(chunks.size(), [&chunks, &options](size_t i) { assembleChunk(chunks[i], options); });
 
-        if (isLabel(line)) {
-            if (isResolvingLabels) {
-                if (labelTable.addLabel(line, currentByteOffset) == ERR_INVALID_LABEL) { statusCode = ERR_INVALID_LABEL; break; }
-            }
-        } else {
-            byte opcode = parseOperation(line);
-            if (opcode == ERR_INVALID_OPERATION) { statusCode = ERR_INVALID_OPERATION; break; }
-
-            // TODO: Clean up somehow
-            char* operandToken = getNextToken(line);
-            if (asRamAccess(operandToken)) opcode |= IS_RAM_OP_MASK;
-            if (getRegisterNumberByName(operandToken) != ERR_INVALID_REGISTER) {
-                opcode |= IS_REG_OP_MASK;
-                if (getOperationArityByOpcode(opcode) == ERR_INVALID_OPERATION) { statusCode = ERR_INVALID_OPERATION; break; }
-                asmWrite(output, opcode, currentByteOffset);
-
-                byte reg = parseRegister(operandToken);
-                if (reg == ERR_INVALID_REGISTER) { statusCode = ERR_INVALID_REGISTER; break; }
-                asmWrite(output, reg, currentByteOffset);
-            } else if (getOperationArityByOpcode(opcode) == 1) {
-                asmWrite(output, opcode, currentByteOffset);
-                if (isJumpOperation(opcode)) {
-                    int labelOffset = 0;
-                    if (!isResolvingLabels) {
-                        labelOffset = labelTable.getLabelOffset(operandToken);
-                        if (labelOffset < 0) { statusCode = ERR_INVALID_LABEL; break; }
-                        labelOffset -= currentByteOffset;
-                    }
-                    asmWrite(output, labelOffset, currentByteOffset);
-                } else {
-                    double operand = parseOperand(operandToken);
-                    if (!std::isfinite(operand)) { statusCode = ERR_INVALID_OPERATION; break; }
-                    asmWrite(output, operand, currentByteOffset);
-                }
-            } else {
-                asmWrite(output, opcode, currentByteOffset);
-            }
-        }
+    // The first error in the source code order is reported, as if the source code was assembled at once
+    byte statusCode = 0;
+    int baseOffset = 0;
+    for (SourceChunk& chunk : chunks) {
+        chunk.baseOffset = baseOffset;
+        baseOffset += chunk.assemblyBuffer.getSize();
+    }
+    forEachChunk(chunks.size(), [&chunks](size_t i) { linkChunk(chunks, i); });
 
-        line = lineOriginPtr;
+    for (const SourceChunk& chunk : chunks) {
+        if (chunk.redefinesLabel) { statusCode = ERR_INVALID_LABEL; break; }
+        if (chunk.statusCode != 0) { statusCode = chunk.statusCode; break; }
+    }
+    if ((statusCode == 0) && chunks.back().endsWithLabel) statusCode = ERR_INVALID_LABEL;
+    for (size_t i = 0; (i < chunks.size()) && (statusCode == 0); ++i) {
+        statusCode = chunks[i].fixupsStatusCode;
     }
-    if (isLabel(lineOriginPtr)) statusCode = ERR_INVALID_LABEL; // because dangling label at the end of the code is an error
 
-    free(lineOriginPtr);
+    for (size_t i = 0; (i < chunks.size()) && (statusCode == 0); ++i) {
+        statusCode = chunks[i].assemblyBuffer.flushToFile(output);
+    }
 
+    for (size_t i = 0; (i < chunks.size()) && (statusCode == 0) && (labels != nullptr); ++i) {
+        for (const ChunkLabel& label : chunks[i].labels) {
+            const char* nameEnd = strchr(label.name, ':');
+            labels->push_back({std::string(label.name, nameEnd), chunks[i].baseOffset + label.offset});
+        }
+    }
     return statusCode;
 }
 
 /**
- * Checks if the given operation code is actually an error code.
- * @param[in] opcode operation code to check
- * @return true, if the operation code is error code, false otherwise.
+ * Content of the input file: mapped into memory, or read into the buffer, if the file can't be mapped (e.g. pipe).
  */
-static bool isError(byte opcode) {
-    return opcode == ERR_INVALID_OPERATION ||
-           opcode == ERR_INVALID_REGISTER  ||
-           opcode == ERR_STACK_UNDERFLOW   ||
-           opcode == ERR_INVALID_LABEL     ||
-           opcode == ERR_INVALID_FILE      ||
-           opcode == ERR_INVALID_RAM_ADDRESS;
-}
+struct InputFile {
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapping = nullptr;
+    std::vector<char> buffer;
+
+    InputFile() = default;
+
+    InputFile(InputFile& inputFile) = delete;
+    InputFile &operator=(const InputFile&) = delete;
+
+    ~InputFile() {
+        if (mapping != nullptr) munmap(mapping, size);
+    }
+};
 
 /**
- * Resolves labels' offsets in assembly file and puts them into the given label table.
- * @param[in]  input      source code file
- * @param[out] labelTable label table to put info about labels into
- * @return 0, if labels was successfully resolved;
- *         ERR_INVALID_OPERATION, if invalid operation was met;
- *         ERR_INVALID_REGISTER, if invalid register was met;
- *         ERR_INVALID_LABEL, if invalid label was met.
+ * Maps the opened input file into memory for the sequential reading. Files that can't be mapped are read.
+ * @param[in]  input     descriptor of the opened input file
+ * @param[out] inputFile content of the file
+ * @return 0, if file was mapped or read successfully, or ERR_INVALID_FILE otherwise.
  */
-static byte resolveLabels(FILE* input, LabelTable& labelTable) {
-    return assemble(input, nullptr, labelTable);
+static byte readInputFile(int input, InputFile& inputFile) {
+    struct stat inputStat {};
+    if (fstat(input, &inputStat) < 0) return ERR_INVALID_FILE;
+
+    if (S_ISREG(inputStat.st_mode) && (inputStat.st_size > 0)) {
+        void* mapping = mmap(nullptr, inputStat.st_size, PROT_READ, MAP_PRIVATE, input, 0);
+        if (mapping == MAP_FAILED) return ERR_INVALID_FILE;
+        madvise(mapping, inputStat.st_size, MADV_SEQUENTIAL);
+
+        inputFile.mapping = mapping;
+        inputFile.data = static_cast<const char*>(mapping);
+        inputFile.size = inputStat.st_size;
+        return 0;
+    }
+
+    char readBuffer[MAX_SOURCE_LINE_LENGTH * 16];
+    ssize_t readSize = 0;
+    while ((readSize = read(input, readBuffer, sizeof(readBuffer))) > 0) {
+        inputFile.buffer.insert(inputFile.buffer.end(), readBuffer, readBuffer + readSize);
+    }
+    inputFile.data = inputFile.buffer.data();
+    inputFile.size = inputFile.buffer.size();
+    return (readSize < 0) ? ERR_INVALID_FILE : 0;
 }
 
 /**
  * Assembles the given source code file into the assembly file.
- * Assembly is performed in two runs: first run resolves labels, second one generates resulting .asm file.
+ * Source code file is mapped into memory and assembled in chunks on the given number of threads (see AssemblyOptions).
+ * The assembly of each chunk is written into the resulting .asm file at once.
  * @param[in] inputFileName  source code file name
  * @param[in] outputFileName resulting assembly file name
+ * @param[in] options        assembly options
  * @return 0, if assembly finished successfully;
  *         ERR_INVALID_OPERATION, if invalid operation was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
  *         ERR_INVALID_LABEL, if invalid label was met;
  *         ERR_INVALID_FILE, if input file is invalid.
  */
-int assemble(const char* inputFileName, const char* outputFileName) {
+int assemble(const char* inputFileName, const char* outputFileName, const AssemblyOptions& options) {
     assert(inputFileName != nullptr);
     assert(outputFileName != nullptr);
 
-    FILE* input  = fopen(inputFileName,  "r");
-    if (input == nullptr) return ERR_INVALID_FILE;
+    int input = open(inputFileName, O_RDONLY);
+    if (input < 0) return ERR_INVALID_FILE;
     FILE* output = fopen(outputFileName, "wb");
-    if (output == nullptr) return ERR_INVALID_FILE;
+    if (output == nullptr) {
+        close(input);
+        return ERR_INVALID_FILE;
+    }
 
-    LabelTable labelTable;
-    byte statusCode = resolveLabels(input, labelTable);
-    if (!isError(statusCode)) {
-        rewind(input);
-        statusCode = assemble(input, output, labelTable);
+    InputFile source;
+    byte statusCode = readInputFile(input, source);
+    if ((statusCode == 0) && (options.format == CONTAINER_FORMAT)) {
+        // Code is assembled into memory, because the container is written after it's code is decoded
+        char* code = nullptr;
+        size_t codeSize = 0;
+        std::vector<SourceLabel> labels;
+        FILE* codeStream = open_memstream(&code, &codeSize);
+        if (codeStream == nullptr) {
+            statusCode = ERR_INVALID_FILE;
+        } else {
+            statusCode = assemble(source.data, source.size, codeStream, options, &labels);
+            fclose(codeStream);
+        }
+        if ((statusCode == 0) && ((codeSize == 0) || (codeSize > INT32_MAX))) statusCode = ERR_INVALID_FILE;
+        if (statusCode == 0) {
+            statusCode = writeBytecodeContainer(output, reinterpret_cast<const byte*>(code), (int)codeSize, true,
+                                                options.stackHint, labels);
+        }
+        free(code);
+    } else if (statusCode == 0) {
+        statusCode = assemble(source.data, source.size, output, options);
     }
 
     fclose(output);
-    fclose(input);
+    close(input);
     return statusCode;
 }
 
 /**
- * Disassembles the given assembly file into the possible source code file.
- * @param[in] inputFileName  assembly file name
- * @param[in] outputFileName resulting source code file name
+ * Reads the operands of the fused operation from assembly and writes the operations sequence it was fused from
+ * into the disassembly buffer.
+ * @param[in]      assembly          assembly bytes
+ * @param[in]      assemblySize      size of the assembly in bytes
+ * @param[in]      opcode            code of the fused operation
+ * @param[in, out] currentByteOffset current offset in bytes
+ * @param[in, out] disasmBuffer      disassembly buffer to write operations into
  * @return 0, if disassembly finished successfully;
- *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_OPERATION, if invalid operand was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
- *         ERR_INVALID_LABEL, if invalid offset was met;
- *         ERR_INVALID_FILE, if input file is invalid.
+ *         ERR_INVALID_LABEL, if invalid offset was met.
  */
-int disassemble(const char* inputFileName, const char* outputFileName) {
-    assert(inputFileName != nullptr);
-    assert(outputFileName != nullptr);
+static byte disassembleFusedOperation(const byte* assembly, int assemblySize, byte opcode, int& currentByteOffset,
+                                      DisassemblyBuffer& disasmBuffer) {
+    assert(isFusedOperation(opcode));
 
-    FILE* input  = fopen(inputFileName,  "rb");
-    if (input == nullptr) return ERR_INVALID_FILE;
-    FILE* output = fopen(outputFileName, "w");
-    if (output == nullptr) return ERR_INVALID_FILE;
+    if (isFusedJumpOperation(opcode)) {
+        disasmBuffer.writeOperation(getOperationNameByOpcode(PUSH_OPCODE));
+        double operand = asmReadOperand(assembly, assemblySize, currentByteOffset);
+        if (!std::isfinite(operand)) return ERR_INVALID_OPERATION;
+        disasmBuffer.writeOperand(operand, false);
 
-    byte statusCode = 0;
+        disasmBuffer.writeFusedOperationPart(getOperationNameByOpcode(getFusedJumpOpcode(opcode)));
+        int jumpByteOffset = asmReadJumpOffset(assembly, assemblySize, currentByteOffset);
+        // sizeof(offset) is subtracted, because currentByteOffset is calculated ahead (with offset size)
+        jumpByteOffset += currentByteOffset - (int)sizeof(jumpByteOffset);
+        if (jumpByteOffset < 0) return ERR_INVALID_LABEL;
+        disasmBuffer.writeJumpLabelArgument(jumpByteOffset);
+    } else if (opcode == PUSHR_PUSHR_MUL_OPCODE) {
+        disasmBuffer.writeOperation(getOperationNameByOpcode(PUSHR_OPCODE));
+        const char* lhsRegName = getRegisterNameByNumber(asmReadRegister(assembly, assemblySize, currentByteOffset));
+        if (lhsRegName == nullptr) return ERR_INVALID_REGISTER;
+        disasmBuffer.writeRegister(lhsRegName, false);
 
-    DisassemblyBuffer disasmBuffer;
+        disasmBuffer.writeFusedOperationPart(getOperationNameByOpcode(PUSHR_OPCODE));
+        const char* rhsRegName = getRegisterNameByNumber(asmReadRegister(assembly, assemblySize, currentByteOffset));
+        if (rhsRegName == nullptr) return ERR_INVALID_REGISTER;
+        disasmBuffer.writeRegister(rhsRegName, false);
+
+        disasmBuffer.writeFusedOperationPart(getOperationNameByOpcode(MUL_OPCODE));
+    } else if (opcode == DUP_ADD_OPCODE) {
+        disasmBuffer.writeOperation(getOperationNameByOpcode(DUP_OPCODE));
+        disasmBuffer.writeFusedOperationPart(getOperationNameByOpcode(ADD_OPCODE));
+    } else if (opcode == POPR_PUSHR_OPCODE) {
+        disasmBuffer.writeOperation(getOperationNameByOpcode(POPR_OPCODE));
+        const char* regName = getRegisterNameByNumber(asmReadRegister(assembly, assemblySize, currentByteOffset));
+        if (regName == nullptr) return ERR_INVALID_REGISTER;
+        disasmBuffer.writeRegister(regName, false);
+
+        // Register is encoded once, so it's not accounted in the size of the second line
+        char pushLine[16] = "";
+        sprintf(pushLine, "%s %s", getOperationNameByOpcode(PUSHR_OPCODE), regName);
+        disasmBuffer.writeFusedOperationPart(pushLine);
+    }
+    return 0;
+}
+
+/**
+ * Disassembles the assembly into the disassembly buffer with a linear sweep.
+ * @param[in]      assembly     assembly bytes
+ * @param[in]      assemblySize size of the assembly in bytes
+ * @param[in, out] disasmBuffer disassembly buffer to write operations into
+ * @return 0, if disassembly finished successfully;
+ *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_INVALID_LABEL, if invalid offset was met.
+ */
+static byte disassemble(const byte* assembly, int assemblySize, DisassemblyBuffer& disasmBuffer) {
+    byte statusCode = 0;
     int currentByteOffset = 0;
 
-    byte opcode = asmReadOperation(input, currentByteOffset);
-    while (!feof(input)) {
+    byte opcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+    while (currentByteOffset <= assemblySize) {
+        if (isFusedOperation(opcode)) {
+            statusCode = disassembleFusedOperation(assembly, assemblySize, opcode, currentByteOffset, disasmBuffer);
+            if (statusCode != 0) break;
+
+            opcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+            continue;
+        }
+
         const char* operation = getOperationNameByOpcode(opcode);
         if (operation == nullptr) { statusCode = ERR_INVALID_OPERATION; break; }
         disasmBuffer.writeOperation(operation);
 
         if ((opcode & IS_REG_OP_MASK) != 0) {
-            byte reg = asmReadRegister(input, currentByteOffset);
-            const char* regName = getRegisterNameByNumber(reg);
+            byte reg = asmReadRegister(assembly, assemblySize, currentByteOffset);
+            const char* regName = isIntegerRegisterOperation(opcode) ? getIntegerRegisterNameByNumber(reg)
+                                                                     : getRegisterNameByNumber(reg);
             if (regName == nullptr) { statusCode = ERR_INVALID_REGISTER; break; }
             disasmBuffer.writeRegister(regName, (opcode & IS_RAM_OP_MASK) != 0);
         } else if (getOperationArityByOpcode(opcode) == 1) {
             if (isJumpOperation(opcode)) {
-                int jumpByteOffset = asmReadJumpOffset(input, currentByteOffset);
+                int jumpByteOffset = asmReadJumpOffset(assembly, assemblySize, currentByteOffset);
                 // sizeof(offset) is subtracted, because currentByteOffset is calculated ahead (with offset size)
                 jumpByteOffset += currentByteOffset - (int)sizeof(jumpByteOffset);
                 if (jumpByteOffset < 0) { statusCode = ERR_INVALID_LABEL; break; }
                 disasmBuffer.writeJumpLabelArgument(jumpByteOffset);
+            } else if (opcode == IPUSH_OPCODE) {
+                disasmBuffer.writeIntegerOperand(asmReadIntegerOperand(assembly, assemblySize, currentByteOffset));
             } else {
-                double operand = asmReadOperand(input, currentByteOffset);
+                double operand = asmReadOperand(assembly, assemblySize, currentByteOffset);
                 if (!std::isfinite(operand)) { statusCode = ERR_INVALID_OPERATION; break; }
                 disasmBuffer.writeOperand(operand, (opcode & IS_RAM_OP_MASK) != 0);
             }
         }
 
-        opcode = asmReadOperation(input, currentByteOffset);
+        opcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+    }
+
+    return statusCode;
+}
+
+/**
+ * Disassembles the assembly into the given file. The first pass collects labels, and the second one writes the code.
+ * @param[in]  assembly     assembly bytes
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] output       file to write the source code into
+ * @param[out] lines        vector to append lines of the written operations to, or nullptr
+ * @return 0, if disassembly finished successfully;
+ *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_INVALID_LABEL, if invalid offset was met;
+ *         ERR_INVALID_FILE, if output file can't be written.
+ */
+int disassemble(const unsigned char* assembly, int assemblySize, FILE* output, std::vector<DisassemblyLine>* lines) {
+    assert(assembly != nullptr || assemblySize == 0);
+    assert(output != nullptr);
+
+    DisassemblyBuffer disasmBuffer;
+    byte statusCode = disassemble(assembly, assemblySize, disasmBuffer);
+    if (statusCode != 0) return statusCode;
+
+    disasmBuffer.startOutput(output);
+    disasmBuffer.setLineMap(lines);
+    statusCode = disassemble(assembly, assemblySize, disasmBuffer);
+    assert(statusCode == 0);
+    return disasmBuffer.flushToFile();
+}
+
+/**
+ * Disassembles the given assembly file into the possible source code file.
+ * Assembly file is mapped into memory and disassembled in two passes: the first one collects labels, and the second
+ * one streams the source code into the file, so memory used depends on the number of labels only.
+ * Code section of the container is disassembled the same way.
+ * @param[in] inputFileName  assembly file name
+ * @param[in] outputFileName resulting source code file name
+ * @return 0, if disassembly finished successfully;
+ *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_INVALID_LABEL, if invalid offset was met;
+ *         ERR_INVALID_FILE, if input file is invalid.
+ */
+int disassemble(const char* inputFileName, const char* outputFileName) {
+    assert(inputFileName != nullptr);
+    assert(outputFileName != nullptr);
+
+    int input = open(inputFileName, O_RDONLY);
+    if (input < 0) return ERR_INVALID_FILE;
+    FILE* output = fopen(outputFileName, "w");
+    if (output == nullptr) {
+        close(input);
+        return ERR_INVALID_FILE;
     }
 
-    if (statusCode == 0) {
-        statusCode = disasmBuffer.flushToFile(output);
+    InputFile assemblyFile;
+    byte statusCode = readInputFile(input, assemblyFile);
+    if ((statusCode == 0) && (assemblyFile.size > INT32_MAX)) statusCode = ERR_INVALID_FILE;
+
+    const byte* assembly = reinterpret_cast<const byte*>(assemblyFile.data);
+    int assemblySize = (int)assemblyFile.size;
+    if ((statusCode == 0) && isBytecodeContainer(assembly, assemblyFile.size)) {
+        BytecodeContainer container;
+        statusCode = readBytecodeContainer(assembly, assemblyFile.size, container);
+        assembly = container.code;
+        assemblySize = container.codeSize;
     }
 
+    if (statusCode == 0) statusCode = disassemble(assembly, assemblySize, output);
+
     fclose(output);
-    fclose(input);
+    close(input);
     return statusCode;
 }
 
 /**
- * Runs the given assembly file.
+ * Finds the byte offset of the snapshot location: label of the source code (see BytecodeImage::getLabelOffset) or
+ * decimal byte offset.
+ * @param[in] machine  machine that runs the program
+ * @param[in] location label name or byte offset
+ * @return byte offset of the operation, or -1, if there is no such label or offset is out of the assembly.
+ */
+static int findSnapshotOffset(const StackMachine& machine, const char* location) {
+    int offset = -1;
+    char* end = nullptr;
+    long number = strtol(location, &end, 10);
+    if ((end != location) && (*end == '\0')) {
+        offset = (number >= 0) && (number <= INT32_MAX) ? (int)number : -1;
+    } else if (machine.getImage() != nullptr) {
+        offset = machine.getImage()->getLabelOffset(location);
+    }
+    return (offset < machine.getAssemblySize()) ? offset : -1;
+}
+
+/**
+ * Executes the program until the snapshot location given in options, and writes the snapshot there.
+ * @param[in, out] machine machine to execute program on
+ * @param[in]      options execution options
+ * @param[out]     status  exit code, if the program shouldn't be continued
+ * @return true, if snapshot was written and the program should be continued, false otherwise.
+ */
+static bool takeSnapshot(StackMachine& machine, const RunOptions& options, int& status) {
+    assert(options.snapshotLabel != nullptr);
+
+    int offset = findSnapshotOffset(machine, options.snapshotLabel);
+    if (offset < 0) {
+        fprintf(stderr, "Unknown snapshot location %s (labels are kept only by the container format)\n",
+                options.snapshotLabel);
+        status = ERR_INVALID_LABEL;
+        return false;
+    }
+
+    byte finishStatus = HLT_OPCODE;
+    if (!machine.executeUntil(offset, finishStatus)) {
+        fprintf(stderr, "Program finished before the snapshot location %s\n", options.snapshotLabel);
+        status = finishStatus;
+        return false;
+    }
+    if ((options.snapshotFileName == nullptr) || (machine.saveSnapshot(options.snapshotFileName) != 0)) {
+        status = ERR_INVALID_FILE;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Applies the execution options, that don't depend on the I/O, to the given machine.
+ * @param[in, out] machine machine to execute program on
+ * @param[in]      options execution options
+ * @return 0, if the machine is ready to run;
+ *         ERR_INVALID_FILE, if assembly file is invalid;
+ *         ERR_INVALID_RAM_ADDRESS, if RAM of the configured size can't be mapped.
+ */
+static int prepareMachine(StackMachine& machine, const RunOptions& options) {
+    if (machine.getAssemblySize() < 0) return ERR_INVALID_FILE;
+
+    RAM& ram = machine.getRam();
+    if ((ram.getSize() != options.ramSize) && !ram.resize(options.ramSize)) return ERR_INVALID_RAM_ADDRESS;
+    ram.setAccessCycles(options.ramAccessCycles);
+    machine.reserveStacks(options.stackReserve);
+    machine.setBudget(options.budget);
+    machine.setStatsCounting(options.printStats);
+    return 0;
+}
+
+/**
+ * Executes the program loaded into the given machine with IN values of the trace given in options, and compares
+ * outcomes of conditional jumps, OUT values and the final state with the trace. The first difference is written to
+ * stderr.
+ * @param[in, out] machine machine to execute program on
+ * @param[in]      options execution options
+ * @return 0, if execution matches the trace;
+ *         ERR_TRACE_MISMATCH, if it doesn't;
+ *         ERR_INVALID_FILE, if assembly file or trace file is invalid, or trace was recorded on another assembly;
+ *         ERR_INVALID_RAM_ADDRESS, if RAM of the configured size can't be mapped.
+ */
+static int replayMachine(StackMachine& machine, const RunOptions& options) {
+    assert(options.replayFileName != nullptr);
+
+    int status = prepareMachine(machine, options);
+    if (status != 0) return status;
+
+    ExecutionTrace trace {};
+    if (readTrace(options.replayFileName, trace) != 0) return ERR_INVALID_FILE;
+    if ((trace.header.assemblySize != (uint32_t)machine.getAssemblySize()) ||
+        (trace.header.assemblyHash != getAssemblyHash(machine.getAssembly(), (size_t)machine.getAssemblySize()))) {
+        fprintf(stderr, "Trace was recorded on another assembly\n");
+        return ERR_INVALID_FILE;
+    }
+
+    std::vector<double> inputs;
+    for (const TraceRecord& record : trace.records) {
+        if (record.kind == TRACE_INPUT) inputs.push_back(record.value);
+    }
+    std::vector<double> outputs;
+    MachineIO& io = machine.getIO();
+    io.setMemory(inputs.data(), inputs.size(), &outputs);
+    // Outcomes are known only up to the last whole record of the trace, that was cut by the crash
+    uint64_t branchesNumber = trace.isFinished ? trace.end.branchesNumber :
+                              (uint64_t)trace.branches.size() * TRACE_BRANCHES_PER_RECORD;
+    BranchLog branchLog(trace.branches, branchesNumber, trace.isFinished);
+    machine.setBranchLog(&branchLog);
+    byte exitCode = machine.execute();
+    machine.setBranchLog(nullptr);
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+
+    TraceEnd end = machine.getTraceEnd(exitCode);
+    end.branchesNumber = branchLog.getBranchesNumber();
+    return compareWithTrace(trace, branchLog, outputs, end, stderr) ? 0 : ERR_TRACE_MISMATCH;
+}
+
+/**
+ * Executes the program loaded into the given machine.
+ * @param[in, out] machine machine to execute program on
+ * @param[in]      options execution options
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_INVALID_FILE, if assembly file, IN values file, OUT values file, snapshot file or trace file is invalid;
+ *         ERR_INVALID_LABEL, if snapshot location is not found;
+ *         ERR_INVALID_RAM_ADDRESS, if RAM of the configured size can't be mapped;
+ *         ERR_TRACE_MISMATCH, if the replayed execution differs from the trace;
+ *         error code of the failed operation otherwise.
+ */
+static int runMachine(StackMachine& machine, const RunOptions& options) {
+    if (options.replayFileName != nullptr) return replayMachine(machine, options);
+
+    int status = prepareMachine(machine, options);
+    if (status != 0) return status;
+
+    MachineIO& io = machine.getIO();
+    TraceWriter traceWriter;
+    BranchLog branchLog(traceWriter);
+    if (options.traceFileName != nullptr) {
+        if (traceWriter.open(options.traceFileName, machine.getAssembly(), machine.getAssemblySize()) != 0) {
+            return ERR_INVALID_FILE;
+        }
+        io.setTrace(&traceWriter);
+        machine.setBranchLog(&branchLog);
+    }
+
+    bool isBinary = (options.ioMode == BINARY_IO);
+    FILE* input = stdin;
+    if (options.ioInputFileName != nullptr) input = fopen(options.ioInputFileName, isBinary ? "rb" : "r");
+    if (input == nullptr) return ERR_INVALID_FILE;
+    FILE* output = stdout;
+    if (options.ioOutputFileName != nullptr) output = fopen(options.ioOutputFileName, isBinary ? "wb" : "w");
+    if (output == nullptr) {
+        if (input != stdin) fclose(input);
+        return ERR_INVALID_FILE;
+    }
+
+    io.setMode(options.ioMode, input, output);
+
+    int exitCode = HLT_OPCODE;
+    bool isFinished = false;
+    if (options.resumeFileName != nullptr) {
+        exitCode = machine.restoreSnapshot(options.resumeFileName);
+        isFinished = (exitCode != 0);
+    }
+    if (!isFinished && (options.snapshotLabel != nullptr)) isFinished = !takeSnapshot(machine, options, exitCode);
+    if (!isFinished) exitCode = machine.execute();
+
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+    if (output != stdout) fclose(output);
+    if (input != stdin) fclose(input);
+
+    if (traceWriter.isOpen()) {
+        io.setTrace(nullptr);
+        machine.setBranchLog(nullptr);
+        branchLog.flush();
+        TraceEnd end = machine.getTraceEnd((byte)exitCode);
+        end.branchesNumber = branchLog.getBranchesNumber();
+        if ((traceWriter.close(&end) != 0) && (exitCode == HLT_OPCODE)) exitCode = ERR_INVALID_FILE;
+    }
+
+    RAM& ram = machine.getRam();
+    if (ram.getAccessCycles() != 0) fprintf(stderr, "RAM access time: %llu virtual cycles\n", ram.getCycles());
+    if (options.printStats) {
+        const ExecutionStats& stats = machine.getStats();
+        fprintf(stderr, "Instructions: %llu, jumps taken: %llu, calls: %llu, RAM reads: %llu, RAM writes: %llu\n",
+                stats.instructions, stats.jumpsTaken, stats.calls, stats.ramReads, stats.ramWrites);
+    }
+    return exitCode;
+}
+
+/**
+ * Executes the program on the profiling machine and writes the profile report.
+ * @param[in] options execution options
+ * @param[in] source  assembly file name, or image of the assembly file
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_INVALID_FILE, if the report can't be written;
+ *         error code otherwise (see runMachine).
+ */
+template <typename AssemblySource>
+static int runProfiled(const RunOptions& options, const AssemblySource& source) {
+    ProfilingStackMachine stackMachine(source);
+    int exitCode = runMachine(stackMachine, options);
+    if (stackMachine.getAssemblySize() < 0) return exitCode;
+
+    FILE* report = stderr;
+    if (options.profileFileName != nullptr) report = fopen(options.profileFileName, "w");
+    if (report == nullptr) return ERR_INVALID_FILE;
+
+    byte reportStatus = stackMachine.writeReport(report);
+    if (report != stderr) fclose(report);
+    return ((exitCode == HLT_OPCODE) && (reportStatus != 0)) ? reportStatus : exitCode;
+}
+
+/**
+ * Creates the machine of the engine given in options and executes the program on it.
+ * @param[in] options execution options
+ * @param[in] source  assembly file name, or image of the assembly file
+ * @return HLT_OPCODE, if program finished successfully, or error code otherwise (see runMachine).
+ */
+template <typename AssemblySource>
+static int runOnEngine(const RunOptions& options, const AssemblySource& source) {
+    if (options.profile) return runProfiled(options, source);
+
+    switch (options.engine) {
+        case THREADED_ENGINE: {
+            ThreadedStackMachine stackMachine(source, false);
+            return runMachine(stackMachine, options);
+        }
+        case TOS_CACHING_ENGINE: {
+            ThreadedStackMachine stackMachine(source, true);
+            return runMachine(stackMachine, options);
+        }
+        case JIT_ENGINE: {
+            JitStackMachine stackMachine(source);
+            return runMachine(stackMachine, options);
+        }
+        case REFERENCE_ENGINE:
+        default: {
+            StackMachine stackMachine(source);
+            return runMachine(stackMachine, options);
+        }
+    }
+}
+
+/**
+ * Runs the given assembly file. If lanes number is set in options, runs it over the batch of inputs.
  * @param[in] inputFileName  assembly file name
+ * @param[in] options        execution options
  * @return 0, if program finished successfully;
  *         ERR_INVALID_OPERATION, if invalid operation was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
  *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
  *         ERR_INVALID_FILE, if input file is invalid;
- *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size.
+ *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size;
+ *         ERR_BUDGET_EXHAUSTED, if the budget given in options was exhausted;
+ *         ERR_TRACE_MISMATCH, if the trace given in options was replayed and the execution differs from it.
  */
-int run(const char* inputFileName) {
+int run(const char* inputFileName, const RunOptions& options) {
     assert(inputFileName != nullptr);
 
-    StackMachine stackMachine(inputFileName);
-    if (stackMachine.getAssemblySize() < 0) return ERR_INVALID_FILE;
+    if ((options.traceFileName != nullptr) && ((options.lanes != 0) || (options.resumeFileName != nullptr))) {
+        fprintf(stderr, "Trace is recorded only by the single run from the beginning of the program\n");
+        return ERR_INVALID_FILE;
+    }
+    if (options.lanes != 0) return runBatch(inputFileName, options);
 
-    byte opcode = 0;
-    do {
-        opcode = stackMachine.processNextOperation();
-    } while (opcode != HLT_OPCODE && !isError(opcode));
+    if ((options.snapshotLabel != nullptr) && (options.snapshotFileName == nullptr)) {
+        std::string snapshotFileName = std::string(inputFileName) + SNAPSHOT_FILE_EXTENSION;
+        RunOptions snapshotOptions = options;
+        snapshotOptions.snapshotFileName = snapshotFileName.c_str();
+        return runOnEngine(snapshotOptions, inputFileName);
+    }
+    return runOnEngine(options, inputFileName);
+}
 
-    return opcode;
+/**
+ * Runs the given image of the assembly file. Batch execution (lanes number in options) is not supported.
+ * @param[in] image   image of the assembly file, or nullptr if the file is invalid
+ * @param[in] options execution options
+ * @return 0, if program finished successfully, or error code otherwise (same as for the assembly file).
+ */
+int run(const std::shared_ptr<const BytecodeImage>& image, const RunOptions& options) {
+    assert(options.lanes == 0);
+
+    return runOnEngine(options, image);
 }
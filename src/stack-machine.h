@@ -5,46 +5,400 @@
 #ifndef STACK_MACHINE_STACK_MACHINE_H
 #define STACK_MACHINE_STACK_MACHINE_H
 
-#include <unistd.h>
-
-#define STACK_SECURITY_LEVEL 3
+#ifndef STACK_SECURITY_LEVEL
+    /**
+     * Stack security level used by default for operand and call stacks: canary guards and hash checking.
+     * Fast build profile (run-fast) uses level 1: bounds checks only.
+     */
+    #define STACK_SECURITY_LEVEL 3
+#endif
 #define STACK_TYPE double
 #include "immortal-stack/stack.h"
 #undef STACK_TYPE
 #define STACK_TYPE int
 #include "immortal-stack/stack.h"
 #undef STACK_TYPE
+#define STACK_TYPE int64_t
+#include "immortal-stack/stack.h"
+#undef STACK_TYPE
 
+#include <climits>
 #include "stack-machine-utils.h"
+#include "machine-io.h"
+#include "execution-trace.h"
+
+#ifndef RAM_ACCESS_CYCLES
+    /** Default cost of a single RAM access in virtual cycles. Zero turns the timing model off */
+    #define RAM_ACCESS_CYCLES 0
+#endif
 
+/**
+ * Random access memory of the stack machine. Each address holds one double value.
+ * Memory is an anonymous mapping, which pages are zero-filled by the kernel on the first touch, so only the used part
+ * of a large memory costs physical memory. It has no guard pages: address operands are arbitrary doubles (negative,
+ * fractional or far out of range), so they are checked by isValidAddress rather than trapped past the end.
+ * Access cost is accounted by the timing model: every read or write takes the configured number of virtual cycles.
+ */
 class RAM {
 
 public:
-    static constexpr int SIZE = 1024;
-    static constexpr __useconds_t DELAY_MICROSECONDS = 10000; // 0.01 seconds
+    /** Number of addresses, if the size is not configured (see RunOptions::ramSize) */
+    static constexpr int DEFAULT_SIZE = 1024;
+    /** Maximal number of addresses (2 GiB of values) */
+    static constexpr int MAX_SIZE = 1 << 28;
 protected:
-    double memory[SIZE];
+    /** Values of the memory, or nullptr if the memory has no addresses */
+    double* memory = nullptr;
+    int size = 0;
+
+    /** Mapping of the memory. Values start at it's beginning */
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    /** Cost of a single access in virtual cycles */
+    unsigned int accessCycles = RAM_ACCESS_CYCLES;
+
+    /** Virtual cycles spent on all accesses */
+    unsigned long long cycles = 0;
 
 public:
-    double getAt(int pos) const;
+    /**
+     * Maps the zero-filled memory of the given size.
+     * @param[in] addressesNumber number of addresses
+     */
+    explicit RAM(int addressesNumber = DEFAULT_SIZE);
+
+    ~RAM();
+
+    RAM(const RAM& ram) = delete;
+    RAM &operator=(const RAM&) = delete;
+
+    /**
+     * Replaces the memory with the zero-filled memory of the given size. Spent virtual cycles are reset.
+     * @param[in] addressesNumber number of addresses (from 0 to MAX_SIZE)
+     * @return true, if memory was mapped, false otherwise (memory is left without addresses).
+     */
+    bool resize(int addressesNumber);
+
+    int getSize() const {
+        return size;
+    }
+
+    /**
+     * Checks if the address operand is inside the memory. Address is truncated to integer, when it's accessed.
+     * @param[in] address address to check
+     * @return true, if the address is valid, false otherwise (also for NaN).
+     */
+    bool isValidAddress(double address) const {
+        return (address >= 0) && (address < size);
+    }
+
+    double getAt(int pos);
     void setAt(int pos, double value);
+
+    void setAccessCycles(unsigned int cyclesPerAccess) {
+        accessCycles = cyclesPerAccess;
+    }
+
+    unsigned int getAccessCycles() const {
+        return accessCycles;
+    }
+
+    unsigned long long getCycles() const {
+        return cycles;
+    }
+
+    /**
+     * Gives values of all addresses. Access through it is not accounted by the timing model.
+     * @return getSize() values of the memory.
+     */
+    const double* getMemory() const {
+        return memory;
+    }
+
+    /**
+     * Copies values of all addresses from the given array. Access is not accounted by the timing model.
+     * @param[in] values getSize() values to copy
+     */
+    void loadMemory(const double* values);
+
+    /**
+     * Sets all addresses to zero and resets the spent virtual cycles. Pages of the large memory are returned to the
+     * kernel instead of being written, so clearing costs as much as the memory that was used.
+     */
+    void clear();
+
+    /**
+     * Checks if the range of addresses given by the operation operands is inside the memory.
+     * Address and count are truncated to integers, as addresses of PUSH [addr] and POP [addr] are.
+     * @param[in] address first address of the range
+     * @param[in] count   number of addresses in the range
+     * @return true, if the range is valid (empty range at any address inside the memory is valid), false otherwise.
+     */
+    bool isValidRange(double address, double count) const;
+
+    // Bulk operations over valid ranges. Sources are read before the destination is written, so ranges may overlap.
+    // Every element read and write is accounted by the timing model.
+
+    /** RAM[destination + i] = RAM[lhs + i] + RAM[rhs + i] for i in [0, count) */
+    void add(int destination, int lhs, int rhs, int count);
+    /** RAM[destination + i] = RAM[lhs + i] * RAM[rhs + i] for i in [0, count) */
+    void multiply(int destination, int lhs, int rhs, int count);
+    /** Sum of RAM[source + i] for i in [0, count). Order of the additions is unspecified */
+    double sum(int source, int count);
+    /** Sum of RAM[lhs + i] * RAM[rhs + i] for i in [0, count). Order of the additions is unspecified */
+    double dot(int lhs, int rhs, int count);
+    /** RAM[destination + i] = value for i in [0, count) */
+    void fill(int destination, double value, int count);
+    /** RAM[destination + i] = RAM[source + i] for i in [0, count) */
+    void copy(int destination, int source, int count);
+
+    // Kernels of sum and dot over values outside of the memory, e.g. gathered from RAM of a lane of VectorStackMachine.
+    // Values are added in the same order as sum and dot add them, so results are the same to the last bit.
+
+    /** Sum of values[i] for i in [0, count) */
+    static double sumValues(const double* values, int count);
+    /** Sum of lhs[i] * rhs[i] for i in [0, count) */
+    static double dotValues(const double* lhs, const double* rhs, int count);
+};
+
+/**
+ * Counters of the work done by the stack machine. Fused operation is counted as a single instruction.
+ */
+struct ExecutionStats {
+    /** Operations executed successfully */
+    unsigned long long instructions = 0;
+    /** Jumps that moved pc to their destination, including CALL */
+    unsigned long long jumpsTaken = 0;
+    unsigned long long calls = 0;
+    unsigned long long ramReads = 0;
+    unsigned long long ramWrites = 0;
+};
+
+/**
+ * Limits of a single StackMachine::execute call. Zero means no limit.
+ */
+struct ExecutionBudget {
+    /** Maximal number of operations to execute */
+    unsigned long long instructions = 0;
+    /** Maximal wall time of the execution in milliseconds. Checked every TIME_CHECK_INTERVAL operations */
+    unsigned long long milliseconds = 0;
+
+    /** Number of operations executed between checks of the time limit */
+    static constexpr unsigned long long TIME_CHECK_INTERVAL = 1024;
+
+    bool isLimited() const {
+        return (instructions != 0) || (milliseconds != 0);
+    }
 };
 
 class StackMachine : public AssemblyMachine {
 
-private:
+protected:
     Stack_double stack;
+    /** Values of the integer operations (IPUSH, IADD, IJMP* and others), that are kept apart from the operand stack */
+    Stack_int64_t integerStack;
+    /** Return addresses of the outer calls. Addresses of the innermost calls are kept in the return ring */
     Stack_int callStack;
     RAM ram;
+    MachineIO io;
+
+    ExecutionStats stats;
+    ExecutionBudget budget;
+    /** Shows if stats are counted */
+    bool isCountingStats = false;
+    /** Log every conditional jump outcome is written into, or nullptr */
+    BranchLog* branchLog = nullptr;
+
+    /**
+     * Operations decoded at their first execution (see processCachedOperation), in the order of these executions,
+     * so only the executed operations take space.
+     */
+    std::vector<DecodedOperation> operationCache;
+    /**
+     * Index of the operation at each byte offset in operationCache plus one, or 0, if the operation at this offset wasn't
+     * executed yet. Allocated zeroed by the first execution, so pages of the code that is never executed stay untouched.
+     */
+    int32_t* operationSlots = nullptr;
+
+    /**
+     * Shows if immediate addresses of all reachable PUSH [addr] and POP [addr] operations of the verified image are
+     * inside RAM, so they are not checked on every access. Set by execute() (see BytecodeVerification::requiredRamSize).
+     */
+    bool areImmediateAddressesValid = false;
+
+    /** Number of the innermost return addresses kept in the machine itself (power of 2) */
+    static constexpr int RETURN_RING_SIZE = 16;
+    /**
+     * Return addresses of the innermost calls. Calls that don't fit spill the oldest of them to callStack, so shallow
+     * calls never touch the (hardened) heap stack.
+     */
+    int returnRing[RETURN_RING_SIZE] = {};
+    /** Index of the oldest return address in the ring */
+    int returnRingStart = 0;
+    /** Number of return addresses in the ring */
+    int returnRingSize = 0;
+
+    /**
+     * Pushes the return address of the call.
+     * @param[in] returnAddress byte offset to return to
+     */
+    void pushReturnAddress(int returnAddress) {
+        if (returnRingSize == RETURN_RING_SIZE) {
+            push(&callStack, returnRing[returnRingStart]);
+            returnRingStart = (returnRingStart + 1) & (RETURN_RING_SIZE - 1);
+            --returnRingSize;
+        }
+        returnRing[(returnRingStart + returnRingSize) & (RETURN_RING_SIZE - 1)] = returnAddress;
+        ++returnRingSize;
+    }
+
+    /**
+     * Pops the return address of the innermost call.
+     * @param[out] returnAddress byte offset to return to
+     * @return true, if address was popped, or false, if there are no calls to return from.
+     */
+    bool popReturnAddress(int& returnAddress) {
+        if (returnRingSize > 0) {
+            --returnRingSize;
+            returnAddress = returnRing[(returnRingStart + returnRingSize) & (RETURN_RING_SIZE - 1)];
+            return true;
+        }
+        if (getStackSize(&callStack) < 1) return false;
+        returnAddress = pop(&callStack);
+        return true;
+    }
+
+    /**
+     * Gets the number of calls that weren't returned from.
+     * @return depth of calls.
+     */
+    ssize_t getCallDepth() {
+        return getStackSize(&callStack) + returnRingSize;
+    }
 
 public:
     explicit StackMachine(const char* assemblyFileName);
 
+    /**
+     * Uses the given image of the assembly file.
+     * @param[in] image image of the assembly file, or nullptr if the file is invalid
+     */
+    explicit StackMachine(std::shared_ptr<const BytecodeImage> image);
+
     ~StackMachine();
 
     StackMachine(StackMachine& stackMachine) = delete;
     StackMachine &operator=(const StackMachine&) = delete;
 
+    RAM& getRam() {
+        return ram;
+    }
+
+    MachineIO& getIO() {
+        return io;
+    }
+
+    /**
+     * Sets the limits of every following execute() call. When a limit is reached, execute() returns
+     * ERR_BUDGET_EXHAUSTED, and the next call continues the program from the operation that wasn't executed.
+     * @param[in] executionBudget limits of the execution
+     */
+    void setBudget(const ExecutionBudget& executionBudget) {
+        budget = executionBudget;
+    }
+
+    const ExecutionBudget& getBudget() const {
+        return budget;
+    }
+
+    /**
+     * Turns counting of the stats on or off. Counted execution uses the reference dispatch loop on every engine,
+     * so it's off by default. Budget doesn't need it: each engine checks the budget in it's own dispatch loop.
+     * @param[in] isCounting shows if stats are counted
+     */
+    void setStatsCounting(bool isCounting) {
+        isCountingStats = isCounting;
+    }
+
+    /**
+     * Checks if execute() counts stats.
+     * @return true, if stats are counted, false otherwise.
+     */
+    bool isCounted() const {
+        return isCountingStats;
+    }
+
+    const ExecutionStats& getStats() const {
+        return stats;
+    }
+
+    /**
+     * Sets the log outcomes of the following conditional jumps are written into. Every engine writes them in the
+     * order they are executed, with the byte offsets of the jumps.
+     * @param[in] log branch log, that lives until another log is set, or nullptr to stop logging
+     */
+    void setBranchLog(BranchLog* log) {
+        branchLog = log;
+    }
+
+    void resetStats() {
+        stats = ExecutionStats();
+    }
+
+    /**
+     * Returns the machine to the state it had before the program was run: pc, registers, RAM, stats and all stacks
+     * are cleared in place. Capacity of the stacks and the decoded (or compiled) program are kept, so the machine can
+     * run the program again without being created anew. Budget, I/O mode and RAM access cost are not changed.
+     */
+    void reset();
+
+    /**
+     * Executes operations by the reference dispatch loop until pc reaches the given offset or the program is finished.
+     * @param[in]  offset byte offset of the operation to stop before
+     * @param[out] status HLT_OPCODE or error code, if the program finished before reaching the offset
+     * @return true, if pc reached the offset, false if the program finished.
+     */
+    bool executeUntil(int offset, unsigned char& status);
+
+    /**
+     * Writes the full state of the machine (pc, registers, RAM, operand, integer and call stacks) into the snapshot
+     * file (see machine-snapshot.h).
+     * @param[in] snapshotFileName snapshot file name
+     * @return 0, if snapshot was written successfully, or ERR_INVALID_FILE, if the file can't be written.
+     */
+    unsigned char saveSnapshot(const char* snapshotFileName);
+
+    /**
+     * Restores the state of the machine from the snapshot file. The file is mapped copy-on-write, and values are
+     * copied from the mapping as they are, without parsing.
+     * @param[in] snapshotFileName snapshot file name
+     * @return 0, if snapshot was restored successfully, or ERR_INVALID_FILE, if the file can't be read, is invalid or
+     *         was taken of another assembly. RAM takes the size of the snapshot. State of the machine is not
+     *         changed, if the snapshot isn't restored, except RAM, that is left empty, if it can't be resized.
+     */
+    unsigned char restoreSnapshot(const char* snapshotFileName);
+
+    /**
+     * Reserves the capacity of the operand and call stacks, so they don't grow until the given depths are reached.
+     * Capacity is never decreased, and is reserved only in empty stacks. Depths are limited by MAX_STACK_RESERVE.
+     * @param[in] reserve depths to reserve
+     */
+    void reserveStacks(const StackReserve& reserve);
+
+    /**
+     * Gets the capacity of the operand and call stacks.
+     * @return numbers of values the stacks hold without growing.
+     */
+    StackReserve getStackCapacity();
+
+    /**
+     * Gets the state of the machine, that is recorded at the end of the execution trace (see execution-trace.h).
+     * @param[in] status HLT_OPCODE or error code the program finished with
+     * @return pc, registers and operand stack of the machine.
+     */
+    TraceEnd getTraceEnd(unsigned char status);
+
     /**
     * Processes the no-operand operation.
     * @param[in] opcode code of the operation to process
@@ -65,6 +419,16 @@ public:
      */
     unsigned char processOperation(unsigned char opcode, double &operand) override;
 
+    /**
+     * Processes the operation with the integer operand.
+     * @param[in]      opcode  code of the operation to process (IPUSH, IPUSHR or IPOPR)
+     * @param[in, out] operand immediate operand or integer register
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty integer stack.
+     */
+    unsigned char processIntegerOperation(unsigned char opcode, int64_t& operand) override;
+
     /**
      * Processes the jump operation.
      * @param[in] opcode     code of the jump operation to process
@@ -74,18 +438,245 @@ public:
      *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
      */
     unsigned char processJumpOperation(unsigned char opcode, int jumpOffset) override;
+
+    /**
+     * Processes the fused operation. Result is the same as of the operations sequence it was fused from.
+     * @param[in] opcode code of the fused operation to process
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code, immediate operand or jump offset was invalid;
+     *         ERR_INVALID_REGISTER, if invalid register was met;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+     */
+    unsigned char processFusedOperation(unsigned char opcode) override;
+
+    /**
+     * Executes operations starting from the current pc until HLT operation or an error is met.
+     * Verified images (see bytecode-verifier.h) are executed without checks of operands and jump destinations,
+     * other ones are executed through the operation cache (see processCachedOperation).
+     * If stats are counted (see isCounted) or the budget is limited, operations are executed by executeCounted.
+     * @return HLT_OPCODE, if program finished successfully;
+     *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+     *         error code of the failed operation otherwise.
+     */
+    virtual unsigned char execute();
+
+protected:
+    /**
+     * Executes operations like execute() does, checking the budget before every operation.
+     * Stats are counted, if counting is turned on.
+     * @param[in] instructions maximal number of operations to execute, or ULLONG_MAX if it's not limited
+     * @param[in] deadline     time to stop the execution at (see getBudgetDeadline), or 0 if it's not limited
+     * @return the same as execute().
+     */
+    unsigned char executeCounted(unsigned long long instructions, unsigned long long deadline);
+
+    /**
+     * Gets the number of operations the budget allows a single execute() call to execute.
+     * @return budget.instructions, or ULLONG_MAX if it's not limited.
+     */
+    unsigned long long getBudgetInstructions() const {
+        return (budget.instructions != 0) ? budget.instructions : ULLONG_MAX;
+    }
+
+    /**
+     * Gets the time the execute() call started now must be stopped at.
+     * @return deadline in milliseconds of the monotonic clock (see readMilliseconds), or 0 if time isn't limited.
+     */
+    unsigned long long getBudgetDeadline() const {
+        return (budget.milliseconds != 0) ? readMilliseconds() + budget.milliseconds : 0;
+    }
+
+    /**
+     * Reads the monotonic clock.
+     * @return time in milliseconds.
+     */
+    static unsigned long long readMilliseconds();
+
+    /**
+     * Accounts the executed operation in the stats.
+     * @param[in] opcode       code of the executed operation
+     * @param[in] operationPc  byte offset of the executed operation
+     */
+    void countOperation(unsigned char opcode, int operationPc);
+
+    /**
+     * Processes the next operation of the verified image (see bytecode-verifier.h). The operation is reachable, so
+     * it's operands and jump destination are known to be valid and aren't checked.
+     * @return processed operation code or error code, if operation failed on the stack or RAM access.
+     */
+    unsigned char processVerifiedOperation();
+
+    /**
+     * Processes the operation at pc through the operation cache. The operation is decoded and validated on it's first
+     * execution, and the following executions take it's opcode, operand, register and absolute jump destination from
+     * the cache entry instead of reading and checking the encoded bytes again.
+     * @return processed operation code or error code, if operation was invalid or failed.
+     */
+    unsigned char processCachedOperation();
+
+    /**
+     * Allocates zeroed slots of the operation cache for every byte offset of the code, if they are not allocated yet.
+     */
+    void allocateOperationSlots();
+
+    /**
+     * Checks if immediate addresses of RAM operations of the verified image are inside RAM.
+     * @return true, if image is verified and it's immediate addresses are valid, false otherwise.
+     */
+    bool hasValidImmediateAddresses() const;
+
+private:
+    /**
+     * Applies the no-operand operation to the machine state.
+     * @param[in] opcode code of the operation to apply
+     * @return the same as processOperation(opcode).
+     */
+    unsigned char applyOperation(unsigned char opcode);
+
+    /**
+     * Applies the single operand operation to the machine state.
+     * @param[in]      opcode  code of the operation to apply
+     * @param[in, out] operand operand of the operation
+     * @return the same as processOperation(opcode, operand).
+     */
+    unsigned char applyOperation(unsigned char opcode, double& operand);
+
+    /**
+     * Applies the operation with the integer operand to the machine state.
+     * @param[in]      opcode  code of the operation to apply
+     * @param[in, out] operand integer operand of the operation
+     * @return the same as processIntegerOperation(opcode, operand).
+     */
+    unsigned char applyIntegerOperation(unsigned char opcode, int64_t& operand);
+
+    /**
+     * Pops operands of the vector operation (VADD, VMUL, VSUM, VDOT, VFILL or VCOPY) and applies it to RAM.
+     * @param[in] opcode code of the vector operation to apply
+     * @return the same as processOperation(opcode).
+     */
+    unsigned char applyVectorOperation(unsigned char opcode);
+
+    /**
+     * Applies the jump operation to the machine state.
+     * @tparam    IS_CHECKED shows if the jump destination is checked to be within the assembly
+     * @param[in] opcode     code of the jump operation to apply
+     * @param[in] jumpOffset offset of the jump
+     * @return the same as processJumpOperation(opcode, jumpOffset).
+     */
+    template <bool IS_CHECKED>
+    unsigned char applyJumpOperation(unsigned char opcode, int jumpOffset);
+
+    /**
+     * Reads operands of the fused operation and applies it to the machine state.
+     * @tparam    IS_CHECKED shows if registers, immediate operand and jump destination are checked
+     * @param[in] opcode     code of the fused operation to apply
+     * @return the same as processFusedOperation(opcode).
+     */
+    template <bool IS_CHECKED>
+    unsigned char applyFusedOperation(unsigned char opcode);
+
+    /**
+     * Applies the decoded fused operation to the machine state. Pc is already moved past the operation.
+     * @tparam    IS_CHECKED shows if the jump destination is checked to be within the assembly
+     * @param[in] operation  decoded fused operation with valid registers and immediate operand
+     * @return the same as processFusedOperation(opcode).
+     */
+    template <bool IS_CHECKED>
+    unsigned char applyDecodedFusedOperation(const DecodedOperation& operation);
+};
+
+/**
+ * Engines that can be used to execute the program.
+ */
+enum ExecutionEngine {
+    REFERENCE_ENGINE   = 1, /**< Decodes and dispatches every operation through StackMachine::processNextOperation */
+    THREADED_ENGINE    = 2, /**< Pre-decodes the program once and runs it with direct-threaded dispatch */
+    TOS_CACHING_ENGINE = 3, /**< Threaded engine that keeps the top of the operand stack in a register */
+    JIT_ENGINE         = 4, /**< Reference engine that compiles hot basic blocks to native code */
+};
+
+/** Extension of the snapshot file that is written, if it's name is not given */
+const char* const SNAPSHOT_FILE_EXTENSION = ".snapshot";
+
+/**
+ * Options that control the program execution.
+ */
+struct RunOptions {
+    ExecutionEngine engine = REFERENCE_ENGINE;
+    /** Cost of a single RAM access in virtual cycles */
+    unsigned int ramAccessCycles = RAM_ACCESS_CYCLES;
+    /** Number of RAM addresses */
+    int ramSize = RAM::DEFAULT_SIZE;
+    IOMode ioMode = INTERACTIVE_IO;
+    /** File with IN values, or nullptr for stdin */
+    const char* ioInputFileName = nullptr;
+    /** File for OUT values, or nullptr for stdout */
+    const char* ioOutputFileName = nullptr;
+    /** Number of lanes of the batch execution (4 or 8), or 0 if program is run once */
+    unsigned int lanes = 0;
+    /** File with IN values of batch execution (one line per run), or nullptr for stdin */
+    const char* batchInputFileName = nullptr;
+    /** File for OUT values of batch execution (one line per run), or nullptr for stdout */
+    const char* batchOutputFileName = nullptr;
+    /** Depths reserved in the stacks, if they exceed the ones expected by the image (BytecodeImage::getStackReserve) */
+    StackReserve stackReserve;
+    /** Shows if the program is run by the profiling machine (see profiling-stack-machine.h) */
+    bool profile = false;
+    /** File for the profile report, or nullptr for stderr */
+    const char* profileFileName = nullptr;
+    /** Limits of the execution. Not supported by the profiling and batch (lanes) execution */
+    ExecutionBudget budget;
+    /** Shows if the execution stats are written to stderr after the program */
+    bool printStats = false;
+    /** Label (or byte offset) of the operation, before which the snapshot is written, or nullptr */
+    const char* snapshotLabel = nullptr;
+    /** File to write the snapshot into, or nullptr for the assembly file name followed by SNAPSHOT_FILE_EXTENSION */
+    const char* snapshotFileName = nullptr;
+    /** Snapshot file to restore the machine from before the program is run, or nullptr */
+    const char* resumeFileName = nullptr;
+    /** Address the server of the programs listens on (see machine-server.h), or nullptr if program is run once */
+    const char* serveAddress = nullptr;
+    /** File to record the execution trace into (see execution-trace.h), or nullptr */
+    const char* traceFileName = nullptr;
+    /**
+     * Trace to replay, or nullptr: IN values are taken from the trace instead of the I/O mode, and outcomes of
+     * conditional jumps, OUT values and the final state are compared with the recorded ones
+     */
+    const char* replayFileName = nullptr;
+};
+
+/**
+ * Formats of the assembly file.
+ */
+enum AssemblyFormat {
+    RAW_FORMAT       = 1, /**< Legacy format: encoded operations one after another */
+    CONTAINER_FORMAT = 2, /**< Versioned container with code, constants and decoded sections (see bytecode-container.h) */
+};
+
+/**
+ * Options that control the assembly.
+ */
+struct AssemblyOptions {
+    /** Shows if frequent operations sequences are fused into superinstructions */
+    bool fuseOperations = false;
+    AssemblyFormat format = RAW_FORMAT;
+    /** Number of threads that assemble chunks of large source code files, or 0 for the number of hardware threads */
+    unsigned int threadsNumber = 0;
+    /** Expected depths of the stacks that are written into the container as it's stack hint */
+    StackReserve stackHint;
 };
 
 /**
  * Assembles the given source code file into the assembly file.
  * @param[in] inputFileName  source code file name
  * @param[in] outputFileName resulting assembly file name
+ * @param[in] options        assembly options
  * @return 0, if assembly finished successfully;
  *         ERR_INVALID_OPERATION, if invalid operation was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
  *         ERR_INVALID_FILE, if input file is invalid.
  */
-int assemble(const char* inputFileName, const char* outputFileName);
+int assemble(const char* inputFileName, const char* outputFileName, const AssemblyOptions& options = AssemblyOptions());
 
 /**
  * Disassembles the given assembly file into the possible source code file.
@@ -98,16 +689,42 @@ int assemble(const char* inputFileName, const char* outputFileName);
  */
 int disassemble(const char* inputFileName, const char* outputFileName);
 
+/**
+ * Disassembles the given assembly into the given file, and maps byte offsets of the operations to the written lines.
+ * @param[in]  assembly     assembly bytes
+ * @param[in]  assemblySize size of the assembly in bytes
+ * @param[out] output       file to write the source code into
+ * @param[out] lines        vector to append lines of the written operations to, or nullptr
+ * @return 0, if disassembly finished successfully;
+ *         ERR_INVALID_OPERATION, if invalid operation was met;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_INVALID_LABEL, if invalid offset was met;
+ *         ERR_INVALID_FILE, if output file can't be written.
+ */
+int disassemble(const unsigned char* assembly, int assemblySize, FILE* output,
+                std::vector<DisassemblyLine>* lines = nullptr);
+
 /**
  * Runs the given assembly file.
  * @param[in] inputFileName  assembly file name
+ * @param[in] options        execution options
  * @return 0, if program finished successfully;
  *         ERR_INVALID_OPERATION, if invalid operation was met;
  *         ERR_INVALID_REGISTER, if invalid register was met;
  *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
  *         ERR_INVALID_FILE, if input file is invalid;
- *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size.
+ *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size;
+ *         ERR_BUDGET_EXHAUSTED, if the budget given in options was exhausted;
+ *         ERR_TRACE_MISMATCH, if the trace given in options was replayed and the execution differs from it.
+ */
+int run(const char* inputFileName, const RunOptions& options = RunOptions());
+
+/**
+ * Runs the given image of the assembly file. Batch execution (lanes number in options) is not supported.
+ * @param[in] image   image of the assembly file, or nullptr if the file is invalid
+ * @param[in] options execution options
+ * @return 0, if program finished successfully, or error code otherwise (same as for the assembly file).
  */
-int run(const char* inputFileName);
+int run(const std::shared_ptr<const BytecodeImage>& image, const RunOptions& options = RunOptions());
 
 #endif // STACK_MACHINE_STACK_MACHINE_H
@@ -0,0 +1,742 @@
+/**
+ * @file
+ * @brief Implementation of stack machine with pre-decoding and direct-threaded dispatch.
+ */
+#include <cassert>
+#include <cmath>
+
+#include "threaded-stack-machine.h"
+#include "bytecode-image.h"
+
+using byte = unsigned char;
+
+ThreadedStackMachine::ThreadedStackMachine(const char* assemblyFileName, bool cacheTopOfStack) :
+    StackMachine(assemblyFileName), cacheTopOfStack(cacheTopOfStack) {
+    if (assemblySize >= 0) decodeAssembly();
+}
+
+ThreadedStackMachine::ThreadedStackMachine(std::shared_ptr<const BytecodeImage> image, bool cacheTopOfStack) :
+    StackMachine(std::move(image)), cacheTopOfStack(cacheTopOfStack) {
+    if (assemblySize >= 0) decodeAssembly();
+}
+
+/**
+ * Decodes the whole assembly into the operations stream.
+ */
+void ThreadedStackMachine::decodeAssembly() {
+    assert(assembly != nullptr);
+    assert(registers != nullptr);
+
+    operationIndexByOffset.assign(assemblySize + 1, -1);
+
+    // Linear sweep of the image is shared by all machines running it, so only it's mapping to the stream is done here
+    const std::vector<PredecodedOperation>& predecodedOperations = image->getDecodedOperations();
+    size_t predecodedIndex = 0;
+
+    int offset = 0;
+    while (offset <= assemblySize) {
+        ThreadedOperation operation {};
+        operation.offset = offset;
+        operation.target = -1;
+        operation.jumpTarget = -1;
+        operation.length = 1;
+
+        if (offset == assemblySize) {
+            operation.kind = END_OP;
+            operation.nextOffset = offset + 1;
+        } else {
+            assert(predecodedOperations[predecodedIndex].offset == offset);
+            const DecodedOperation& decoded = predecodedOperations[predecodedIndex].operation;
+            byte status = predecodedOperations[predecodedIndex].status;
+            ++predecodedIndex;
+
+            operation.nextOffset = offset + decoded.size;
+            operation.operand = decoded.operand;
+            operation.reg = registers + decoded.reg;
+            operation.reg2 = registers + decoded.reg2;
+            operation.integerOperand = decoded.integerOperand;
+            operation.integerReg = integerRegisters + decoded.reg;
+            operation.jumpTarget = decoded.jumpTarget;
+            operation.status = status;
+
+            switch (isError(status) ? ERR_INVALID_OPERATION : decoded.opcode) {
+                case ERR_INVALID_OPERATION: operation.kind = ERROR_OP; break;
+                case HLT_OPCODE:   operation.kind = HLT_OP;   break;
+                case PUSH_OPCODE:  operation.kind = PUSH_OP;  break;
+                case PUSHR_OPCODE: operation.kind = PUSHR_OP; break;
+                case POP_OPCODE:   operation.kind = POP_OP;   break;
+                case POPR_OPCODE:  operation.kind = POPR_OP;  break;
+                case ADD_OPCODE:   operation.kind = ADD_OP;   break;
+                case SUB_OPCODE:   operation.kind = SUB_OP;   break;
+                case MUL_OPCODE:   operation.kind = MUL_OP;   break;
+                case DIV_OPCODE:   operation.kind = DIV_OP;   break;
+                case SQRT_OPCODE:  operation.kind = SQRT_OP;  break;
+                case DUP_OPCODE:   operation.kind = DUP_OP;   break;
+                case JMP_OPCODE:   operation.kind = JMP_OP;   break;
+                case JMPE_OPCODE:  operation.kind = JMPE_OP;  break;
+                case JMPNE_OPCODE: operation.kind = JMPNE_OP; break;
+                case JMPL_OPCODE:  operation.kind = JMPL_OP;  break;
+                case JMPLE_OPCODE: operation.kind = JMPLE_OP; break;
+                case JMPG_OPCODE:  operation.kind = JMPG_OP;  break;
+                case JMPGE_OPCODE: operation.kind = JMPGE_OP; break;
+                case CALL_OPCODE:  operation.kind = CALL_OP;  break;
+                case TAILCALL_OPCODE: operation.kind = JMP_OP; break;
+                case RET_OPCODE:   operation.kind = RET_OP;   break;
+                case PUSHR_PUSHR_MUL_OPCODE: operation.kind = PUSHR_PUSHR_MUL_OP; break;
+                case DUP_ADD_OPCODE:         operation.kind = DUP_ADD_OP;         break;
+                case POPR_PUSHR_OPCODE:      operation.kind = POPR_PUSHR_OP;      break;
+                case CMP_IMM_JMPE_OPCODE:    operation.kind = CMP_IMM_JMPE_OP;    break;
+                case CMP_IMM_JMPNE_OPCODE:   operation.kind = CMP_IMM_JMPNE_OP;   break;
+                case CMP_IMM_JMPL_OPCODE:    operation.kind = CMP_IMM_JMPL_OP;    break;
+                case CMP_IMM_JMPLE_OPCODE:   operation.kind = CMP_IMM_JMPLE_OP;   break;
+                case CMP_IMM_JMPG_OPCODE:    operation.kind = CMP_IMM_JMPG_OP;    break;
+                case CMP_IMM_JMPGE_OPCODE:   operation.kind = CMP_IMM_JMPGE_OP;   break;
+                case IPUSH_OPCODE:  operation.kind = IPUSH_OP;  break;
+                case IPUSHR_OPCODE: operation.kind = IPUSHR_OP; break;
+                case IPOP_OPCODE:   operation.kind = IPOP_OP;   break;
+                case IPOPR_OPCODE:  operation.kind = IPOPR_OP;  break;
+                case ITOF_OPCODE:   operation.kind = ITOF_OP;   break;
+                case FTOI_OPCODE:   operation.kind = FTOI_OP;   break;
+                case IADD_OPCODE:   operation.kind = IADD_OP;   break;
+                case ISUB_OPCODE:   operation.kind = ISUB_OP;   break;
+                case IMUL_OPCODE:   operation.kind = IMUL_OP;   break;
+                case IJMPE_OPCODE:  operation.kind = IJMPE_OP;  break;
+                case IJMPNE_OPCODE: operation.kind = IJMPNE_OP; break;
+                case IJMPL_OPCODE:  operation.kind = IJMPL_OP;  break;
+                case IJMPLE_OPCODE: operation.kind = IJMPLE_OP; break;
+                case IJMPG_OPCODE:  operation.kind = IJMPG_OP;  break;
+                case IJMPGE_OPCODE: operation.kind = IJMPGE_OP; break;
+                default:           operation.kind = GENERIC_OP; break;
+            }
+        }
+
+        operationIndexByOffset[offset] = (int)operations.size();
+        operations.push_back(operation);
+        offset = operation.nextOffset;
+    }
+
+    for (ThreadedOperation& operation : operations) {
+        operation.target = getOperationIndex(operation.jumpTarget);
+        // Jump to the end of the assembly is invalid, so it's handled by the reference engine
+        if ((operation.target >= 0) && (operations[operation.target].kind == END_OP)) operation.target = -1;
+    }
+
+    fuseOperations();
+    measureSegments();
+}
+
+/**
+ * Fuses frequent operations sequences of the operations stream into superinstructions.
+ * Sequences that contain a jump destination (except for their first operation) are not fused.
+ *
+ * The first operation of the sequence is replaced by the superinstruction, and the rest of them are kept in the stream
+ * (but skipped by the superinstruction handler), so indices of operations stay the same.
+ */
+void ThreadedStackMachine::fuseOperations() {
+    const int operationsNumber = (int)operations.size();
+
+    std::vector<bool> isJumpDestination(operationsNumber, false);
+    for (const ThreadedOperation& operation : operations) {
+        if (operation.target >= 0) isJumpDestination[operation.target] = true;
+        // Return address of the call is also a jump destination
+        if ((operation.kind == CALL_OP) && (getOperationIndex(operation.nextOffset) >= 0)) {
+            isJumpDestination[getOperationIndex(operation.nextOffset)] = true;
+        }
+    }
+
+    int index = 0;
+    while (index + 1 < operationsNumber) {
+        ThreadedOperation& first = operations[index];
+        const ThreadedOperation& second = operations[index + 1];
+
+        if (isJumpDestination[index + 1]) {
+            ++index;
+            continue;
+        }
+
+        bool isThirdFusible = (index + 2 < operationsNumber) && !isJumpDestination[index + 2];
+        if ((first.kind == PUSHR_OP) && (second.kind == PUSHR_OP) && isThirdFusible &&
+            (operations[index + 2].kind == MUL_OP)) {
+            first.kind = PUSHR_PUSHR_MUL_OP;
+            first.reg2 = second.reg;
+            first.length = 3;
+        } else if ((first.kind == PUSH_OP) && (second.kind >= JMPE_OP) && (second.kind <= JMPGE_OP)) {
+            first.kind = (OperationKind)(CMP_IMM_JMPE_OP + (second.kind - JMPE_OP));
+            first.target = second.target;
+            first.jumpTarget = second.jumpTarget;
+            first.length = 2;
+        } else if ((first.kind == DUP_OP) && (second.kind == ADD_OP)) {
+            first.kind = DUP_ADD_OP;
+            first.length = 2;
+        } else if ((first.kind == POPR_OP) && (second.kind == PUSHR_OP) && (first.reg == second.reg)) {
+            first.kind = POPR_PUSHR_OP;
+            first.length = 2;
+        }
+        index += first.length;
+    }
+}
+
+/**
+ * Computes segment lengths of operations, so that the budget is charged once per segment.
+ * Segment of the fused operation continues after all operations it covers, as the superinstruction handler does.
+ */
+void ThreadedStackMachine::measureSegments() {
+    for (int index = (int)operations.size() - 1; index >= 0; --index) {
+        ThreadedOperation& operation = operations[index];
+        bool isSegmentEnd = (operation.kind < PUSH_OP) || ((operation.kind >= JMP_OP) && (operation.kind <= RET_OP)) ||
+                            ((operation.kind >= CMP_IMM_JMPE_OP) && (operation.kind <= CMP_IMM_JMPGE_OP)) ||
+                            (operation.kind >= IJMPE_OP);
+        // The last operation is END_OP, so the segment of any other one ends before the end of the stream
+        operation.segmentLength = operation.length;
+        if (!isSegmentEnd) operation.segmentLength += operations[index + operation.length].segmentLength;
+    }
+}
+
+/**
+ * Gets the index of the operation that starts at the given byte offset.
+ * @param[in] offset byte offset of the operation
+ * @return index of the operation in the operations stream, or -1 if no operation starts at this offset.
+ */
+int ThreadedStackMachine::getOperationIndex(int offset) const {
+    if ((offset < 0) || (offset > assemblySize)) return -1;
+    return operationIndexByOffset[offset];
+}
+
+/**
+ * Executes operations starting from the current pc until HLT operation or an error is met.
+ * If stats are counted (see isCounted), the program is executed by StackMachine::execute.
+ * Budget is charged by segments of operations (see ThreadedOperation::segmentLength), and the segment that
+ * exceeds it is executed by StackMachine::executeCounted up to the exact limit. Budgeted execution and execution
+ * with the branch log use the monitored dispatch loop, so the unlimited one has no checks of them.
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+ *         error code of the failed operation otherwise.
+ */
+byte ThreadedStackMachine::execute() {
+    int index = getOperationIndex(pc);
+    if ((index < 0) || isCounted()) return StackMachine::execute();
+
+    if (budget.isLimited() || (branchLog != nullptr)) {
+        if (cacheTopOfStack) return executeThreaded<true, true>(index);
+        return executeThreaded<false, true>(index);
+    }
+    if (cacheTopOfStack) return executeThreaded<true, false>(index);
+    return executeThreaded<false, false>(index);
+}
+
+// Labels as values and computed goto are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+/**
+ * Runs the dispatch loop starting from the operation with the given index.
+ *
+ * If CACHE_TOP is true, the tops of the operand and integer stacks are kept in local variables while the loop runs,
+ * and only values under them are stored in the stacks. The stacks are brought back to the normal state (spilled)
+ * before any operation that is processed outside of the loop and before leaving the loop. So an integer loop
+ * (IPUSHR, IPUSH, IADD, IPOPR, IJMP*) keeps it's counter in a general purpose register.
+ *
+ * If MONITORED is true, the budget is charged for the whole segment of operations when it's entered: at the start,
+ * after control transfers and after conditional jumps that aren't taken. The time limit is checked every
+ * TIME_CHECK_INTERVAL charged operations. Outcomes of conditional jumps are written into the branch log, if it's set.
+ *
+ * @param[in] index index of the first operation to execute
+ * @return HLT_OPCODE, if program finished successfully;
+ *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+ *         error code of the failed operation otherwise.
+ */
+template <bool CACHE_TOP, bool MONITORED>
+byte ThreadedStackMachine::executeThreaded(int index) {
+    assert((index >= 0) && (index < (int)operations.size()));
+
+    // Must be in the same order as OperationKind values
+    static const void* const dispatchTable[OPERATION_KINDS_NUMBER] = {
+        &&handleGeneric,
+        &&handleError,
+        &&handleEnd,
+        &&handleHlt,
+        &&handlePush,
+        &&handlePushR,
+        &&handlePop,
+        &&handlePopR,
+        &&handleAdd,
+        &&handleSub,
+        &&handleMul,
+        &&handleDiv,
+        &&handleSqrt,
+        &&handleDup,
+        &&handleJmp,
+        &&handleJmpE,
+        &&handleJmpNE,
+        &&handleJmpL,
+        &&handleJmpLE,
+        &&handleJmpG,
+        &&handleJmpGE,
+        &&handleCall,
+        &&handleRet,
+        &&handlePushRPushRMul,
+        &&handleDupAdd,
+        &&handlePopRPushR,
+        &&handleCmpImmJmpE,
+        &&handleCmpImmJmpNE,
+        &&handleCmpImmJmpL,
+        &&handleCmpImmJmpLE,
+        &&handleCmpImmJmpG,
+        &&handleCmpImmJmpGE,
+        &&handleIPush,
+        &&handleIPushR,
+        &&handleIPop,
+        &&handleIPopR,
+        &&handleItoF,
+        &&handleFtoI,
+        &&handleIAdd,
+        &&handleISub,
+        &&handleIMul,
+        &&handleIJmpE,
+        &&handleIJmpNE,
+        &&handleIJmpL,
+        &&handleIJmpLE,
+        &&handleIJmpG,
+        &&handleIJmpGE,
+    };
+
+    if (resolvedDispatchTable != dispatchTable) {
+        for (ThreadedOperation& operation : operations) {
+            operation.handler = dispatchTable[operation.kind];
+        }
+        resolvedDispatchTable = dispatchTable;
+    }
+
+    ThreadedOperation* const stream = operations.data();
+    const ThreadedOperation* op = stream + index;
+    double lhs = NAN, rhs = NAN;
+
+    /** Cached top of the stack. Valid only if CACHE_TOP is true and depth > 0 */
+    double tos = NAN;
+    /** Depth of the operand stack including the cached top. Used only if CACHE_TOP is true */
+    ssize_t depth = 0;
+    int64_t integerLhs = 0, integerRhs = 0;
+    /** Cached top of the integer stack. Valid only if CACHE_TOP is true and integerDepth > 0 */
+    int64_t integerTos = 0;
+    /** Depth of the integer stack including the cached top. Used only if CACHE_TOP is true */
+    ssize_t integerDepth = 0;
+
+    /** Number of operations left in the budget. Used only if MONITORED is true */
+    unsigned long long remaining = MONITORED ? getBudgetInstructions() : ULLONG_MAX;
+    const unsigned long long deadline = MONITORED ? getBudgetDeadline() : 0;
+    /** Number of operations charged since the last check of the time limit. The first segment is checked */
+    unsigned long long sinceTimeCheck = ExecutionBudget::TIME_CHECK_INTERVAL;
+
+    #define SPILL_TOP() do {                                                                                           \
+        if (CACHE_TOP && (depth > 0)) push(&stack, tos);                                                               \
+        if (CACHE_TOP && (integerDepth > 0)) push(&integerStack, integerTos);                                          \
+    } while (0)
+
+    #define RELOAD_TOP() do {                                                                                          \
+        if (CACHE_TOP) {                                                                                               \
+            depth = getStackSize(&stack);                                                                              \
+            if (depth > 0) tos = pop(&stack);                                                                          \
+            integerDepth = getStackSize(&integerStack);                                                                \
+            if (integerDepth > 0) integerTos = pop(&integerStack);                                                     \
+        }                                                                                                              \
+    } while (0)
+
+    #define RETURN(status) do {                                                                                        \
+        SPILL_TOP();                                                                                                   \
+        return (status);                                                                                               \
+    } while (0)
+
+    // Finishes the program with the error. Pc is left past the failed operation, as the reference engine leaves it
+    #define FAIL(status) do {                                                                                          \
+        pc = op->nextOffset;                                                                                           \
+        RETURN(status);                                                                                                \
+    } while (0)
+
+    #define DISPATCH() goto *op->handler
+
+    #define NEXT() do { ++op; DISPATCH(); } while (0)
+
+    // Moves to the operation after all operations covered by the current one
+    #define SKIP() do { op += op->length; DISPATCH(); } while (0)
+
+    // Continues the program at pc on the reference engine, with the rest of the budget if it's checked
+    #define CONTINUE_ON_REFERENCE() do {                                                                               \
+        SPILL_TOP();                                                                                                   \
+        return MONITORED ? executeCounted(remaining, deadline) : StackMachine::execute();                              \
+    } while (0)
+
+    // Charges the budget for the segment starting at the current operation. The segment that exceeds the budget
+    // is executed by the reference engine operation by operation, so the execution stops exactly at the limit
+    #define CHARGE_SEGMENT() do {                                                                                      \
+        if (MONITORED) {                                                                                               \
+            unsigned long long segmentLength = (unsigned long long)op->segmentLength;                                  \
+            if ((deadline != 0) && ((sinceTimeCheck += segmentLength) >= ExecutionBudget::TIME_CHECK_INTERVAL)) {      \
+                sinceTimeCheck = 0;                                                                                    \
+                if (readMilliseconds() >= deadline) {                                                                  \
+                    pc = op->offset;                                                                                   \
+                    RETURN(ERR_BUDGET_EXHAUSTED);                                                                      \
+                }                                                                                                      \
+            }                                                                                                          \
+            if (remaining < segmentLength) {                                                                           \
+                pc = op->offset;                                                                                       \
+                CONTINUE_ON_REFERENCE();                                                                               \
+            }                                                                                                          \
+            remaining -= segmentLength;                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+    // Moves to the operation after the conditional jump that wasn't taken, which starts a new segment
+    #define FALL_THROUGH() do { op += op->length; CHARGE_SEGMENT(); DISPATCH(); } while (0)
+
+    // Continues at the given byte offset. If no decoded operation starts there, execution is continued by the reference engine
+    #define CONTINUE_AT(offset) do {                                                                                   \
+        pc = (offset);                                                                                                 \
+        int nextIndex = getOperationIndex(pc);                                                                         \
+        if (nextIndex < 0) CONTINUE_ON_REFERENCE();                                                                    \
+        op = stream + nextIndex;                                                                                       \
+        CHARGE_SEGMENT();                                                                                              \
+        DISPATCH();                                                                                                    \
+    } while (0)
+
+    #define JUMP() do {                                                                                                \
+        if (op->target >= 0) {                                                                                         \
+            op = stream + op->target;                                                                                  \
+            CHARGE_SEGMENT();                                                                                          \
+            DISPATCH();                                                                                                \
+        }                                                                                                              \
+        pc = op->jumpTarget;                                                                                           \
+        if ((pc < 0) || (pc >= assemblySize)) RETURN(ERR_INVALID_OPERATION);                                           \
+        CONTINUE_ON_REFERENCE();                                                                                       \
+    } while (0)
+
+    // Takes the conditional jump, if the condition holds. The outcome is logged with the offset of the jump itself,
+    // which is the last operation covered by the fused one
+    #define BRANCH(condition) do {                                                                                     \
+        bool isTaken = (condition);                                                                                    \
+        if (MONITORED && (branchLog != nullptr)) branchLog->log(op[op->length - 1].offset, isTaken);                   \
+        if (isTaken) JUMP();                                                                                           \
+        FALL_THROUGH();                                                                                                \
+    } while (0)
+
+    #define REQUIRE_STACK_SIZE(size) do {                                                                              \
+        if ((CACHE_TOP ? depth : getStackSize(&stack)) < (size)) FAIL(ERR_STACK_UNDERFLOW);                            \
+    } while (0)
+
+    #define PUSH_VALUE(value) do {                                                                                     \
+        if (CACHE_TOP) {                                                                                               \
+            if (depth > 0) push(&stack, tos);                                                                          \
+            tos = (value);                                                                                             \
+            ++depth;                                                                                                   \
+        } else {                                                                                                       \
+            push(&stack, (value));                                                                                     \
+        }                                                                                                              \
+    } while (0)
+
+    #define POP_VALUE(destination) do {                                                                                \
+        REQUIRE_STACK_SIZE(1);                                                                                         \
+        if (CACHE_TOP) {                                                                                               \
+            destination = tos;                                                                                         \
+            if (--depth > 0) tos = pop(&stack);                                                                        \
+        } else {                                                                                                       \
+            destination = pop(&stack);                                                                                 \
+        }                                                                                                              \
+    } while (0)
+
+    #define UNARY_OPERATION(function) do {                                                                             \
+        REQUIRE_STACK_SIZE(1);                                                                                         \
+        if (CACHE_TOP) {                                                                                               \
+            tos = function(tos);                                                                                       \
+        } else {                                                                                                       \
+            push(&stack, function(pop(&stack)));                                                                       \
+        }                                                                                                              \
+    } while (0)
+
+    // Pops lhs and rhs operands from the stack
+    #define POP_OPERANDS() do {                                                                                        \
+        REQUIRE_STACK_SIZE(2);                                                                                         \
+        if (CACHE_TOP) {                                                                                               \
+            rhs = tos;                                                                                                 \
+            lhs = pop(&stack);                                                                                         \
+            depth -= 2;                                                                                                \
+            if (depth > 0) tos = pop(&stack);                                                                          \
+        } else {                                                                                                       \
+            rhs = pop(&stack);                                                                                         \
+            lhs = pop(&stack);                                                                                         \
+        }                                                                                                              \
+    } while (0)
+
+    // Pops lhs operand from the stack and uses the immediate operand as rhs. On the empty stack the immediate is left
+    // on it and pc is left past the jump, as PUSH and the conditional jump the operation is fused from leave them
+    #define POP_IMMEDIATE_OPERANDS() do {                                                                              \
+        if ((CACHE_TOP ? depth : getStackSize(&stack)) < 1) {                                                          \
+            PUSH_VALUE(op->operand);                                                                                   \
+            pc = op[op->length - 1].nextOffset;                                                                        \
+            RETURN(ERR_STACK_UNDERFLOW);                                                                               \
+        }                                                                                                              \
+        POP_VALUE(lhs);                                                                                                \
+        rhs = op->operand;                                                                                             \
+    } while (0)
+
+    // Replaces lhs and rhs operands on top of the stack with the result of the given expression
+    #define BINARY_OPERATION(expression) do {                                                                          \
+        REQUIRE_STACK_SIZE(2);                                                                                         \
+        if (CACHE_TOP) {                                                                                               \
+            rhs = tos;                                                                                                 \
+            lhs = pop(&stack);                                                                                         \
+            --depth;                                                                                                   \
+            tos = (expression);                                                                                        \
+        } else {                                                                                                       \
+            rhs = pop(&stack);                                                                                         \
+            lhs = pop(&stack);                                                                                         \
+            push(&stack, (expression));                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+    #define REQUIRE_INTEGER_STACK_SIZE(size) do {                                                                      \
+        if ((CACHE_TOP ? integerDepth : getStackSize(&integerStack)) < (size)) FAIL(ERR_STACK_UNDERFLOW);              \
+    } while (0)
+
+    #define PUSH_INTEGER(value) do {                                                                                   \
+        if (CACHE_TOP) {                                                                                               \
+            if (integerDepth > 0) push(&integerStack, integerTos);                                                     \
+            integerTos = (value);                                                                                      \
+            ++integerDepth;                                                                                            \
+        } else {                                                                                                       \
+            push(&integerStack, (value));                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+    #define POP_INTEGER(destination) do {                                                                              \
+        REQUIRE_INTEGER_STACK_SIZE(1);                                                                                 \
+        if (CACHE_TOP) {                                                                                               \
+            destination = integerTos;                                                                                  \
+            if (--integerDepth > 0) integerTos = pop(&integerStack);                                                   \
+        } else {                                                                                                       \
+            destination = pop(&integerStack);                                                                          \
+        }                                                                                                              \
+    } while (0)
+
+    // Pops integerLhs and integerRhs operands from the integer stack
+    #define POP_INTEGER_OPERANDS() do {                                                                                \
+        REQUIRE_INTEGER_STACK_SIZE(2);                                                                                 \
+        if (CACHE_TOP) {                                                                                               \
+            integerRhs = integerTos;                                                                                   \
+            integerLhs = pop(&integerStack);                                                                           \
+            integerDepth -= 2;                                                                                         \
+            if (integerDepth > 0) integerTos = pop(&integerStack);                                                     \
+        } else {                                                                                                       \
+            integerRhs = pop(&integerStack);                                                                           \
+            integerLhs = pop(&integerStack);                                                                           \
+        }                                                                                                              \
+    } while (0)
+
+    // Replaces integerLhs and integerRhs operands on top of the integer stack with the result of the given opcode
+    #define INTEGER_ARITHMETIC(opcode) do {                                                                            \
+        REQUIRE_INTEGER_STACK_SIZE(2);                                                                                 \
+        if (CACHE_TOP) {                                                                                               \
+            integerLhs = pop(&integerStack);                                                                           \
+            --integerDepth;                                                                                            \
+            integerTos = applyIntegerArithmetic((opcode), integerLhs, integerTos);                                     \
+        } else {                                                                                                       \
+            integerRhs = pop(&integerStack);                                                                           \
+            integerLhs = pop(&integerStack);                                                                           \
+            push(&integerStack, applyIntegerArithmetic((opcode), integerLhs, integerRhs));                             \
+        }                                                                                                              \
+    } while (0)
+
+    RELOAD_TOP();
+    CHARGE_SEGMENT();
+    DISPATCH();
+
+    handleGeneric: {
+        pc = op->offset;
+        SPILL_TOP();
+        byte status = processNextOperation();
+        if ((status == HLT_OPCODE) || isError(status)) return status;
+        RELOAD_TOP();
+        CONTINUE_AT(pc);
+    }
+    handleError:
+        // Invalid operation isn't decoded, so pc is left at it
+        pc = op->offset;
+        RETURN(op->status);
+    handleEnd:
+        pc = op->offset;
+        RETURN(ERR_INVALID_OPERATION);
+    handleHlt:
+        pc = op->nextOffset;
+        RETURN(HLT_OPCODE);
+    handlePush:
+        PUSH_VALUE(op->operand);
+        NEXT();
+    handlePushR:
+        PUSH_VALUE(*op->reg);
+        NEXT();
+    handlePop:
+        POP_VALUE(rhs);
+        NEXT();
+    handlePopR:
+        POP_VALUE(*op->reg);
+        NEXT();
+    handleAdd:
+        BINARY_OPERATION(lhs + rhs);
+        NEXT();
+    handleSub:
+        BINARY_OPERATION(lhs - rhs);
+        NEXT();
+    handleMul:
+        BINARY_OPERATION(lhs * rhs);
+        NEXT();
+    handleDiv:
+        BINARY_OPERATION(lhs / rhs);
+        NEXT();
+    handleSqrt:
+        UNARY_OPERATION(sqrt);
+        NEXT();
+    handleDup:
+        REQUIRE_STACK_SIZE(1);
+        if (CACHE_TOP) {
+            push(&stack, tos);
+            ++depth;
+        } else {
+            push(&stack, top(&stack));
+        }
+        NEXT();
+    handleJmp:
+        JUMP();
+    handleJmpE:
+        POP_OPERANDS();
+        BRANCH(fabs(lhs - rhs) < COMPARE_EPS);
+    handleJmpNE:
+        POP_OPERANDS();
+        BRANCH(fabs(lhs - rhs) >= COMPARE_EPS);
+    handleJmpL:
+        POP_OPERANDS();
+        BRANCH(lhs < rhs);
+    handleJmpLE:
+        POP_OPERANDS();
+        BRANCH(lhs <= rhs);
+    handleJmpG:
+        POP_OPERANDS();
+        BRANCH(lhs > rhs);
+    handleJmpGE:
+        POP_OPERANDS();
+        BRANCH(lhs >= rhs);
+    handleCall:
+        pushReturnAddress(op->nextOffset);
+        JUMP();
+    handleRet: {
+        int returnAddress = 0;
+        if (!popReturnAddress(returnAddress)) FAIL(ERR_STACK_UNDERFLOW);
+        CONTINUE_AT(returnAddress);
+    }
+    handlePushRPushRMul:
+        PUSH_VALUE(*op->reg * *op->reg2);
+        SKIP();
+    handleDupAdd:
+        REQUIRE_STACK_SIZE(1);
+        if (CACHE_TOP) {
+            tos = tos + tos;
+        } else {
+            rhs = pop(&stack);
+            push(&stack, rhs + rhs);
+        }
+        SKIP();
+    handlePopRPushR:
+        REQUIRE_STACK_SIZE(1);
+        *op->reg = CACHE_TOP ? tos : top(&stack);
+        SKIP();
+    handleCmpImmJmpE:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(fabs(lhs - rhs) < COMPARE_EPS);
+    handleCmpImmJmpNE:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(fabs(lhs - rhs) >= COMPARE_EPS);
+    handleCmpImmJmpL:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(lhs < rhs);
+    handleCmpImmJmpLE:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(lhs <= rhs);
+    handleCmpImmJmpG:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(lhs > rhs);
+    handleCmpImmJmpGE:
+        POP_IMMEDIATE_OPERANDS();
+        BRANCH(lhs >= rhs);
+    handleIPush:
+        PUSH_INTEGER(op->integerOperand);
+        NEXT();
+    handleIPushR:
+        PUSH_INTEGER(*op->integerReg);
+        NEXT();
+    handleIPop:
+        POP_INTEGER(integerRhs);
+        NEXT();
+    handleIPopR:
+        POP_INTEGER(*op->integerReg);
+        NEXT();
+    handleItoF:
+        POP_INTEGER(integerRhs);
+        PUSH_VALUE((double)integerRhs);
+        NEXT();
+    handleFtoI:
+        POP_VALUE(rhs);
+        PUSH_INTEGER(toIntegerOperand(rhs));
+        NEXT();
+    handleIAdd:
+        INTEGER_ARITHMETIC(IADD_OPCODE);
+        NEXT();
+    handleISub:
+        INTEGER_ARITHMETIC(ISUB_OPCODE);
+        NEXT();
+    handleIMul:
+        INTEGER_ARITHMETIC(IMUL_OPCODE);
+        NEXT();
+    handleIJmpE:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs == integerRhs);
+    handleIJmpNE:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs != integerRhs);
+    handleIJmpL:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs < integerRhs);
+    handleIJmpLE:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs <= integerRhs);
+    handleIJmpG:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs > integerRhs);
+    handleIJmpGE:
+        POP_INTEGER_OPERANDS();
+        BRANCH(integerLhs >= integerRhs);
+
+    #undef INTEGER_ARITHMETIC
+    #undef POP_INTEGER_OPERANDS
+    #undef POP_INTEGER
+    #undef PUSH_INTEGER
+    #undef REQUIRE_INTEGER_STACK_SIZE
+    #undef BINARY_OPERATION
+    #undef POP_IMMEDIATE_OPERANDS
+    #undef POP_OPERANDS
+    #undef UNARY_OPERATION
+    #undef POP_VALUE
+    #undef PUSH_VALUE
+    #undef REQUIRE_STACK_SIZE
+    #undef BRANCH
+    #undef JUMP
+    #undef CONTINUE_AT
+    #undef FALL_THROUGH
+    #undef CHARGE_SEGMENT
+    #undef CONTINUE_ON_REFERENCE
+    #undef SKIP
+    #undef NEXT
+    #undef DISPATCH
+    #undef FAIL
+    #undef RETURN
+    #undef RELOAD_TOP
+    #undef SPILL_TOP
+}
+
+#pragma GCC diagnostic pop
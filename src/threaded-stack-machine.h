@@ -0,0 +1,188 @@
+/**
+ * @file
+ * @brief Declaration of stack machine with pre-decoding and direct-threaded dispatch.
+ */
+#ifndef STACK_MACHINE_THREADED_STACK_MACHINE_H
+#define STACK_MACHINE_THREADED_STACK_MACHINE_H
+
+#include <vector>
+#include "stack-machine.h"
+
+/**
+ * Stack machine that decodes the whole assembly once on load and executes the resulting operations stream
+ * with direct-threaded dispatch (each decoded operation stores the address of it's handler).
+ *
+ * Behaviour is identical to StackMachine: operations that have no dedicated handler are processed by
+ * StackMachine::processNextOperation, and jumps to offsets that are not the beginning of a decoded operation
+ * continue execution on the reference engine.
+ */
+class ThreadedStackMachine : public StackMachine {
+
+private:
+    /**
+     * Kinds of decoded operations. Each kind has it's own handler in the dispatch loop.
+     */
+    enum OperationKind {
+        GENERIC_OP, /**< Operation is processed by StackMachine::processNextOperation */
+        ERROR_OP,   /**< Invalid operation. Returns the stored status when executed */
+        END_OP,     /**< Sentinel after the last operation of the assembly */
+        HLT_OP,
+        PUSH_OP,
+        PUSHR_OP,
+        POP_OP,
+        POPR_OP,
+        ADD_OP,
+        SUB_OP,
+        MUL_OP,
+        DIV_OP,
+        SQRT_OP,
+        DUP_OP,
+        JMP_OP,
+        JMPE_OP,
+        JMPNE_OP,
+        JMPL_OP,
+        JMPLE_OP,
+        JMPG_OP,
+        JMPGE_OP,
+        CALL_OP,
+        RET_OP,
+        PUSHR_PUSHR_MUL_OP,
+        DUP_ADD_OP,
+        POPR_PUSHR_OP,
+        CMP_IMM_JMPE_OP,
+        CMP_IMM_JMPNE_OP,
+        CMP_IMM_JMPL_OP,
+        CMP_IMM_JMPLE_OP,
+        CMP_IMM_JMPG_OP,
+        CMP_IMM_JMPGE_OP,
+        IPUSH_OP,
+        IPUSHR_OP,
+        IPOP_OP,
+        IPOPR_OP,
+        ITOF_OP,
+        FTOI_OP,
+        IADD_OP,
+        ISUB_OP,
+        IMUL_OP,
+        IJMPE_OP,
+        IJMPNE_OP,
+        IJMPL_OP,
+        IJMPLE_OP,
+        IJMPG_OP,
+        IJMPGE_OP,
+        OPERATION_KINDS_NUMBER,
+    };
+
+    struct ThreadedOperation {
+        /** Address of the handler in the dispatch loop. Set on the first execution */
+        const void* handler;
+        /** Immediate operand */
+        double operand;
+        /** Register operand */
+        double* reg;
+        /** Second register operand (for PUSHR_PUSHR_MUL operation) */
+        double* reg2;
+        /** Integer immediate operand */
+        int64_t integerOperand;
+        /** Integer register operand */
+        int64_t* integerReg;
+        /** Index of the jump destination in the operations stream, or -1 if it's not the start of an operation */
+        int target;
+        /** Absolute byte offset of the jump destination */
+        int jumpTarget;
+        /** Byte offset of this operation */
+        int offset;
+        /** Byte offset of the next operation */
+        int nextOffset;
+        /** Number of entries of the operations stream covered by this operation. Greater than 1 if it was fused on load */
+        int length;
+        /**
+         * Number of entries of the operations stream from this operation to the end of it's segment: the first
+         * operation that may leave the straight-line order (jump, call, return, generic or final operation)
+         */
+        int segmentLength;
+        OperationKind kind;
+        /** Status returned by an invalid operation */
+        unsigned char status;
+    };
+
+    std::vector<ThreadedOperation> operations;
+
+    /** Index of the operation in the operations stream by it's byte offset, or -1 if no operation starts there */
+    std::vector<int> operationIndexByOffset;
+
+    /** Dispatch table which handlers are currently stored in the operations stream */
+    const void* const* resolvedDispatchTable = nullptr;
+
+    /** Shows if the tops of the operand and integer stacks are kept in local variables of the dispatch loop */
+    const bool cacheTopOfStack;
+
+    /**
+     * Decodes the whole assembly into the operations stream.
+     */
+    void decodeAssembly();
+
+    /**
+     * Fuses frequent operations sequences of the operations stream into superinstructions.
+     * Sequences that contain a jump destination (except for their first operation) are not fused.
+     */
+    void fuseOperations();
+
+    /**
+     * Computes segment lengths of operations, so that the budget is charged once per segment.
+     */
+    void measureSegments();
+
+    /**
+     * Gets the index of the operation that starts at the given byte offset.
+     * @param[in] offset byte offset of the operation
+     * @return index of the operation in the operations stream, or -1 if no operation starts at this offset.
+     */
+    int getOperationIndex(int offset) const;
+
+    /**
+     * Runs the dispatch loop starting from the operation with the given index.
+     * @tparam    CACHE_TOP shows if the tops of the operand and integer stacks are cached in local variables
+     * @tparam    MONITORED shows if the budget is checked and outcomes of conditional jumps are logged
+     * @param[in] index     index of the first operation to execute
+     * @return HLT_OPCODE, if program finished successfully;
+     *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+     *         error code of the failed operation otherwise.
+     */
+    template <bool CACHE_TOP, bool MONITORED>
+    unsigned char executeThreaded(int index);
+
+public:
+    /**
+     * Loads and decodes the given assembly file.
+     * @param[in] assemblyFileName assembly file name
+     * @param[in] cacheTopOfStack  if true, the tops of the operand and integer stacks are kept in registers while
+     *                             operations are executed
+     */
+    explicit ThreadedStackMachine(const char* assemblyFileName, bool cacheTopOfStack = false);
+
+    /**
+     * Decodes the given image of the assembly file. Pre-decoded operations of the image are reused.
+     * @param[in] image           image of the assembly file, or nullptr if the file is invalid
+     * @param[in] cacheTopOfStack if true, the tops of the operand and integer stacks are kept in registers while
+     *                            operations are executed
+     */
+    explicit ThreadedStackMachine(std::shared_ptr<const BytecodeImage> image, bool cacheTopOfStack = false);
+
+    ThreadedStackMachine(ThreadedStackMachine& stackMachine) = delete;
+    ThreadedStackMachine &operator=(const ThreadedStackMachine&) = delete;
+
+    /**
+     * Executes operations starting from the current pc until HLT operation or an error is met.
+     * If stats are counted (see isCounted), the program is executed by StackMachine::execute.
+     * Budget is charged by segments of operations (see ThreadedOperation::segmentLength), and the segment that
+     * exceeds it is executed by StackMachine::executeCounted up to the exact limit. Budgeted execution and execution
+     * with the branch log use the monitored dispatch loop, so the unlimited one has no checks of them.
+     * @return HLT_OPCODE, if program finished successfully;
+     *         ERR_BUDGET_EXHAUSTED, if budget was exhausted before the program finished;
+     *         error code of the failed operation otherwise.
+     */
+    unsigned char execute() override;
+};
+
+#endif // STACK_MACHINE_THREADED_STACK_MACHINE_H
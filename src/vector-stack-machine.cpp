@@ -0,0 +1,749 @@
+/**
+ * @file
+ * @brief Implementation of stack machine that runs one program over several input vectors (lanes) at once.
+ */
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "vector-stack-machine.h"
+
+using byte = unsigned char;
+
+// GCC vector extension types. Arithmetic on them is compiled to SIMD instructions of the target
+typedef double DoubleLanes4 __attribute__((vector_size(4 * sizeof(double))));
+typedef double DoubleLanes8 __attribute__((vector_size(8 * sizeof(double))));
+
+template <unsigned int LANES>
+struct LaneVector;
+
+template <>
+struct LaneVector<4> {
+    typedef DoubleLanes4 Type;
+};
+
+template <>
+struct LaneVector<8> {
+    typedef DoubleLanes8 Type;
+};
+
+/**
+ * Applies the arithmetic operation to lhs and rhs values of all lanes. Result is stored in lhs.
+ * Values are copied to and from vector variables, so they don't have to be aligned.
+ * @param[in]      opcode code of the arithmetic operation (ADD, SUB, MUL or DIV)
+ * @param[in, out] lhs    lhs values of all lanes
+ * @param[in]      rhs    rhs values of all lanes
+ */
+template <unsigned int LANES>
+static inline void applyArithmetic(byte opcode, double* lhs, const double* rhs) {
+    typename LaneVector<LANES>::Type lhsVector, rhsVector;
+    memcpy(&lhsVector, lhs, sizeof(lhsVector));
+    memcpy(&rhsVector, rhs, sizeof(rhsVector));
+    switch (opcode) {
+        case ADD_OPCODE: lhsVector += rhsVector; break;
+        case SUB_OPCODE: lhsVector -= rhsVector; break;
+        case MUL_OPCODE: lhsVector *= rhsVector; break;
+        case DIV_OPCODE: lhsVector /= rhsVector; break;
+        default: assert(false);
+    }
+    memcpy(lhs, &lhsVector, sizeof(lhsVector));
+}
+
+template <unsigned int LANES>
+VectorStackMachine<LANES>::VectorStackMachine(const char* assemblyFileName) : AssemblyMachine(assemblyFileName) {
+}
+
+/**
+ * Finishes the given lanes of the current group with the given status.
+ * @param[in] lanes  bit mask of lanes to finish
+ * @param[in] status exit code of the lanes
+ */
+template <unsigned int LANES>
+void VectorStackMachine<LANES>::finishLanes(unsigned int lanes, byte status) {
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        if ((lanes & (1u << lane)) != 0) (*laneStatuses)[lane] = status;
+    }
+    group.activeLanes &= ~lanes;
+}
+
+/**
+ * Moves the given lanes of the current group to the new group that continues at the given offset.
+ * If the offset is invalid, lanes are finished with ERR_INVALID_OPERATION instead.
+ * @param[in] lanes  bit mask of lanes to move
+ * @param[in] offset byte offset the new group continues at
+ */
+template <unsigned int LANES>
+void VectorStackMachine<LANES>::splitLanes(unsigned int lanes, int offset) {
+    assert((lanes & ~group.activeLanes) == 0);
+
+    if ((offset < 0) || (offset >= assemblySize)) {
+        finishLanes(lanes, ERR_INVALID_OPERATION);
+        return;
+    }
+
+    pendingGroups.push_back(group);
+    pendingGroups.back().pc = offset;
+    pendingGroups.back().activeLanes = lanes;
+    group.activeLanes &= ~lanes;
+}
+
+/**
+ * Gets the register number from the operand reference given by AssemblyMachine::processNextOperation.
+ * @param[in] operand reference to the scalar register
+ * @return register number.
+ */
+template <unsigned int LANES>
+int VectorStackMachine<LANES>::getRegisterNumber(const double& operand) const {
+    int reg = (int)(&operand - registers);
+    assert((reg >= 0) && (reg < (int)REGISTERS_NUMBER));
+    return reg;
+}
+
+/**
+ * Gets the integer register number from the operand reference given by AssemblyMachine::processNextOperation.
+ * @param[in] operand reference to the scalar integer register
+ * @return integer register number.
+ */
+template <unsigned int LANES>
+int VectorStackMachine<LANES>::getIntegerRegisterNumber(const int64_t& operand) const {
+    int reg = (int)(&operand - integerRegisters);
+    assert((reg >= 0) && (reg < (int)REGISTERS_NUMBER));
+    return reg;
+}
+
+/**
+ * Gets the bit mask of lanes that have invalid RAM address in the given lane values.
+ * @param[in] addresses RAM address of each lane
+ * @return bit mask of active lanes with invalid address.
+ */
+template <unsigned int LANES>
+unsigned int VectorStackMachine<LANES>::getInvalidAddressLanes(const double* addresses) const {
+    unsigned int invalidLanes = 0;
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        if (!((addresses[lane] >= 0) && (addresses[lane] < ramSize))) invalidLanes |= (1u << lane);
+    }
+    return invalidLanes & group.activeLanes;
+}
+
+/**
+ * Gets the value of RAM address of the current group. Allocates RAM on the first access.
+ * @param[in] address RAM address
+ * @return pointer to LANES doubles stored at the address.
+ */
+template <unsigned int LANES>
+double* VectorStackMachine<LANES>::getRamAt(int address) {
+    assert((address >= 0) && (address < ramSize));
+
+    if (group.ram.empty()) group.ram.assign((size_t)ramSize * LANES, 0.0);
+    return group.ram.data() + (size_t)address * LANES;
+}
+
+/**
+ * Gets the bit mask of lanes that have invalid RAM range in the given lane values (see RAM::isValidRange).
+ * @param[in] addresses first RAM address of the range of each lane
+ * @param[in] counts    number of addresses in the range of each lane
+ * @return bit mask of active lanes with invalid range.
+ */
+template <unsigned int LANES>
+unsigned int VectorStackMachine<LANES>::getInvalidRangeLanes(const double* addresses, const double* counts) const {
+    unsigned int invalidLanes = 0;
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        double address = addresses[lane], count = counts[lane];
+        // Comparisons with NaN are false, so NaN operands are invalid too
+        bool isValid = (address >= 0) && (address < ramSize) && (count >= 0) && (count <= ramSize) &&
+                       ((long long)address + (long long)count <= ramSize);
+        if (!isValid) invalidLanes |= (1u << lane);
+    }
+    return invalidLanes & group.activeLanes;
+}
+
+/**
+ * Pops operands of the vector operation (VADD, VMUL, VSUM, VDOT, VFILL or VCOPY) and applies it to RAM of each
+ * lane of the current group. Lanes that have invalid range are finished, and the rest of them continue.
+ * Sources of each lane are gathered before the destination is written, so ranges may overlap as in StackMachine.
+ * @param[in] opcode code of the vector operation to apply
+ * @return given operation code, if operation processed successfully;
+ *         ERR_STACK_UNDERFLOW, if there are not enough operands on the stack;
+ *         ERR_INVALID_RAM_ADDRESS, if any range exceeds RAM size for all lanes.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::applyVectorOperation(byte opcode) {
+    int operandsNumber = 3;
+    if ((opcode == VADD_OPCODE) || (opcode == VMUL_OPCODE)) operandsNumber = 4;
+    if (opcode == VSUM_OPCODE) operandsNumber = 2;
+    if (group.getStackSize() < operandsNumber) return ERR_STACK_UNDERFLOW;
+
+    // Operands are pushed in the order they are listed, so count is on top
+    double operands[4][LANES] = { };
+    for (int i = operandsNumber - 1; i >= 0; --i) {
+        group.pop(operands[i]);
+    }
+    const double* counts = operands[operandsNumber - 1];
+    double zeros[LANES] = { };
+    unsigned int invalidLanes = getInvalidRangeLanes(zeros, counts);
+    // Ranges of VFILL are dst and value, but only dst is an address
+    int rangesNumber = (opcode == VFILL_OPCODE) ? 1 : operandsNumber - 1;
+    for (int i = 0; i < rangesNumber; ++i) {
+        invalidLanes |= getInvalidRangeLanes(operands[i], counts);
+    }
+    if (invalidLanes == group.activeLanes) return ERR_INVALID_RAM_ADDRESS;
+    finishLanes(invalidLanes, ERR_INVALID_RAM_ADDRESS);
+
+    double results[LANES] = { };
+    std::vector<double> lhs, rhs;
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        if ((group.activeLanes & (1u << lane)) == 0) continue;
+
+        int count = (int)counts[lane];
+        int addresses[3] = {(int)operands[0][lane], (int)operands[1][lane], (int)operands[2][lane]};
+        // Sources follow the destination, and VSUM and VDOT have no destination. VFILL has value instead of source
+        int firstSource = ((opcode == VSUM_OPCODE) || (opcode == VDOT_OPCODE)) ? 0 : 1;
+        int sourcesNumber = (opcode == VFILL_OPCODE) ? 0 : operandsNumber - 1 - firstSource;
+        lhs.resize(count);
+        rhs.resize(count);
+        for (int i = 0; i < count; ++i) {
+            if (sourcesNumber >= 1) lhs[i] = getRamAt(addresses[firstSource] + i)[lane];
+            if (sourcesNumber >= 2) rhs[i] = getRamAt(addresses[firstSource + 1] + i)[lane];
+        }
+
+        switch (opcode) {
+            case VADD_OPCODE: for (int i = 0; i < count; ++i) getRamAt(addresses[0] + i)[lane] = lhs[i] + rhs[i]; break;
+            case VMUL_OPCODE: for (int i = 0; i < count; ++i) getRamAt(addresses[0] + i)[lane] = lhs[i] * rhs[i]; break;
+            case VSUM_OPCODE: results[lane] = RAM::sumValues(lhs.data(), count); break;
+            case VDOT_OPCODE: results[lane] = RAM::dotValues(lhs.data(), rhs.data(), count); break;
+            case VFILL_OPCODE:
+                for (int i = 0; i < count; ++i) getRamAt(addresses[0] + i)[lane] = operands[1][lane];
+                break;
+            case VCOPY_OPCODE: for (int i = 0; i < count; ++i) getRamAt(addresses[0] + i)[lane] = lhs[i]; break;
+            default: assert(false);
+        }
+    }
+    if ((opcode == VSUM_OPCODE) || (opcode == VDOT_OPCODE)) group.push(results);
+    return opcode;
+}
+
+/**
+ * Processes the jump of the current group: lanes that take the jump are moved to the new group.
+ * @param[in] opcode     code of the jump operation
+ * @param[in] takenLanes bit mask of lanes that take the jump
+ * @param[in] jumpOffset offset of the jump relative to the current pc
+ * @return given operation code, or ERR_INVALID_OPERATION, if all lanes take the jump and it's offset is invalid.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::jump(byte opcode, unsigned int takenLanes, int jumpOffset) {
+    if (takenLanes == 0) return opcode;
+
+    if (takenLanes != group.activeLanes) {
+        splitLanes(takenLanes, pc + jumpOffset);
+        return opcode;
+    }
+
+    pc += jumpOffset;
+    if (pc < 0 || pc >= assemblySize) return ERR_INVALID_OPERATION;
+    return opcode;
+}
+
+/**
+ * Processes the no-operand operation for all lanes of the current group.
+ * @param[in] opcode code of the operation to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::processOperation(byte opcode) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+
+    double values[LANES] = { };
+    int64_t integers[LANES] = { };
+    switch (opcode) {
+        case IN_OPCODE:
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                if ((group.activeLanes & (1u << lane)) == 0) continue;
+
+                const std::vector<double>& input = (*laneInputs)[lane];
+                size_t& position = laneInputPositions[lane];
+                values[lane] = (position < input.size()) ? input[position++] : NAN;
+            }
+            group.push(values);
+            break;
+        case OUT_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.pop(values);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                if ((group.activeLanes & (1u << lane)) != 0) (*laneOutputs)[lane].push_back(values[lane]);
+            }
+            break;
+        case POP_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.pop(values);
+            break;
+        case ADD_OPCODE:
+        case SUB_OPCODE:
+        case MUL_OPCODE:
+        case DIV_OPCODE:
+            if (group.getStackSize() < 2) return ERR_STACK_UNDERFLOW;
+
+            group.pop(values);
+            applyArithmetic<LANES>(opcode, group.top(), values);
+            break;
+        case IPOP_OPCODE:
+            if (group.getIntegerStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.popInteger(integers);
+            break;
+        case ITOF_OPCODE:
+            if (group.getIntegerStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.popInteger(integers);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                values[lane] = (double)integers[lane];
+            }
+            group.push(values);
+            break;
+        case FTOI_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.pop(values);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                integers[lane] = toIntegerOperand(values[lane]);
+            }
+            group.pushInteger(integers);
+            break;
+        case IADD_OPCODE:
+        case ISUB_OPCODE:
+        case IMUL_OPCODE:
+            if (group.getIntegerStackSize() < 2) return ERR_STACK_UNDERFLOW;
+
+            group.popInteger(integers);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                group.integerTop()[lane] = applyIntegerArithmetic(opcode, group.integerTop()[lane], integers[lane]);
+            }
+            break;
+        case SQRT_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                group.top()[lane] = sqrt(group.top()[lane]);
+            }
+            break;
+        case DUP_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            memcpy(values, group.top(), sizeof(values));
+            group.push(values);
+            break;
+        case POW_OPCODE:
+            if (group.getStackSize() < 2) return ERR_STACK_UNDERFLOW;
+
+            group.pop(values);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                group.top()[lane] = pow(group.top()[lane], values[lane]);
+            }
+            break;
+        case VADD_OPCODE:
+        case VMUL_OPCODE:
+        case VSUM_OPCODE:
+        case VDOT_OPCODE:
+        case VFILL_OPCODE:
+        case VCOPY_OPCODE:
+            return applyVectorOperation(opcode);
+        case RET_OPCODE:
+            if (group.callStack.empty()) return ERR_STACK_UNDERFLOW;
+
+            pc = group.callStack.back();
+            group.callStack.pop_back();
+            break;
+        case HLT_OPCODE:
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Processes the single operand operation for all lanes of the current group.
+ * Lanes that have invalid RAM address are finished, and the rest of them continue.
+ * @param[in]      opcode  code of the operation to process
+ * @param[in, out] operand immediate operand, or the scalar register that identifies register operand
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
+ *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size for all lanes.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::processOperation(byte opcode, double& operand) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+
+    double* reg = nullptr;
+    double values[LANES] = { };
+    if ((opcode & IS_REG_OP_MASK) != 0) {
+        reg = group.registers[getRegisterNumber(operand)];
+        memcpy(values, reg, sizeof(values));
+    } else {
+        for (double& value : values) value = operand;
+    }
+
+    switch (opcode) {
+        case PUSH_OPCODE:
+        case PUSHR_OPCODE:
+            group.push(values);
+            break;
+        case POPR_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.pop(reg);
+            break;
+        case PUSHM_OPCODE:
+        case PUSHRM_OPCODE: {
+            unsigned int invalidLanes = getInvalidAddressLanes(values);
+            if (invalidLanes == group.activeLanes) return ERR_INVALID_RAM_ADDRESS;
+            finishLanes(invalidLanes, ERR_INVALID_RAM_ADDRESS);
+
+            double loaded[LANES] = { };
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                if ((group.activeLanes & (1u << lane)) != 0) loaded[lane] = getRamAt((int)values[lane])[lane];
+            }
+            group.push(loaded);
+            break;
+        }
+        case POPM_OPCODE:
+        case POPRM_OPCODE: {
+            unsigned int invalidLanes = getInvalidAddressLanes(values);
+            if (invalidLanes == group.activeLanes) return ERR_INVALID_RAM_ADDRESS;
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+            finishLanes(invalidLanes, ERR_INVALID_RAM_ADDRESS);
+
+            double popped[LANES] = { };
+            group.pop(popped);
+            for (unsigned int lane = 0; lane < LANES; ++lane) {
+                if ((group.activeLanes & (1u << lane)) != 0) getRamAt((int)values[lane])[lane] = popped[lane];
+            }
+            break;
+        }
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Processes the operation with the integer operand for all lanes of the current group.
+ * @param[in]      opcode  code of the operation to process (IPUSH, IPUSHR or IPOPR)
+ * @param[in, out] operand immediate operand, or the scalar integer register that identifies register operand
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty integer stack.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::processIntegerOperation(byte opcode, int64_t& operand) {
+    assert(assemblySize >= 0);
+    assert((pc >= 0) && (pc <= assemblySize));
+
+    int64_t values[LANES] = { };
+    switch (opcode) {
+        case IPUSH_OPCODE:
+            for (int64_t& value : values) value = operand;
+            group.pushInteger(values);
+            break;
+        case IPUSHR_OPCODE:
+            group.pushInteger(group.integerRegisters[getIntegerRegisterNumber(operand)]);
+            break;
+        case IPOPR_OPCODE:
+            if (group.getIntegerStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            group.popInteger(group.integerRegisters[getIntegerRegisterNumber(operand)]);
+            break;
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Processes the jump operation for all lanes of the current group.
+ * If only some of the lanes take the jump, they are moved to the new group.
+ * @param[in] opcode     code of the jump operation to process
+ * @param[in] jumpOffset offset of the jump to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::processJumpOperation(byte opcode, int jumpOffset) {
+    assert(isJumpOperation(opcode));
+
+    if (opcode == CALL_OPCODE) group.callStack.push_back(pc);
+    if ((opcode == JMP_OPCODE) || (opcode == CALL_OPCODE) || (opcode == TAILCALL_OPCODE)) {
+        return jump(opcode, group.activeLanes, jumpOffset);
+    }
+
+    unsigned int takenLanes = 0;
+    if (isIntegerJumpOperation(opcode)) {
+        if (group.getIntegerStackSize() < 2) return ERR_STACK_UNDERFLOW;
+        int64_t lhs[LANES] = { }, rhs[LANES] = { };
+        group.popInteger(rhs);
+        group.popInteger(lhs);
+
+        for (unsigned int lane = 0; lane < LANES; ++lane) {
+            if (isIntegerJumpTaken(opcode, lhs[lane], rhs[lane])) takenLanes |= (1u << lane);
+        }
+        return jump(opcode, takenLanes & group.activeLanes, jumpOffset);
+    }
+
+    if (group.getStackSize() < 2) return ERR_STACK_UNDERFLOW;
+    double lhs[LANES] = { }, rhs[LANES] = { };
+    group.pop(rhs);
+    group.pop(lhs);
+
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        if (isJumpTaken(opcode, lhs[lane], rhs[lane])) takenLanes |= (1u << lane);
+    }
+    return jump(opcode, takenLanes & group.activeLanes, jumpOffset);
+}
+
+/**
+ * Processes the fused operation for all lanes of the current group.
+ * @param[in] opcode code of the fused operation to process
+ * @return given operation code, if operation processed successfully;
+ *         ERR_INVALID_OPERATION, if operation code, immediate operand or jump offset was invalid;
+ *         ERR_INVALID_REGISTER, if invalid register was met;
+ *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+ */
+template <unsigned int LANES>
+byte VectorStackMachine<LANES>::processFusedOperation(byte opcode) {
+    double values[LANES] = { };
+
+    if (isFusedJumpOperation(opcode)) {
+        double rhs = getNextOperand();
+        if (!std::isfinite(rhs)) return ERR_INVALID_OPERATION;
+        int jumpOffset = getNextJumpOffset();
+        // sizeof(offset) is subtracted, because pc is calculated ahead (with offset size)
+        jumpOffset -= (int)sizeof(jumpOffset);
+
+        if (group.getStackSize() < 1) {
+            // PUSH and the conditional jump the operation is fused from fail with the immediate left on the stack
+            for (double& value : values) value = rhs;
+            group.push(values);
+            return ERR_STACK_UNDERFLOW;
+        }
+        group.pop(values);
+
+        unsigned int takenLanes = 0;
+        for (unsigned int lane = 0; lane < LANES; ++lane) {
+            if (isJumpTaken(getFusedJumpOpcode(opcode), values[lane], rhs)) takenLanes |= (1u << lane);
+        }
+        return jump(opcode, takenLanes & group.activeLanes, jumpOffset);
+    }
+
+    switch (opcode) {
+        case PUSHR_PUSHR_MUL_OPCODE: {
+            byte lhsReg = getNextRegister();
+            if (lhsReg == ERR_INVALID_REGISTER) return ERR_INVALID_REGISTER;
+            byte rhsReg = getNextRegister();
+            if (rhsReg == ERR_INVALID_REGISTER) return ERR_INVALID_REGISTER;
+
+            memcpy(values, group.registers[lhsReg], sizeof(values));
+            applyArithmetic<LANES>(MUL_OPCODE, values, group.registers[rhsReg]);
+            group.push(values);
+            break;
+        }
+        case DUP_ADD_OPCODE:
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            applyArithmetic<LANES>(ADD_OPCODE, group.top(), group.top());
+            break;
+        case POPR_PUSHR_OPCODE: {
+            byte reg = getNextRegister();
+            if (reg == ERR_INVALID_REGISTER) return ERR_INVALID_REGISTER;
+            if (group.getStackSize() < 1) return ERR_STACK_UNDERFLOW;
+
+            memcpy(group.registers[reg], group.top(), sizeof(values));
+            break;
+        }
+        default:
+            return ERR_INVALID_OPERATION;
+    }
+    return opcode;
+}
+
+/**
+ * Runs the program for the given inputs (IN values of each lane). Program state is reset before the run.
+ * @param[in]  inputs   IN values of each lane. Number of used lanes is the number of inputs (at most LANES).
+ *                      IN operation reads NAN, when there are no values left
+ * @param[out] outputs  OUT values of each lane
+ * @param[out] statuses exit code of each lane: HLT_OPCODE, if lane finished successfully, or error code
+ */
+template <unsigned int LANES>
+void VectorStackMachine<LANES>::runLanes(const std::vector<std::vector<double>>& inputs,
+                                         std::vector<std::vector<double>>& outputs, std::vector<byte>& statuses) {
+    assert(inputs.size() <= LANES);
+
+    laneInputs = &inputs;
+    laneInputPositions.assign(LANES, 0);
+    laneOutputs = &outputs;
+    outputs.assign(LANES, std::vector<double>());
+    laneStatuses = &statuses;
+    statuses.assign(LANES, (byte)ERR_INVALID_FILE);
+
+    if (assemblySize < 0) {
+        statuses.resize(inputs.size());
+        outputs.resize(inputs.size());
+        return;
+    }
+
+    pendingGroups.clear();
+    pendingGroups.emplace_back();
+    pendingGroups.back().pc = 0;
+    pendingGroups.back().activeLanes = (1u << inputs.size()) - 1;
+
+    while (!pendingGroups.empty()) {
+        group = std::move(pendingGroups.back());
+        pendingGroups.pop_back();
+
+        pc = group.pc;
+        byte status = HLT_OPCODE;
+        do {
+            status = processNextOperation();
+        } while ((status != HLT_OPCODE) && !isError(status) && (group.activeLanes != 0));
+        finishLanes(group.activeLanes, status);
+    }
+
+    statuses.resize(inputs.size());
+    outputs.resize(inputs.size());
+}
+
+template class VectorStackMachine<4>;
+template class VectorStackMachine<8>;
+
+/**
+ * Reads the line of the batch input with IN values for one run of the program.
+ * @param[in]  input  batch input file
+ * @param[out] values values read
+ * @return true, if line was read, false if the end of the file is reached.
+ */
+static bool readBatchLine(FILE* input, std::vector<double>& values) {
+    assert(input != nullptr);
+
+    values.clear();
+
+    char* line = nullptr;
+    size_t lineCapacity = 0;
+    if (getline(&line, &lineCapacity, input) < 0) {
+        free(line);
+        return false;
+    }
+
+    char* position = line;
+    while (true) {
+        char* end = nullptr;
+        double value = strtod(position, &end);
+        if (end == position) break;
+        values.push_back(value);
+        position = end;
+    }
+    free(line);
+    return true;
+}
+
+/**
+ * Writes OUT values of one run of the program into the batch output.
+ * @param[out] output batch output file
+ * @param[in]  values values to write
+ */
+static void writeBatchLine(FILE* output, const std::vector<double>& values) {
+    assert(output != nullptr);
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        fprintf(output, (i == 0) ? "%lg" : " %lg", values[i]);
+    }
+    fprintf(output, "\n");
+}
+
+/**
+ * Runs the given assembly file over all lines of the batch input using the given number of lanes.
+ * @param[in]  inputFileName assembly file name
+ * @param[in]  input         batch input file
+ * @param[out] output        batch output file
+ * @param[in]  ramSize       number of RAM addresses of each lane
+ * @return 0, if program finished successfully for all input lines;
+ *         ERR_INVALID_FILE, if assembly file is invalid;
+ *         error code of the first failed input line otherwise.
+ */
+template <unsigned int LANES>
+static int runBatchOnLanes(const char* inputFileName, FILE* input, FILE* output, int ramSize) {
+    VectorStackMachine<LANES> stackMachine(inputFileName);
+    if (stackMachine.getAssemblySize() < 0) return ERR_INVALID_FILE;
+    stackMachine.setRamSize(ramSize);
+
+    int exitCode = HLT_OPCODE;
+    size_t lineNumber = 0;
+    std::vector<std::vector<double>> inputs;
+    std::vector<std::vector<double>> outputs;
+    std::vector<byte> statuses;
+
+    bool isEndOfInput = false;
+    while (!isEndOfInput) {
+        inputs.clear();
+        std::vector<double> values;
+        while (inputs.size() < LANES) {
+            if (!readBatchLine(input, values)) {
+                isEndOfInput = true;
+                break;
+            }
+            inputs.push_back(values);
+        }
+        if (inputs.empty()) break;
+
+        stackMachine.runLanes(inputs, outputs, statuses);
+
+        for (size_t lane = 0; lane < inputs.size(); ++lane) {
+            ++lineNumber;
+            writeBatchLine(output, outputs[lane]);
+            if (statuses[lane] == HLT_OPCODE) continue;
+
+            fprintf(stderr, "Line %zu: ", lineNumber);
+            printErrorMessageForExitCode(statuses[lane]);
+            if (exitCode == HLT_OPCODE) exitCode = statuses[lane];
+        }
+    }
+    return exitCode;
+}
+
+/**
+ * Runs the given assembly file over batch of inputs. Each line of the batch input contains IN values for one run
+ * of the program, and the corresponding line of the batch output contains OUT values of this run.
+ * @param[in] inputFileName assembly file name
+ * @param[in] options       execution options (lanes number and batch files)
+ * @return 0, if program finished successfully for all input lines;
+ *         ERR_INVALID_FILE, if assembly or batch file is invalid;
+ *         error code of the first failed input line otherwise.
+ */
+int runBatch(const char* inputFileName, const RunOptions& options) {
+    assert(inputFileName != nullptr);
+    assert((options.lanes == 4) || (options.lanes == 8));
+
+    FILE* input = stdin;
+    if (options.batchInputFileName != nullptr) input = fopen(options.batchInputFileName, "r");
+    if (input == nullptr) return ERR_INVALID_FILE;
+    FILE* output = stdout;
+    if (options.batchOutputFileName != nullptr) output = fopen(options.batchOutputFileName, "w");
+    if (output == nullptr) {
+        if (input != stdin) fclose(input);
+        return ERR_INVALID_FILE;
+    }
+
+    int exitCode = (options.lanes == 8) ? runBatchOnLanes<8>(inputFileName, input, output, options.ramSize) :
+                                          runBatchOnLanes<4>(inputFileName, input, output, options.ramSize);
+
+    if (output != stdout) fclose(output);
+    if (input != stdin) fclose(input);
+    return exitCode;
+}
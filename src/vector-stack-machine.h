@@ -0,0 +1,247 @@
+/**
+ * @file
+ * @brief Declaration of stack machine that runs one program over several input vectors (lanes) at once.
+ */
+#ifndef STACK_MACHINE_VECTOR_STACK_MACHINE_H
+#define STACK_MACHINE_VECTOR_STACK_MACHINE_H
+
+#include <cstring>
+#include <vector>
+#include "stack-machine.h"
+
+/**
+ * Stack machine that executes the program for LANES input vectors at once. Every value of the operand stack,
+ * registers and RAM holds LANES doubles (one per lane), and arithmetic is done with vector instructions. Values of
+ * the integer stack and integer registers hold LANES int64 values the same way.
+ *
+ * Lanes that follow the same path through the program are executed together as a lane group. When a conditional
+ * jump (or a RAM access with per-lane address) has different outcome for lanes of the group, the group is split:
+ * lanes that take the jump continue in a copy of the group, and the rest continue in the original one.
+ * Vector operations (VADD, VSUM, ...) process the RAM ranges of each lane separately, as their ranges may differ.
+ * Every lane behaves exactly as the same program run on StackMachine with this lane's input.
+ *
+ * @tparam LANES number of lanes (4 or 8)
+ */
+template <unsigned int LANES>
+class VectorStackMachine : public AssemblyMachine {
+    static_assert((LANES == 4) || (LANES == 8), "Only 4 and 8 lanes are supported");
+
+    struct LaneGroup {
+        int pc;
+        /** Bit mask of lanes executed by this group */
+        unsigned int activeLanes;
+        /** Operand stack. Each value takes LANES doubles */
+        std::vector<double> stack;
+        /** Integer stack. Each value takes LANES int64 values */
+        std::vector<int64_t> integerStack;
+        std::vector<int> callStack;
+        double registers[REGISTERS_NUMBER][LANES];
+        int64_t integerRegisters[REGISTERS_NUMBER][LANES];
+        /** RAM. Each address takes LANES doubles. Allocated on the first access */
+        std::vector<double> ram;
+
+        int getStackSize() const {
+            return (int)(stack.size() / LANES);
+        }
+
+        double* top() {
+            return stack.data() + stack.size() - LANES;
+        }
+
+        void push(const double* values) {
+            stack.insert(stack.end(), values, values + LANES);
+        }
+
+        void pop(double* values) {
+            memcpy(values, top(), LANES * sizeof(double));
+            stack.resize(stack.size() - LANES);
+        }
+
+        int getIntegerStackSize() const {
+            return (int)(integerStack.size() / LANES);
+        }
+
+        int64_t* integerTop() {
+            return integerStack.data() + integerStack.size() - LANES;
+        }
+
+        void pushInteger(const int64_t* values) {
+            integerStack.insert(integerStack.end(), values, values + LANES);
+        }
+
+        void popInteger(int64_t* values) {
+            memcpy(values, integerTop(), LANES * sizeof(int64_t));
+            integerStack.resize(integerStack.size() - LANES);
+        }
+    };
+
+    /** Group that is currently executed */
+    LaneGroup group {};
+
+    /** Groups split from the executed ones that wait for execution */
+    std::vector<LaneGroup> pendingGroups;
+
+    const std::vector<std::vector<double>>* laneInputs = nullptr;
+    std::vector<size_t> laneInputPositions;
+    std::vector<std::vector<double>>* laneOutputs = nullptr;
+    std::vector<unsigned char>* laneStatuses = nullptr;
+
+    /** Number of RAM addresses of each lane */
+    int ramSize = RAM::DEFAULT_SIZE;
+
+    /**
+     * Finishes the given lanes of the current group with the given status.
+     * @param[in] lanes  bit mask of lanes to finish
+     * @param[in] status exit code of the lanes
+     */
+    void finishLanes(unsigned int lanes, unsigned char status);
+
+    /**
+     * Moves the given lanes of the current group to the new group that continues at the given offset.
+     * If the offset is invalid, lanes are finished with ERR_INVALID_OPERATION instead.
+     * @param[in] lanes  bit mask of lanes to move
+     * @param[in] offset byte offset the new group continues at
+     */
+    void splitLanes(unsigned int lanes, int offset);
+
+    /**
+     * Gets the register number from the operand reference given by AssemblyMachine::processNextOperation.
+     * @param[in] operand reference to the scalar register
+     * @return register number.
+     */
+    int getRegisterNumber(const double& operand) const;
+
+    /**
+     * Gets the integer register number from the operand reference given by AssemblyMachine::processNextOperation.
+     * @param[in] operand reference to the scalar integer register
+     * @return integer register number.
+     */
+    int getIntegerRegisterNumber(const int64_t& operand) const;
+
+    /**
+     * Gets the bit mask of lanes that have invalid RAM address in the given lane values.
+     * @param[in] addresses RAM address of each lane
+     * @return bit mask of active lanes with invalid address.
+     */
+    unsigned int getInvalidAddressLanes(const double* addresses) const;
+
+    /**
+     * Gets the value of RAM address of the current group. Allocates RAM on the first access.
+     * @param[in] address RAM address
+     * @return pointer to LANES doubles stored at the address.
+     */
+    double* getRamAt(int address);
+
+    /**
+     * Gets the bit mask of lanes that have invalid RAM range in the given lane values (see RAM::isValidRange).
+     * @param[in] addresses first RAM address of the range of each lane
+     * @param[in] counts    number of addresses in the range of each lane
+     * @return bit mask of active lanes with invalid range.
+     */
+    unsigned int getInvalidRangeLanes(const double* addresses, const double* counts) const;
+
+    /**
+     * Pops operands of the vector operation (VADD, VMUL, VSUM, VDOT, VFILL or VCOPY) and applies it to RAM of each
+     * lane of the current group. Lanes that have invalid range are finished, and the rest of them continue.
+     * @param[in] opcode code of the vector operation to apply
+     * @return given operation code, if operation processed successfully;
+     *         ERR_STACK_UNDERFLOW, if there are not enough operands on the stack;
+     *         ERR_INVALID_RAM_ADDRESS, if any range exceeds RAM size for all lanes.
+     */
+    unsigned char applyVectorOperation(unsigned char opcode);
+
+    /**
+     * Processes the jump of the current group: lanes that take the jump are moved to the new group.
+     * @param[in] opcode     code of the jump operation
+     * @param[in] takenLanes bit mask of lanes that take the jump
+     * @param[in] jumpOffset offset of the jump relative to the current pc
+     * @return given operation code, or ERR_INVALID_OPERATION, if all lanes take the jump and it's offset is invalid.
+     */
+    unsigned char jump(unsigned char opcode, unsigned int takenLanes, int jumpOffset);
+
+public:
+    explicit VectorStackMachine(const char* assemblyFileName);
+
+    VectorStackMachine(VectorStackMachine& stackMachine) = delete;
+    VectorStackMachine &operator=(const VectorStackMachine&) = delete;
+
+    /**
+     * Sets the number of RAM addresses of each lane. RAM of the lanes is allocated on the first access.
+     * @param[in] addressesNumber number of addresses (from 0 to RAM::MAX_SIZE)
+     */
+    void setRamSize(int addressesNumber) {
+        ramSize = addressesNumber;
+    }
+
+    /**
+     * Runs the program for the given inputs (IN values of each lane). Program state is reset before the run.
+     * @param[in]  inputs   IN values of each lane. Number of used lanes is the number of inputs (at most LANES).
+     *                      IN operation reads NAN, when there are no values left
+     * @param[out] outputs  OUT values of each lane
+     * @param[out] statuses exit code of each lane: HLT_OPCODE, if lane finished successfully, or error code
+     */
+    void runLanes(const std::vector<std::vector<double>>& inputs, std::vector<std::vector<double>>& outputs,
+                  std::vector<unsigned char>& statuses);
+
+    /**
+     * Processes the no-operand operation for all lanes of the current group.
+     * @param[in] opcode code of the operation to process
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+     */
+    unsigned char processOperation(unsigned char opcode) override;
+
+    /**
+     * Processes the single operand operation for all lanes of the current group.
+     * Lanes that have invalid RAM address are finished, and the rest of them continue.
+     * @param[in]      opcode  code of the operation to process
+     * @param[in, out] operand immediate operand, or the scalar register that identifies register operand
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack;
+     *         ERR_INVALID_RAM_ADDRESS, if address operand exceeds RAM size for all lanes.
+     */
+    unsigned char processOperation(unsigned char opcode, double& operand) override;
+
+    /**
+     * Processes the operation with the integer operand for all lanes of the current group.
+     * @param[in]      opcode  code of the operation to process (IPUSH, IPUSHR or IPOPR)
+     * @param[in, out] operand immediate operand, or the scalar integer register that identifies register operand
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty integer stack.
+     */
+    unsigned char processIntegerOperation(unsigned char opcode, int64_t& operand) override;
+
+    /**
+     * Processes the jump operation for all lanes of the current group.
+     * If only some of the lanes take the jump, they are moved to the new group.
+     * @param[in] opcode     code of the jump operation to process
+     * @param[in] jumpOffset offset of the jump to process
+     * @return given operation code, if operation processed successfully;
+     *         ERR_INVALID_OPERATION, if operation code or offset was invalid;
+     *         ERR_STACK_UNDERFLOW, if pop operation was processed on empty stack.
+     */
+    unsigned char processJumpOperation(unsigned char opcode, int jumpOffset) override;
+
+    /**
+     * Processes the fused operation for all lanes of the current group.
+     * @param[in] opcode code of the fused operation to process
+     * @return given operation code, if operation processed successfully, or error code otherwise.
+     */
+    unsigned char processFusedOperation(unsigned char opcode) override;
+};
+
+/**
+ * Runs the given assembly file over batch of inputs. Each line of the batch input contains IN values for one run
+ * of the program, and the corresponding line of the batch output contains OUT values of this run.
+ * @param[in] inputFileName assembly file name
+ * @param[in] options       execution options (lanes number and batch files)
+ * @return 0, if program finished successfully for all input lines;
+ *         ERR_INVALID_FILE, if assembly or batch file is invalid;
+ *         error code of the first failed input line otherwise.
+ */
+int runBatch(const char* inputFileName, const RunOptions& options);
+
+#endif // STACK_MACHINE_VECTOR_STACK_MACHINE_H
@@ -0,0 +1,106 @@
+/**
+ * @file
+ */
+#include <string>
+#include <sys/wait.h>
+#include "testlib.h"
+#include "../src/stack-machine.h"
+#include "../src/aot-compiler.h"
+
+static const char* const aotSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const aotAsmFileName = "AOT_TEST_FILE_NAME.asm";
+static const char* const aotExecutableFileName = "./AOT_TEST_FILE_NAME";
+static const char* const aotInputFileName = "AOT_TEST_FILE_NAME.in";
+static const char* const aotRunOutputFileName = "AOT_TEST_FILE_NAME.run.out";
+static const char* const aotOutputFileName = "AOT_TEST_FILE_NAME.out";
+
+/**
+ * Fills RAM with i * 0.5 for i < N in the integer loop, then writes the sum of it, the dot product of it's copy with
+ * itself and N * N + sqrt(2) computed by the subroutine. Call makes depths after it unknown, so the stack is growing.
+ */
+static const char* const aotTestProgram = "IN\nDUP\nPOP AX\nFTOI\nPOP IAX\nPUSH 0\nPOP IBX\n"
+                                          "FILL:\nPUSH IBX\nITOF\nPOP BX\nPUSH BX\nPUSH 0.5\nMUL\nPOP [BX]\n"
+                                          "PUSH IBX\nPUSH 1\nADD\nPOP IBX\nPUSH IBX\nPUSH IAX\nJMPL FILL\n"
+                                          "PUSH 0\nPUSH AX\nVSUM\nOUT\nPUSH 100\nPUSH 0\nPUSH AX\nVCOPY\n"
+                                          "PUSH 0\nPUSH 100\nPUSH AX\nVDOT\nOUT\nPUSH AX\nCALL SQUARE\nOUT\n"
+                                          "PUSH [3]\nOUT\nIN\nDUP\nADD\nOUT\nIN\nOUT\nPUSH AX\nPUSH 10\nJMPGE END\n"
+                                          "PUSH -0\nOUT\nEND:\nHLT\n"
+                                          "SQUARE:\nPOP CX\nPUSH CX\nPUSH CX\nMUL\nPUSH 2\nSQRT\nADD\nRET\n";
+
+static void writeAotTestFile(const char* fileName, const char* text) {
+    FILE* file = fopen(fileName, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+static std::string readAotTestFile(const char* fileName) {
+    std::string text;
+    FILE* file = fopen(fileName, "r");
+    if (file == nullptr) return text;
+    for (int c = fgetc(file); c != EOF; c = fgetc(file)) text += (char)c;
+    fclose(file);
+    return text;
+}
+
+/**
+ * Assembles the program and compiles it into the executable.
+ * @param[in] source         source code of the program
+ * @param[in] fuseOperations shows if the program is assembled with superinstructions
+ * @return exit code of the compilation.
+ */
+static int compileAotTestProgram(const char* source, bool fuseOperations) {
+    writeAotTestFile(aotSourceFileName, source);
+    remove(aotAsmFileName);
+    AssemblyOptions assemblyOptions;
+    assemblyOptions.fuseOperations = fuseOperations;
+    assemble(aotSourceFileName, aotAsmFileName, assemblyOptions);
+    remove(aotExecutableFileName);
+    return compileAheadOfTime(aotAsmFileName, aotExecutableFileName, AotOptions());
+}
+
+/**
+ * Runs the compiled executable in the text I/O mode.
+ * @return exit code of the executable.
+ */
+static int runAotExecutable() {
+    std::string command = std::string(aotExecutableFileName) + " --io=text < " + aotInputFileName + " > " +
+                          aotOutputFileName + " 2> /dev/null";
+    int status = system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(aot, compiledProgram_sameOutputAsRun) {
+    writeAotTestFile(aotInputFileName, "12 2.25 nope");
+
+    for (bool fuseOperations : {false, true}) {
+        int compileExitCode = compileAotTestProgram(aotTestProgram, fuseOperations);
+        RunOptions options;
+        options.ioMode = TEXT_IO;
+        options.ioInputFileName = aotInputFileName;
+        options.ioOutputFileName = aotRunOutputFileName;
+        int runExitCode = run(aotAsmFileName, options);
+        int executableExitCode = runAotExecutable();
+
+        ASSERT_EQUALS(compileExitCode, 0);
+        ASSERT_EQUALS(runExitCode, 0);
+        ASSERT_EQUALS(executableExitCode, 0);
+        ASSERT_TRUE(readAotTestFile(aotOutputFileName) == readAotTestFile(aotRunOutputFileName));
+        ASSERT_TRUE(readAotTestFile(aotOutputFileName) == "33\n126.5\n145.414\n1.5\n4.5\nnan\n");
+    }
+}
+
+TEST(aot, failingOrUnverifiedProgram_sameErrorCodes) {
+    writeAotTestFile(aotInputFileName, "");
+
+    int underflowCompileExitCode = compileAotTestProgram("PUSH 1\nOUT\nOUT\nHLT\n", false);
+    int underflowExitCode = runAotExecutable();
+    int ramCompileExitCode = compileAotTestProgram("PUSH 5000\nPOP AX\nPUSH [AX]\nHLT\n", false);
+    int ramExitCode = runAotExecutable();
+    int unverifiedCompileExitCode = compileAotTestProgram("PUSH 1\nOUT\n", false);
+
+    ASSERT_EQUALS(underflowCompileExitCode, 0);
+    ASSERT_EQUALS(underflowExitCode, ERR_STACK_UNDERFLOW);
+    ASSERT_EQUALS(ramCompileExitCode, 0);
+    ASSERT_EQUALS(ramExitCode, ERR_INVALID_RAM_ADDRESS);
+    ASSERT_EQUALS(unverifiedCompileExitCode, ERR_INVALID_FILE);
+}
@@ -0,0 +1,32 @@
+/**
+ * @file
+ */
+#include <cstdint>
+#include <cstring>
+#include "testlib.h"
+#include "../src/arena.h"
+
+TEST(arena, allocations_alignedAndNotOverlapped) {
+    Arena arena;
+
+    char* first = (char*)arena.allocate(3, 1);
+    double* second = (double*)arena.allocate(sizeof(double), alignof(double));
+    char* third = (char*)arena.allocate(5, 1);
+
+    ASSERT_EQUALS((uintptr_t)second % alignof(double), 0);
+    ASSERT_TRUE(first + 3 <= (char*)second);
+    ASSERT_TRUE((char*)(second + 1) <= third);
+}
+
+TEST(arena, manyStrings_copiesKeptAfterNewBlocks) {
+    Arena arena;
+    const char* firstCopy = arena.copyString("label:", 5);
+
+    for (unsigned int i = 0; i < 4 * ARENA_BLOCK_SIZE / 16; ++i) {
+        arena.copyString("0123456789abcdef", 16);
+    }
+    const char* largeCopy = (const char*)arena.allocate(ARENA_BLOCK_SIZE);
+
+    ASSERT_EQUALS(strcmp(firstCopy, "label"), 0);
+    ASSERT_NOT_NULL(largeCopy);
+}
@@ -0,0 +1,239 @@
+/**
+ * @file
+ */
+#include <cstring>
+#include "testlib.h"
+#include "../src/bytecode-container.h"
+#include "../src/bytecode-image.h"
+#include "../src/threaded-stack-machine.h"
+
+static const char* const containerSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const containerRawFileName = "RAW_TEST_FILE_NAME.asm";
+static const char* const containerTestFileName = "CONTAINER_TEST_FILE_NAME.asm";
+
+/**
+ * Assembles the given program into legacy and container assembly files.
+ * @param[in] source source code of the program
+ */
+static void assembleContainerProgram(const char* source) {
+    FILE* sourceFile = fopen(containerSourceFileName, "w");
+    fputs(source, sourceFile);
+    fclose(sourceFile);
+
+    AssemblyOptions options;
+    options.fuseOperations = true;
+    assemble(containerSourceFileName, containerRawFileName, options);
+    options.format = CONTAINER_FORMAT;
+    assemble(containerSourceFileName, containerTestFileName, options);
+}
+
+static std::vector<unsigned char> readFileBytes(const char* fileName) {
+    std::vector<unsigned char> content;
+    FILE* file = fopen(fileName, "rb");
+    int c = 0;
+    while ((c = fgetc(file)) != EOF) content.push_back((unsigned char)c);
+    fclose(file);
+    return content;
+}
+
+static const char* const containerTestProgram = "PUSH 5\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH AX\n"
+                                                "POP [1]\nPUSH 0\nJMPG LOOP\nPUSH 1\nPOP [2]\nHLT\n";
+
+TEST(bytecodeContainer, containerAssembled_codeSameAsLegacyAssembly) {
+    assembleContainerProgram(containerTestProgram);
+    std::vector<unsigned char> rawAssembly = readFileBytes(containerRawFileName);
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+
+    BytecodeContainer sections;
+    unsigned char statusCode = readBytecodeContainer(container.data(), container.size(), sections);
+
+    ASSERT_EQUALS(statusCode, 0);
+    ASSERT_TRUE(isBytecodeContainer(container.data(), container.size()));
+    ASSERT_TRUE(!isBytecodeContainer(rawAssembly.data(), rawAssembly.size()));
+    ASSERT_EQUALS(sections.codeSize, (int)rawAssembly.size());
+    ASSERT_EQUALS(memcmp(sections.code, rawAssembly.data(), rawAssembly.size()), 0);
+    ASSERT_EQUALS((uintptr_t)sections.constants % alignof(double), 0);
+    // 5, 1 and 0 are pushed, and 1 and 2 are RAM addresses
+    ASSERT_EQUALS(sections.constantsNumber, 4);
+    ASSERT_NOT_NULL(sections.operations);
+}
+
+TEST(bytecodeContainer, containerLoaded_sameDecodedOperationsAsLinearSweep) {
+    assembleContainerProgram(containerTestProgram);
+    std::shared_ptr<const BytecodeImage> rawImage = BytecodeImage::load(containerRawFileName);
+    std::shared_ptr<const BytecodeImage> containerImage = BytecodeImage::load(containerTestFileName);
+
+    ASSERT_NOT_NULL(containerImage.get());
+    const std::vector<PredecodedOperation>& rawOperations = rawImage->getDecodedOperations();
+    const std::vector<PredecodedOperation>& containerOperations = containerImage->getDecodedOperations();
+    ASSERT_EQUALS(containerOperations.size(), rawOperations.size());
+    for (size_t i = 0; i < rawOperations.size(); ++i) {
+        ASSERT_EQUALS(containerOperations[i].offset, rawOperations[i].offset);
+        ASSERT_EQUALS(containerOperations[i].status, rawOperations[i].status);
+        ASSERT_EQUALS(containerOperations[i].operation.opcode, rawOperations[i].operation.opcode);
+        ASSERT_EQUALS(containerOperations[i].operation.reg, rawOperations[i].operation.reg);
+        ASSERT_DOUBLE_EQUALS(containerOperations[i].operation.operand, rawOperations[i].operation.operand);
+        ASSERT_EQUALS(containerOperations[i].operation.jumpTarget, rawOperations[i].operation.jumpTarget);
+        ASSERT_EQUALS(containerOperations[i].operation.size, rawOperations[i].operation.size);
+    }
+}
+
+TEST(bytecodeContainer, containerExecuted_sameResultAsLegacyAssembly) {
+    assembleContainerProgram(containerTestProgram);
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(containerTestFileName);
+
+    StackMachine stackMachine(containerTestFileName);
+    ThreadedStackMachine threadedStackMachine(image, true);
+
+    ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+    ASSERT_EQUALS(threadedStackMachine.execute(), HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(1), 0.0);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(2), 1.0);
+    ASSERT_DOUBLE_EQUALS(threadedStackMachine.getRam().getAt(2), 1.0);
+}
+
+TEST(bytecodeContainer, containerWithoutDecodedSection_operationsDecodedOnLoad) {
+    assembleContainerProgram(containerTestProgram);
+    std::vector<unsigned char> rawAssembly = readFileBytes(containerRawFileName);
+    FILE* containerFile = fopen(containerTestFileName, "wb");
+    unsigned char statusCode = writeBytecodeContainer(containerFile, rawAssembly.data(), (int)rawAssembly.size(), false);
+    fclose(containerFile);
+
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    BytecodeContainer sections;
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(containerTestFileName);
+
+    ASSERT_EQUALS(statusCode, 0);
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), 0);
+    ASSERT_NULL(sections.operations);
+    ASSERT_NOT_NULL(image.get());
+    ASSERT_EQUALS(image->getDecodedOperations().size(), BytecodeImage::load(containerRawFileName)->getDecodedOperations().size());
+}
+
+TEST(bytecodeContainer, containerDisassembled_sameSourceAsLegacyAssembly) {
+    assembleContainerProgram(containerTestProgram);
+
+    int rawExitCode = disassemble(containerRawFileName, "RAW_DISASM_TEST_FILE_NAME.txt");
+    int containerExitCode = disassemble(containerTestFileName, "CONTAINER_DISASM_TEST_FILE_NAME.txt");
+
+    ASSERT_EQUALS(rawExitCode, 0);
+    ASSERT_EQUALS(containerExitCode, 0);
+    ASSERT_TRUE(readFileBytes("RAW_DISASM_TEST_FILE_NAME.txt") == readFileBytes("CONTAINER_DISASM_TEST_FILE_NAME.txt"));
+}
+
+TEST(bytecodeContainer, truncatedContainer_invalidFile) {
+    assembleContainerProgram(containerTestProgram);
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    FILE* containerFile = fopen(containerTestFileName, "wb");
+    fwrite(container.data(), sizeof(unsigned char), container.size() - 1, containerFile);
+    fclose(containerFile);
+
+    BytecodeContainer sections;
+
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size() - 1, sections), ERR_INVALID_FILE);
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), sizeof(ContainerHeader) - 1, sections), ERR_INVALID_FILE);
+    ASSERT_NULL(BytecodeImage::load(containerTestFileName).get());
+    ASSERT_EQUALS(disassemble(containerTestFileName, "CONTAINER_DISASM_TEST_FILE_NAME.txt"), ERR_INVALID_FILE);
+}
+
+TEST(bytecodeContainer, decodedOperationWithInvalidRegister_invalidFile) {
+    assembleContainerProgram("PUSH AX\nHLT\n");
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    BytecodeContainer sections;
+    readBytecodeContainer(container.data(), container.size(), sections);
+
+    size_t operationOffset = (const unsigned char*)sections.operations - container.data();
+    container[operationOffset + offsetof(ContainerOperation, reg)] = REGISTERS_NUMBER;
+
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), ERR_INVALID_FILE);
+}
+
+TEST(bytecodeContainer, changedConstantOrDecodedRecord_invalidFile) {
+    assembleContainerProgram("PUSH 7\nOUT\nJMP END\nEND:\nHLT\n");
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    BytecodeContainer sections;
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), 0);
+    size_t constantOffset = (const unsigned char*)sections.constants - container.data();
+    size_t operationsOffset = (const unsigned char*)sections.operations - container.data();
+
+    // Constant 7 of PUSH is changed to 8, so the code and the decoded records are different programs
+    std::vector<unsigned char> changedConstant = container;
+    double changedValue = 8;
+    memcpy(changedConstant.data() + constantOffset, &changedValue, sizeof(changedValue));
+    std::vector<unsigned char> changedJump = container;
+    changedJump[operationsOffset + 2 * sizeof(ContainerOperation) + offsetof(ContainerOperation, jumpTarget)] += 1;
+    std::vector<unsigned char> changedOpcode = container;
+    changedOpcode[operationsOffset + sizeof(ContainerOperation) + offsetof(ContainerOperation, opcode)] = POP_OPCODE;
+
+    ASSERT_EQUALS(readBytecodeContainer(changedConstant.data(), changedConstant.size(), sections), ERR_INVALID_FILE);
+    ASSERT_EQUALS(readBytecodeContainer(changedJump.data(), changedJump.size(), sections), ERR_INVALID_FILE);
+    ASSERT_EQUALS(readBytecodeContainer(changedOpcode.data(), changedOpcode.size(), sections), ERR_INVALID_FILE);
+}
+
+TEST(bytecodeContainer, stackHintAssembled_stacksReservedBeforeRun) {
+    assembleContainerProgram(containerTestProgram);
+    AssemblyOptions options;
+    options.format = CONTAINER_FORMAT;
+    options.stackHint.operandStackDepth = 64;
+    options.stackHint.callStackDepth = 16;
+    // File is written anew, so it doesn't get the cached image of the previous test with the same identity
+    remove(containerTestFileName);
+    assemble(containerSourceFileName, containerTestFileName, options);
+
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    BytecodeContainer sections;
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(containerTestFileName);
+    StackMachine stackMachine(image);
+
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), 0);
+    ASSERT_EQUALS(sections.stackHint.operandStackDepth, 64);
+    ASSERT_EQUALS(sections.stackHint.callStackDepth, 16);
+    ASSERT_NOT_NULL(sections.operations);
+    ASSERT_EQUALS(image->getStackReserve().operandStackDepth, 64);
+    ASSERT_EQUALS(stackMachine.getStackCapacity().operandStackDepth, 64);
+    ASSERT_EQUALS(stackMachine.getStackCapacity().callStackDepth, 16);
+    ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(2), 1.0);
+}
+
+TEST(bytecodeContainer, stackHintSectionWithInvalidSize_invalidFile) {
+    assembleContainerProgram(containerTestProgram);
+    std::vector<unsigned char> rawAssembly = readFileBytes(containerRawFileName);
+    StackReserve stackHint;
+    stackHint.callStackDepth = 1;
+    FILE* containerFile = fopen(containerTestFileName, "wb");
+    writeBytecodeContainer(containerFile, rawAssembly.data(), (int)rawAssembly.size(), false, stackHint);
+    fclose(containerFile);
+
+    std::vector<unsigned char> container = readFileBytes(containerTestFileName);
+    ContainerHeader header;
+    memcpy(&header, container.data(), sizeof(header));
+    size_t hintDescriptorOffset = header.sectionsOffset + (header.sectionsNumber - 1) * sizeof(ContainerSection);
+    ContainerSection hintSection;
+    memcpy(&hintSection, container.data() + hintDescriptorOffset, sizeof(hintSection));
+    BytecodeContainer sections;
+
+    ASSERT_EQUALS(hintSection.type, STACK_HINT_SECTION);
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), 0);
+    ASSERT_EQUALS(sections.stackHint.operandStackDepth, 0);
+    ASSERT_EQUALS(sections.stackHint.callStackDepth, 1);
+
+    --hintSection.size;
+    memcpy(container.data() + hintDescriptorOffset, &hintSection, sizeof(hintSection));
+
+    ASSERT_EQUALS(readBytecodeContainer(container.data(), container.size(), sections), ERR_INVALID_FILE);
+}
+
+TEST(bytecodeContainer, containerAssembled_labelsOffsetsFound) {
+    assembleContainerProgram(containerTestProgram);
+    std::shared_ptr<const BytecodeImage> container = BytecodeImage::load(containerTestFileName);
+    std::shared_ptr<const BytecodeImage> rawAssembly = BytecodeImage::load(containerRawFileName);
+
+    ASSERT_NOT_NULL(container);
+    ASSERT_NOT_NULL(rawAssembly);
+    // PUSH 5 (9 bytes) and POP AX (2 bytes) are before the label
+    ASSERT_EQUALS(container->getLabelOffset("LOOP"), 11);
+    ASSERT_EQUALS(container->getLabelOffset("LOOP:"), -1);
+    ASSERT_EQUALS(container->getLabelOffset("LOO"), -1);
+    ASSERT_EQUALS(rawAssembly->getLabelOffset("LOOP"), -1);
+}
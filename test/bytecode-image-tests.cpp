@@ -0,0 +1,62 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/bytecode-image.h"
+#include "../src/threaded-stack-machine.h"
+
+static const char* const imageTestFileName = "IMAGE_TEST_FILE_NAME.asm";
+
+static void assembleImageProgram(const char* source) {
+    FILE* sourceFile = fopen("SOURCE_TEST_FILE_NAME.txt", "w");
+    fputs(source, sourceFile);
+    fclose(sourceFile);
+    assemble("SOURCE_TEST_FILE_NAME.txt", imageTestFileName);
+}
+
+TEST(bytecodeImage, sameFileLoadedTwice_imageShared) {
+    assembleImageProgram("PUSH 1\nPOP [0]\nHLT\n");
+
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(imageTestFileName);
+    std::shared_ptr<const BytecodeImage> secondImage = BytecodeImage::load(imageTestFileName);
+
+    ASSERT_NOT_NULL(image.get());
+    ASSERT_TRUE(image == secondImage);
+    ASSERT_EQUALS(image->getAssemblySize(), 1 + sizeof(double) + 1 + sizeof(double) + 1);
+}
+
+TEST(bytecodeImage, machinesOfSameFile_imageSharedAndReleased) {
+    assembleImageProgram("PUSH 2\nPOP [0]\nHLT\n");
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(imageTestFileName);
+
+    {
+        StackMachine stackMachine(imageTestFileName);
+        ThreadedStackMachine threadedStackMachine(image, true);
+        ASSERT_EQUALS(image.use_count(), 3);
+
+        ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+        ASSERT_EQUALS(threadedStackMachine.execute(), HLT_OPCODE);
+        ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 2.0);
+        ASSERT_DOUBLE_EQUALS(threadedStackMachine.getRam().getAt(0), 2.0);
+    }
+
+    ASSERT_EQUALS(image.use_count(), 1);
+}
+
+TEST(bytecodeImage, predecodedOperations_linearSweepOfAssembly) {
+    assembleImageProgram("PUSH 3\nPUSH AX\nADD\nHLT\n");
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(imageTestFileName);
+
+    const std::vector<PredecodedOperation>& operations = image->getDecodedOperations();
+
+    ASSERT_EQUALS(operations.size(), 4);
+    ASSERT_EQUALS(operations[0].operation.opcode, PUSH_OPCODE);
+    ASSERT_DOUBLE_EQUALS(operations[0].operation.operand, 3.0);
+    ASSERT_EQUALS(operations[1].offset, 1 + sizeof(double));
+    ASSERT_EQUALS(operations[1].operation.opcode, PUSHR_OPCODE);
+    ASSERT_EQUALS(operations[3].operation.opcode, HLT_OPCODE);
+}
+
+TEST(bytecodeImage, missingFile_nullptrReturned) {
+    ASSERT_NULL(BytecodeImage::load("IMAGE_MISSING_TEST_FILE_NAME.asm").get());
+}
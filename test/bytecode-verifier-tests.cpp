@@ -0,0 +1,184 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/bytecode-verifier.h"
+#include "../src/bytecode-image.h"
+#include "../src/stack-machine.h"
+
+static const char* const verifierSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const verifierTestFileName = "VERIFIER_TEST_FILE_NAME.asm";
+
+/**
+ * Assembles the given program and loads it's image.
+ * @param[in] source  source code of the program
+ * @param[in] options assembly options
+ * @return image of the assembled program.
+ */
+static std::shared_ptr<const BytecodeImage> loadVerifierProgram(const char* source,
+                                                                const AssemblyOptions& options = AssemblyOptions()) {
+    FILE* sourceFile = fopen(verifierSourceFileName, "w");
+    fputs(source, sourceFile);
+    fclose(sourceFile);
+    // File is written anew, so it doesn't get the cached image of the previous test with the same identity
+    remove(verifierTestFileName);
+    assemble(verifierSourceFileName, verifierTestFileName, options);
+    return BytecodeImage::load(verifierTestFileName);
+}
+
+/**
+ * Writes the given bytes as the assembly file and loads it's image.
+ * @param[in] assembly     assembly bytes
+ * @param[in] assemblySize size of the assembly in bytes
+ * @return image of the assembly.
+ */
+static std::shared_ptr<const BytecodeImage> loadVerifierAssembly(const unsigned char* assembly, size_t assemblySize) {
+    remove(verifierTestFileName);
+    FILE* assemblyFile = fopen(verifierTestFileName, "wb");
+    fwrite(assembly, sizeof(unsigned char), assemblySize, assemblyFile);
+    fclose(assemblyFile);
+    return BytecodeImage::load(verifierTestFileName);
+}
+
+static const char* const verifierLoopProgram = "PUSH 5\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH AX\n"
+                                               "POP [1]\nPUSH 0\nJMPG LOOP\nPUSH 1\nPOP [2]\nHLT\n";
+
+TEST(bytecodeVerifier, loopProgram_verifiedWithStackDepths) {
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram(verifierLoopProgram);
+
+    const BytecodeVerification& verification = image->getVerification();
+
+    ASSERT_EQUALS(verification.status, VERIFIED);
+    ASSERT_EQUALS(verification.failedOffset, -1);
+    ASSERT_EQUALS(verification.blocks.size(), 3);
+    ASSERT_EQUALS(verification.blocks[0].offset, 0);
+    ASSERT_EQUALS(verification.blocks[1].entryStackDepth, 0);
+    ASSERT_EQUALS(verification.blocks[1].maxStackDepth, 2);
+    ASSERT_EQUALS(verification.blocks[2].maxStackDepth, 1);
+    ASSERT_EQUALS(verification.maxStackDepth, 2);
+    ASSERT_TRUE(verification.isReachable(0));
+    ASSERT_TRUE(!verification.isReachable(1));
+}
+
+TEST(bytecodeVerifier, fusedLoopProgram_executedOnVerifiedPath) {
+    AssemblyOptions options;
+    options.fuseOperations = true;
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram(verifierLoopProgram, options);
+    StackMachine stackMachine(image);
+
+    ASSERT_TRUE(image->getVerification().isVerified());
+    ASSERT_EQUALS(image->getVerification().maxStackDepth, 2);
+    ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(1), 0.0);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(2), 1.0);
+}
+
+TEST(bytecodeVerifier, loopGrowingStack_verifiedWithUnknownDepth) {
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram("LOOP:\nPUSH 1\nPUSH AX\nPUSH 0\nJMPE LOOP\nHLT\n");
+
+    const BytecodeVerification& verification = image->getVerification();
+
+    ASSERT_EQUALS(verification.status, VERIFIED);
+    ASSERT_EQUALS(verification.blocks[0].entryStackDepth, -1);
+    ASSERT_EQUALS(verification.blocks[0].maxStackGrowth, 3);
+    ASSERT_EQUALS(verification.maxStackDepth, -1);
+}
+
+TEST(bytecodeVerifier, functionCall_depthAfterCallUnknown) {
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram("PUSH 2\nCALL SQUARE\nPOP [0]\nHLT\n"
+                                                                     "SQUARE:\nDUP\nMUL\nRET\n");
+    StackMachine stackMachine(image);
+
+    const BytecodeVerification& verification = image->getVerification();
+
+    ASSERT_EQUALS(verification.status, VERIFIED);
+    ASSERT_EQUALS(verification.blocks.size(), 3);
+    ASSERT_EQUALS(verification.blocks[1].entryStackDepth, -1);
+    ASSERT_EQUALS(verification.blocks[2].entryStackDepth, 1);
+    ASSERT_EQUALS(verification.blocks[2].maxStackDepth, 2);
+    ASSERT_EQUALS(verification.maxStackDepth, -1);
+    ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 4.0);
+}
+
+TEST(bytecodeVerifier, invalidBytesAfterHlt_verified) {
+    const unsigned char assembly[] = {HLT_OPCODE, ERR_INVALID_OPERATION, PUSHR_OPCODE, REGISTERS_NUMBER};
+    std::shared_ptr<const BytecodeImage> image = loadVerifierAssembly(assembly, sizeof(assembly));
+
+    ASSERT_EQUALS(image->getVerification().status, VERIFIED);
+    ASSERT_EQUALS(image->getVerification().maxStackDepth, 0);
+}
+
+TEST(bytecodeVerifier, reachableInvalidRegister_notVerifiedAndChecked) {
+    const unsigned char assembly[] = {PUSHR_OPCODE, REGISTERS_NUMBER, HLT_OPCODE};
+    std::shared_ptr<const BytecodeImage> image = loadVerifierAssembly(assembly, sizeof(assembly));
+    StackMachine stackMachine(image);
+
+    ASSERT_EQUALS(image->getVerification().status, INVALID_OPERATION_REACHED);
+    ASSERT_EQUALS(image->getVerification().failedOffset, 0);
+    ASSERT_EQUALS(stackMachine.execute(), ERR_INVALID_REGISTER);
+}
+
+TEST(bytecodeVerifier, jumpIntoOperation_invalidJumpTarget) {
+    // PUSH 0, then JMP to the second byte of the PUSH: offset is relative to the offset field itself
+    unsigned char assembly[1 + sizeof(double) + 1 + sizeof(int) + 1] = {PUSH_OPCODE};
+    int jumpOffset = 1 - (int)(1 + sizeof(double) + 1);
+    assembly[1 + sizeof(double)] = JMP_OPCODE;
+    memcpy(assembly + 1 + sizeof(double) + 1, &jumpOffset, sizeof(jumpOffset));
+    assembly[sizeof(assembly) - 1] = HLT_OPCODE;
+    std::shared_ptr<const BytecodeImage> image = loadVerifierAssembly(assembly, sizeof(assembly));
+
+    ASSERT_EQUALS(image->getVerification().status, INVALID_JUMP_TARGET);
+    ASSERT_EQUALS(image->getVerification().failedOffset, 1 + sizeof(double));
+}
+
+TEST(bytecodeVerifier, programWithoutHlt_notVerified) {
+    std::shared_ptr<const BytecodeImage> loopImage = loadVerifierProgram("LOOP:\nJMP LOOP\n");
+    ASSERT_EQUALS(loopImage->getVerification().status, HLT_UNREACHABLE);
+
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram("PUSH 1\nPOP [0]\n");
+    ASSERT_EQUALS(image->getVerification().status, END_OF_ASSEMBLY_REACHED);
+    ASSERT_EQUALS(image->getVerification().failedOffset, 1 + sizeof(double));
+}
+
+TEST(bytecodeVerifier, containerCodeDiffersFromDecodedSection_notLoaded) {
+    AssemblyOptions options;
+    options.format = CONTAINER_FORMAT;
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram("PUSH AX\nHLT\n", options);
+    ASSERT_TRUE(image->getVerification().isVerified());
+
+    // Register of the code section is made invalid, while the decoded section still has the valid one
+    std::vector<unsigned char> container;
+    FILE* containerFile = fopen(verifierTestFileName, "rb");
+    fseek(containerFile, 0, SEEK_END);
+    container.resize(ftell(containerFile));
+    fseek(containerFile, 0, SEEK_SET);
+    ASSERT_EQUALS(fread(container.data(), sizeof(unsigned char), container.size(), containerFile), container.size());
+    fclose(containerFile);
+    BytecodeContainer sections;
+    readBytecodeContainer(container.data(), container.size(), sections);
+    container[sections.code - container.data() + 1] = REGISTERS_NUMBER;
+    image = loadVerifierAssembly(container.data(), container.size());
+
+    ASSERT_NULL(image.get());
+}
+
+TEST(bytecodeVerifier, verifiedStackDepth_operandStackReserved) {
+    std::shared_ptr<const BytecodeImage> image = loadVerifierProgram(verifierLoopProgram);
+    StackMachine stackMachine(image);
+
+    ASSERT_EQUALS(image->getStackReserve().operandStackDepth, 2);
+    ASSERT_EQUALS(image->getStackReserve().callStackDepth, 0);
+    ASSERT_EQUALS(stackMachine.getStackCapacity().operandStackDepth, 2);
+
+    // Reserve never decreases the capacity and is limited by MAX_STACK_RESERVE
+    StackReserve reserve;
+    reserve.operandStackDepth = 1;
+    reserve.callStackDepth = MAX_STACK_RESERVE + 1;
+    stackMachine.reserveStacks(reserve);
+
+    ASSERT_EQUALS(stackMachine.getStackCapacity().operandStackDepth, 2);
+    ASSERT_EQUALS(stackMachine.getStackCapacity().callStackDepth, MAX_STACK_RESERVE);
+    ASSERT_EQUALS(stackMachine.execute(), HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(2), 1.0);
+}
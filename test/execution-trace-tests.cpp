@@ -0,0 +1,216 @@
+/**
+ * @file
+ */
+#include <string>
+#include "testlib.h"
+#include "../src/stack-machine.h"
+#include "../src/jit-stack-machine.h"
+#include "../src/execution-trace.h"
+
+static const char* const traceSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const traceAsmFileName = "TRACE_TEST_FILE_NAME.asm";
+static const char* const traceInputFileName = "TRACE_TEST_FILE_NAME.in";
+static const char* const traceOutputFileName = "TRACE_TEST_FILE_NAME.out";
+static const char* const traceTestFileName = "TRACE_TEST_FILE_NAME.trace";
+
+/**
+ * Reads N and writes partial sums of N, N - 1, ... 1, then reads and writes one more value.
+ * Registers and the operand stack are left not empty, so the final state is compared too.
+ */
+static const char* const traceTestProgram = "IN\nPOP AX\nPUSH 0\nPOP BX\nLOOP:\nPUSH BX\nPUSH AX\nADD\nPOP BX\n"
+                                            "PUSH BX\nOUT\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\nJMPG LOOP\n"
+                                            "IN\nOUT\nPUSH 7\nHLT\n";
+
+/**
+ * Counts AX down from N to 0 by the loop, that the JIT engine runs in native code, then writes AX.
+ */
+static const char* const branchTestProgram = "IN\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\n"
+                                             "JMPG LOOP\nPUSH AX\nOUT\nHLT\n";
+
+static void writeTraceTestFile(const char* fileName, const char* text) {
+    FILE* file = fopen(fileName, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+/**
+ * Runs the test program with the given IN values and records the trace of it.
+ * @param[in] source source code of the program
+ * @param[in] inputs text of IN values
+ * @return exit code of the run.
+ */
+static int recordTrace(const char* source, const char* inputs) {
+    writeTraceTestFile(traceSourceFileName, source);
+    remove(traceAsmFileName);
+    assemble(traceSourceFileName, traceAsmFileName);
+    writeTraceTestFile(traceInputFileName, inputs);
+
+    RunOptions options;
+    options.ioMode = TEXT_IO;
+    options.ioInputFileName = traceInputFileName;
+    options.ioOutputFileName = traceOutputFileName;
+    options.traceFileName = traceTestFileName;
+    return run(traceAsmFileName, options);
+}
+
+/**
+ * Gets the description of the first branch that differs from the recorded one.
+ * @param[in] branchLog log the outcomes were compared by
+ * @return text of the report, or empty string, if outcomes are the same.
+ */
+static std::string reportBranches(const BranchLog& branchLog) {
+    FILE* report = tmpfile();
+    branchLog.reportDivergence(report);
+    rewind(report);
+    std::string text;
+    int symbol = 0;
+    while ((symbol = fgetc(report)) != EOF) text += (char)symbol;
+    fclose(report);
+    return text;
+}
+
+static int replayTrace(ExecutionEngine engine) {
+    RunOptions options;
+    options.engine = engine;
+    options.replayFileName = traceTestFileName;
+    return run(traceAsmFileName, options);
+}
+
+TEST(trace, recordedOnReferenceEngine_replayedOnEveryEngineWithoutDifferences) {
+    // 20000 OUT records don't fit one buffer of the writer, so buffers are written by the background thread
+    int recordExitCode = recordTrace(traceTestProgram, "20000 2.5\n");
+    ExecutionTrace trace {};
+    unsigned char readStatus = readTrace(traceTestFileName, trace);
+
+    ASSERT_EQUALS(recordExitCode, 0);
+    ASSERT_EQUALS(readStatus, 0);
+    ASSERT_EQUALS(trace.records.size(), 20003u);
+    ASSERT_EQUALS(trace.records[0].kind, TRACE_INPUT);
+    ASSERT_DOUBLE_EQUALS(trace.records[0].value, 20000.0);
+    ASSERT_EQUALS(trace.records[20000].kind, TRACE_OUTPUT);
+    ASSERT_DOUBLE_EQUALS(trace.records[20000].value, 200010000.0);
+    ASSERT_EQUALS(trace.records[20001].kind, TRACE_INPUT);
+    ASSERT_DOUBLE_EQUALS(trace.records[20002].value, 2.5);
+    ASSERT_TRUE(trace.isFinished);
+    ASSERT_EQUALS(trace.end.status, HLT_OPCODE);
+    ASSERT_EQUALS(trace.end.operandStackSize, 1u);
+    ASSERT_DOUBLE_EQUALS(trace.end.topValue, 7.0);
+    ASSERT_DOUBLE_EQUALS(trace.end.registers[1], 200010000.0);
+    // JMPG is taken 19999 times and falls through at the end
+    ASSERT_EQUALS(trace.end.branchesNumber, 20000u);
+    ASSERT_EQUALS(trace.branches.size(), 313u);
+    ASSERT_EQUALS(trace.branches[0], UINT64_MAX);
+    ASSERT_EQUALS(trace.branches[312], (1ull << 31u) - 1);
+
+    ASSERT_EQUALS(replayTrace(REFERENCE_ENGINE), 0);
+    ASSERT_EQUALS(replayTrace(THREADED_ENGINE), 0);
+    ASSERT_EQUALS(replayTrace(TOS_CACHING_ENGINE), 0);
+    ASSERT_EQUALS(replayTrace(JIT_ENGINE), 0);
+}
+
+TEST(trace, programFinishedWithError_replayedOnEveryEngineWithoutDifferences) {
+    // Loop counts N down to 0, then the final state is the one the failed POP, RET and JMPL leave on each engine
+    const char* const failedPrograms[] = {
+        "IN\nPOP AX\nLOOP:\nPUSH AX\nOUT\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\nJMPG LOOP\nPOP BX\nHLT\n",
+        "IN\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\nJMPG LOOP\nPUSH 3\nRET\n",
+        "IN\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\nJMPG LOOP\nPUSH 0\nJMPL LOOP\nHLT\n",
+    };
+
+    for (const char* program : failedPrograms) {
+        int recordExitCode = recordTrace(program, "5000\n");
+        ExecutionTrace trace {};
+        unsigned char readStatus = readTrace(traceTestFileName, trace);
+
+        ASSERT_TRUE(recordExitCode != 0);
+        ASSERT_EQUALS(readStatus, 0);
+        ASSERT_TRUE(trace.isFinished);
+        ASSERT_TRUE(trace.end.status != HLT_OPCODE);
+        ASSERT_EQUALS(replayTrace(REFERENCE_ENGINE), 0);
+        ASSERT_EQUALS(replayTrace(THREADED_ENGINE), 0);
+        ASSERT_EQUALS(replayTrace(TOS_CACHING_ENGINE), 0);
+        ASSERT_EQUALS(replayTrace(JIT_ENGINE), 0);
+    }
+}
+
+TEST(trace, changedTraceOrAnotherProgram_differenceReported) {
+    ASSERT_EQUALS(recordTrace(traceTestProgram, "3 1\n"), 0);
+
+    // OUT value of the second record (partial sum 3) is changed to 4
+    FILE* traceFile = fopen(traceTestFileName, "r+b");
+    double changedValue = 4;
+    fseek(traceFile, (long)(sizeof(TraceHeader) + 9 + 1), SEEK_SET);
+    fwrite(&changedValue, sizeof(changedValue), 1, traceFile);
+    fclose(traceFile);
+    int changedExitCode = replayTrace(THREADED_ENGINE);
+
+    ASSERT_EQUALS(recordTrace(traceTestProgram, "3 1\n"), 0);
+    RunOptions budgetOptions;
+    budgetOptions.replayFileName = traceTestFileName;
+    budgetOptions.budget.instructions = 10;
+    int budgetExitCode = run(traceAsmFileName, budgetOptions);
+
+    writeTraceTestFile(traceSourceFileName, "IN\nOUT\nHLT\n");
+    remove(traceAsmFileName);
+    assemble(traceSourceFileName, traceAsmFileName);
+    int anotherProgramExitCode = replayTrace(REFERENCE_ENGINE);
+
+    ASSERT_EQUALS(changedExitCode, ERR_TRACE_MISMATCH);
+    ASSERT_EQUALS(budgetExitCode, ERR_TRACE_MISMATCH);
+    ASSERT_EQUALS(anotherProgramExitCode, ERR_INVALID_FILE);
+}
+
+TEST(trace, changedBranchOutcome_firstDifferentBranchReportedOnEveryEngine) {
+    ASSERT_EQUALS(recordTrace(branchTestProgram, "200\n"), 0);
+
+    // Branch #100 (bit 36 of the second TRACE_BRANCHES record, that follows the IN record) is changed to not taken
+    FILE* traceFile = fopen(traceTestFileName, "r+b");
+    long outcomesPosition = (long)(sizeof(TraceHeader) + 9 + 9 + 1);
+    uint64_t outcomes = 0;
+    fseek(traceFile, outcomesPosition, SEEK_SET);
+    ASSERT_EQUALS(fread(&outcomes, sizeof(outcomes), 1, traceFile), 1u);
+    outcomes ^= 1ull << 36u;
+    fseek(traceFile, outcomesPosition, SEEK_SET);
+    fwrite(&outcomes, sizeof(outcomes), 1, traceFile);
+    fclose(traceFile);
+
+    ExecutionTrace trace {};
+    ASSERT_EQUALS(readTrace(traceTestFileName, trace), 0);
+    ASSERT_EQUALS(trace.end.branchesNumber, 200u);
+
+    // Block of the loop is compiled after 16 runs, so the changed outcome is logged by the exit of the native loop
+    JitStackMachine machine(traceAsmFileName, 16);
+    double input = 200;
+    std::vector<double> outputs;
+    machine.getIO().setMemory(&input, 1, &outputs);
+    BranchLog branchLog(trace.branches, trace.end.branchesNumber, true);
+    machine.setBranchLog(&branchLog);
+    unsigned char exitCode = machine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_TRUE(machine.getCompiledBlocksNumber() > 0);
+    ASSERT_EQUALS(branchLog.getBranchesNumber(), 200u);
+    ASSERT_EQUALS(reportBranches(branchLog), std::string("Branch #100 at pc 28: expected not taken, got taken\n"));
+    ASSERT_EQUALS(replayTrace(REFERENCE_ENGINE), ERR_TRACE_MISMATCH);
+    ASSERT_EQUALS(replayTrace(THREADED_ENGINE), ERR_TRACE_MISMATCH);
+    ASSERT_EQUALS(replayTrace(TOS_CACHING_ENGINE), ERR_TRACE_MISMATCH);
+    ASSERT_EQUALS(replayTrace(JIT_ENGINE), ERR_TRACE_MISMATCH);
+}
+
+TEST(trace, moreBranchesThanRecorded_firstUnexpectedBranchReported) {
+    // Taken, not taken, taken
+    const std::vector<uint64_t> recorded = {5};
+
+    BranchLog longerLog(recorded, 3, true);
+    longerLog.log(1, true);
+    longerLog.log(2, false);
+    longerLog.logTaken(3, 2);
+    BranchLog cutLog(recorded, 3, false);
+    for (int i = 0; i < 100; ++i) {
+        cutLog.log(1, (i % 2) == 0);
+    }
+
+    ASSERT_EQUALS(reportBranches(longerLog),
+                  std::string("Branch #3 at pc 3: unexpected conditional jump, the trace has only 3 of them\n"));
+    // Jumps after the end of the cut trace are unknown
+    ASSERT_EQUALS(reportBranches(cutLog), std::string());
+}
@@ -0,0 +1,242 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/jit-stack-machine.h"
+#include "../src/stack-machine-utils.h"
+
+static const char* const sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+
+static void assembleSource(const char* source, bool fuseOperations = false) {
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs(source, sourceTestFile);
+    fclose(sourceTestFile);
+
+    AssemblyOptions options;
+    options.fuseOperations = fuseOperations;
+    assemble(sourceTestFileName, asmTestFileName, options);
+}
+
+// Sums numbers from 99 to 0 into BX, result is stored at RAM address 0
+static const char* const sumLoopSource =
+    "PUSH 100\n"
+    "POP AX\n"
+    "LOOP:\n"
+    "PUSH AX\n"
+    "PUSH 1\n"
+    "SUB\n"
+    "POP AX\n"
+    "PUSH BX\n"
+    "PUSH AX\n"
+    "ADD\n"
+    "POP BX\n"
+    "PUSH AX\n"
+    "PUSH 0\n"
+    "JMPG LOOP\n"
+    "PUSH BX\n"
+    "POP [0]\n"
+    "HLT\n";
+
+TEST(jit, hotLoop_blockCompiledAndResultComputed) {
+    assembleSource(sumLoopSource);
+    JitStackMachine stackMachine(asmTestFileName, 2);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(stackMachine.getCompiledBlocksNumber(), 1);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 4950.0);
+}
+
+TEST(jit, fusedHotLoop_blockCompiledAndResultComputed) {
+    assembleSource(sumLoopSource, true);
+    JitStackMachine stackMachine(asmTestFileName, 2);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(stackMachine.getCompiledBlocksNumber(), 1);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 4950.0);
+}
+
+TEST(jit, loopConsumingStackValue_valueTakenFromOperandStack) {
+    assembleSource(
+        "PUSH 0\n"
+        "PUSH 10\n"
+        "POP AX\n"
+        "LOOP:\n"
+        "PUSH AX\n"
+        "ADD\n"
+        "PUSH AX\n"
+        "PUSH 1\n"
+        "SUB\n"
+        "POP AX\n"
+        "PUSH AX\n"
+        "PUSH 0\n"
+        "JMPG LOOP\n"
+        "POP [0]\n"
+        "HLT\n");
+    JitStackMachine stackMachine(asmTestFileName, 1);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(stackMachine.getCompiledBlocksNumber(), 1);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 55.0);
+}
+
+TEST(jit, equalityWithinEpsilon_loopFinished) {
+    assembleSource(
+        "PUSH 1\n"
+        "POP AX\n"
+        "LOOP:\n"
+        "PUSH BX\n"
+        "PUSH 1\n"
+        "ADD\n"
+        "POP BX\n"
+        "PUSH AX\n"
+        "PUSH 0.1\n"
+        "SUB\n"
+        "POP AX\n"
+        "PUSH AX\n"
+        "PUSH 0\n"
+        "JMPNE LOOP\n"
+        "PUSH BX\n"
+        "POP [0]\n"
+        "HLT\n");
+    JitStackMachine stackMachine(asmTestFileName, 1);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(0), 10.0);
+}
+
+TEST(jit, notEnoughValuesForCompiledBlock_stackUnderflowErrorCodeReturned) {
+    assembleSource(
+        "PUSH 0\n"
+        "PUSH 3\n"
+        "POP AX\n"
+        "LOOP:\n"
+        "PUSH 1\n"
+        "ADD\n"
+        "PUSH AX\n"
+        "PUSH 1\n"
+        "SUB\n"
+        "POP AX\n"
+        "PUSH AX\n"
+        "PUSH 0\n"
+        "JMPG LOOP\n"
+        "POP\n"
+        "JMP LOOP\n");
+    JitStackMachine stackMachine(asmTestFileName, 1);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(jit, integerOperationsInHotLoops_sameResultsAsInterpreter) {
+    // NAN, infinity and values out of int64 range are converted to 0, -2^63 is kept, products wrap around.
+    // The last loop keeps the running sum on the integer stack, so it's block has integer input and output
+    const char* source =
+        "PUSH 0\n"
+        "POP IAX\n"
+        "LOOP:\n"
+        "PUSH IBX\n"
+        "PUSH -7.9\n"
+        "FTOI\n"
+        "PUSH 2.5\n"
+        "FTOI\n"
+        "MUL\n"
+        "ADD\n"
+        "POP IBX\n"
+        "PUSH -9223372036854775808\n"
+        "PUSH 1e300\n"
+        "PUSH 1e300\n"
+        "MUL\n"
+        "FTOI\n"
+        "ADD\n"
+        "POP ICX\n"
+        "PUSH 0\n"
+        "PUSH 1e300\n"
+        "PUSH 1e300\n"
+        "MUL\n"
+        "MUL\n"
+        "FTOI\n"
+        "PUSH 5\n"
+        "ADD\n"
+        "PUSH 18446744073709551616\n"
+        "FTOI\n"
+        "PUSH -3\n"
+        "SUB\n"
+        "MUL\n"
+        "PUSH 4611686018427387904\n"
+        "PUSH 4\n"
+        "MUL\n"
+        "ADD\n"
+        "POP IDX\n"
+        "PUSH IAX\n"
+        "PUSH 1\n"
+        "ADD\n"
+        "POP IAX\n"
+        "PUSH IAX\n"
+        "PUSH 10\n"
+        "JMPL LOOP\n"
+        "DOWN:\n"
+        "PUSH IAX\n"
+        "PUSH 1\n"
+        "SUB\n"
+        "POP IAX\n"
+        "PUSH IAX\n"
+        "PUSH 1e300\n"
+        "PUSH 1e300\n"
+        "MUL\n"
+        "FTOI\n"
+        "JMPNE DOWN\n"
+        "IPUSH 0\n"
+        "SUM:\n"
+        "PUSH IAX\n"
+        "ADD\n"
+        "PUSH IAX\n"
+        "PUSH 1\n"
+        "ADD\n"
+        "POP IAX\n"
+        "PUSH IAX\n"
+        "PUSH 100\n"
+        "JMPL SUM\n"
+        "ITOF\n"
+        "POP [4]\n"
+        "PUSH IAX\n"
+        "ITOF\n"
+        "POP [0]\n"
+        "PUSH IBX\n"
+        "ITOF\n"
+        "POP [1]\n"
+        "PUSH ICX\n"
+        "ITOF\n"
+        "POP [2]\n"
+        "PUSH IDX\n"
+        "ITOF\n"
+        "POP [3]\n"
+        "HLT\n";
+    assembleSource(source);
+    JitStackMachine jitMachine(asmTestFileName, 1);
+    StackMachine referenceMachine(asmTestFileName);
+
+    int jitExitCode = jitMachine.execute();
+    int referenceExitCode = referenceMachine.execute();
+
+    ASSERT_EQUALS(jitExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(referenceExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(jitMachine.getCompiledBlocksNumber(), 3);
+    ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(0), 100.0);
+    ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(1), -140.0);
+    ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(2), -9223372036854775808.0);
+    ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(3), 15.0);
+    ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(4), 4950.0);
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_DOUBLE_EQUALS(jitMachine.getRam().getAt(i), referenceMachine.getRam().getAt(i));
+    }
+}
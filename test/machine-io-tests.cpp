@@ -0,0 +1,118 @@
+/**
+ * @file
+ */
+#include <cstring>
+#include "testlib.h"
+#include "../src/machine-io.h"
+#include "../src/stack-machine.h"
+
+static const char* const ioInputTestFileName = "IO_INPUT_TEST_FILE_NAME.txt";
+static const char* const ioOutputTestFileName = "IO_OUTPUT_TEST_FILE_NAME.txt";
+
+static bool isSameDouble(double lhs, double rhs) {
+    return memcmp(&lhs, &rhs, sizeof(double)) == 0;
+}
+
+TEST(machineIO, textValues_parsedExactlyAsStrtod) {
+    const char* const values[] = {
+        "1", "-2.5", "3e2", "0.1", "-0", "123456789012345", "1234567890123456789", "4.9e-324", "1e-22", "7E+22",
+        "2.2250738585072014e-308", "0.30000000000000004", "inf", "+17.125",
+    };
+    FILE* inputFile = fopen(ioInputTestFileName, "w");
+    for (const char* value : values) fprintf(inputFile, "%s\n\t ", value);
+    fclose(inputFile);
+
+    inputFile = fopen(ioInputTestFileName, "r");
+    MachineIO io;
+    io.setMode(TEXT_IO, inputFile, stdout);
+
+    for (const char* value : values) {
+        ASSERT_TRUE(isSameDouble(io.read(), strtod(value, nullptr)));
+    }
+    ASSERT_TRUE(std::isnan(io.read()));
+
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+    fclose(inputFile);
+}
+
+TEST(machineIO, invalidTextValue_nanReadAndNextValueParsed) {
+    FILE* inputFile = fopen(ioInputTestFileName, "w");
+    fputs("abc 5", inputFile);
+    fclose(inputFile);
+
+    inputFile = fopen(ioInputTestFileName, "r");
+    MachineIO io;
+    io.setMode(TEXT_IO, inputFile, stdout);
+
+    ASSERT_TRUE(std::isnan(io.read()));
+    ASSERT_DOUBLE_EQUALS(io.read(), 5.0);
+
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+    fclose(inputFile);
+}
+
+TEST(machineIO, binaryValues_writtenAndReadBack) {
+    const double values[] = {1.0, -0.5, 1e300, 3.14159};
+    FILE* outputFile = fopen(ioOutputTestFileName, "wb");
+    MachineIO io;
+    io.setMode(BINARY_IO, stdin, outputFile);
+    for (double value : values) io.write(value);
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+    fclose(outputFile);
+
+    FILE* inputFile = fopen(ioOutputTestFileName, "rb");
+    unsigned char firstValue[sizeof(double)] = { };
+    ASSERT_EQUALS(fread(firstValue, 1, sizeof(firstValue), inputFile), sizeof(double));
+    ASSERT_EQUALS(firstValue[7], 0x3F); // Little-endian 1.0
+    rewind(inputFile);
+
+    io.setMode(BINARY_IO, inputFile, stdout);
+    for (double value : values) {
+        ASSERT_TRUE(isSameDouble(io.read(), value));
+    }
+    ASSERT_TRUE(std::isnan(io.read()));
+
+    io.setMode(INTERACTIVE_IO, stdin, stdout);
+    fclose(inputFile);
+}
+
+TEST(machineIO, memoryValues_readFromArrayAndAppendedToVector) {
+    const double values[] = {2.5, -1.0};
+    std::vector<double> outputs = {7.0};
+    MachineIO io;
+    io.setMemory(values, 2, &outputs);
+
+    ASSERT_DOUBLE_EQUALS(io.read(), 2.5);
+    ASSERT_DOUBLE_EQUALS(io.read(), -1.0);
+    ASSERT_TRUE(std::isnan(io.read()));
+    io.write(4.0);
+    io.flush();
+
+    ASSERT_EQUALS(io.getMode(), MEMORY_IO);
+    ASSERT_EQUALS(outputs.size(), 2u);
+    ASSERT_DOUBLE_EQUALS(outputs[1], 4.0);
+}
+
+TEST(machineIO, programWithTextIO_valuesStreamedThroughFiles) {
+    FILE* sourceFile = fopen("SOURCE_TEST_FILE_NAME.txt", "w");
+    fputs("START:\nIN\nDUP\nPUSH 0\nJMPE END\nDUP\nMUL\nOUT\nJMP START\nEND:\nHLT\n", sourceFile);
+    fclose(sourceFile);
+    assemble("SOURCE_TEST_FILE_NAME.txt", "ASM_TEST_FILE_NAME.txt");
+    FILE* inputFile = fopen(ioInputTestFileName, "w");
+    fputs("1 2\n3\n0\n", inputFile);
+    fclose(inputFile);
+
+    RunOptions options;
+    options.ioMode = TEXT_IO;
+    options.ioInputFileName = ioInputTestFileName;
+    options.ioOutputFileName = ioOutputTestFileName;
+    int exitCode = run("ASM_TEST_FILE_NAME.txt", options);
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    char output[64] = "";
+    FILE* outputFile = fopen(ioOutputTestFileName, "r");
+    size_t outputSize = fread(output, 1, sizeof(output) - 1, outputFile);
+    fclose(outputFile);
+    output[outputSize] = '\0';
+    ASSERT_EQUALS(strcmp(output, "1\n4\n9\n"), 0);
+}
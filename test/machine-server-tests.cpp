@@ -0,0 +1,272 @@
+/**
+ * @file
+ */
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "testlib.h"
+#include "../src/machine-server.h"
+
+static const char* const serverSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const serverAsmFileName = "SERVER_TEST_FILE_NAME.asm";
+static const char* const serverSocketFileName = "SERVER_TEST_FILE_NAME.sock";
+
+/** Reads two values and writes their sum. Sum is accumulated in RAM, so it shows if RAM is cleared between runs */
+static const char* const serverTestProgram = "IN\nIN\nADD\nPUSH [3]\nADD\nDUP\nPOP [3]\nOUT\nHLT\n";
+
+static void assembleServerProgram(const char* source) {
+    FILE* sourceFile = fopen(serverSourceFileName, "w");
+    fputs(source, sourceFile);
+    fclose(sourceFile);
+
+    remove(serverAsmFileName);
+    assemble(serverSourceFileName, serverAsmFileName);
+}
+
+static void appendRequest(std::vector<char>& request, uint32_t programId, const std::vector<double>& inputs) {
+    uint32_t header[2] = {programId, (uint32_t)inputs.size()};
+    request.insert(request.end(), (const char*)header, (const char*)header + sizeof(header));
+    request.insert(request.end(), (const char*)inputs.data(), (const char*)(inputs.data() + inputs.size()));
+}
+
+/**
+ * Reads the response of the server (little-endian host is assumed).
+ * @param[in]  fd      client socket
+ * @param[out] outputs OUT values of the response
+ * @return status of the response, or -1 if the connection was closed.
+ */
+static int readResponse(int fd, std::vector<double>& outputs) {
+    auto readFully = [fd](void* destination, size_t size) {
+        char* bytes = static_cast<char*>(destination);
+        while (size != 0) {
+            ssize_t readSize = read(fd, bytes, size);
+            if (readSize <= 0) return false;
+            bytes += readSize;
+            size -= (size_t)readSize;
+        }
+        return true;
+    };
+
+    uint32_t header[2] = {};
+    if (!readFully(header, sizeof(header))) return -1;
+    outputs.resize(header[1]);
+    if (!readFully(outputs.data(), outputs.size() * sizeof(double))) return -1;
+    return (int)header[0];
+}
+
+TEST(machineServer, requestsOnResidentMachine_machineIsResetBetweenThem) {
+    assembleServerProgram(serverTestProgram);
+    RunOptions options;
+    options.engine = TOS_CACHING_ENGINE;
+    MachineServer server(options);
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+
+    const double firstInputs[] = {3, 4};
+    const double secondInputs[] = {1, 2};
+    std::vector<double> firstOutputs, secondOutputs;
+    int firstStatus = server.runRequest(0, firstInputs, 2, firstOutputs);
+    int secondStatus = server.runRequest(0, secondInputs, 2, secondOutputs);
+
+    ASSERT_EQUALS(firstStatus, 0);
+    ASSERT_EQUALS(secondStatus, 0);
+    ASSERT_EQUALS(firstOutputs.size(), 1u);
+    ASSERT_EQUALS(secondOutputs.size(), 1u);
+    ASSERT_DOUBLE_EQUALS(firstOutputs[0], 7.0);
+    ASSERT_DOUBLE_EQUALS(secondOutputs[0], 3.0);
+}
+
+TEST(machineServer, unknownProgramOrExhaustedBudget_errorStatusReturned) {
+    assembleServerProgram("LOOP:\nJMP LOOP\n");
+    RunOptions options;
+    options.budget.instructions = 1000;
+    MachineServer server(options);
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+
+    std::vector<double> outputs;
+    ASSERT_EQUALS(server.runRequest(1, nullptr, 0, outputs), ERR_INVALID_FILE);
+    ASSERT_EQUALS(server.runRequest(0, nullptr, 0, outputs), ERR_BUDGET_EXHAUSTED);
+    ASSERT_EQUALS(server.runRequest(0, nullptr, 0, outputs), ERR_BUDGET_EXHAUSTED);
+    ASSERT_EQUALS(server.addProgram("NOT_EXISTING_FILE_NAME.asm"), ERR_INVALID_FILE);
+}
+
+TEST(machineServer, pipelinedRequests_answeredInOrder) {
+    assembleServerProgram(serverTestProgram);
+    MachineServer server {RunOptions()};
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+
+    int sockets[2] = {-1, -1};
+    ASSERT_EQUALS(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets), 0);
+    ASSERT_EQUALS(server.addConnection(sockets[0]), 0);
+    int client = sockets[1];
+    int clientFlags = 0;
+    ASSERT_EQUALS(fcntl(client, F_SETFL, clientFlags), 0);
+
+    std::vector<char> requests;
+    appendRequest(requests, 0, {1, 2});
+    appendRequest(requests, 7, {});
+    appendRequest(requests, 0, {10, 20});
+    ASSERT_EQUALS(write(client, requests.data(), requests.size()), (ssize_t)requests.size());
+    shutdown(client, SHUT_WR);
+
+    // Server stops, when the only connection is closed
+    int serveStatus = -1;
+    std::thread serverThread([&server, &serveStatus]() { serveStatus = server.serve(); });
+
+    std::vector<double> firstOutputs, secondOutputs, thirdOutputs, extraOutputs;
+    int firstStatus = readResponse(client, firstOutputs);
+    int secondStatus = readResponse(client, secondOutputs);
+    int thirdStatus = readResponse(client, thirdOutputs);
+    int extraStatus = readResponse(client, extraOutputs);
+    serverThread.join();
+    close(client);
+
+    ASSERT_EQUALS(serveStatus, 0);
+    ASSERT_EQUALS(firstStatus, 0);
+    ASSERT_EQUALS(secondStatus, ERR_INVALID_FILE);
+    ASSERT_EQUALS(thirdStatus, 0);
+    ASSERT_EQUALS(extraStatus, -1);
+    ASSERT_EQUALS(firstOutputs.size(), 1u);
+    ASSERT_EQUALS(secondOutputs.size(), 0u);
+    ASSERT_EQUALS(thirdOutputs.size(), 1u);
+    ASSERT_DOUBLE_EQUALS(firstOutputs[0], 3.0);
+    ASSERT_DOUBLE_EQUALS(thirdOutputs[0], 30.0);
+}
+
+TEST(machineServer, morePipelinedRequestsThanQueued_allAnsweredInOrder) {
+    // Writes the sum of two values, then runs a loop, so that requests are queued faster than they are run
+    assembleServerProgram("IN\nIN\nADD\nOUT\nPUSH 0\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nADD\nPOP AX\nPUSH AX\n"
+                          "PUSH 300\nJMPL LOOP\nHLT\n");
+    MachineServer server(RunOptions(), 1);
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+
+    int sockets[2] = {-1, -1};
+    ASSERT_EQUALS(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets), 0);
+    ASSERT_EQUALS(server.addConnection(sockets[0]), 0);
+    int client = sockets[1];
+    ASSERT_EQUALS(fcntl(client, F_SETFL, 0), 0);
+
+    // Connection isn't read, while it has too many pending requests, and is read again, when they are answered
+    const int requestsNumber = 600;
+    std::vector<char> requests;
+    for (int i = 0; i < requestsNumber; ++i) {
+        appendRequest(requests, 0, {(double)i, 1});
+    }
+    ASSERT_EQUALS(write(client, requests.data(), requests.size()), (ssize_t)requests.size());
+
+    int serveStatus = -1;
+    std::thread serverThread([&server, &serveStatus]() { serveStatus = server.serve(); });
+
+    // Connection is kept open until all responses are read, so it's read again after the queue was full
+    int answeredNumber = 0;
+    bool areAnsweredInOrder = true;
+    std::vector<double> outputs;
+    while ((answeredNumber < requestsNumber) && (readResponse(client, outputs) == 0)) {
+        areAnsweredInOrder = areAnsweredInOrder && (outputs.size() == 1u) &&
+                             (fabs(outputs[0] - (answeredNumber + 1)) < COMPARE_EPS);
+        ++answeredNumber;
+    }
+    shutdown(client, SHUT_WR);
+    int extraStatus = readResponse(client, outputs);
+    serverThread.join();
+    close(client);
+
+    ASSERT_EQUALS(serveStatus, 0);
+    ASSERT_EQUALS(answeredNumber, requestsNumber);
+    ASSERT_TRUE(areAnsweredInOrder);
+    ASSERT_EQUALS(extraStatus, -1);
+}
+
+TEST(machineServer, longRequest_otherConnectionsAnsweredWhileItRuns) {
+    assembleServerProgram("LOOP:\nJMP LOOP\n");
+    RunOptions options;
+    options.engine = THREADED_ENGINE;
+    options.budget.milliseconds = 500;
+    MachineServer server(options, 2);
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+    assembleServerProgram(serverTestProgram);
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+
+    int slowSockets[2] = {-1, -1};
+    int fastSockets[2] = {-1, -1};
+    ASSERT_EQUALS(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, slowSockets), 0);
+    ASSERT_EQUALS(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fastSockets), 0);
+    ASSERT_EQUALS(server.addConnection(slowSockets[0]), 0);
+    ASSERT_EQUALS(server.addConnection(fastSockets[0]), 0);
+    int slowClient = slowSockets[1];
+    int fastClient = fastSockets[1];
+    ASSERT_EQUALS(fcntl(slowClient, F_SETFL, 0), 0);
+    ASSERT_EQUALS(fcntl(fastClient, F_SETFL, 0), 0);
+
+    // The second request of the slow connection is answered after the first one, though it finishes earlier
+    std::vector<char> slowRequests, fastRequests;
+    appendRequest(slowRequests, 0, {});
+    appendRequest(slowRequests, 1, {1, 2});
+    appendRequest(fastRequests, 1, {10, 20});
+    ASSERT_EQUALS(write(slowClient, slowRequests.data(), slowRequests.size()), (ssize_t)slowRequests.size());
+    ASSERT_EQUALS(write(fastClient, fastRequests.data(), fastRequests.size()), (ssize_t)fastRequests.size());
+    shutdown(slowClient, SHUT_WR);
+    shutdown(fastClient, SHUT_WR);
+
+    int serveStatus = -1;
+    std::thread serverThread([&server, &serveStatus]() { serveStatus = server.serve(); });
+
+    std::vector<double> fastOutputs, slowOutputs, afterSlowOutputs;
+    int fastStatus = readResponse(fastClient, fastOutputs);
+    char byte = 0;
+    ssize_t slowReadSize = recv(slowClient, &byte, sizeof(byte), MSG_DONTWAIT | MSG_PEEK);
+    int slowStatus = readResponse(slowClient, slowOutputs);
+    int afterSlowStatus = readResponse(slowClient, afterSlowOutputs);
+    serverThread.join();
+    close(slowClient);
+    close(fastClient);
+
+    ASSERT_EQUALS(serveStatus, 0);
+    ASSERT_EQUALS(fastStatus, 0);
+    ASSERT_EQUALS(slowReadSize, (ssize_t)-1);
+    ASSERT_EQUALS(slowStatus, ERR_BUDGET_EXHAUSTED);
+    ASSERT_EQUALS(afterSlowStatus, 0);
+    ASSERT_EQUALS(fastOutputs.size(), 1u);
+    ASSERT_EQUALS(slowOutputs.size(), 0u);
+    ASSERT_EQUALS(afterSlowOutputs.size(), 1u);
+    ASSERT_DOUBLE_EQUALS(fastOutputs[0], 30.0);
+    ASSERT_DOUBLE_EQUALS(afterSlowOutputs[0], 3.0);
+}
+
+TEST(machineServer, unixSocket_clientServedUntilServerIsStopped) {
+    assembleServerProgram(serverTestProgram);
+    MachineServer server {RunOptions()};
+    ASSERT_EQUALS(server.addProgram(serverAsmFileName), 0);
+    ASSERT_EQUALS(server.listen((std::string("unix:") + serverSocketFileName).c_str()), 0);
+    MachineServer invalidServer {RunOptions()};
+    ASSERT_EQUALS(invalidServer.listen("tcp:not-a-port"), ERR_INVALID_FILE);
+
+    int serveStatus = -1;
+    std::thread serverThread([&server, &serveStatus]() { serveStatus = server.serve(); });
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, serverSocketFileName);
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    int connectStatus = connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+
+    std::vector<char> request;
+    appendRequest(request, 0, {0.5, 0.25});
+    ssize_t writtenSize = write(client, request.data(), request.size());
+    std::vector<double> outputs;
+    int status = readResponse(client, outputs);
+    close(client);
+
+    server.stop();
+    serverThread.join();
+
+    ASSERT_EQUALS(connectStatus, 0);
+    ASSERT_EQUALS(writtenSize, (ssize_t)request.size());
+    ASSERT_EQUALS(status, 0);
+    ASSERT_EQUALS(outputs.size(), 1u);
+    ASSERT_DOUBLE_EQUALS(outputs[0], 0.75);
+    ASSERT_EQUALS(serveStatus, 0);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/stack-machine.h"
+#include "../src/threaded-stack-machine.h"
+#include "../src/bytecode-image.h"
+
+static const char* const snapshotSourceFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const snapshotAsmFileName = "SNAPSHOT_TEST_FILE_NAME.asm";
+static const char* const snapshotTestFileName = "SNAPSHOT_TEST_FILE_NAME.snapshot";
+
+/**
+ * Assembles the given program into the container, so it's labels are kept.
+ * @param[in] source source code of the program
+ */
+static void assembleSnapshotProgram(const char* source) {
+    FILE* sourceFile = fopen(snapshotSourceFileName, "w");
+    fputs(source, sourceFile);
+    fclose(sourceFile);
+
+    AssemblyOptions options;
+    options.format = CONTAINER_FORMAT;
+    remove(snapshotAsmFileName);
+    assemble(snapshotSourceFileName, snapshotAsmFileName, options);
+}
+
+// Snapshot is taken inside the subroutine, so both stacks, registers and RAM are not empty
+static const char* const snapshotTestProgram = "PUSH 3\nPOP [7]\nPUSH 2\nPOP BX\nPUSH 10\nCALL F\nPOP [1]\nHLT\n"
+                                               "F:\nPUSH [7]\nWARM:\nPUSH BX\nMUL\nADD\nRET\n";
+
+TEST(snapshot, snapshotTakenInsideSubroutine_resumedMachineFinishesTheSame) {
+    assembleSnapshotProgram(snapshotTestProgram);
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(snapshotAsmFileName);
+    int offset = image->getLabelOffset("WARM");
+
+    StackMachine stackMachine(image);
+    unsigned char status = HLT_OPCODE;
+    bool isReached = stackMachine.executeUntil(offset, status);
+    unsigned char saveStatus = stackMachine.saveSnapshot(snapshotTestFileName);
+    int exitCode = stackMachine.execute();
+
+    StackMachine resumedMachine(image);
+    unsigned char restoreStatus = resumedMachine.restoreSnapshot(snapshotTestFileName);
+    int resumedExitCode = resumedMachine.execute();
+
+    ASSERT_TRUE(offset > 0);
+    ASSERT_TRUE(isReached);
+    ASSERT_EQUALS(saveStatus, 0);
+    ASSERT_EQUALS(restoreStatus, 0);
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(resumedExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(1), 16.0);
+    ASSERT_DOUBLE_EQUALS(resumedMachine.getRam().getAt(1), 16.0);
+    ASSERT_DOUBLE_EQUALS(resumedMachine.getRam().getAt(7), 3.0);
+}
+
+TEST(snapshot, snapshotResumedByThreadedEngine_programFinishedSuccessfully) {
+    assembleSnapshotProgram(snapshotTestProgram);
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(snapshotAsmFileName);
+    RunOptions options;
+    options.snapshotLabel = "WARM";
+    options.snapshotFileName = snapshotTestFileName;
+    int snapshotExitCode = run(image, options);
+
+    ThreadedStackMachine resumedMachine(image, true);
+    unsigned char restoreStatus = resumedMachine.restoreSnapshot(snapshotTestFileName);
+    int resumedExitCode = resumedMachine.execute();
+
+    ASSERT_EQUALS(snapshotExitCode, 0);
+    ASSERT_EQUALS(restoreStatus, 0);
+    ASSERT_EQUALS(resumedExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(resumedMachine.getRam().getAt(1), 16.0);
+}
+
+TEST(snapshot, snapshotTakenInDeepRecursion_returnAddressesOfRingAndCallStackRestored) {
+    // Recursion is 40 calls deep at DEEP, so return addresses are spilled from the return ring to the call stack
+    assembleSnapshotProgram("PUSH 0\nPOP AX\nCALL F\nPUSH AX\nPOP [1]\nHLT\n"
+                            "F:\nPUSH AX\nPUSH 1\nADD\nPOP AX\nPUSH AX\nPUSH 40\nJMPGE DEEP\nCALL F\n"
+                            "PUSH AX\nPUSH 1\nADD\nPOP AX\nRET\nDEEP:\nRET\n");
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(snapshotAsmFileName);
+    int offset = image->getLabelOffset("DEEP");
+
+    StackMachine stackMachine(image);
+    unsigned char status = HLT_OPCODE;
+    bool isReached = stackMachine.executeUntil(offset, status);
+    unsigned char saveStatus = stackMachine.saveSnapshot(snapshotTestFileName);
+    int exitCode = stackMachine.execute();
+
+    ThreadedStackMachine resumedMachine(image, false);
+    unsigned char restoreStatus = resumedMachine.restoreSnapshot(snapshotTestFileName);
+    int resumedExitCode = resumedMachine.execute();
+
+    ASSERT_TRUE(isReached);
+    ASSERT_EQUALS(saveStatus, 0);
+    ASSERT_EQUALS(restoreStatus, 0);
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(resumedExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(1), 79.0);
+    ASSERT_DOUBLE_EQUALS(resumedMachine.getRam().getAt(1), 79.0);
+}
+
+TEST(snapshot, snapshotWithIntegerValues_integerStackAndRegistersRestored) {
+    assembleSnapshotProgram("IPUSH 7\nIPOP ICX\nIPUSH 5\nIPUSH -6\nWARM:\nIMUL\nIPUSH ICX\nIADD\nITOF\nPOP [1]\nHLT\n");
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(snapshotAsmFileName);
+    int offset = image->getLabelOffset("WARM");
+
+    StackMachine stackMachine(image);
+    unsigned char status = HLT_OPCODE;
+    bool isReached = stackMachine.executeUntil(offset, status);
+    unsigned char saveStatus = stackMachine.saveSnapshot(snapshotTestFileName);
+
+    ThreadedStackMachine resumedMachine(image, true);
+    unsigned char restoreStatus = resumedMachine.restoreSnapshot(snapshotTestFileName);
+    int resumedExitCode = resumedMachine.execute();
+
+    ASSERT_TRUE(isReached);
+    ASSERT_EQUALS(saveStatus, 0);
+    ASSERT_EQUALS(restoreStatus, 0);
+    ASSERT_EQUALS(resumedExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(resumedMachine.getRam().getAt(1), -23.0);
+}
+
+TEST(snapshot, snapshotOfOtherAssembly_invalidFileErrorCodeReturned) {
+    assembleSnapshotProgram(snapshotTestProgram);
+    StackMachine stackMachine(snapshotAsmFileName);
+    unsigned char saveStatus = stackMachine.saveSnapshot(snapshotTestFileName);
+
+    assembleSnapshotProgram("PUSH 1\nPOP [1]\nHLT\n");
+    StackMachine otherMachine(snapshotAsmFileName);
+    unsigned char restoreStatus = otherMachine.restoreSnapshot(snapshotTestFileName);
+    int exitCode = otherMachine.execute();
+
+    ASSERT_EQUALS(saveStatus, 0);
+    ASSERT_EQUALS(restoreStatus, ERR_INVALID_FILE);
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(otherMachine.getRam().getAt(1), 1.0);
+}
+
+TEST(snapshot, unknownSnapshotLabel_invalidLabelErrorCodeReturned) {
+    assembleSnapshotProgram(snapshotTestProgram);
+    RunOptions options;
+    options.snapshotLabel = "NOT_A_LABEL";
+    options.snapshotFileName = snapshotTestFileName;
+
+    int exitCode = run(snapshotAsmFileName, options);
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_LABEL);
+}
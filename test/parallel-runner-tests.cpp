@@ -0,0 +1,75 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/parallel-runner.h"
+
+static const char* const squareProgramFileName = "PARALLEL_SQUARE_TEST_FILE_NAME.asm";
+static const char* const manifestTestFileName = "PARALLEL_MANIFEST_TEST_FILE_NAME.txt";
+
+static void assembleSquareProgram() {
+    FILE* sourceFile = fopen("SOURCE_TEST_FILE_NAME.txt", "w");
+    fputs("IN\nDUP\nMUL\nOUT\nHLT\n", sourceFile);
+    fclose(sourceFile);
+    assemble("SOURCE_TEST_FILE_NAME.txt", squareProgramFileName);
+}
+
+TEST(parallelRunner, manyJobsOnSeveralThreads_eachJobWritesOwnOutput) {
+    assembleSquareProgram();
+    const int jobsNumber = 24;
+    FILE* manifest = fopen(manifestTestFileName, "w");
+    fprintf(manifest, "# program input output\n\n");
+    for (int i = 0; i < jobsNumber; ++i) {
+        char inputFileName[64] = "";
+        snprintf(inputFileName, sizeof(inputFileName), "PARALLEL_INPUT_%d.txt", i);
+        FILE* input = fopen(inputFileName, "w");
+        fprintf(input, "%d\n", i);
+        fclose(input);
+        fprintf(manifest, "%s %s PARALLEL_OUTPUT_%d.txt\n", squareProgramFileName, inputFileName, i);
+    }
+    fclose(manifest);
+
+    std::vector<Job> jobs;
+    ASSERT_EQUALS(readJobs(manifestTestFileName, jobs), 0);
+    ASSERT_EQUALS(jobs.size(), jobsNumber);
+
+    RunOptions options;
+    options.ioMode = TEXT_IO;
+    int exitCode = runJobs(jobs, options, 4);
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    for (int i = 0; i < jobsNumber; ++i) {
+        char outputFileName[64] = "";
+        snprintf(outputFileName, sizeof(outputFileName), "PARALLEL_OUTPUT_%d.txt", i);
+        FILE* output = fopen(outputFileName, "r");
+        double value = NAN;
+        ASSERT_EQUALS(fscanf(output, "%lg", &value), 1);
+        fclose(output);
+        ASSERT_DOUBLE_EQUALS(value, (double)(i * i));
+    }
+}
+
+TEST(parallelRunner, missingProgram_firstFailedJobExitCodeReturned) {
+    assembleSquareProgram();
+    FILE* manifest = fopen(manifestTestFileName, "w");
+    fprintf(manifest, "%s PARALLEL_INPUT_0.txt PARALLEL_OUTPUT_0.txt\n", squareProgramFileName);
+    fprintf(manifest, "PARALLEL_MISSING.asm PARALLEL_INPUT_0.txt PARALLEL_OUTPUT_1.txt\n");
+    fclose(manifest);
+
+    std::vector<Job> jobs;
+    ASSERT_EQUALS(readJobs(manifestTestFileName, jobs), 0);
+    int exitCode = runJobs(jobs, RunOptions(), 2);
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_FILE);
+    ASSERT_EQUALS(jobs[0].exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(jobs[1].exitCode, ERR_INVALID_FILE);
+}
+
+TEST(parallelRunner, invalidManifestLine_invalidFileErrorCodeReturned) {
+    FILE* manifest = fopen(manifestTestFileName, "w");
+    fprintf(manifest, "program.asm input.txt\n");
+    fclose(manifest);
+
+    std::vector<Job> jobs;
+    ASSERT_EQUALS(readJobs(manifestTestFileName, jobs), ERR_INVALID_FILE);
+}
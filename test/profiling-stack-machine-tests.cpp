@@ -0,0 +1,90 @@
+/**
+ * @file
+ */
+#include <cstdlib>
+#include <cstring>
+#include "testlib.h"
+#include "../src/profiling-stack-machine.h"
+#include "../src/stack-machine-utils.h"
+
+static const char* const sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+
+static void assembleSource(const char* source, bool fuseOperations = false) {
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs(source, sourceTestFile);
+    fclose(sourceTestFile);
+
+    AssemblyOptions options;
+    options.fuseOperations = fuseOperations;
+    remove(asmTestFileName);
+    assemble(sourceTestFileName, asmTestFileName, options);
+}
+
+// Counts AX down from 10 to 0. Offsets: PUSH 10 (0), POP AX (9), LOOP: PUSH AX (11), PUSH 1 (13), SUB (22),
+// POP AX (23), PUSH AX (25), PUSH 0 (27), JMPG LOOP (36), HLT (41)
+static const char* const countdownSource =
+    "PUSH 10\n"
+    "POP AX\n"
+    "LOOP:\n"
+    "PUSH AX\n"
+    "PUSH 1\n"
+    "SUB\n"
+    "POP AX\n"
+    "PUSH AX\n"
+    "PUSH 0\n"
+    "JMPG LOOP\n"
+    "HLT\n";
+
+TEST(profiling, loop_executionsAndJumpsCounted) {
+    assembleSource(countdownSource);
+    ProfilingStackMachine stackMachine(asmTestFileName);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(stackMachine.getOffsetProfile(0).executions, 1);
+    ASSERT_EQUALS(stackMachine.getOffsetProfile(11).executions, 10);
+    ASSERT_EQUALS(stackMachine.getOffsetProfile(36).jumpsTaken, 9);
+    ASSERT_EQUALS(stackMachine.getOffsetProfile(36).jumpsNotTaken, 1);
+    ASSERT_EQUALS(stackMachine.getOpcodeProfile(SUB_OPCODE).executions, 10);
+    ASSERT_EQUALS(stackMachine.getOpcodeProfile(PUSHR_OPCODE).executions, 20);
+    ASSERT_EQUALS(stackMachine.getOpcodeProfile(HLT_OPCODE).executions, 1);
+}
+
+TEST(profiling, fusedLoop_fusedJumpsCounted) {
+    assembleSource(countdownSource, true);
+    ProfilingStackMachine stackMachine(asmTestFileName);
+
+    int exitCode = stackMachine.execute();
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(stackMachine.getOpcodeProfile(CMP_IMM_JMPG_OPCODE).executions, 10);
+    unsigned long long jumpsTaken = 0, jumpsNotTaken = 0;
+    for (int offset = 0; offset < stackMachine.getAssemblySize(); ++offset) {
+        jumpsTaken += stackMachine.getOffsetProfile(offset).jumpsTaken;
+        jumpsNotTaken += stackMachine.getOffsetProfile(offset).jumpsNotTaken;
+    }
+    ASSERT_EQUALS(jumpsTaken, 9);
+    ASSERT_EQUALS(jumpsNotTaken, 1);
+}
+
+TEST(profiling, report_operationsLocatedByDisassemblyLabels) {
+    assembleSource(countdownSource);
+    ProfilingStackMachine stackMachine(asmTestFileName);
+    stackMachine.execute();
+
+    char* report = nullptr;
+    size_t reportSize = 0;
+    FILE* reportStream = open_memstream(&report, &reportSize);
+    int statusCode = stackMachine.writeReport(reportStream);
+    fclose(reportStream);
+
+    ASSERT_EQUALS(statusCode, 0);
+    ASSERT_NOT_NULL(strstr(report, "Profile: 73 operations"));
+    // JMPG LOOP is at the line 10 of the disassembly, 25 bytes after the label L0
+    ASSERT_NOT_NULL(strstr(report, "36     10 L0+25"));
+    ASSERT_NOT_NULL(strstr(report, "JMPG L0"));
+    ASSERT_NOT_NULL(strstr(report, "PUSH reg"));
+    free(report);
+}
@@ -3,7 +3,10 @@
  */
 #include "testlib.h"
 #include "../src/stack-machine.h"
+#include "../src/threaded-stack-machine.h"
+#include "../src/jit-stack-machine.h"
 #include "../src/stack-machine-utils.h"
+#include "../src/bytecode-image.h"
 
 TEST(failures, emptyStackPop_stackUnderflowErrorCodeReturned) {
     const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
@@ -139,3 +142,618 @@ TEST(failures, invalidRegister_invalidRegisterErrorCodeReturned) {
 
     ASSERT_EQUALS(exitCode, ERR_INVALID_REGISTER);
 }
+
+TEST(ram, adjacentAddressesWrite_valuesDoNotOverlap) {
+    RAM ram;
+    ram.setAt(0, 1.5);
+    ram.setAt(1, -2.5);
+    ram.setAt(ram.getSize() - 1, 3.5);
+
+    ASSERT_DOUBLE_EQUALS(ram.getAt(0), 1.5);
+    ASSERT_DOUBLE_EQUALS(ram.getAt(1), -2.5);
+    ASSERT_DOUBLE_EQUALS(ram.getAt(ram.getSize() - 1), 3.5);
+    ASSERT_DOUBLE_EQUALS(ram.getAt(2), 0.0);
+}
+
+TEST(ram, accessCyclesSet_cyclesAccountedForEachAccess) {
+    RAM ram;
+    ram.setAccessCycles(7);
+    ram.setAt(0, 1.0);
+    ram.getAt(0);
+    ram.getAt(1);
+
+    ASSERT_EQUALS(ram.getCycles(), 21ull);
+}
+
+TEST(ram, largeMemory_touchedValuesKeptAndClearedToZero) {
+    RAM ram(1 << 24);
+    ram.setAt(0, 1.5);
+    ram.setAt(ram.getSize() - 1, 2.5);
+    double lastValue = ram.getAt(ram.getSize() - 1);
+    ram.clear();
+    RAM tooLargeRam(RAM::MAX_SIZE + 1);
+
+    ASSERT_EQUALS(ram.getSize(), 1 << 24);
+    ASSERT_DOUBLE_EQUALS(lastValue, 2.5);
+    ASSERT_DOUBLE_EQUALS(ram.getAt(0), 0.0);
+    ASSERT_DOUBLE_EQUALS(ram.getAt(ram.getSize() - 1), 0.0);
+    ASSERT_EQUALS(tooLargeRam.getSize(), 0);
+    ASSERT_TRUE(!tooLargeRam.isValidAddress(0));
+}
+
+TEST(ram, configuredSize_immediateAddressesCheckedAgainstIt) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("PUSH 5\nPOP [100000]\nPUSH [100000]\nPOP [1]\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+    remove(asmTestFileName);
+    assemble(sourceTestFileName, asmTestFileName);
+    std::shared_ptr<const BytecodeImage> image = BytecodeImage::load(asmTestFileName);
+    StackMachine smallRamMachine(image);
+    StackMachine largeRamMachine(image);
+    largeRamMachine.getRam().resize(1 << 20);
+    RunOptions options;
+    options.ramSize = 1 << 20;
+
+    int smallRamExitCode = smallRamMachine.execute();
+    int largeRamExitCode = largeRamMachine.execute();
+    int runExitCode = run(asmTestFileName, options);
+
+    ASSERT_TRUE(image->getVerification().isVerified());
+    ASSERT_EQUALS(image->getVerification().requiredRamSize, 100001);
+    ASSERT_EQUALS(smallRamExitCode, ERR_INVALID_RAM_ADDRESS);
+    ASSERT_EQUALS(largeRamExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(largeRamMachine.getRam().getAt(1), 5.0);
+    ASSERT_EQUALS(runExitCode, HLT_OPCODE);
+}
+
+TEST(fusion, compareWithImmediateAndJump_fusedIntoSingleOperation) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("PUSH 1\nPUSH 2\nJMPL END\nPUSH 3\nEND:\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+    AssemblyOptions options;
+    options.fuseOperations = true;
+
+    int exitCode = assemble(sourceTestFileName, asmTestFileName, options);
+    unsigned char assembly[32] = {};
+    FILE* asmTestFile = fopen(asmTestFileName, "rb");
+    int assemblySize = (int)fread(assembly, sizeof(unsigned char), sizeof(assembly), asmTestFile);
+    fclose(asmTestFile);
+    int currentByteOffset = 0;
+    asmReadOperation(assembly, assemblySize, currentByteOffset);
+    asmReadOperand(assembly, assemblySize, currentByteOffset);
+    unsigned char fusedOpcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+
+    ASSERT_EQUALS(exitCode, 0);
+    ASSERT_EQUALS(fusedOpcode, CMP_IMM_JMPL_OPCODE);
+}
+
+TEST(fusion, fusedLoopOfUnverifiedProgram_sameResultWithOperationCache) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    // HLT is unreachable (program ends with RET on the empty call stack), so the program is not verified
+    fputs("LOOP:\nPUSH AX\nPUSH 1\nADD\nPOP AX\nPUSH AX\nPUSH 5\nJMPL LOOP\nPUSH AX\nPUSH AX\nMUL\nPOP [2]\nRET\n",
+          sourceTestFile);
+    fclose(sourceTestFile);
+    AssemblyOptions options;
+    options.fuseOperations = true;
+    remove(asmTestFileName);
+    assemble(sourceTestFileName, asmTestFileName, options);
+
+    StackMachine stackMachine(asmTestFileName);
+    int firstExitCode = stackMachine.execute();
+    double firstValue = stackMachine.getRam().getAt(2);
+    stackMachine.reset();
+    int secondExitCode = stackMachine.execute();
+
+    ASSERT_TRUE(!stackMachine.getImage()->getVerification().isVerified());
+    ASSERT_EQUALS(firstExitCode, ERR_STACK_UNDERFLOW);
+    ASSERT_EQUALS(secondExitCode, ERR_STACK_UNDERFLOW);
+    ASSERT_DOUBLE_EQUALS(firstValue, 25.0);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(2), 25.0);
+}
+
+TEST(fusion, labelBetweenOperations_operationsNotFused) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("PUSH 1\nDUP\nLOOP:\nADD\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+    AssemblyOptions options;
+    options.fuseOperations = true;
+
+    int exitCode = assemble(sourceTestFileName, asmTestFileName, options);
+    unsigned char assembly[32] = {};
+    FILE* asmTestFile = fopen(asmTestFileName, "rb");
+    int assemblySize = (int)fread(assembly, sizeof(unsigned char), sizeof(assembly), asmTestFile);
+    fclose(asmTestFile);
+    int currentByteOffset = 0;
+    asmReadOperation(assembly, assemblySize, currentByteOffset);
+    asmReadOperand(assembly, assemblySize, currentByteOffset);
+    unsigned char opcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+
+    ASSERT_EQUALS(exitCode, 0);
+    ASSERT_EQUALS(opcode, DUP_OPCODE);
+}
+
+TEST(fusion, tailRecursion_callAndReturnRewrittenIntoTailCall) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    // Counts AX down from 100000 by the recursion that calls itself right before the return
+    fputs("PUSH 100000\nPOP AX\nCALL F\nPUSH AX\nPOP [1]\nHLT\n"
+          "F:\nPUSH AX\nPUSH 0\nJMPE DONE\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nCALL F\nRET\nDONE:\nRET\n", sourceTestFile);
+    fclose(sourceTestFile);
+    AssemblyOptions options;
+    options.fuseOperations = true;
+    remove(asmTestFileName);
+    assemble(sourceTestFileName, asmTestFileName, options);
+
+    StackMachine stackMachine(asmTestFileName);
+    StackReserve initialCapacity = stackMachine.getStackCapacity();
+    stackMachine.setStatsCounting(true);
+    int exitCode = stackMachine.execute();
+    ThreadedStackMachine threadedMachine(asmTestFileName, false);
+    int threadedExitCode = threadedMachine.execute();
+
+    ASSERT_TRUE(stackMachine.getImage()->getVerification().isVerified());
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+    ASSERT_EQUALS(threadedExitCode, HLT_OPCODE);
+    ASSERT_DOUBLE_EQUALS(stackMachine.getRam().getAt(1), 0.0);
+    ASSERT_EQUALS(stackMachine.getStats().calls, 100001ull);
+    // Only the first call is left, so the call stack hasn't grown
+    ASSERT_EQUALS(stackMachine.getStackCapacity().callStackDepth, initialCapacity.callStackDepth);
+}
+
+TEST(fusion, fusedOperationDisassembled_originalOperationsWritten) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSHR_PUSHR_MUL_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)0, dummy);
+    asmWrite(asmTestFile, (unsigned char)1, dummy);
+    asmWrite(asmTestFile, (unsigned char)POPR_PUSHR_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)2, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = disassemble(asmTestFileName, sourceTestFileName);
+    char source[256] = "";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "r");
+    size_t sourceLength = fread(source, sizeof(char), sizeof(source) - 1, sourceTestFile);
+    fclose(sourceTestFile);
+
+    ASSERT_EQUALS(exitCode, 0);
+    ASSERT_EQUALS(strncmp(source, "PUSH AX\nPUSH BX\nMUL\nPOP CX\nPUSH CX\nHLT\n", sourceLength), 0);
+}
+
+TEST(fusion, fusedCompareOnEmptyStack_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)CMP_IMM_JMPE_OPCODE, dummy);
+    asmWrite(asmTestFile, 1.0, dummy);
+    asmWrite(asmTestFile, 0, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName);
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(assembler, jumpsToLabelsBeforeAndAfterJump_offsetsRelativeToOperand) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("BEGIN:\nJMP END\nJMP BEGIN\nEND:\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+
+    int exitCode = assemble(sourceTestFileName, asmTestFileName);
+    unsigned char assembly[32] = {};
+    FILE* asmTestFile = fopen(asmTestFileName, "rb");
+    int assemblySize = (int)fread(assembly, sizeof(unsigned char), sizeof(assembly), asmTestFile);
+    fclose(asmTestFile);
+    int currentByteOffset = 0;
+    asmReadOperation(assembly, assemblySize, currentByteOffset);
+    int forwardJumpOffset = asmReadJumpOffset(assembly, assemblySize, currentByteOffset);
+    asmReadOperation(assembly, assemblySize, currentByteOffset);
+    int backwardJumpOffset = asmReadJumpOffset(assembly, assemblySize, currentByteOffset);
+    unsigned char opcode = asmReadOperation(assembly, assemblySize, currentByteOffset);
+
+    ASSERT_EQUALS(exitCode, 0);
+    ASSERT_EQUALS(forwardJumpOffset, 9);  // END is at 10, offset operand is at 1
+    ASSERT_EQUALS(backwardJumpOffset, -6); // BEGIN is at 0, offset operand is at 6
+    ASSERT_EQUALS(opcode, HLT_OPCODE);
+}
+
+TEST(assembler, jumpToUndefinedLabel_invalidLabelErrorCodeReturned) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("PUSH 1\nJMP END\nEND_OF_CODE:\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+
+    int exitCode = assemble(sourceTestFileName, asmTestFileName);
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_LABEL);
+}
+
+/**
+ * Writes the source code with jumps between labels that are far from each other, so they are in different chunks.
+ * @param[in] sourceFileName source code file name
+ * @param[in] blocksNumber   number of labeled blocks
+ * @param[in] duplicateLabel shows if the last block has the same label as the first one
+ */
+static void writeLargeSource(const char* sourceFileName, int blocksNumber, bool duplicateLabel) {
+    FILE* sourceFile = fopen(sourceFileName, "w");
+    for (int i = 0; i < blocksNumber; ++i) {
+        int label = (duplicateLabel && (i == blocksNumber - 1)) ? 0 : i;
+        fprintf(sourceFile, "L%d:\nPUSH %d\nJMPE L%d\nPUSH AX\nPUSH BX\nMUL\n", label, i, blocksNumber - 1 - i);
+    }
+    fputs("HLT\n", sourceFile);
+    fclose(sourceFile);
+}
+
+static std::vector<char> readWholeFile(const char* fileName) {
+    std::vector<char> content;
+    FILE* file = fopen(fileName, "rb");
+    int c = 0;
+    while ((c = fgetc(file)) != EOF) content.push_back((char)c);
+    fclose(file);
+    return content;
+}
+
+TEST(assembler, largeSourceAssembledInChunks_sameAsSingleThreadAssembly) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    writeLargeSource(sourceTestFileName, 40000, false);
+    AssemblyOptions options;
+    options.fuseOperations = true;
+
+    options.threadsNumber = 1;
+    int singleThreadExitCode = assemble(sourceTestFileName, asmTestFileName, options);
+    std::vector<char> singleThreadAssembly = readWholeFile(asmTestFileName);
+    options.threadsNumber = 4;
+    int chunksExitCode = assemble(sourceTestFileName, asmTestFileName, options);
+    std::vector<char> chunksAssembly = readWholeFile(asmTestFileName);
+
+    ASSERT_EQUALS(singleThreadExitCode, 0);
+    ASSERT_EQUALS(chunksExitCode, 0);
+    ASSERT_TRUE(singleThreadAssembly == chunksAssembly);
+}
+
+TEST(assembler, labelRedefinedInOtherChunk_invalidLabelErrorCodeReturned) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    writeLargeSource(sourceTestFileName, 40000, true);
+    AssemblyOptions options;
+    options.threadsNumber = 4;
+
+    int exitCode = assemble(sourceTestFileName, asmTestFileName, options);
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_LABEL);
+}
+
+TEST(disassembler, largeAssemblyDisassembled_sameAssemblyAfterReassembly) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    const char* disasmTestFileName = "DISASM_TEST_FILE_NAME.txt";
+    writeLargeSource(sourceTestFileName, 40000, false);
+
+    int assemblyExitCode = assemble(sourceTestFileName, asmTestFileName);
+    std::vector<char> assembly = readWholeFile(asmTestFileName);
+    int disassemblyExitCode = disassemble(asmTestFileName, disasmTestFileName);
+    int reassemblyExitCode = assemble(disasmTestFileName, asmTestFileName);
+    std::vector<char> reassembly = readWholeFile(asmTestFileName);
+
+    ASSERT_EQUALS(assemblyExitCode, 0);
+    ASSERT_EQUALS(disassemblyExitCode, 0);
+    ASSERT_EQUALS(reassemblyExitCode, 0);
+    ASSERT_TRUE(assembly == reassembly);
+}
+
+TEST(operations, namesOfOperations_sameOperationCodesParsed) {
+    int mnemonicsNumber = 0;
+    for (unsigned int opcode = 0; opcode < 256; ++opcode) {
+        const char* name = getOperationNameByOpcode((unsigned char)opcode);
+        if ((name == nullptr) || isFusedOperation((unsigned char)opcode)) continue;
+        if ((opcode & (IS_REG_OP_MASK | IS_RAM_OP_MASK)) != 0) continue;
+
+        ASSERT_EQUALS(getOpcodeByOperationName(name), opcode);
+        ++mnemonicsNumber;
+    }
+
+    ASSERT_EQUALS(mnemonicsNumber, 41);
+    ASSERT_EQUALS(getOpcodeByOperationName("DUP_ADD"), ERR_INVALID_OPERATION);
+    ASSERT_EQUALS(getOpcodeByOperationName("PUSHX"), ERR_INVALID_OPERATION);
+    ASSERT_EQUALS(getOpcodeByOperationName(""), ERR_INVALID_OPERATION);
+}
+
+TEST(operations, namesOfRegisters_sameRegisterNumbersParsed) {
+    for (unsigned char reg = 0; reg < REGISTERS_NUMBER; ++reg) {
+        ASSERT_EQUALS(getRegisterNumberByName(getRegisterNameByNumber(reg)), reg);
+    }
+
+    ASSERT_NULL(getRegisterNameByNumber(REGISTERS_NUMBER));
+    ASSERT_EQUALS(getRegisterNumberByName("EX"), ERR_INVALID_REGISTER);
+    ASSERT_EQUALS(getRegisterNumberByName("AXX"), ERR_INVALID_REGISTER);
+}
+
+TEST(labelTable, manyLabels_offsetsFoundAfterGrowth) {
+    LabelTable labelTable;
+    char labelLine[32] = "";
+    for (unsigned int i = 0; i < 1000; ++i) {
+        sprintf(labelLine, "label%u:", i);
+        ASSERT_EQUALS(labelTable.addLabel(labelLine, 10 * i), 0);
+    }
+
+    LabelTable labelTableCopy(labelTable);
+    for (unsigned int i = 0; i < 1000; ++i) {
+        sprintf(labelLine, "label%u", i);
+        ASSERT_EQUALS(labelTable.getLabelOffset(labelLine), (int)(10 * i));
+        ASSERT_EQUALS(labelTableCopy.getLabelOffset(labelLine), (int)(10 * i));
+    }
+
+    ASSERT_EQUALS(labelTable.addLabel("label7:", 0), ERR_INVALID_LABEL);
+    ASSERT_EQUALS(labelTable.getLabelOffset("label1000"), -1);
+    ASSERT_EQUALS(labelTable.getLabelOffset("label"), -1);
+}
+
+static void assembleBudgetSource(const char* source, const char* asmTestFileName) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs(source, sourceTestFile);
+    fclose(sourceTestFile);
+    remove(asmTestFileName);
+    assemble(sourceTestFileName, asmTestFileName);
+}
+
+TEST(budget, infiniteLoop_budgetExhaustedAndExecutionResumed) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource("PUSH 0\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nADD\nPOP AX\nJMP LOOP\nHLT\n", asmTestFileName);
+    StackMachine stackMachine(asmTestFileName);
+    ExecutionBudget budget;
+    budget.instructions = 102;
+    stackMachine.setBudget(budget);
+    stackMachine.setStatsCounting(true);
+
+    int firstExitCode = stackMachine.execute();
+    int secondExitCode = stackMachine.execute();
+    const ExecutionStats& stats = stackMachine.getStats();
+
+    ASSERT_EQUALS(firstExitCode, ERR_BUDGET_EXHAUSTED);
+    ASSERT_EQUALS(secondExitCode, ERR_BUDGET_EXHAUSTED);
+    ASSERT_EQUALS(stats.instructions, 204ull);
+    ASSERT_EQUALS(stats.jumpsTaken, 40ull);
+    ASSERT_EQUALS(stats.calls, 0ull);
+}
+
+TEST(budget, timeLimitOfInfiniteLoop_budgetExhaustedErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource("LOOP:\nPUSH 1\nPOP AX\nJMP LOOP\nHLT\n", asmTestFileName);
+    RunOptions options;
+    options.engine = TOS_CACHING_ENGINE;
+    options.budget.milliseconds = 10;
+
+    int exitCode = run(asmTestFileName, options);
+
+    ASSERT_EQUALS(exitCode, ERR_BUDGET_EXHAUSTED);
+}
+
+TEST(budget, hotLoopWithInstructionsLimit_everyEngineStopsAtTheSameOperations) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    // Sums numbers from 999 to 0, so that the loop is compiled by the jit engine
+    assembleBudgetSource("PUSH 1000\nPOP AX\nLOOP:\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH BX\nPUSH AX\nADD\nPOP BX\n"
+                         "PUSH AX\nPUSH 0\nJMPG LOOP\nPUSH BX\nOUT\nHLT\n", asmTestFileName);
+    std::unique_ptr<StackMachine> machines[] = {
+        std::unique_ptr<StackMachine>(new StackMachine(asmTestFileName)),
+        std::unique_ptr<StackMachine>(new ThreadedStackMachine(asmTestFileName, false)),
+        std::unique_ptr<StackMachine>(new ThreadedStackMachine(asmTestFileName, true)),
+        std::unique_ptr<StackMachine>(new JitStackMachine(asmTestFileName, 2)),
+    };
+    ExecutionBudget budget;
+    budget.instructions = 37;
+
+    for (std::unique_ptr<StackMachine>& machine : machines) {
+        std::vector<double> outputs;
+        machine->getIO().setMemory(nullptr, 0, &outputs);
+        machine->setBudget(budget);
+
+        // The program takes 11005 operations, so the last of 298 calls executes 16 of them
+        int callsNumber = 1;
+        int exitCode = machine->execute();
+        while (exitCode == ERR_BUDGET_EXHAUSTED) {
+            ++callsNumber;
+            exitCode = machine->execute();
+        }
+
+        ASSERT_EQUALS(exitCode, HLT_OPCODE);
+        ASSERT_EQUALS(callsNumber, 298);
+        ASSERT_EQUALS(outputs.size(), 1u);
+        ASSERT_DOUBLE_EQUALS(outputs[0], 499500.0);
+        ASSERT_EQUALS(machine->getStats().instructions, 0ull);
+    }
+}
+
+TEST(budget, timeLimitOfInfiniteLoop_budgetExhaustedOnEveryEngine) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource("LOOP:\nPUSH AX\nPUSH 1\nADD\nPOP AX\nJMP LOOP\nHLT\n", asmTestFileName);
+    std::unique_ptr<StackMachine> machines[] = {
+        std::unique_ptr<StackMachine>(new ThreadedStackMachine(asmTestFileName, false)),
+        std::unique_ptr<StackMachine>(new ThreadedStackMachine(asmTestFileName, true)),
+        std::unique_ptr<StackMachine>(new JitStackMachine(asmTestFileName, 2)),
+    };
+    ExecutionBudget budget;
+    budget.milliseconds = 10;
+
+    for (std::unique_ptr<StackMachine>& machine : machines) {
+        machine->setBudget(budget);
+
+        ASSERT_EQUALS(machine->execute(), ERR_BUDGET_EXHAUSTED);
+        ASSERT_EQUALS(machine->execute(), ERR_BUDGET_EXHAUSTED);
+    }
+}
+
+TEST(budget, statsCounted_sameStatsOnReferenceAndThreadedEngines) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource("PUSH 3\nPOP AX\nLOOP:\nCALL STORE\nPUSH AX\nPUSH 1\nSUB\nPOP AX\nPUSH AX\nPUSH 0\n"
+                         "JMPG LOOP\nHLT\nSTORE:\nPUSH [AX]\nPUSH AX\nADD\nPOP [AX]\nRET\n", asmTestFileName);
+    StackMachine referenceMachine(asmTestFileName);
+    ThreadedStackMachine threadedMachine(asmTestFileName, false);
+    referenceMachine.setStatsCounting(true);
+    threadedMachine.setStatsCounting(true);
+
+    int referenceExitCode = referenceMachine.execute();
+    int threadedExitCode = threadedMachine.execute();
+    const ExecutionStats& referenceStats = referenceMachine.getStats();
+    const ExecutionStats& threadedStats = threadedMachine.getStats();
+
+    ASSERT_EQUALS(referenceExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(threadedExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(referenceStats.instructions, 42ull);
+    ASSERT_EQUALS(referenceStats.jumpsTaken, 5ull);
+    ASSERT_EQUALS(referenceStats.calls, 3ull);
+    ASSERT_EQUALS(referenceStats.ramReads, 3ull);
+    ASSERT_EQUALS(referenceStats.ramWrites, 3ull);
+    ASSERT_EQUALS(threadedStats.instructions, referenceStats.instructions);
+    ASSERT_EQUALS(threadedStats.jumpsTaken, referenceStats.jumpsTaken);
+}
+
+TEST(vectorOperations, operationsOnRamRanges_sameResultsOnReferenceAndThreadedEngines) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    // Fills two arrays of 10 values, adds and multiplies them, then sums them, copies the result and doubles it with the shift
+    assembleBudgetSource("PUSH 0\nPUSH 2\nPUSH 10\nVFILL\nPUSH 10\nPUSH 3\nPUSH 10\nVFILL\n"
+                         "PUSH 20\nPUSH 0\nPUSH 10\nPUSH 10\nVADD\nPUSH 30\nPUSH 20\nPUSH 10\nPUSH 10\nVMUL\n"
+                         "PUSH 30\nPUSH 10\nVSUM\nOUT\nPUSH 0\nPUSH 10\nPUSH 10\nVDOT\nOUT\n"
+                         "PUSH 7\nPOP [40]\nPUSH 41\nPUSH 30\nPUSH 3\nVCOPY\nPUSH 41\nPUSH 40\nPUSH 40\nPUSH 4\nVADD\n"
+                         "PUSH [41]\nOUT\nPUSH [44]\nOUT\nHLT\n", asmTestFileName);
+    StackMachine referenceMachine(asmTestFileName);
+    ThreadedStackMachine threadedMachine(asmTestFileName, true);
+    std::vector<double> referenceOutputs, threadedOutputs;
+    referenceMachine.getIO().setMemory(nullptr, 0, &referenceOutputs);
+    threadedMachine.getIO().setMemory(nullptr, 0, &threadedOutputs);
+    referenceMachine.setStatsCounting(true);
+
+    int referenceExitCode = referenceMachine.execute();
+    int threadedExitCode = threadedMachine.execute();
+    const ExecutionStats& stats = referenceMachine.getStats();
+
+    ASSERT_EQUALS(referenceExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(threadedExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(referenceOutputs.size(), 4u);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[0], 150.0);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[1], 60.0);
+    // [40..44] = 7, 15, 15, 15, 0 before the doubling, sources are read before the overlapping destination is written
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[2], 14.0);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[3], 30.0);
+    ASSERT_TRUE(threadedOutputs == referenceOutputs);
+    ASSERT_EQUALS(stats.ramReads, 40ull + 10 + 20 + 3 + 8 + 2);
+    ASSERT_EQUALS(stats.ramWrites, 20ull + 20 + 1 + 3 + 4);
+}
+
+TEST(vectorOperations, rangeOutOfRam_invalidRamAddressErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource("PUSH 1000\nPUSH 0\nPUSH 100\nVCOPY\nHLT\n", asmTestFileName);
+    int tooLongExitCode = run(asmTestFileName);
+    assembleBudgetSource("PUSH 0\nPUSH -1\nVSUM\nHLT\n", asmTestFileName);
+    int negativeCountExitCode = run(asmTestFileName);
+    assembleBudgetSource("PUSH 0\nPUSH 1024\nVSUM\nPOP\nPUSH 1\nVSUM\nHLT\n", asmTestFileName);
+    int wholeRamExitCode = run(asmTestFileName);
+
+    ASSERT_EQUALS(tooLongExitCode, ERR_INVALID_RAM_ADDRESS);
+    ASSERT_EQUALS(negativeCountExitCode, ERR_INVALID_RAM_ADDRESS);
+    ASSERT_EQUALS(wholeRamExitCode, ERR_STACK_UNDERFLOW);
+}
+
+// Sums squares of 0..9 in the integer loop, then checks truncation of FTOI and exact integer comparison
+static const char* const integerTestProgram =
+    "IPUSH 0\nIPOP IAX\nIPUSH 0\nIPOP IBX\nLOOP:\nIPUSH IBX\nIPUSH IAX\nIPUSH IAX\nIMUL\nIADD\nIPOP IBX\n"
+    "IPUSH IAX\nIPUSH 1\nIADD\nIPOP IAX\nIPUSH IAX\nIPUSH 10\nIJMPL LOOP\nIPUSH IBX\nITOF\nOUT\n"
+    "PUSH 7.9\nFTOI\nPUSH -2.5\nFTOI\nIMUL\nITOF\nOUT\nIPUSH 3\nIPUSH 5\nISUB\nITOF\nOUT\n"
+    "PUSH 2.9\nFTOI\nPUSH 2.1\nFTOI\nIJMPE EQUAL\nPUSH 0\nOUT\n"
+    "EQUAL:\nPUSH 1e300\nFTOI\nIPUSH 1\nIADD\nITOF\nOUT\nIPUSH -9223372036854775808\nIPOP\nHLT\n";
+
+TEST(integerOperations, loopAndTruncatedOperands_sameResultsOnReferenceAndThreadedEngines) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource(integerTestProgram, asmTestFileName);
+    StackMachine referenceMachine(asmTestFileName);
+    ThreadedStackMachine threadedMachine(asmTestFileName, false);
+    ThreadedStackMachine tosCachingMachine(asmTestFileName, true);
+    std::vector<double> referenceOutputs, threadedOutputs, tosCachingOutputs;
+    referenceMachine.getIO().setMemory(nullptr, 0, &referenceOutputs);
+    threadedMachine.getIO().setMemory(nullptr, 0, &threadedOutputs);
+    tosCachingMachine.getIO().setMemory(nullptr, 0, &tosCachingOutputs);
+
+    int referenceExitCode = referenceMachine.execute();
+    int threadedExitCode = threadedMachine.execute();
+    int tosCachingExitCode = tosCachingMachine.execute();
+
+    ASSERT_EQUALS(referenceExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(threadedExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(tosCachingExitCode, HLT_OPCODE);
+    ASSERT_EQUALS(referenceOutputs.size(), 4u);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[0], 285.0);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[1], -14.0);
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[2], -2.0);
+    // Value out of int64 range is taken as 0
+    ASSERT_DOUBLE_EQUALS(referenceOutputs[3], 1.0);
+    ASSERT_TRUE(threadedOutputs == referenceOutputs);
+    ASSERT_TRUE(tosCachingOutputs == referenceOutputs);
+}
+
+TEST(integerOperations, untypedOperationsOnIntegerValues_sameAssemblyAsIntegerOperations) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    // Literals, arithmetic and jumps take the type of the values they meet within the label block. Values that
+    // cross the label (PUSH 0 before LOOP) are floating point
+    assembleBudgetSource("PUSH 0\nPOP IAX\nPUSH 0\nLOOP:\nPUSH IAX\nPUSH 1\nADD\nPOP IAX\nPUSH IAX\nPUSH 5\n"
+                         "JMPL LOOP\nPUSH 2\nPUSH 3\nMUL\nADD\nOUT\nPUSH 7\nPOP\nHLT\n", asmTestFileName);
+    std::vector<char> inferredAssembly = readWholeFile(asmTestFileName);
+    assembleBudgetSource("IPUSH 0\nIPOP IAX\nPUSH 0\nLOOP:\nIPUSH IAX\nIPUSH 1\nIADD\nIPOP IAX\nIPUSH IAX\n"
+                         "IPUSH 5\nIJMPL LOOP\nPUSH 2\nPUSH 3\nMUL\nADD\nOUT\nPUSH 7\nPOP\nHLT\n", asmTestFileName);
+    std::vector<char> explicitAssembly = readWholeFile(asmTestFileName);
+
+    ASSERT_TRUE(!inferredAssembly.empty());
+    ASSERT_TRUE(inferredAssembly == explicitAssembly);
+}
+
+TEST(integerOperations, mistypedOperands_errorCodesReturned) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    const char* sources[] = {"IPUSH 1.5\nHLT\n", "IPUSH AX\nHLT\n", "ADD IAX\nHLT\n", "PUSH [IAX]\nHLT\n",
+                             "IPUSH 9223372036854775808\nHLT\n"};
+    const unsigned char expectedExitCodes[] = {ERR_INVALID_OPERATION, ERR_INVALID_REGISTER, ERR_INVALID_OPERATION,
+                                               ERR_INVALID_OPERATION, ERR_INVALID_OPERATION};
+
+    for (int i = 0; i < 5; ++i) {
+        FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+        fputs(sources[i], sourceTestFile);
+        fclose(sourceTestFile);
+
+        int exitCode = assemble(sourceTestFileName, asmTestFileName);
+
+        ASSERT_EQUALS(exitCode, expectedExitCodes[i]);
+    }
+}
+
+TEST(integerOperations, integerAssemblyDisassembled_sameAssemblyAfterReassembly) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    const char* disasmTestFileName = "DISASM_TEST_FILE_NAME.txt";
+    assembleBudgetSource(integerTestProgram, asmTestFileName);
+    std::vector<char> assembly = readWholeFile(asmTestFileName);
+
+    int disassemblyExitCode = disassemble(asmTestFileName, disasmTestFileName);
+    int reassemblyExitCode = assemble(disasmTestFileName, asmTestFileName);
+    std::vector<char> reassembly = readWholeFile(asmTestFileName);
+
+    ASSERT_EQUALS(disassemblyExitCode, 0);
+    ASSERT_EQUALS(reassemblyExitCode, 0);
+    ASSERT_TRUE(assembly == reassembly);
+}
@@ -0,0 +1,318 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include <cstring>
+#include "../src/stack-machine.h"
+#include "../src/threaded-stack-machine.h"
+#include "../src/jit-stack-machine.h"
+#include "../src/stack-machine-utils.h"
+
+static RunOptions threadedRunOptions() {
+    RunOptions options;
+    options.engine = THREADED_ENGINE;
+    return options;
+}
+
+static RunOptions tosCachingRunOptions() {
+    RunOptions options;
+    options.engine = TOS_CACHING_ENGINE;
+    return options;
+}
+
+TEST(threaded, singleOperandStackAdd_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 0.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)ADD_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(threaded, emptyStackPopRegister_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)POPR_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)0, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(threaded, invalidOpcode_invalidOperationErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)ERR_INVALID_OPERATION, dummy); // ERR_INVALID_OPERATION is absolutely invalid opcode
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_OPERATION);
+}
+
+TEST(threaded, invalidRegister_invalidRegisterErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSHR_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)(REGISTERS_NUMBER + 1), dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_REGISTER);
+}
+
+TEST(threaded, jumpOutOfAssembly_invalidOperationErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)JMP_OPCODE, dummy);
+    asmWrite(asmTestFile, 100, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_INVALID_OPERATION);
+}
+
+TEST(threaded, callAndReturn_programFinishedSuccessfully) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int offset = 0;
+    asmWrite(asmTestFile, (unsigned char)CALL_OPCODE, offset);
+    asmWrite(asmTestFile, 5, offset); // Jump over HLT to the RET operation
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)RET_OPCODE, offset);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+}
+
+TEST(threaded, jumpIntoOperandBytes_executionContinuedByReferenceEngine) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int offset = 0;
+    asmWrite(asmTestFile, (unsigned char)JMP_OPCODE, offset);
+    asmWrite(asmTestFile, 5, offset); // Jump into the register operand of PUSH AX, which is an ADD operation byte
+    asmWrite(asmTestFile, (unsigned char)PUSHR_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)ADD_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, offset);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(tosCaching, singleOperandStackAdd_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 0.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)ADD_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, tosCachingRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(tosCaching, popAfterConsumedOperands_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 1.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 2.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)MUL_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)DUP_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)ADD_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)POP_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)POP_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, tosCachingRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(tosCaching, conditionalJumpOnSingleOperand_stackUnderflowErrorCodeReturned) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 1.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)JMPE_OPCODE, dummy);
+    asmWrite(asmTestFile, 4, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, tosCachingRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(tosCaching, valueStoredToRamAndLoadedBack_programFinishedSuccessfully) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int dummy = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, dummy);
+    asmWrite(asmTestFile, 1.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)POPM_OPCODE, dummy); // Processed outside of the dispatch loop
+    asmWrite(asmTestFile, 3.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)PUSHM_OPCODE, dummy);
+    asmWrite(asmTestFile, 3.0, dummy);
+    asmWrite(asmTestFile, (unsigned char)POP_OPCODE, dummy);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, dummy);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, tosCachingRunOptions());
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+}
+
+TEST(threaded, jumpToSecondOperationOfFusiblePair_pairNotFused) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int offset = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSH_OPCODE, offset);
+    asmWrite(asmTestFile, 1.0, offset);
+    asmWrite(asmTestFile, (unsigned char)JMP_OPCODE, offset);
+    asmWrite(asmTestFile, 5, offset); // Jump over DUP to ADD, so only one value is on the stack
+    asmWrite(asmTestFile, (unsigned char)DUP_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)ADD_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, offset);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, threadedRunOptions());
+
+    ASSERT_EQUALS(exitCode, ERR_STACK_UNDERFLOW);
+}
+
+TEST(tosCaching, fusedOperations_programFinishedSuccessfully) {
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* asmTestFile = fopen(asmTestFileName, "wb");
+    int offset = 0;
+    asmWrite(asmTestFile, (unsigned char)PUSHR_PUSHR_MUL_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)0, offset);
+    asmWrite(asmTestFile, (unsigned char)1, offset);
+    asmWrite(asmTestFile, (unsigned char)DUP_ADD_OPCODE, offset);
+    asmWrite(asmTestFile, (unsigned char)CMP_IMM_JMPE_OPCODE, offset);
+    asmWrite(asmTestFile, 0.0, offset);
+    asmWrite(asmTestFile, 5, offset); // Jump over the invalid operation to HLT, because registers are zero
+    asmWrite(asmTestFile, (unsigned char)ERR_INVALID_OPERATION, offset);
+    asmWrite(asmTestFile, (unsigned char)HLT_OPCODE, offset);
+    fflush(asmTestFile);
+    fclose(asmTestFile);
+
+    int exitCode = run(asmTestFileName, tosCachingRunOptions());
+
+    ASSERT_EQUALS(exitCode, HLT_OPCODE);
+}
+
+/**
+ * Runs the assembled source on the given machine and gets it's final state.
+ */
+static TraceEnd getFinalState(StackMachine& machine) {
+    return machine.getTraceEnd(machine.execute());
+}
+
+TEST(engines, failedPrograms_samePcAndStackAfterErrorOnEveryEngine) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    // Underflow of the binary operation, of RET, of the conditional jump, that the threaded engine fuses on load,
+    // and of the integer operation
+    const char* sources[] = {"PUSH 1\nADD\nHLT\n", "PUSH 2\nPOP AX\nRET\nHLT\n",
+                             "PUSH 3\nPOP AX\nPUSH 5\nJMPL END\nEND:\nHLT\n",
+                             "IPUSH 7\nIPOP IAX\nIPUSH 1\nIADD\nHLT\n"};
+    const int expectedPcs[] = {10, 12, 25, 21};
+
+    for (int i = 0; i < 4; ++i) {
+        FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+        fputs(sources[i], sourceTestFile);
+        fclose(sourceTestFile);
+        remove(asmTestFileName);
+        assemble(sourceTestFileName, asmTestFileName);
+
+        StackMachine referenceMachine(asmTestFileName);
+        ThreadedStackMachine threadedMachine(asmTestFileName, false);
+        ThreadedStackMachine tosCachingMachine(asmTestFileName, true);
+        JitStackMachine jitMachine(asmTestFileName);
+        TraceEnd referenceEnd = getFinalState(referenceMachine);
+        TraceEnd threadedEnd = getFinalState(threadedMachine);
+        TraceEnd tosCachingEnd = getFinalState(tosCachingMachine);
+        TraceEnd jitEnd = getFinalState(jitMachine);
+
+        ASSERT_EQUALS(referenceEnd.status, (uint32_t)ERR_STACK_UNDERFLOW);
+        ASSERT_EQUALS(referenceEnd.pc, expectedPcs[i]);
+        ASSERT_EQUALS(memcmp(&threadedEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+        ASSERT_EQUALS(memcmp(&tosCachingEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+        ASSERT_EQUALS(memcmp(&jitEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+    }
+}
+
+TEST(engines, fusedCompareOnEmptyStack_sameStateAsUnfusedOperationsOnEveryEngine) {
+    const char* sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+    const char* asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs("PUSH 5\nJMPL END\nEND:\nHLT\n", sourceTestFile);
+    fclose(sourceTestFile);
+
+    for (bool fuseOperations : {false, true}) {
+        remove(asmTestFileName);
+        AssemblyOptions options;
+        options.fuseOperations = fuseOperations;
+        assemble(sourceTestFileName, asmTestFileName, options);
+
+        StackMachine referenceMachine(asmTestFileName);
+        ThreadedStackMachine threadedMachine(asmTestFileName, false);
+        ThreadedStackMachine tosCachingMachine(asmTestFileName, true);
+        JitStackMachine jitMachine(asmTestFileName);
+        TraceEnd referenceEnd = getFinalState(referenceMachine);
+        TraceEnd threadedEnd = getFinalState(threadedMachine);
+        TraceEnd tosCachingEnd = getFinalState(tosCachingMachine);
+        TraceEnd jitEnd = getFinalState(jitMachine);
+
+        // Immediate is left on the stack, and pc is past the jump (fused operation is 1 byte shorter)
+        ASSERT_EQUALS(referenceEnd.status, (uint32_t)ERR_STACK_UNDERFLOW);
+        ASSERT_EQUALS(referenceEnd.pc, fuseOperations ? 13 : 14);
+        ASSERT_EQUALS(referenceEnd.operandStackSize, 1u);
+        ASSERT_DOUBLE_EQUALS(referenceEnd.topValue, 5.0);
+        ASSERT_EQUALS(memcmp(&threadedEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+        ASSERT_EQUALS(memcmp(&tosCachingEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+        ASSERT_EQUALS(memcmp(&jitEnd, &referenceEnd, sizeof(TraceEnd)), 0);
+    }
+}
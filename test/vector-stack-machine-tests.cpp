@@ -0,0 +1,184 @@
+/**
+ * @file
+ */
+#include "testlib.h"
+#include "../src/vector-stack-machine.h"
+#include "../src/stack-machine-utils.h"
+
+static const char* const sourceTestFileName = "SOURCE_TEST_FILE_NAME.txt";
+static const char* const asmTestFileName = "ASM_TEST_FILE_NAME.txt";
+
+static void assembleSource(const char* source) {
+    FILE* sourceTestFile = fopen(sourceTestFileName, "w");
+    fputs(source, sourceTestFile);
+    fclose(sourceTestFile);
+
+    assemble(sourceTestFileName, asmTestFileName);
+}
+
+// Outputs absolute value of the input, using the conditional jump
+static const char* const absSource =
+    "IN\n"
+    "POP AX\n"
+    "PUSH AX\n"
+    "PUSH 0\n"
+    "JMPL NEGATIVE\n"
+    "PUSH AX\n"
+    "OUT\n"
+    "HLT\n"
+    "NEGATIVE:\n"
+    "PUSH 0\n"
+    "PUSH AX\n"
+    "SUB\n"
+    "OUT\n"
+    "HLT\n";
+
+TEST(vectorLanes, uniformProgram_eachLaneComputed) {
+    assembleSource(
+        "IN\n"
+        "IN\n"
+        "MUL\n"
+        "PUSH 1\n"
+        "ADD\n"
+        "OUT\n"
+        "HLT\n");
+    VectorStackMachine<4> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{1, 2}, {3, 4}, {5, 6}, {7, 8}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    ASSERT_EQUALS(outputs.size(), 4);
+    for (size_t lane = 0; lane < 4; ++lane) {
+        ASSERT_EQUALS(statuses[lane], HLT_OPCODE);
+        ASSERT_EQUALS(outputs[lane].size(), 1);
+        ASSERT_DOUBLE_EQUALS(outputs[lane][0], inputs[lane][0] * inputs[lane][1] + 1);
+    }
+}
+
+TEST(vectorLanes, divergentJump_eachLaneTakesOwnBranch) {
+    assembleSource(absSource);
+    VectorStackMachine<8> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{-1}, {2}, {-3}, {4}, {5}, {-6}, {7}, {-8}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    for (size_t lane = 0; lane < 8; ++lane) {
+        ASSERT_EQUALS(statuses[lane], HLT_OPCODE);
+        ASSERT_EQUALS(outputs[lane].size(), 1);
+        ASSERT_DOUBLE_EQUALS(outputs[lane][0], fabs(inputs[lane][0]));
+    }
+}
+
+TEST(vectorLanes, partialBatch_onlyGivenLanesReported) {
+    assembleSource(absSource);
+    VectorStackMachine<4> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{-5}, {6}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    ASSERT_EQUALS(outputs.size(), 2);
+    ASSERT_EQUALS(statuses.size(), 2);
+    ASSERT_DOUBLE_EQUALS(outputs[0][0], 5.0);
+    ASSERT_DOUBLE_EQUALS(outputs[1][0], 6.0);
+}
+
+TEST(vectorLanes, errorInOneBranch_onlyFailedLanesHaveErrorCode) {
+    assembleSource(
+        "IN\n"
+        "PUSH 0\n"
+        "JMPG POSITIVE\n"
+        "POP\n"
+        "HLT\n"
+        "POSITIVE:\n"
+        "PUSH 1\n"
+        "OUT\n"
+        "HLT\n");
+    VectorStackMachine<4> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{1}, {-1}, {2}, {-2}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    ASSERT_EQUALS(statuses[0], HLT_OPCODE);
+    ASSERT_EQUALS(statuses[1], ERR_STACK_UNDERFLOW);
+    ASSERT_EQUALS(statuses[2], HLT_OPCODE);
+    ASSERT_EQUALS(statuses[3], ERR_STACK_UNDERFLOW);
+    ASSERT_EQUALS(outputs[0].size(), 1);
+    ASSERT_EQUALS(outputs[1].size(), 0);
+}
+
+TEST(vectorLanes, integerLoopWithDifferentCounts_eachLaneComputed) {
+    // Outputs 2^N in the integer loop, that runs N times
+    assembleSource(
+        "IN\n"
+        "FTOI\n"
+        "POP IAX\n"
+        "IPUSH 1\n"
+        "LOOP:\n"
+        "PUSH 2\n"
+        "MUL\n"
+        "PUSH IAX\n"
+        "PUSH 1\n"
+        "SUB\n"
+        "POP IAX\n"
+        "PUSH IAX\n"
+        "PUSH 0\n"
+        "JMPG LOOP\n"
+        "ITOF\n"
+        "OUT\n"
+        "HLT\n");
+    VectorStackMachine<4> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{1}, {3}, {5.5}, {10}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    const double expectedOutputs[] = {2, 8, 32, 1024};
+    for (size_t lane = 0; lane < 4; ++lane) {
+        ASSERT_EQUALS(statuses[lane], HLT_OPCODE);
+        ASSERT_EQUALS(outputs[lane].size(), 1);
+        ASSERT_DOUBLE_EQUALS(outputs[lane][0], expectedOutputs[lane]);
+    }
+}
+
+TEST(vectorLanes, vectorOperationsWithDifferentRanges_eachLaneComputedOverOwnRanges) {
+    // Fills N addresses with V, copies them one address further (overlapping ranges), adds both ranges, then writes
+    // the sum and the dot product of them. Negative N is invalid range
+    assembleSource(
+        "IN\nPOP AX\nIN\nPOP BX\n"
+        "PUSH 0\nPUSH BX\nPUSH AX\nVFILL\n"
+        "PUSH 1\nPUSH 0\nPUSH AX\nVCOPY\n"
+        "PUSH 0\nPUSH 0\nPUSH 1\nPUSH AX\nVADD\n"
+        "PUSH 0\nPUSH AX\nVSUM\nOUT\n"
+        "PUSH 0\nPUSH 1\nPUSH AX\nVDOT\nOUT\n"
+        "HLT\n");
+    VectorStackMachine<4> stackMachine(asmTestFileName);
+    std::vector<std::vector<double>> inputs = {{3, 2}, {5, -1}, {0, 7}, {-1, 1}};
+    std::vector<std::vector<double>> outputs;
+    std::vector<unsigned char> statuses;
+
+    stackMachine.runLanes(inputs, outputs, statuses);
+
+    ASSERT_EQUALS(statuses[0], HLT_OPCODE);
+    ASSERT_EQUALS(outputs[0].size(), 2);
+    ASSERT_DOUBLE_EQUALS(outputs[0][0], 12.0);
+    ASSERT_DOUBLE_EQUALS(outputs[0][1], 40.0);
+    ASSERT_EQUALS(statuses[1], HLT_OPCODE);
+    ASSERT_EQUALS(outputs[1].size(), 2);
+    ASSERT_DOUBLE_EQUALS(outputs[1][0], -10.0);
+    ASSERT_DOUBLE_EQUALS(outputs[1][1], 18.0);
+    ASSERT_EQUALS(statuses[2], HLT_OPCODE);
+    ASSERT_EQUALS(outputs[2].size(), 2);
+    ASSERT_DOUBLE_EQUALS(outputs[2][0], 0.0);
+    ASSERT_DOUBLE_EQUALS(outputs[2][1], 0.0);
+    ASSERT_EQUALS(statuses[3], ERR_INVALID_RAM_ADDRESS);
+    ASSERT_EQUALS(outputs[3].size(), 0);
+}